@@ -21,6 +21,12 @@
 // SOFTWARE.
 #include "Adafruit_MQTT.h"
 
+// The sizes every other file must have been compiled with (see
+// Adafruit_MQTT_Sizes in Adafruit_MQTT.h).
+template <unsigned Subscriptions, unsigned HashSize, unsigned TrieNodes, unsigned DataLen>
+const uint8_t Adafruit_MQTT_Sizes<Subscriptions, HashSize, TrieNodes, DataLen>::linked = 1;
+template struct Adafruit_MQTT_Sizes<MAXSUBSCRIPTIONS, MQTT_TOPIC_HASHSIZE, MQTT_TOPIC_TRIENODES, SUBSCRIPTIONDATALEN>;
+
 #if defined(ARDUINO_SAMD_ZERO) || defined(ARDUINO_SAMD_MKR1000) || defined(SPARK)
 static char *dtostrf (double val, signed char width, unsigned char prec, char *sout) {
   char fmt[20];
@@ -93,6 +99,31 @@ static uint8_t *stringprint(uint8_t *p, const char *s, uint16_t maxlen=0) {
   return p+len;
 }
 
+// Size of a publish packet as built by publishPacket().
+static uint32_t publishPacketSize(const char *topic, uint32_t bLen, uint8_t qos) {
+  uint32_t remaining = 2 + strlen(topic) + (qos > 0 ? 2 : 0) + bLen;
+  uint32_t header = 2;
+
+  if (remaining > 127) header++;
+  if (remaining > 16383) header++;
+  if (remaining > 2097151) header++;
+  return header + remaining;
+}
+
+// Case-insensitive FNV-1a, matching the strncasecmp() topic comparison.
+static uint32_t topicHashOf(const char *topic, uint16_t len) {
+  uint32_t h = 2166136261UL;
+  for (uint16_t i=0; i<len; i++) {
+    h ^= (uint8_t)tolower(topic[i]);
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+static bool isTopicFilter(const char *topic) {
+  return strchr(topic, '+') != NULL || strchr(topic, '#') != NULL;
+}
+
 
 // Adafruit_MQTT Definition ////////////////////////////////////////////////////
 
@@ -111,6 +142,7 @@ Adafruit_MQTT::Adafruit_MQTT(const char *server,
   for (uint8_t i=0; i<MAXSUBSCRIPTIONS; i++) {
     subscriptions[i] = 0;
   }
+  rebuildTopicIndex();
 
   will_topic = 0;
   will_payload = 0;
@@ -119,6 +151,12 @@ Adafruit_MQTT::Adafruit_MQTT(const char *server,
 
   packet_id_counter = 0;
 
+  rxtopic = 0;
+  rxtopiclen = 0;
+  rxpayload = 0;
+  rxpayloadlen = 0;
+  rxoverflow = 0;
+
 }
 
 
@@ -136,6 +174,7 @@ Adafruit_MQTT::Adafruit_MQTT(const char *server,
   for (uint8_t i=0; i<MAXSUBSCRIPTIONS; i++) {
     subscriptions[i] = 0;
   }
+  rebuildTopicIndex();
 
   will_topic = 0;
   will_payload = 0;
@@ -144,6 +183,12 @@ Adafruit_MQTT::Adafruit_MQTT(const char *server,
 
   packet_id_counter = 0;
 
+  rxtopic = 0;
+  rxtopiclen = 0;
+  rxpayload = 0;
+  rxpayloadlen = 0;
+  rxoverflow = 0;
+
 }
 
 int8_t Adafruit_MQTT::connect() {
@@ -225,7 +270,9 @@ uint16_t Adafruit_MQTT::readFullPacket(uint8_t *buffer, uint16_t maxsize, uint16
   // will read a packet and Do The Right Thing with length
   uint8_t *pbuff = buffer;
 
-  uint8_t rlen;
+  uint16_t rlen;
+
+  rxoverflow = 0;
 
   // read the packet type:
   rlen = readPacket(pbuff, 1, timeout);
@@ -263,6 +310,10 @@ uint16_t Adafruit_MQTT::readFullPacket(uint8_t *buffer, uint16_t maxsize, uint16
   }
   //DEBUG_PRINT(F("Remaining packet:\t")); DEBUG_PRINTBUFFER(pbuff, rlen);
 
+  // Whatever did not fit (or has not arrived yet) is left for the caller to
+  // stream or skip, so the next read starts on a packet boundary.
+  rxoverflow = value - rlen;
+
   return ((pbuff - buffer)+rlen);
 }
 
@@ -299,29 +350,129 @@ bool Adafruit_MQTT::publish(const char *topic, const char *data, uint8_t qos) {
 }
 
 bool Adafruit_MQTT::publish(const char *topic, uint8_t *data, uint16_t bLen, uint8_t qos) {
+  // Too big for the shared buffer: send it straight from the caller's memory.
+  if (publishPacketSize(topic, bLen, qos) > MAXBUFFERSIZE)
+    return publishDirect(topic, data, bLen, qos);
+
   // Construct and send publish packet.
   uint16_t len = publishPacket(buffer, topic, data, bLen, qos);
   if (!sendPacket(buffer, len))
     return false;
 
   // If QOS level is high enough verify the response packet.
-  if (qos > 0) {
-    len = readFullPacket(buffer, MAXBUFFERSIZE, PUBLISH_TIMEOUT_MS);
-    DEBUG_PRINT(F("Publish QOS1+ reply:\t"));
-    DEBUG_PRINTBUFFER(buffer, len);
-    if (len != 4)
-      return false;
-    if ((buffer[0] >> 4) != MQTT_CTRL_PUBACK)
+  if (qos > 0)
+    return pubackReceived();
+
+  return true;
+}
+
+bool Adafruit_MQTT::publishDirect(const char *topic, const uint8_t *data, uint32_t bLen, uint8_t qos) {
+  Adafruit_MQTT_Span payload[MAXPUBLISHSPANS];
+  uint8_t count = 0;
+
+  // Spans carry 16 bit lengths, so split very large payloads.
+  while (bLen > 0) {
+    if (count == MAXPUBLISHSPANS)
       return false;
-    uint16_t packnum = buffer[2];
-    packnum <<= 8;
-    packnum |= buffer[3];
+    payload[count].data = data;
+    payload[count].len = bLen > 0xFFFF ? 0xFFFF : bLen;
+    data += payload[count].len;
+    bLen -= payload[count].len;
+    count++;
+  }
+  return publishSpans(topic, payload, count, qos);
+}
+
+bool Adafruit_MQTT::publishSpans(const char *topic, const Adafruit_MQTT_Span *payload, uint8_t count, uint8_t qos) {
+  // fixed header (up to 4 length bytes) + topic length, packet id
+  uint8_t header[7];
+  uint8_t packetid[2];
+  Adafruit_MQTT_Span spans[MAXPUBLISHSPANS + 3];
+  uint8_t nspans = 0;
+  uint16_t topiclen = strlen(topic);
+  uint32_t len;
+  uint8_t *p = header;
+
+  if (count > MAXPUBLISHSPANS)
+    return false;
+
+  len = 2 + topiclen + (qos > 0 ? 2 : 0);
+  for (uint8_t i=0; i<count; i++)
+    len += payload[i].len;
+
+  p[0] = MQTT_CTRL_PUBLISH << 4 | qos << 1;
+  p++;
+  do {
+    uint8_t encodedByte = len % 128;
+    len /= 128;
+    if ( len > 0 ) {
+      encodedByte |= 0x80;
+    }
+    p[0] = encodedByte;
+    p++;
+  } while ( len > 0 );
+  p[0] = topiclen >> 8;
+  p[1] = topiclen & 0xFF;
+  p += 2;
+
+  spans[nspans].data = header;
+  spans[nspans].len = p - header;
+  nspans++;
+  spans[nspans].data = (const uint8_t *)topic;
+  spans[nspans].len = topiclen;
+  nspans++;
+
+  if (qos > 0) {
+    packetid[0] = (packet_id_counter >> 8) & 0xFF;
+    packetid[1] = packet_id_counter & 0xFF;
+    packet_id_counter++;
+    spans[nspans].data = packetid;
+    spans[nspans].len = 2;
+    nspans++;
+  }
+
+  for (uint8_t i=0; i<count; i++) {
+    if (payload[i].len == 0)
+      continue;
+    spans[nspans++] = payload[i];
+  }
+
+  DEBUG_PRINTLN(F("MQTT publish packet header:"));
+  DEBUG_PRINTBUFFER(header, spans[0].len);
+  if (!sendPacketSpans(spans, nspans))
+    return false;
+
+  if (qos > 0)
+    return pubackReceived();
+
+  return true;
+}
 
-    // we increment the packet_id_counter right after publishing so inc here too to match
-    packnum++;
-    if (packnum != packet_id_counter)
+bool Adafruit_MQTT::sendPacketSpans(const Adafruit_MQTT_Span *spans, uint8_t count) {
+  for (uint8_t i=0; i<count; i++) {
+    if (!sendPacket((uint8_t *)spans[i].data, spans[i].len))
       return false;
   }
+  return true;
+}
+
+// Read the PUBACK for the publish just sent and check its packet id.
+bool Adafruit_MQTT::pubackReceived() {
+  uint16_t len = readFullPacket(buffer, MAXBUFFERSIZE, PUBLISH_TIMEOUT_MS);
+  DEBUG_PRINT(F("Publish QOS1+ reply:\t"));
+  DEBUG_PRINTBUFFER(buffer, len);
+  if (len != 4)
+    return false;
+  if ((buffer[0] >> 4) != MQTT_CTRL_PUBACK)
+    return false;
+  uint16_t packnum = buffer[2];
+  packnum <<= 8;
+  packnum |= buffer[3];
+
+  // we increment the packet_id_counter right after publishing so inc here too to match
+  packnum++;
+  if (packnum != packet_id_counter)
+    return false;
 
   return true;
 }
@@ -354,8 +505,16 @@ bool Adafruit_MQTT::subscribe(Adafruit_MQTT_Subscribe *sub) {
   if (i==MAXSUBSCRIPTIONS) { // add to subscriptionlist
     for (i=0; i<MAXSUBSCRIPTIONS; i++) {
       if (subscriptions[i] == 0) {
-        DEBUG_PRINT(F("Added sub ")); DEBUG_PRINTLN(i);
+        sub->topiclen = strlen(sub->topic);
+        sub->topichash = topicHashOf(sub->topic, sub->topiclen);
         subscriptions[i] = sub;
+        if (!rebuildTopicIndex()) {
+          DEBUG_PRINTLN(F("no more topic index space :("));
+          subscriptions[i] = 0;
+          rebuildTopicIndex();
+          return false;
+        }
+        DEBUG_PRINT(F("Added sub ")); DEBUG_PRINTLN(i);
         return true;
       }
     }
@@ -397,6 +556,7 @@ bool Adafruit_MQTT::unsubscribe(Adafruit_MQTT_Subscribe *sub) {
       }
 
       subscriptions[i] = 0;
+      rebuildTopicIndex();
       return true;
     }
 
@@ -415,30 +575,7 @@ void Adafruit_MQTT::processPackets(int16_t timeout) {
     Adafruit_MQTT_Subscribe *sub = readSubscription(timeout - elapsed);
     if (sub) {
       //Serial.println("**** sub packet received");
-      if (sub->callback_uint32t != NULL) {
-	// huh lets do the callback in integer mode
-	uint32_t data = 0;
-	data = atoi((char *)sub->lastread);
-	//Serial.print("*** calling int callback with : "); Serial.println(data);
-	sub->callback_uint32t(data);
-      } 
-      else if (sub->callback_double != NULL) {
-	// huh lets do the callback in doublefloat mode
-	double data = 0;
-	data = atof((char *)sub->lastread);
-	//Serial.print("*** calling double callback with : "); Serial.println(data);
-	sub->callback_double(data);
-      }
-      else if (sub->callback_buffer != NULL) {
-	// huh lets do the callback in buffer mode
-	//Serial.print("*** calling buffer callback with : "); Serial.println((char *)sub->lastread);
-	sub->callback_buffer((char *)sub->lastread, sub->datalen);
-      }
-      else if (sub->callback_io != NULL) {
-        // huh lets do the callback in io mode
-        //Serial.print("*** calling io instance callback with : "); Serial.println((char *)sub->lastread);
-        ((sub->io_feed)->*(sub->callback_io))((char *)sub->lastread, sub->datalen);
-      }
+      dispatchCallback(sub);
     }
 
     // keep track over elapsed time
@@ -450,59 +587,166 @@ void Adafruit_MQTT::processPackets(int16_t timeout) {
   }
 }
 
-Adafruit_MQTT_Subscribe *Adafruit_MQTT::readSubscription(int16_t timeout) {
-  uint16_t i, topiclen, datalen;
+uint8_t Adafruit_MQTT::poll(uint8_t maxPackets) {
+  uint8_t handled = 0;
+
+  while (maxPackets-- && packetAvailable()) {
+    // Data is already waiting, so the rest of the packet follows promptly.
+    uint16_t len = readFullPacket(buffer, MAXBUFFERSIZE, POLL_PACKET_TIMEOUT_MS);
+    if (!len)
+      break;
+    Adafruit_MQTT_Subscribe *sub = handleSubscriptionPacket(len);
+    if (sub) {
+      dispatchCallback(sub);
+      handled++;
+    } else if ((buffer[0] >> 4) != MQTT_CTRL_PUBLISH) {
+      ERROR_PRINTLN(F("Dropped a packet"));
+    }
+  }
+  return handled;
+}
+
+void Adafruit_MQTT::dispatchCallback(Adafruit_MQTT_Subscribe *sub) {
+  if (sub->callback_uint32t != NULL) {
+    // huh lets do the callback in integer mode
+    uint32_t data = 0;
+    data = atoi((char *)sub->lastread);
+    sub->callback_uint32t(data);
+  }
+  else if (sub->callback_int != NULL) {
+    sub->callback_int(atoi((char *)sub->lastread));
+  }
+  else if (sub->callback_double != NULL) {
+    // huh lets do the callback in doublefloat mode
+    double data = 0;
+    data = atof((char *)sub->lastread);
+    sub->callback_double(data);
+  }
+  else if (sub->callback_buffer != NULL) {
+    // huh lets do the callback in buffer mode
+    sub->callback_buffer((char *)sub->lastread, sub->datalen);
+  }
+  else if (sub->callback_io != NULL) {
+    // huh lets do the callback in io mode
+    ((sub->io_feed)->*(sub->callback_io))((char *)sub->lastread, sub->datalen);
+  }
+  else if (sub->callback_span != NULL) {
+    // zero-copy: hand over the receive buffer itself
+    sub->callback_span(rxtopic, rxtopiclen, rxpayload, rxpayloadlen);
+  }
+}
 
+Adafruit_MQTT_Subscribe *Adafruit_MQTT::readSubscription(int16_t timeout) {
   // Check if data is available to read.
   uint16_t len = readFullPacket(buffer, MAXBUFFERSIZE, timeout); // return one full packet
   if (!len)
     return NULL;  // No data available, just quit.
+  return handleSubscriptionPacket(len);
+}
+
+// Decode the PUBLISH packet of `len` bytes in buffer: find its subscription,
+// copy the payload into lastread and acknowledge it if it was sent QoS 1.
+Adafruit_MQTT_Subscribe *Adafruit_MQTT::handleSubscriptionPacket(uint16_t len) {
+  uint16_t topiclen, datalen, hdrlen;
+  Adafruit_MQTT_Subscribe *sub;
+
   DEBUG_PRINT("Packet len: "); DEBUG_PRINTLN(len); 
   DEBUG_PRINTBUFFER(buffer, len);
 
-  // Parse out length of packet.
-  topiclen = buffer[3];
+  if ((buffer[0] >> 4) != MQTT_CTRL_PUBLISH) {
+    skipOverflow();
+    return NULL;
+  }
+
+  // Skip the fixed header; the remaining length takes 1 to 4 bytes.
+  hdrlen = 2;
+  while ((buffer[hdrlen-1] & 0x80) && hdrlen < 5)
+    hdrlen++;
+  if (len < hdrlen + 2) {
+    skipOverflow();
+    return NULL;
+  }
+
+  // Parse out length of topic.
+  topiclen = ((uint16_t)buffer[hdrlen] << 8) | buffer[hdrlen+1];
   DEBUG_PRINT(F("Looking for subscription len ")); DEBUG_PRINTLN(topiclen);
+  if (len < hdrlen + 2 + topiclen) {
+    skipOverflow();
+    return NULL;
+  }
 
   // Find subscription associated with this packet.
-  for (i=0; i<MAXSUBSCRIPTIONS; i++) {
-    if (subscriptions[i]) {
-      // Skip this subscription if its name length isn't the same as the
-      // received topic name.
-      if (strlen(subscriptions[i]->topic) != topiclen)
-        continue;
-      // Stop if the subscription topic matches the received topic. Be careful
-      // to make comparison case insensitive.
-      if (strncasecmp((char*)buffer+4, subscriptions[i]->topic, topiclen) == 0) {
-        DEBUG_PRINT(F("Found sub #")); DEBUG_PRINTLN(i);
-        break;
-      }
-    }
+  sub = matchTopic((char *)buffer+hdrlen+2, topiclen);
+  if (sub == NULL) { // matching sub not found ???
+    skipOverflow();
+    return NULL;
   }
-  if (i==MAXSUBSCRIPTIONS) return NULL; // matching sub not found ???
 
   uint8_t packet_id_len = 0;
   uint16_t packetid=0;
   // Check if it is QoS 1, TODO: we dont support QoS 2
   if ((buffer[0] & 0x6) == 0x2) {
     packet_id_len = 2;
-    packetid = buffer[topiclen+4];
+    packetid = buffer[hdrlen+2+topiclen];
     packetid <<= 8;
-    packetid |= buffer[topiclen+5];
+    packetid |= buffer[hdrlen+3+topiclen];
   }
 
-  // zero out the old data
-  memset(subscriptions[i]->lastread, 0, SUBSCRIPTIONDATALEN);
+  rxtopic = (const char *)buffer+hdrlen+2;
+  rxtopiclen = topiclen;
+  rxpayload = buffer+hdrlen+2+topiclen+packet_id_len;
+  rxpayloadlen = len - topiclen - packet_id_len - hdrlen - 2;
+
+  uint32_t total = rxpayloadlen + rxoverflow;
+
+  if (sub->callback_chunk != NULL) {
+    // Streaming: first the part already in the buffer, then the rest in
+    // buffer-sized chunks read straight into the (now free) packet buffer.
+    uint32_t offset = rxpayloadlen;
+    sub->callback_chunk(rxpayload, rxpayloadlen, 0, total);
+    while (rxoverflow > 0) {
+      uint16_t n = readPacket(buffer, rxoverflow < MAXBUFFERSIZE ? rxoverflow : MAXBUFFERSIZE, PUBLISH_TIMEOUT_MS);
+      if (n == 0) {
+        ERROR_PRINTLN(F("Payload stream stalled"));
+        break;
+      }
+      sub->callback_chunk(buffer, n, offset, total);
+      offset += n;
+      rxoverflow -= n;
+    }
+    rxpayload = 0;
+    rxpayloadlen = 0;
+    sub->datalen = 0;
+    sub->truncated = offset < total;
+  } else {
+    // zero out the old data
+    memset(sub->lastread, 0, sub->lastreadsize);
 
-  datalen = len - topiclen - packet_id_len - 4;
-  if (datalen > SUBSCRIPTIONDATALEN) {
-    datalen = SUBSCRIPTIONDATALEN-1; // cut it off
+    datalen = rxpayloadlen;
+    if (datalen >= sub->lastreadsize) {
+      datalen = sub->lastreadsize-1; // cut it off
+    }
+    // extract out just the data, into the subscription object itself
+    memmove(sub->lastread, rxpayload, datalen);
+
+    // A payload bigger than the packet buffer continues in the transport:
+    // read as much as fits directly into the subscription's storage.
+    if (rxoverflow > 0 && datalen < sub->lastreadsize-1) {
+      uint32_t want = sub->lastreadsize-1 - datalen;
+      if (want > rxoverflow) want = rxoverflow;
+      uint16_t n = readPacket(sub->lastread + datalen, want, PUBLISH_TIMEOUT_MS);
+      datalen += n;
+      rxoverflow -= n;
+    }
+    sub->datalen = datalen;
+    sub->truncated = datalen < total;
+    if (sub->truncated) {
+      ERROR_PRINTLN(F("Subscription payload truncated"));
+    }
+    skipOverflow();
   }
-  // extract out just the data, into the subscription object itself
-  memmove(subscriptions[i]->lastread, buffer+4+topiclen+packet_id_len, datalen);
-  subscriptions[i]->datalen = datalen;
-  DEBUG_PRINT(F("Data len: ")); DEBUG_PRINTLN(datalen);
-  DEBUG_PRINT(F("Data: ")); DEBUG_PRINTLN((char *)subscriptions[i]->lastread);
+  DEBUG_PRINT(F("Data len: ")); DEBUG_PRINTLN(sub->datalen);
+  DEBUG_PRINT(F("Data: ")); DEBUG_PRINTLN((char *)sub->lastread);
 
   if ((MQTT_PROTOCOL_LEVEL > 3) &&(buffer[0] & 0x6) == 0x2) {
     uint8_t ackpacket[4];
@@ -514,7 +758,135 @@ Adafruit_MQTT_Subscribe *Adafruit_MQTT::readSubscription(int16_t timeout) {
   }
 
   // return the valid matching subscription
-  return subscriptions[i];
+  return sub;
+}
+
+bool Adafruit_MQTT::rebuildTopicIndex() {
+  bool ok = true;
+
+  memset(topicHash, 0, sizeof(topicHash));
+  memset(topicNodes, 0, sizeof(topicNodes));
+  topicNodeCount = 1;  // the root
+
+  for (uint8_t i=0; i<MAXSUBSCRIPTIONS; i++) {
+    Adafruit_MQTT_Subscribe *sub = subscriptions[i];
+    if (sub == 0) continue;
+
+    if (isTopicFilter(sub->topic)) {
+      ok = addTopicFilter(i) && ok;
+      continue;
+    }
+
+    // Linear probing; the table is always larger than MAXSUBSCRIPTIONS.
+    uint8_t slot = sub->topichash & (MQTT_TOPIC_HASHSIZE - 1);
+    while (topicHash[slot])
+      slot = (slot + 1) & (MQTT_TOPIC_HASHSIZE - 1);
+    topicHash[slot] = i + 1;
+  }
+  return ok;
+}
+
+bool Adafruit_MQTT::addTopicFilter(uint8_t sub) {
+  const char *level = subscriptions[sub]->topic;
+  uint8_t node = 0;
+
+  for (;;) {
+    const char *end = strchr(level, '/');
+    uint8_t levellen = end ? end - level : strlen(level);
+
+    if (levellen == 1 && level[0] == '#') {
+      if (!topicNodes[node].multisub)
+        topicNodes[node].multisub = sub + 1;
+      return true;
+    }
+
+    // Find or add the child node for this level.
+    uint8_t child = topicNodes[node].child;
+    while (child && !(topicNodes[child].levellen == levellen &&
+                      strncasecmp(topicNodes[child].level, level, levellen) == 0))
+      child = topicNodes[child].sibling;
+    if (!child) {
+      if (topicNodeCount == MQTT_TOPIC_TRIENODES)
+        return false;
+      child = topicNodeCount++;
+      topicNodes[child].level = level;
+      topicNodes[child].levellen = levellen;
+      topicNodes[child].sibling = topicNodes[node].child;
+      topicNodes[node].child = child;
+    }
+    node = child;
+
+    if (!end) {
+      if (!topicNodes[node].sub)
+        topicNodes[node].sub = sub + 1;
+      return true;
+    }
+    level = end + 1;
+  }
+}
+
+// Match the topic levels from `level` on against the trie below `node`.
+// `done` is set once every level of the topic has been consumed.
+uint8_t Adafruit_MQTT::matchTopicLevels(uint8_t node, const char *level, const char *end, bool done) {
+  // "a/#" matches "a" itself and everything below it.
+  if (topicNodes[node].multisub)
+    return topicNodes[node].multisub;
+  if (done)
+    return topicNodes[node].sub;
+
+  const char *next = (const char *)memchr(level, '/', end - level);
+  if (!next) next = end;
+  uint16_t levellen = next - level;
+
+  for (uint8_t child = topicNodes[node].child; child; child = topicNodes[child].sibling) {
+    const TopicNode &n = topicNodes[child];
+    if ((n.levellen == 1 && n.level[0] == '+') ||
+        (n.levellen == levellen && strncasecmp(n.level, level, levellen) == 0)) {
+      uint8_t found = matchTopicLevels(child, next + 1, end, next == end);
+      if (found)
+        return found;
+    }
+  }
+  return 0;
+}
+
+Adafruit_MQTT_Subscribe *Adafruit_MQTT::matchTopic(const char *topic, uint16_t len) {
+  uint32_t hash = topicHashOf(topic, len);
+  uint8_t slot = hash & (MQTT_TOPIC_HASHSIZE - 1);
+
+  // Exact subscriptions first.
+  while (topicHash[slot]) {
+    Adafruit_MQTT_Subscribe *sub = subscriptions[topicHash[slot] - 1];
+    if (sub->topichash == hash && sub->topiclen == len &&
+        strncasecmp(topic, sub->topic, len) == 0) {
+      DEBUG_PRINT(F("Found sub #")); DEBUG_PRINTLN(topicHash[slot] - 1);
+      return sub;
+    }
+    slot = (slot + 1) & (MQTT_TOPIC_HASHSIZE - 1);
+  }
+
+  // Then wildcard filters, if any.
+  if (topicNodes[0].child || topicNodes[0].multisub) {
+    uint8_t found = matchTopicLevels(0, topic, topic + len, false);
+    if (found) {
+      DEBUG_PRINT(F("Found wildcard sub #")); DEBUG_PRINTLN(found - 1);
+      return subscriptions[found - 1];
+    }
+  }
+  return NULL;
+}
+
+// Discard the unread remainder of the last packet.
+void Adafruit_MQTT::skipOverflow() {
+  uint8_t scratch[32];
+
+  while (rxoverflow > 0) {
+    uint16_t n = readPacket(scratch, rxoverflow < sizeof(scratch) ? rxoverflow : sizeof(scratch), PUBLISH_TIMEOUT_MS);
+    if (n == 0)
+      break;
+    rxoverflow -= n;
+  }
+  rxoverflow = 0;
 }
 
 void Adafruit_MQTT::flushIncoming(uint16_t timeout) {
@@ -782,8 +1154,8 @@ bool Adafruit_MQTT_Publish::publish(int i) {
   return mqtt->publish(topic, payload, qos);
 }
 
-bool Adafruit_MQTT_Publish::publish(int32_t i) {
-  char payload[12];
+bool Adafruit_MQTT_Publish::publish(long i) {
+  char payload[21];  // long is 64 bit on the host
   ltoa(i, payload, 10);
   return mqtt->publish(topic, payload, qos);
 }
@@ -810,19 +1182,45 @@ bool Adafruit_MQTT_Publish::publish(uint8_t *payload, uint16_t bLen) {
   return mqtt->publish(topic, payload, bLen, qos);
 }
 
+//publish a large buffer without copying it into the shared packet buffer
+bool Adafruit_MQTT_Publish::publishDirect(const uint8_t *payload, uint32_t bLen) {
+
+  return mqtt->publishDirect(topic, payload, bLen, qos);
+}
+
 
 // Adafruit_MQTT_Subscribe Definition //////////////////////////////////////////
 
 Adafruit_MQTT_Subscribe::Adafruit_MQTT_Subscribe(Adafruit_MQTT *mqttserver,
                                                  const char *feed, uint8_t q) {
+  lastread = defaultread;
+  lastreadsize = SUBSCRIPTIONDATALEN;
+  init(mqttserver, feed, q);
+}
+
+Adafruit_MQTT_Subscribe::Adafruit_MQTT_Subscribe(Adafruit_MQTT *mqttserver, const char *feed,
+                                                 uint8_t *storage, uint16_t size, uint8_t q) {
+  lastread = storage;
+  lastreadsize = size;
+  init(mqttserver, feed, q);
+}
+
+void Adafruit_MQTT_Subscribe::init(Adafruit_MQTT *mqttserver, const char *feed, uint8_t q) {
   mqtt = mqttserver;
   topic = feed;
   qos = q;
+  topiclen = strlen(feed);
+  topichash = 0;
+  memset(lastread, 0, lastreadsize);
   datalen = 0;
+  truncated = false;
   callback_uint32t = 0;
+  callback_int = 0;
   callback_buffer = 0;
   callback_double = 0;
   callback_io = 0;
+  callback_span = 0;
+  callback_chunk = 0;
   io_feed = 0;
 }
 
@@ -830,6 +1228,10 @@ void Adafruit_MQTT_Subscribe::setCallback(SubscribeCallbackUInt32Type cb) {
   callback_uint32t = cb;
 }
 
+void Adafruit_MQTT_Subscribe::setCallback(SubscribeCallbackIntType cb) {
+  callback_int = cb;
+}
+
 void Adafruit_MQTT_Subscribe::setCallback(SubscribeCallbackDoubleType cb) {
   callback_double = cb;
 }
@@ -843,10 +1245,156 @@ void Adafruit_MQTT_Subscribe::setCallback(AdafruitIO_Feed *f, SubscribeCallbackI
   io_feed = f;
 }
 
+void Adafruit_MQTT_Subscribe::setCallback(SubscribeCallbackSpanType cb) {
+  callback_span = cb;
+}
+
+void Adafruit_MQTT_Subscribe::setCallback(SubscribeCallbackChunkType cb) {
+  callback_chunk = cb;
+}
+
 void Adafruit_MQTT_Subscribe::removeCallback(void) {
   callback_uint32t = 0;
+  callback_int = 0;
   callback_buffer = 0;
   callback_double = 0;
   callback_io = 0;
+  callback_span = 0;
+  callback_chunk = 0;
   io_feed = 0;
 }
+
+
+// Adafruit_MQTT_Batch Definition //////////////////////////////////////////////
+
+Adafruit_MQTT_Batch::Adafruit_MQTT_Batch(Adafruit_MQTT *mqttserver,
+                                         uint8_t *buf, uint16_t bufsize) {
+  mqtt = mqttserver;
+  buffer = buf;
+  size = bufsize;
+  len = 0;
+  packets = 0;
+}
+
+bool Adafruit_MQTT_Batch::add(const char *topic, const char *payload) {
+  return add(topic, (uint8_t *)payload, strlen(payload));
+}
+
+bool Adafruit_MQTT_Batch::add(Adafruit_MQTT_Publish *feed, const char *payload) {
+  return add(feed->topic, (uint8_t *)payload, strlen(payload));
+}
+
+bool Adafruit_MQTT_Batch::add(const char *topic, uint8_t *payload, uint16_t bLen) {
+  if ((uint32_t)len + publishPacketSize(topic, bLen, 0) > size) {
+    DEBUG_PRINTLN(F("Batch full"));
+    return false;
+  }
+  len += mqtt->publishPacket(buffer + len, topic, payload, bLen, 0);
+  packets++;
+  return true;
+}
+
+bool Adafruit_MQTT_Batch::send(const char *topic, const char *payload) {
+  bool sent = true;
+
+  if (add(topic, payload))
+    return true;
+  if (packets > 0) {
+    sent = flush();
+    if (add(topic, payload))
+      return sent;
+  }
+  return mqtt->publish(topic, payload) && sent;
+}
+
+bool Adafruit_MQTT_Batch::send(Adafruit_MQTT_Publish *feed, const char *payload) {
+  return send(feed->topic, payload);
+}
+
+bool Adafruit_MQTT_Batch::flush() {
+  bool sent = true;
+
+  if (len > 0) {
+    DEBUG_PRINT(F("Sending batch of ")); DEBUG_PRINT(packets);
+    DEBUG_PRINT(F(" packets, bytes: ")); DEBUG_PRINTLN(len);
+    sent = mqtt->sendPacket(buffer, len);
+  }
+  clear();
+  return sent;
+}
+
+void Adafruit_MQTT_Batch::clear() {
+  len = 0;
+  packets = 0;
+}
+
+
+// Adafruit_MQTT_Group Definition //////////////////////////////////////////////
+
+Adafruit_MQTT_Group::Adafruit_MQTT_Group(Adafruit_MQTT *mqttserver, const char *grouptopic,
+                                         char *buf, uint16_t bufsize, uint8_t f, uint8_t q) {
+  mqtt = mqttserver;
+  topic = grouptopic;
+  buffer = buf;
+  size = bufsize;
+  format = f;
+  qos = q;
+  clear();
+}
+
+bool Adafruit_MQTT_Group::add(const char *key, const char *value) {
+  int n;
+
+  // JSON needs room left for the closing "}}" added by publish().
+  if (format == MQTT_GROUP_JSON) {
+    n = snprintf(buffer + len, size - len, "%s\"%s\":\"%s\"", values ? "," : "{\"feeds\":{", key, value);
+    if (n < 0 || len + n + 2 >= size) {
+      buffer[len] = 0;
+      return false;
+    }
+  } else {
+    n = snprintf(buffer + len, size - len, "%s%s,%s", values ? "\n" : "", key, value);
+    if (n < 0 || len + n >= size) {
+      buffer[len] = 0;
+      return false;
+    }
+  }
+  len += n;
+  values++;
+  return true;
+}
+
+bool Adafruit_MQTT_Group::add(const char *key, double f, uint8_t precision) {
+  char value[41];
+  dtostrf(f, 0, precision, value);
+  return add(key, value);
+}
+
+bool Adafruit_MQTT_Group::add(const char *key, int i) {
+  char value[12];
+  ltoa(i, value, 10);
+  return add(key, value);
+}
+
+bool Adafruit_MQTT_Group::publish() {
+  bool sent;
+
+  if (values == 0) {
+    return true;
+  }
+  if (format == MQTT_GROUP_JSON) {
+    strcpy(buffer + len, "}}");
+    len += 2;
+  }
+  sent = mqtt->publish(topic, (uint8_t *)buffer, len, qos);
+  clear();
+  return sent;
+}
+
+void Adafruit_MQTT_Group::clear() {
+  len = 0;
+  values = 0;
+  if (size > 0) {
+    buffer[0] = 0;
+  }
+}
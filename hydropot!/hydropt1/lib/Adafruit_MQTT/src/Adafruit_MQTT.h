@@ -93,6 +93,8 @@
 #define MQTT_QOS_0 0x0
 
 #define CONNECT_TIMEOUT_MS 6000
+// once poll() has seen the first byte of a packet, how long to wait for the rest
+#define POLL_PACKET_TIMEOUT_MS 50
 #define PUBLISH_TIMEOUT_MS 500
 #define PING_TIMEOUT_MS    500
 #define SUBACK_TIMEOUT_MS  500
@@ -113,27 +115,92 @@
 #define MQTT_CONN_WILLFLAG        0x04
 #define MQTT_CONN_CLEANSESSION    0x02
 
-// how many subscriptions we want to be able to track
+// most payload pieces publishSpans() accepts in one call
+#define MAXPUBLISHSPANS 4
+
+// The sizes below fix the layout of Adafruit_MQTT and Adafruit_MQTT_Subscribe,
+// so every file in the program must see the same values. Change them here or
+// with -D flags for the whole build, never by defining them ahead of this
+// header in one file: a file that sees other values fails to link (see
+// Adafruit_MQTT_Sizes).
+
+// how many subscriptions we want to be able to track (at most 254)
+#ifndef MAXSUBSCRIPTIONS
 #define MAXSUBSCRIPTIONS 5
+#endif
+
+// slots in the exact-topic hash table, a power of two above MAXSUBSCRIPTIONS
+#ifndef MQTT_TOPIC_HASHSIZE
+#define MQTT_TOPIC_HASHSIZE 16
+#endif
+
+// nodes in the wildcard topic trie, one per distinct level of the + and #
+// subscription filters plus the root
+#ifndef MQTT_TOPIC_TRIENODES
+#define MQTT_TOPIC_TRIENODES (MAXSUBSCRIPTIONS * 4 + 1)
+#endif
+
+#if MAXSUBSCRIPTIONS > 254
+#error "MAXSUBSCRIPTIONS must be 254 or less"
+#endif
+#if (MQTT_TOPIC_HASHSIZE <= MAXSUBSCRIPTIONS) || (MQTT_TOPIC_HASHSIZE & (MQTT_TOPIC_HASHSIZE - 1))
+#error "MQTT_TOPIC_HASHSIZE must be a power of two larger than MAXSUBSCRIPTIONS"
+#endif
+#if MQTT_TOPIC_TRIENODES > 255
+#error "MQTT_TOPIC_TRIENODES must be 255 or less"
+#endif
 
 // how much data we save in a subscription object
 // eg max-subscription-payload-size
+// (per subscription it can be raised with Adafruit_MQTT_SubscribeBuffer<N>
+// or caller-provided storage, see Adafruit_MQTT_Subscribe)
+#ifndef SUBSCRIPTIONDATALEN
 #define SUBSCRIPTIONDATALEN 20
+#endif
+
+// Each file refers to the instance for the sizes it was compiled with, and
+// only the one for the library's own sizes is defined, in Adafruit_MQTT.cpp.
+template <unsigned Subscriptions, unsigned HashSize, unsigned TrieNodes, unsigned DataLen>
+struct Adafruit_MQTT_Sizes {
+  static const uint8_t linked;
+};
+static const uint8_t *const Adafruit_MQTT_sizesCheck __attribute__((used)) =
+  &Adafruit_MQTT_Sizes<MAXSUBSCRIPTIONS, MQTT_TOPIC_HASHSIZE, MQTT_TOPIC_TRIENODES, SUBSCRIPTIONDATALEN>::linked;
 
 class AdafruitIO_Feed;  // forward decl
 
 //Function pointer that returns an int
 typedef void (*SubscribeCallbackUInt32Type)(uint32_t);
+typedef void (*SubscribeCallbackIntType)(int);
 // returns a double
 typedef void (*SubscribeCallbackDoubleType)(double);
 // returns a chunk of raw data
 typedef void (*SubscribeCallbackBufferType)(char *str, uint16_t len);
 // returns an io data wrapper instance
 typedef void (AdafruitIO_Feed::*SubscribeCallbackIOType)(char *str, uint16_t len);
+// zero-copy: topic and payload point into the receive buffer and are only
+// valid during the call; the payload is not truncated to SUBSCRIPTIONDATALEN
+// (but only what fits in MAXBUFFERSIZE is passed, see the chunk callback)
+typedef void (*SubscribeCallbackSpanType)(const char *topic, uint16_t topiclen,
+                                          const uint8_t *data, uint16_t len);
+// streaming: called once per chunk as the payload arrives, straight from the
+// receive buffer, so payloads larger than MAXBUFFERSIZE and lastread work;
+// offset is the chunk's position in a payload of total bytes
+typedef void (*SubscribeCallbackChunkType)(const uint8_t *chunk, uint16_t len,
+                                           uint32_t offset, uint32_t total);
 
 extern void printBuffer(uint8_t *buffer, uint16_t len);
 
+// One contiguous piece of an outgoing packet. Packets that are sent as a list
+// of spans are written straight from the caller's memory instead of being
+// copied into the shared buffer first.
+struct Adafruit_MQTT_Span {
+  const uint8_t *data;
+  uint16_t len;
+};
+
 class Adafruit_MQTT_Subscribe;  // forward decl
+class Adafruit_MQTT_Batch;      // forward decl
 
 class Adafruit_MQTT {
  public:
@@ -185,10 +252,21 @@ class Adafruit_MQTT {
   bool publish(const char *topic, const char *payload, uint8_t qos = 0);
   bool publish(const char *topic, uint8_t *payload, uint16_t bLen, uint8_t qos = 0);
 
+  // Publish without copying the payload into the shared buffer: the fixed
+  // header, topic and each payload span are handed to the transport as
+  // separate spans, so the payload is not limited by MAXBUFFERSIZE. The
+  // payload may be split over up to MAXPUBLISHSPANS pieces (e.g. a JSON
+  // prefix, a binary snapshot and a suffix). publish() falls back to this
+  // automatically when a packet would not fit in the buffer.
+  bool publishDirect(const char *topic, const uint8_t *payload, uint32_t bLen, uint8_t qos = 0);
+  bool publishSpans(const char *topic, const Adafruit_MQTT_Span *payload, uint8_t count, uint8_t qos = 0);
+
   // Add a subscription to receive messages for a topic.  Returns true if the
   // subscription could be added or was already present, false otherwise.
   // Must be called before connect(), subscribing after the connection
-  // is made is not currently supported.
+  // is made is not currently supported.  The topic may be an MQTT filter
+  // with + (one level) and # (all remaining levels) wildcards, e.g.
+  // "user/feeds/hydropot/#".
   bool subscribe(Adafruit_MQTT_Subscribe *sub);
 
   // Unsubscribe from a previously subscribed MQTT topic.
@@ -202,6 +280,12 @@ class Adafruit_MQTT {
 
   void processPackets(int16_t timeout);
 
+  // Non-blocking receive: decode every packet that has already arrived (at
+  // most maxPackets) and invoke the matching subscription's callback right
+  // away. Returns without waiting when nothing is pending, so it can be
+  // called on every pass of loop(). Returns the number of callbacks run.
+  uint8_t poll(uint8_t maxPackets = 4);
+
   // Ping the server to ensure the connection is still alive.
   bool ping(uint8_t n = 1);
 
@@ -217,11 +301,20 @@ class Adafruit_MQTT {
   // Send data to the server specified by the buffer and length of data.
   virtual bool sendPacket(uint8_t *buffer, uint16_t len) = 0;
 
+  // Send one packet given as a list of spans. The default implementation
+  // sends each span with sendPacket(); transports can override it to
+  // coalesce small spans or use a real gather write.
+  virtual bool sendPacketSpans(const Adafruit_MQTT_Span *spans, uint8_t count);
+
   // Read MQTT packet from the server.  Will read up to maxlen bytes and store
   // the data in the provided buffer.  Waits up to the specified timeout (in
   // milliseconds) for data to be available. 
   virtual uint16_t readPacket(uint8_t *buffer, uint16_t maxlen, int16_t timeout) = 0;
 
+  // Return true if at least one byte can be read without waiting. poll()
+  // uses it to stay non-blocking; the default keeps older transports working.
+  virtual bool packetAvailable() { return true; }
+
   // Read a full packet, keeping note of the correct length
   uint16_t readFullPacket(uint8_t *buffer, uint16_t maxsize, uint16_t timeout);
   // Properly process packets until you get to one you want
@@ -241,9 +334,47 @@ class Adafruit_MQTT {
   uint16_t packet_id_counter;
 
  private:
+  friend class Adafruit_MQTT_Batch;
+
   Adafruit_MQTT_Subscribe *subscriptions[MAXSUBSCRIPTIONS];
 
+  // Topic index, rebuilt by subscribe() and unsubscribe() so an incoming
+  // PUBLISH is matched in time proportional to its topic length: exact topics
+  // through an open-addressing hash table, + and # filters through a trie of
+  // topic levels.
+  struct TopicNode {
+    const char *level;  // points into the subscription's topic
+    uint8_t levellen;
+    uint8_t child;      // first child node, 0 if none (node 0 is the root)
+    uint8_t sibling;    // next sibling node, 0 if none
+    uint8_t sub;        // subscription index + 1 of a filter ending here
+    uint8_t multisub;   // subscription index + 1 of a filter ending here with /#
+  };
+  uint8_t topicHash[MQTT_TOPIC_HASHSIZE];  // subscription index + 1, 0 if free
+  TopicNode topicNodes[MQTT_TOPIC_TRIENODES];
+  uint8_t topicNodeCount;
+
+  bool    rebuildTopicIndex();
+  bool    addTopicFilter(uint8_t sub);
+  uint8_t matchTopicLevels(uint8_t node, const char *level, const char *end, bool done);
+  Adafruit_MQTT_Subscribe *matchTopic(const char *topic, uint16_t len);
+
   void    flushIncoming(uint16_t timeout);
+  bool    pubackReceived();
+  Adafruit_MQTT_Subscribe *handleSubscriptionPacket(uint16_t len);
+  void    dispatchCallback(Adafruit_MQTT_Subscribe *sub);
+  void    skipOverflow();
+
+  // Bytes of the last packet that did not fit in buffer and are still
+  // waiting in the transport.
+  uint32_t rxoverflow;
+
+  // Topic and full payload of the last PUBLISH decoded by
+  // handleSubscriptionPacket(), pointing into buffer.
+  const char *rxtopic;
+  uint16_t rxtopiclen;
+  const uint8_t *rxpayload;
+  uint16_t rxpayloadlen;
 
   // Functions to generate MQTT packets.
   uint8_t connectPacket(uint8_t *packet);
@@ -264,44 +395,158 @@ class Adafruit_MQTT_Publish {
   bool publish(double f, uint8_t precision=2);  // Precision controls the minimum number of digits after decimal.
                                                 // This might be ignored and a higher precision value sent.
   bool publish(int i);
-  bool publish(int32_t i);
+  bool publish(long i);     // int32_t on the device; spelled long so it stays distinct from int on 64 bit hosts
   bool publish(uint32_t i);
   bool publish(uint8_t *b, uint16_t bLen);
+  bool publishDirect(const uint8_t *b, uint32_t bLen);
 
 
 private:
+  friend class Adafruit_MQTT_Batch;
+
   Adafruit_MQTT *mqtt;
   const char *topic;
   uint8_t qos;
 };
 
+// Serializes several QoS 0 PUBLISH packets back to back into a caller supplied
+// buffer and hands them to sendPacket() together. The client still writes at
+// most 250 bytes at a time, so a burst of feed updates costs one write per 250
+// bytes instead of one per feed.
+class Adafruit_MQTT_Batch {
+ public:
+  Adafruit_MQTT_Batch(Adafruit_MQTT *mqttserver, uint8_t *buf, uint16_t size);
+
+  // Append a publish packet. Returns false, leaving the batch unchanged, if it
+  // does not fit in the remaining buffer space.
+  bool add(const char *topic, const char *payload);
+  bool add(const char *topic, uint8_t *payload, uint16_t bLen);
+  bool add(Adafruit_MQTT_Publish *feed, const char *payload);
+
+  // Like add(), but when the packet does not fit, flush() first and add it
+  // to the emptied batch; one too big for the whole buffer is published on
+  // its own. Returns false if anything failed to send.
+  bool send(const char *topic, const char *payload);
+  bool send(Adafruit_MQTT_Publish *feed, const char *payload);
+
+  // Send everything added so far with one sendPacket() call, which writes it
+  // in 250 byte pieces, and empty the batch. Returns false if the write failed (the batch is emptied anyway).
+  bool flush();
+  void clear();
+
+  uint16_t length() const { return len; }
+  uint8_t count() const { return packets; }
+
+ private:
+  Adafruit_MQTT *mqtt;
+  uint8_t *buffer;
+  uint16_t size;
+  uint16_t len;
+  uint8_t packets;
+};
+
+// Adafruit IO group publish: one message carrying a value for every feed in a
+// group, formatted as "key,value" lines (the group's /csv topic) or as
+// {"feeds":{"key":"value",...}} (the group's /json topic).
+#define MQTT_GROUP_CSV  0
+#define MQTT_GROUP_JSON 1
+
+class Adafruit_MQTT_Group {
+ public:
+  Adafruit_MQTT_Group(Adafruit_MQTT *mqttserver, const char *grouptopic, char *buf, uint16_t size,
+                      uint8_t format = MQTT_GROUP_CSV, uint8_t qos = 0);
+
+  bool add(const char *key, const char *value);
+  bool add(const char *key, double f, uint8_t precision=2);
+  bool add(const char *key, int i);
+
+  // Publish the collected values as one message and start a new one.
+  bool publish();
+  void clear();
+
+  uint8_t count() const { return values; }
+
+ private:
+  Adafruit_MQTT *mqtt;
+  const char *topic;
+  char *buffer;
+  uint16_t size;
+  uint16_t len;
+  uint8_t format;
+  uint8_t qos;
+  uint8_t values;
+};
+
 class Adafruit_MQTT_Subscribe {
  public:
   Adafruit_MQTT_Subscribe(Adafruit_MQTT *mqttserver, const char *feedname, uint8_t q=0);
+  // Receive into caller-provided storage instead of the built-in
+  // SUBSCRIPTIONDATALEN bytes, e.g. for schedules or JSON config.
+  Adafruit_MQTT_Subscribe(Adafruit_MQTT *mqttserver, const char *feedname,
+                          uint8_t *storage, uint16_t size, uint8_t q=0);
+
+  // lastread points at defaultread or at storage the subscription was given,
+  // so a copy would read and write the original's buffer; subscriptions stay
+  // where they are declared.
+  Adafruit_MQTT_Subscribe(const Adafruit_MQTT_Subscribe &) = delete;
+  Adafruit_MQTT_Subscribe &operator=(const Adafruit_MQTT_Subscribe &) = delete;
+  Adafruit_MQTT_Subscribe(Adafruit_MQTT_Subscribe &&) = delete;
+  Adafruit_MQTT_Subscribe &operator=(Adafruit_MQTT_Subscribe &&) = delete;
 
   void setCallback(SubscribeCallbackUInt32Type callb);
+  void setCallback(SubscribeCallbackIntType callb);
   void setCallback(SubscribeCallbackDoubleType callb);
   void setCallback(SubscribeCallbackBufferType callb);
   void setCallback(AdafruitIO_Feed *io, SubscribeCallbackIOType callb);
+  void setCallback(SubscribeCallbackSpanType callb);
+  void setCallback(SubscribeCallbackChunkType callb);
   void removeCallback(void);
 
   const char *topic;
   uint8_t qos;
 
-  uint8_t lastread[SUBSCRIPTIONDATALEN];
-  // Number valid bytes in lastread. Limited to SUBSCRIPTIONDATALEN-1 to
+  // Cached by Adafruit_MQTT::subscribe() for the topic index.
+  uint16_t topiclen;
+  uint32_t topichash;
+
+  uint8_t *lastread;
+  uint16_t lastreadsize;
+  // Number valid bytes in lastread. Limited to lastreadsize-1 to
   // ensure nul terminating lastread.
   uint16_t datalen;
+  // Set when the last payload was longer than lastread could hold.
+  bool truncated;
 
   SubscribeCallbackUInt32Type callback_uint32t;
+  SubscribeCallbackIntType    callback_int;
   SubscribeCallbackDoubleType callback_double;
   SubscribeCallbackBufferType callback_buffer;
   SubscribeCallbackIOType     callback_io;
+  SubscribeCallbackSpanType   callback_span;
+  SubscribeCallbackChunkType  callback_chunk;
 
   AdafruitIO_Feed *io_feed;
 
  private:
+  void init(Adafruit_MQTT *mqttserver, const char *feedname, uint8_t q);
+
   Adafruit_MQTT *mqtt;
+  uint8_t defaultread[SUBSCRIPTIONDATALEN];
+};
+
+// A subscription that carries its own SIZE-byte lastread buffer, so only the
+// subscriptions that need large payloads pay for them:
+//   Adafruit_MQTT_SubscribeBuffer<256> config(&mqtt, "user/feeds/config");
+template <uint16_t SIZE>
+class Adafruit_MQTT_SubscribeBuffer : public Adafruit_MQTT_Subscribe {
+ public:
+  Adafruit_MQTT_SubscribeBuffer(Adafruit_MQTT *mqttserver, const char *feedname, uint8_t q=0)
+    : Adafruit_MQTT_Subscribe(mqttserver, feedname, storage, SIZE, q) {}
+
+  // Not copyable or movable, like its base.
+
+ private:
+  uint8_t storage[SIZE];
 };
 
 
@@ -102,8 +102,12 @@ uint16_t Adafruit_MQTT_SPARK::readPacket(uint8_t *buffer, uint16_t maxlen,
   return len;
 }
 
+bool Adafruit_MQTT_SPARK::packetAvailable() {
+  return client->connected() && client->available() > 0;
+}
+
 bool Adafruit_MQTT_SPARK::sendPacket(uint8_t *buffer, uint16_t len) {
-  uint16_t ret = 0;
+  int ret = 0;
 
   while (len > 0) {
     if (client->connected()) {
@@ -111,8 +115,13 @@ bool Adafruit_MQTT_SPARK::sendPacket(uint8_t *buffer, uint16_t len) {
 
       uint16_t sendlen = min(len, 250);
       //Serial.print("Sending: "); Serial.println(sendlen);
-      ret = client->write(buffer, sendlen);
+      ret = (int)client->write(buffer, sendlen);
       DEBUG_PRINT(F("Client sendPacket returned: ")); DEBUG_PRINTLN(ret);
+      if (ret <= 0) {
+	DEBUG_PRINTLN("Failed to send packet.");
+	return false;
+      }
+      buffer += ret;
       len -= ret;
 
       if (ret != sendlen) {
@@ -126,3 +135,34 @@ bool Adafruit_MQTT_SPARK::sendPacket(uint8_t *buffer, uint16_t len) {
   }
   return true;
 }
+
+bool Adafruit_MQTT_SPARK::sendPacketSpans(const Adafruit_MQTT_Span *spans, uint8_t count) {
+  uint8_t gather[MQTT_CLIENT_GATHERSIZE];
+  uint16_t gathered = 0;
+
+  for (uint8_t i=0; i<count; i++) {
+    if (spans[i].len < MQTT_CLIENT_GATHERSIZE) {
+      if (gathered + spans[i].len > MQTT_CLIENT_GATHERSIZE) {
+        if (!sendPacket(gather, gathered))
+          return false;
+        gathered = 0;
+      }
+      memcpy(gather + gathered, spans[i].data, spans[i].len);
+      gathered += spans[i].len;
+      continue;
+    }
+
+    // Large span: flush what was gathered, then write it in place.
+    if (gathered > 0) {
+      if (!sendPacket(gather, gathered))
+        return false;
+      gathered = 0;
+    }
+    if (!sendPacket((uint8_t *)spans[i].data, spans[i].len))
+      return false;
+  }
+
+  if (gathered > 0)
+    return sendPacket(gather, gathered);
+  return true;
+}
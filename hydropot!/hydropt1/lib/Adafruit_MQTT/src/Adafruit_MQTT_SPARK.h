@@ -31,6 +31,11 @@
 // How long to delay waiting for new data to be available in readPacket.
 #define MQTT_CLIENT_READINTERVAL_MS 10
 
+// Spans shorter than this are gathered into one small stack buffer by
+// sendPacketSpans() so header and topic go out in a single write; longer
+// spans are written directly from the caller's memory.
+#define MQTT_CLIENT_GATHERSIZE 64
+
 
 // MQTT client implementation for a generic Arduino Client interface.  Can work
 // with almost all Arduino network hardware like ethernet shield, wifi shield,
@@ -55,7 +60,9 @@ class Adafruit_MQTT_SPARK : public Adafruit_MQTT {
   bool disconnectServer();
   bool connected();
   uint16_t readPacket(uint8_t *buffer, uint16_t maxlen, int16_t timeout);
+  bool packetAvailable();
   bool sendPacket(uint8_t *buffer, uint16_t len);
+  bool sendPacketSpans(const Adafruit_MQTT_Span *spans, uint8_t count);
 
  private:
   TCPClient* client;
@@ -1,6 +1,8 @@
 #ifndef _BUTTON_H_
 #define _BUTTON_H_
 
+#include <atomic>
+
 class Button {
   int _buttonPin;
   int _prevButtonState;
@@ -17,6 +19,8 @@ class Button {
       else {
         pinMode(_buttonPin,INPUT_PULLDOWN);       
       }
+      // A button already held at start up is not a click
+      _prevButtonState = isPressed();
     }
 
     bool isPressed() {
@@ -47,4 +51,177 @@ class Button {
     }
 };
 
-#endif // _BUTTON_H_
\ No newline at end of file
+enum ButtonEvent {
+  BUTTON_NONE,
+  BUTTON_CLICK,
+  BUTTON_DOUBLE_CLICK,
+  BUTTON_LONG_PRESS
+};
+
+// A Button that never needs polling: an interrupt on every edge queues the
+// time and the new level, and read() works through the queue later, so a
+// press during a long loop() is still seen, at the time it happened. Bounce
+// is filtered there: a level only counts once it has held for debounceMs.
+//
+// Call begin() from setup() (it attaches the interrupt), then read() from
+// one thread whenever convenient: a click is reported once doubleClickMs has
+// passed without a second one, a long press as soon as it has been held for
+// longPressMs.
+class InterruptButton {
+  static const uint8_t EDGES = 16;          // power of 2
+  static const uint8_t EVENTS = 4;          // power of 2
+
+  struct Edge {
+    uint32_t ms;
+    bool pressed;
+  };
+
+  int _buttonPin;
+  bool _pullUp;
+  uint16_t _debounceMs, _doubleClickMs, _longPressMs;
+
+  // Filled by the interrupt, emptied by read()
+  Edge _edges[EDGES];
+  std::atomic<uint8_t> _edgeHead, _edgeTail;
+  std::atomic<bool> _overflow;
+
+  // Debouncing and events, read() only
+  bool _raw, _pressed, _longSent, _clickPending;
+  uint32_t _rawSince, _pressedAt, _releasedAt;
+  uint8_t _events[EVENTS];
+  uint8_t _eventHead, _eventTail;
+
+  public:
+    InterruptButton(int buttonPin, bool pullUp=false, uint16_t debounceMs=20, uint16_t doubleClickMs=300,
+                    uint16_t longPressMs=1000) : _edgeHead(0), _edgeTail(0), _overflow(false) {
+      _buttonPin = buttonPin;
+      _pullUp = pullUp;
+      _debounceMs = debounceMs;
+      _doubleClickMs = doubleClickMs;
+      _longPressMs = longPressMs;
+      _raw = _pressed = _longSent = _clickPending = false;
+      _rawSince = _pressedAt = _releasedAt = 0;
+      _eventHead = _eventTail = 0;
+    }
+
+    void begin() {
+      pinMode(_buttonPin, _pullUp ? INPUT_PULLUP : INPUT_PULLDOWN);
+      _raw = _pressed = level();
+      _rawSince = millis();
+      attachInterrupt(_buttonPin, &InterruptButton::onEdge, this, CHANGE);
+    }
+
+    // The next event, or BUTTON_NONE.
+    ButtonEvent read() {
+      Edge edge;
+      uint32_t now;
+
+      while (popEdge(edge)) {
+        settle(edge.ms);
+        _raw = edge.pressed;
+        _rawSince = edge.ms;
+      }
+      if (_overflow.exchange(false)) {
+        // Edges were lost; go by the pin as it is now
+        _raw = level();
+        _rawSince = millis();
+      }
+      now = millis();
+      settle(now);
+      if (_pressed && !_longSent && now - _pressedAt >= _longPressMs) {
+        _longSent = true;
+        flushClick();
+        addEvent(BUTTON_LONG_PRESS);
+      }
+      // Not while a second press may be starting, still inside the debounce
+      if (_clickPending && !_pressed && !_raw && now - _releasedAt > _doubleClickMs) {
+        flushClick();
+      }
+
+      if (_eventTail == _eventHead) {
+        return BUTTON_NONE;
+      }
+      return (ButtonEvent)_events[_eventTail++ & (EVENTS - 1)];
+    }
+
+    // Debounced, as of the last read().
+    bool isPressed() const {
+      return _pressed;
+    }
+
+  private:
+    bool level() {
+      bool high = digitalRead(_buttonPin);
+      return _pullUp ? !high : high;
+    }
+
+    void onEdge() {
+      uint8_t head = _edgeHead.load(std::memory_order_relaxed);
+
+      if ((uint8_t)(head - _edgeTail.load(std::memory_order_acquire)) >= EDGES) {
+        _overflow.store(true, std::memory_order_relaxed);
+        return;
+      }
+      _edges[head & (EDGES - 1)].ms = millis();
+      _edges[head & (EDGES - 1)].pressed = level();
+      _edgeHead.store(head + 1, std::memory_order_release);
+    }
+
+    bool popEdge(Edge &edge) {
+      uint8_t tail = _edgeTail.load(std::memory_order_relaxed);
+
+      if (tail == _edgeHead.load(std::memory_order_acquire)) {
+        return false;
+      }
+      edge = _edges[tail & (EDGES - 1)];
+      _edgeTail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // If the raw level has held for debounceMs by `ms`, it is the new
+    // debounced level, from when it started.
+    void settle(uint32_t ms) {
+      if (_raw == _pressed || ms - _rawSince < _debounceMs) {
+        return;
+      }
+      _pressed = _raw;
+      if (_pressed) {
+        _pressedAt = _rawSince;
+        _longSent = false;
+        if (_clickPending && _pressedAt - _releasedAt > _doubleClickMs) {
+          flushClick();
+        }
+        return;
+      }
+      if (!_longSent && _rawSince - _pressedAt >= _longPressMs) {
+        // Released before read() caught it held
+        flushClick();
+        addEvent(BUTTON_LONG_PRESS);
+      }
+      else if (!_longSent) {
+        if (_clickPending) {
+          _clickPending = false;
+          addEvent(BUTTON_DOUBLE_CLICK);
+        }
+        else {
+          _clickPending = true;
+        }
+      }
+      _releasedAt = _rawSince;
+    }
+
+    void flushClick() {
+      if (_clickPending) {
+        _clickPending = false;
+        addEvent(BUTTON_CLICK);
+      }
+    }
+
+    void addEvent(ButtonEvent event) {
+      if ((uint8_t)(_eventHead - _eventTail) < EVENTS) {
+        _events[_eventHead++ & (EVENTS - 1)] = event;
+      }
+    }
+};
+
+#endif // _BUTTON_H_
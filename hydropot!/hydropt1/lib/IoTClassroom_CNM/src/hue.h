@@ -21,6 +21,14 @@
  */
 
 
+// Request and response buffers are fixed size so commands do not use the heap
+#ifndef HUE_COMMAND_SIZE
+#define HUE_COMMAND_SIZE 64        // longest: {"on":true,"sat":255,"bri":255,"hue":65535}
+#endif
+#ifndef HUE_RESPONSE_SIZE
+#define HUE_RESPONSE_SIZE 1024     // getHue() reads this much of the light's state
+#endif
+
 // Hue Configuration
 const char hueHubIP[] = "192.168.1.5";       // Hue hub IP
 const char hueUsername[] = "MQlZziRO0Wai5MsMHll8xAUAQqw85Qrr8tM37F3T";
@@ -51,7 +59,7 @@ bool setHue(int lightNum, bool HueOn, int HueColor, int HueBright, int HueSat) {
 
   static int PrevLightNum,PrevOn, PrevColor, PrevBright, PrevSat;
 
-  String command = "";  
+  char command[HUE_COMMAND_SIZE];
 
   if((lightNum==PrevLightNum)&&(HueOn==PrevOn)&&(HueColor==PrevColor)&&(HueBright==PrevBright)&&(HueSat==PrevSat)) {
     Serial.printf("No Change - Cancelling CMD\n");
@@ -64,18 +72,10 @@ bool setHue(int lightNum, bool HueOn, int HueColor, int HueBright, int HueSat) {
   PrevSat=HueSat;
 
   if(HueOn == true) {
-    /*
-    command = "{\"on\":true,\"sat\":255,\"bri\":255,\"hue\":";
-    command = command + String(HueColor) + "}";
-    */
-    
-    command = "{\"on\":true,\"sat\":";
-    command = command + String(HueSat) + ",\"bri\":";
-    command = command + String(HueBright) + ",\"hue\":";
-    command = command + String(HueColor) + "}";
+    snprintf(command, sizeof(command), "{\"on\":true,\"sat\":%i,\"bri\":%i,\"hue\":%i}", HueSat, HueBright, HueColor);
   }
   else {
-    command = "{\"on\":false}";
+    snprintf(command, sizeof(command), "{\"on\":false}");
   }
 
   if (HueClient.connect(hueHubIP, hueHubPort)) {
@@ -83,7 +83,7 @@ bool setHue(int lightNum, bool HueOn, int HueColor, int HueBright, int HueSat) {
     //{
       // Serial.println("Sending Command to Hue");
       // Serial.println(command);
-      Serial.printf("Sending Command to Hue: %s\n",command.c_str());
+      Serial.printf("Sending Command to Hue: %s\n",command);
       HueClient.print("PUT /api/");
       HueClient.print(hueUsername);
       HueClient.print("/lights/");
@@ -94,7 +94,7 @@ bool setHue(int lightNum, bool HueOn, int HueColor, int HueBright, int HueSat) {
       HueClient.print("Host: ");
       HueClient.println(hueHubIP);
       HueClient.print("Content-Length: ");
-      HueClient.println(command.length());
+      HueClient.println(strlen(command));
       HueClient.println("Content-Type: text/plain;charset=UTF-8");
       HueClient.println();  // blank line before body
       HueClient.println(command);  // Hue command
@@ -110,6 +110,10 @@ bool setHue(int lightNum, bool HueOn, int HueColor, int HueBright, int HueSat) {
 
 
 bool getHue(int lightNum) {
+  static char response[HUE_RESPONSE_SIZE];
+  const char *field;
+  size_t len;
+
   if (HueClient.connect(hueHubIP, hueHubPort))
   {
     HueClient.print("GET /api/");
@@ -122,28 +126,25 @@ bool getHue(int lightNum) {
     HueClient.println("Content-type: application/json");
     HueClient.println("keep-alive");
     HueClient.println();
-    //while (HueClient.connected())
-    //{
-    //  if (HueClient.available()) {
-        Serial.println();
-        Serial.println(HueClient.readString());
-        Serial.println();
-        HueClient.findUntil("\"on\":", "\0");
-        hueOn = (HueClient.readStringUntil(',') == "true");  // if light is on, set variable to true
-        Serial.print("Hue Status: ");
-        Serial.println(hueOn);
- 
-        HueClient.findUntil("\"bri\":", "\0");
-        hueBri = HueClient.readStringUntil(',').toInt();  // set variable to brightness value
-        Serial.println(hueBri);
-        
-        HueClient.findUntil("\"hue\":", "\0");
-        hueHue = HueClient.readStringUntil(',').toInt();  // set variable to hue value
-        Serial.printf("Hue is\n\n\n %i\n",hueHue);
-        
-        //break;  // not capturing other light attributes yet
-    //  }
-    //}
+    len = HueClient.readBytes(response, sizeof(response) - 1);
+    response[len] = 0;
+    Serial.println();
+    Serial.println(response);
+    Serial.println();
+
+    field = strstr(response, "\"on\":");
+    hueOn = field && strncmp(field + 5, "true", 4) == 0;  // if light is on, set variable to true
+    Serial.print("Hue Status: ");
+    Serial.println(hueOn);
+
+    field = strstr(response, "\"bri\":");
+    hueBri = field ? atoi(field + 6) : 0;  // set variable to brightness value
+    Serial.println(hueBri);
+
+    field = strstr(response, "\"hue\":");
+    hueHue = field ? atol(field + 6) : 0;  // set variable to hue value
+    Serial.printf("Hue is\n\n\n %li\n",hueHue);
+
     HueClient.stop();
     return true;  // captured on,bri,hue
   }
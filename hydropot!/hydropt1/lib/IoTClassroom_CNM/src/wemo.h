@@ -19,6 +19,7 @@ const char *wemoIP[6] = {"192.168.1.30","192.168.1.31","192.168.1.32","192.168.1
 void switchON(int wemo);
 void switchOFF(int wemo);
 void wemoWrite(int outlet, bool wemoState);
+void wemoSend(int wemo, int state);
 
 // Turn on/off wemo outlets similar to digitalWrite
 void wemoWrite(int outlet, bool wemoState) {
@@ -32,20 +33,22 @@ void wemoWrite(int outlet, bool wemoState) {
 
 
 
-// turn on specified wemo outlet
-void switchON(int wemo) {
-  
-  String data1;
-  
-  Serial.printf("Switching On Wemo #%i\n",wemo);
-  data1+="<?xml version=\"1.0\" encoding=\"utf-8\"?><s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:SetBinaryState xmlns:u=\"urn:Belkin:service:basicevent:1\"><BinaryState>1</BinaryState></u:SetBinaryState></s:Body></s:Envelope>"; // Use HTML encoding for comma's
+// SOAP body for SetBinaryState, %i is the new state (HTML encoding for comma's)
+const char wemoBody[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?><s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:SetBinaryState xmlns:u=\"urn:Belkin:service:basicevent:1\"><BinaryState>%i</BinaryState></u:SetBinaryState></s:Body></s:Envelope>";
+
+// Send the state to one outlet. The body is built in a fixed buffer, not a
+// String, so switching does not use the heap.
+void wemoSend(int wemo, int state) {
+  char data1[sizeof(wemoBody)];
+
+  snprintf(data1, sizeof(data1), wemoBody, state);
   if (WemoClient.connect(wemoIP[wemo],wemoPort)) {
         WemoClient.println("POST /upnp/control/basicevent1 HTTP/1.1");
         WemoClient.println("Content-Type: text/xml; charset=utf-8");
         WemoClient.println("SOAPACTION: \"urn:Belkin:service:basicevent:1#SetBinaryState\"");
         WemoClient.println("Connection: keep-alive");
         WemoClient.print("Content-Length: ");
-        WemoClient.println(data1.length());
+        WemoClient.println(strlen(data1));
         WemoClient.println();
         WemoClient.print(data1);
         WemoClient.println();
@@ -56,27 +59,16 @@ void switchON(int wemo) {
   }
 }
 
+// turn on specified wemo outlet
+void switchON(int wemo) {
+  Serial.printf("Switching On Wemo #%i\n",wemo);
+  wemoSend(wemo, 1);
+}
+
 // turn off wemo outlet specified
 void switchOFF(int wemo){
-  String data1;
-  
   Serial.printf("Switching Off Wemo #%i \n",wemo);
-  data1+="<?xml version=\"1.0\" encoding=\"utf-8\"?><s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body><u:SetBinaryState xmlns:u=\"urn:Belkin:service:basicevent:1\"><BinaryState>0</BinaryState></u:SetBinaryState></s:Body></s:Envelope>"; // Use HTML encoding for comma's
-  if (WemoClient.connect(wemoIP[wemo],wemoPort)) {
-        WemoClient.println("POST /upnp/control/basicevent1 HTTP/1.1");
-        WemoClient.println("Content-Type: text/xml; charset=utf-8");
-        WemoClient.println("SOAPACTION: \"urn:Belkin:service:basicevent:1#SetBinaryState\"");
-        WemoClient.println("Connection: keep-alive");
-        WemoClient.print("Content-Length: ");
-        WemoClient.println(data1.length());
-        WemoClient.println();
-        WemoClient.print(data1);
-        WemoClient.println();
-    }
-   
-  if (WemoClient.connected()) {
-     WemoClient.stop();
-  }
+  wemoSend(wemo, 0);
 }
 
 #endif // _WEMO_H_
\ No newline at end of file
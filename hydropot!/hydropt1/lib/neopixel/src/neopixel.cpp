@@ -85,14 +85,30 @@
 
 #if (PLATFORM_ID == 32)
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t) :
-  begun(false), type(t), brightness(0), pixels(NULL), endTime(0)
+  begun(false), type(t), brightness(0), pixels(NULL), endTime(0), pixelCapacity(0), spiBuffer(NULL), spiCapacity(0)
+{
+  updateLength(n);
+  spi_ = &spi;
+}
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t, uint8_t *pixelBuf, uint16_t pixelBufSize,
+                                     uint8_t *spiBuf, uint16_t spiBufSize) :
+  begun(false), type(t), brightness(0), pixels(pixelBuf), endTime(0), pixelCapacity(pixelBufSize),
+  spiBuffer(spiBuf), spiCapacity(spiBufSize)
 {
   updateLength(n);
   spi_ = &spi;
 }
 #else
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) :
-  begun(false), type(t), brightness(0), pixels(NULL), endTime(0)
+  begun(false), type(t), brightness(0), pixels(NULL), endTime(0), pixelCapacity(0)
+{
+  updateLength(n);
+  setPin(p);
+}
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t, uint8_t *pixelBuf, uint16_t pixelBufSize) :
+  begun(false), type(t), brightness(0), pixels(pixelBuf), endTime(0), pixelCapacity(pixelBufSize)
 {
   updateLength(n);
   setPin(p);
@@ -101,7 +117,7 @@ Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) :
 #endif // #if (PLATFORM_ID == 32)
 
 Adafruit_NeoPixel::~Adafruit_NeoPixel() {
-  if (pixels) free(pixels);
+  if (pixels && !pixelCapacity) free(pixels);
 #if (PLATFORM_ID == 32)
   spi_->end();
 #else
@@ -118,10 +134,21 @@ uint8_t Adafruit_NeoPixel::getType() const {
 }
 
 void Adafruit_NeoPixel::updateLength(uint16_t n) {
+  numBytes = NEOPIXEL_PIXEL_BYTES(n, type);
+  if (pixelCapacity) {
+    // Fixed storage: reuse it if the strip fits -- ALL PIXELS ARE CLEARED
+    if (numBytes <= pixelCapacity) {
+      memset(pixels, 0, numBytes);
+      numLEDs = n;
+    } else {
+      numLEDs = numBytes = 0;
+    }
+    return;
+  }
+
   if (pixels) free(pixels); // Free existing data (if any)
 
   // Allocate new data -- note: ALL PIXELS ARE CLEARED
-  numBytes = n * ((type == SK6812RGBW) ? 4 : 3);
   if ((pixels = (uint8_t *)malloc(numBytes))) {
     memset(pixels, 0, numBytes);
     numLEDs = n;
@@ -895,7 +922,11 @@ void Adafruit_NeoPixel::show(void) {
   constexpr uint8_t numBitsPerBit = 3; // How many SPI bits represent one neopixel bit
   uint32_t spiArraySize = (numBytes * numBitsPerBit) + resetOff + resetOff;
   uint8_t* spiArray = NULL;
-  spiArray = (uint8_t*) malloc(spiArraySize);
+  if (spiBuffer && spiArraySize <= spiCapacity) {
+    spiArray = spiBuffer;
+  } else {
+    spiArray = (uint8_t*) malloc(spiArraySize);
+  }
 
   if (spiArray == NULL) {
     Log.error("Not enough memory available!");
@@ -916,7 +947,9 @@ void Adafruit_NeoPixel::show(void) {
   spi_->transfer(spiArray, nullptr, spiArraySize, nullptr);
   spi_->endTransaction();
 
-  free(spiArray);
+  if (spiArray != spiBuffer) {
+    free(spiArray);
+  }
 
 #elif HAL_PLATFORM_NRF52840 // Argon, Boron, Xenon, B SoM, B5 SoM, E SoM X, Tracker
 // [[[Begin of the Neopixel NRF52 EasyDMA implementation
@@ -68,6 +68,12 @@
 #define WS2812B_FAST   0x07 // 800 KHz datastream (NeoPixel)
 #define WS2812B2_FAST  0x08 // 800 KHz datastream (NeoPixel)
 
+// Buffer sizes for n pixels of type t, for the constructors that take
+// caller-provided storage (see Adafruit_NeoPixelStatic below).
+#define NEOPIXEL_PIXEL_BYTES(n, t) ((n) * ((t) == SK6812RGBW ? 4 : 3))
+// P2: 3 SPI bits per data bit plus the reset time before and after
+#define NEOPIXEL_SPI_BYTES(n, t) (NEOPIXEL_PIXEL_BYTES(n, t) * 3 + 2 * ((t) == WS2812B ? 120 : 20))
+
 class Adafruit_NeoPixel {
 
  public:
@@ -75,8 +81,15 @@ class Adafruit_NeoPixel {
   // Constructor: number of LEDs, pin number, LED type
 #if (PLATFORM_ID == 32)
   Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t=WS2812B);
+  // No heap: pixel data lives in pixelBuf (NEOPIXEL_PIXEL_BYTES) and show()
+  // builds the SPI stream in spiBuf (NEOPIXEL_SPI_BYTES). updateLength()
+  // cannot grow past them.
+  Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t, uint8_t *pixelBuf, uint16_t pixelBufSize,
+                    uint8_t *spiBuf, uint16_t spiBufSize);
 #else
   Adafruit_NeoPixel(uint16_t n, uint8_t p=2, uint8_t t=WS2812B);
+  // No heap: pixel data lives in pixelBuf (NEOPIXEL_PIXEL_BYTES).
+  Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t, uint8_t *pixelBuf, uint16_t pixelBufSize);
 #endif // #if (PLATFORM_ID == 32)
   ~Adafruit_NeoPixel();
 
@@ -127,9 +140,40 @@ class Adafruit_NeoPixel {
    *pixels;        // Holds LED color values (3 bytes each)
   uint32_t
     endTime;       // Latch timing reference
+  uint16_t
+    pixelCapacity; // Size of caller-provided 'pixels', 0 if on the heap
 #if (PLATFORM_ID == 32)
   SPIClass*
     spi_;
+  uint8_t
+   *spiBuffer;     // Caller-provided SPI stream buffer, or NULL for the heap
+  uint16_t
+    spiCapacity;
+#endif
+};
+
+// A strip whose buffers are sized at compile time and allocated with the
+// object, e.g. as a global: Adafruit_NeoPixelStatic<12> pixel(SPI1);
+template <uint16_t N, uint8_t T=WS2812B>
+class Adafruit_NeoPixelStatic : public Adafruit_NeoPixel {
+
+ public:
+
+#if (PLATFORM_ID == 32)
+  Adafruit_NeoPixelStatic(SPIClass& spi) :
+    Adafruit_NeoPixel(N, spi, T, pixelStorage, sizeof(pixelStorage), spiStorage, sizeof(spiStorage)) {}
+#else
+  Adafruit_NeoPixelStatic(uint8_t p=2) :
+    Adafruit_NeoPixel(N, p, T, pixelStorage, sizeof(pixelStorage)) {}
+#endif // #if (PLATFORM_ID == 32)
+
+ private:
+
+  uint8_t
+    pixelStorage[NEOPIXEL_PIXEL_BYTES(N, T)];
+#if (PLATFORM_ID == 32)
+  uint8_t
+    spiStorage[NEOPIXEL_SPI_BYTES(N, T)];
 #endif
 };
 
@@ -0,0 +1,684 @@
+/*
+ * Particle.h
+ * Host stand-in for the Device OS API, enough of it to build src/ and lib/
+ * on Linux for the simulation (see SimHal.h). Only what the firmware and its
+ * libraries use is here; behaviour follows the P2 (PLATFORM_ID 32).
+ *
+ * Time is virtual: millis()/micros() only advance when delay() is called or
+ * the simulator steps the clock, so a run is repeatable and a day of loop()
+ * passes takes seconds.
+ */
+
+#ifndef _SIM_PARTICLE_H_
+#define _SIM_PARTICLE_H_
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef PLATFORM_ID
+#define PLATFORM_ID 32
+#endif
+#ifndef SPARK
+#define SPARK 1
+#endif
+#ifndef PARTICLE
+#define PARTICLE 1
+#endif
+#ifndef ARDUINO
+#define ARDUINO 10800
+#endif
+
+#define SIM_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+
+//TYPES AND CONSTANTS
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+typedef uint16_t pin_t;
+
+#define HIGH 1
+#define LOW 0
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define _BV(bit) (1 << (bit))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Pins, numbered as on the P2. The analog inputs share D numbers there too,
+// but the mock only needs them to be distinct.
+enum {
+  D0 = 0, D1, D2, D3, D4, D5, D6, D7, D8, D9, D10, D11, D12, D13, D14, D15, D16,
+  D17, D18, D19, D20, D21, D22,
+  A0 = 30, A1, A2, A3, A4, A5, A6, A7,
+  SIM_PIN_COUNT
+};
+#define PIN_INVALID 0xFF
+#define SDA D0
+#define SCL D1
+#define SCK D17
+#define MISO D16
+#define MOSI D15
+#define SS D18
+#define SCK1 D2
+#define MISO1 D3
+#define MOSI1 D2
+#define SS1 D5
+
+typedef enum PinMode {
+  INPUT,
+  OUTPUT,
+  INPUT_PULLUP,
+  INPUT_PULLDOWN,
+  AF_OUTPUT_PUSHPULL,
+  AF_OUTPUT_DRAIN,
+  AN_INPUT,
+  AN_OUTPUT,
+  OUTPUT_OPEN_DRAIN = AF_OUTPUT_DRAIN,
+  PIN_MODE_NONE = 0xFF
+} PinMode;
+
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+
+//SYSTEM MACROS
+#define SYSTEM_MODE(mode)
+#define SYSTEM_THREAD(state)
+#define STARTUP(code)
+// Retained RAM survives a reset on the device; each sim run starts afresh.
+#define retained
+#define PRODUCT_VERSION(v)
+
+enum LogLevel {
+  LOG_LEVEL_ALL = 1,
+  LOG_LEVEL_TRACE = 1,
+  LOG_LEVEL_INFO = 30,
+  LOG_LEVEL_WARN = 40,
+  LOG_LEVEL_ERROR = 50,
+  LOG_LEVEL_NONE = 70
+};
+
+//TIMING AND GPIO
+unsigned long millis();
+unsigned long micros();
+typedef uint32_t system_tick_t;
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint16_t pin, PinMode mode);
+PinMode getPinMode(uint16_t pin);
+void digitalWrite(uint16_t pin, uint8_t value);
+int32_t digitalRead(uint16_t pin);
+int32_t analogRead(uint16_t pin);
+void analogWrite(uint16_t pin, uint32_t value);
+void shiftOut(uint16_t dataPin, uint16_t clockPin, uint8_t bitOrder, uint8_t val);
+
+void noInterrupts();
+void interrupts();
+
+// The handler runs on the thread that changed the level with
+// SimHal::setDigitalInput(), there and then.
+typedef uint8_t InterruptMode;
+typedef std::function<void()> wiring_interrupt_handler_t;
+bool attachInterrupt(uint16_t pin, wiring_interrupt_handler_t handler, InterruptMode mode, int8_t priority=-1,
+                     uint8_t subpriority=0);
+template <typename T>
+bool attachInterrupt(uint16_t pin, void (T::*handler)(), T *instance, InterruptMode mode, int8_t priority=-1,
+                     uint8_t subpriority=0) {
+  return attachInterrupt(pin, std::bind(handler, instance), mode, priority, subpriority);
+}
+void detachInterrupt(uint16_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned int seed);
+int map(int value, int fromStart, int fromEnd, int toStart, int toEnd);
+double map(double value, double fromStart, double fromEnd, double toStart, double toEnd);
+
+char *itoa(int value, char *out, int radix);
+char *ltoa(long value, char *out, int radix);
+char *utoa(unsigned value, char *out, int radix);
+char *ultoa(unsigned long value, char *out, int radix);
+
+// waitFor(Serial.isConnected, 10000) etc: polls the condition, advancing the
+// virtual clock, until it holds or the timeout expires.
+bool simWaitFor(bool (*poll)(void *), void *context, unsigned long timeout);
+#define waitFor(condition, timeout) \
+  simWaitFor([](void *) -> bool { return condition(); }, nullptr, (timeout))
+#define waitUntil(condition) waitFor(condition, 0xFFFFFFFFUL)
+
+//STRING
+class String {
+  public:
+    String() {}
+    String(const char *s) : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(int value, unsigned char base=10);
+    explicit String(unsigned int value, unsigned char base=10);
+    explicit String(long value, unsigned char base=10);
+    explicit String(unsigned long value, unsigned char base=10);
+    explicit String(float value, int decimalPlaces=6);
+    explicit String(double value, int decimalPlaces=6);
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    bool reserve(unsigned int size) { _s.reserve(size); return true; }
+
+    String &operator=(const char *s) { _s = s ? s : ""; return *this; }
+    String &operator+=(const String &s) { _s += s._s; return *this; }
+    String &operator+=(const char *s) { _s += s ? s : ""; return *this; }
+    String &operator+=(char c) { _s += c; return *this; }
+    String &operator+=(int value) { return *this += String(value); }
+    String &operator+=(unsigned int value) { return *this += String(value); }
+    String &operator+=(long value) { return *this += String(value); }
+    String &operator+=(unsigned long value) { return *this += String(value); }
+    String &operator+=(float value) { return *this += String(value, 2); }
+    String &operator+=(double value) { return *this += String(value, 2); }
+    bool concat(const String &s) { _s += s._s; return true; }
+    bool concat(const char *s) { _s += s ? s : ""; return true; }
+    bool concat(char c) { _s += c; return true; }
+
+    friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+    friend String operator+(const String &a, const char *b) { return String(a._s + (b ? b : "")); }
+    friend String operator+(const char *a, const String &b) { return String((a ? a : "") + b._s); }
+    friend String operator+(const String &a, char b) { return String(a._s + b); }
+    friend String operator+(const String &a, int b) { return a + String(b); }
+    friend String operator+(const String &a, long b) { return a + String(b); }
+    friend String operator+(const String &a, unsigned long b) { return a + String(b); }
+
+    bool operator==(const String &s) const { return _s == s._s; }
+    bool operator==(const char *s) const { return _s == (s ? s : ""); }
+    bool operator!=(const String &s) const { return _s != s._s; }
+    bool operator!=(const char *s) const { return !(*this == s); }
+    bool operator<(const String &s) const { return _s < s._s; }
+    bool equals(const String &s) const { return _s == s._s; }
+    bool equalsIgnoreCase(const String &s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    bool startsWith(const String &s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+    bool endsWith(const String &s) const;
+
+    char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    void setCharAt(unsigned int index, char c) { if (index < _s.size()) _s[index] = c; }
+    int indexOf(char c, unsigned int from=0) const;
+    int indexOf(const String &s, unsigned int from=0) const;
+    int lastIndexOf(char c) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void toCharArray(char *buf, unsigned int size, unsigned int index=0) const;
+    void getBytes(unsigned char *buf, unsigned int size, unsigned int index=0) const;
+
+    String &remove(unsigned int index);
+    String &remove(unsigned int index, unsigned int count);
+    String &replace(const String &find, const String &with);
+    String &toLowerCase();
+    String &toUpperCase();
+    String &trim();
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+
+  private:
+    std::string _s;
+};
+
+//PRINT AND STREAMS
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base=DEC) { return print((unsigned long)value, base); }
+    size_t print(int value, int base=DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base=DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base=DEC);
+    size_t print(unsigned long value, int base=DEC);
+    size_t print(double value, int digits=2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T &value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(const T &value, int format) { size_t n = print(value, format); return n + println(); }
+
+    size_t printf(const char *format, ...) SIM_PRINTF(2, 3);
+    size_t printlnf(const char *format, ...) SIM_PRINTF(2, 3);
+    size_t vprintf(bool newline, const char *format, va_list args);
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    // Stops after the timeout with no data, as on the device.
+    size_t readBytes(char *buffer, size_t length);
+
+  protected:
+    unsigned long _timeout = 1000;
+};
+
+// Serial: writes go to stdout, reads come from stdin.
+class USBSerial : public Stream {
+  public:
+    void begin(long baud=9600) { (void)baud; }
+    void end() {}
+    bool isConnected() { return true; }
+    // Input comes from the simulator's stdin, without blocking.
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    // stdout never fills up, so there is always a full USB buffer free.
+    int availableForWrite() { return 1024; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    operator bool() { return true; }
+};
+extern USBSerial Serial;
+
+//LOGGING
+class Logger {
+  public:
+    void trace(const char *format, ...) const SIM_PRINTF(2, 3);
+    void info(const char *format, ...) const SIM_PRINTF(2, 3);
+    void warn(const char *format, ...) const SIM_PRINTF(2, 3);
+    void error(const char *format, ...) const SIM_PRINTF(2, 3);
+    void log(LogLevel level, const char *format, va_list args) const;
+};
+extern const Logger Log;
+
+class SerialLogHandler {
+  public:
+    SerialLogHandler(LogLevel level=LOG_LEVEL_INFO);
+};
+
+//NETWORK
+class IPAddress {
+  public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) :
+      _address((uint32_t)a << 24 | (uint32_t)b << 16 | (uint32_t)c << 8 | d) {}
+    uint8_t operator[](int index) const { return _address >> (8 * (3 - index)); }
+    operator bool() const { return _address != 0; }
+    String toString() const;
+
+  private:
+    uint32_t _address;
+};
+
+// A TCP connection on a real socket, so the sim can talk to a broker on
+// localhost. Non-blocking once connected, like the Device OS client.
+class TCPClient : public Stream {
+  public:
+    TCPClient();
+    ~TCPClient();
+
+    int connect(const char *host, uint16_t port);
+    int connect(IPAddress ip, uint16_t port);
+    uint8_t connected();
+    void stop();
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size);
+    int peek() override;
+    void flush() override {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    operator bool() { return connected(); }
+
+  private:
+    void poll();
+
+    int _fd;
+    bool _closed;         // peer closed or the socket failed
+};
+
+// As in Device OS; the mock only fills in the SSID.
+enum WLanSecurityType {
+  WLAN_SEC_UNSEC = 0,
+  WLAN_SEC_WEP = 1,
+  WLAN_SEC_WPA = 2,
+  WLAN_SEC_WPA2 = 3,
+  WLAN_SEC_NOT_SET = 0xFF
+};
+
+struct WiFiAccessPoint {
+  size_t size;
+  char ssid[33];
+  uint8_t ssidLength;
+  WLanSecurityType security;
+  int rssi;
+};
+
+// Credentials are kept in the sim root like the EEPROM image, so they carry
+// over between runs. A join takes about 1 s to a known network and 4 s after
+// setCredentials(), which makes the radio scan.
+class WiFiClass {
+  public:
+    void on();
+    void off();
+    void connect();
+    void disconnect();
+    bool connecting();
+    bool ready();
+    bool listening() { return false; }
+    bool setCredentials(const char *ssid, const char *password=nullptr);
+    bool hasCredentials();
+    bool clearCredentials();
+    int getCredentials(WiFiAccessPoint *results, size_t count);
+    IPAddress localIP();
+    int RSSI();
+};
+extern WiFiClass WiFi;
+
+class CloudClass {
+  public:
+    bool connected() { return false; }
+    void connect() {}
+    void disconnect() {}
+    void process() {}
+    bool publish(const char *name, const char *data=nullptr) { (void)name; (void)data; return false; }
+    template <typename T> bool variable(const char *name, const T &value) { (void)name; (void)value; return true; }
+    template <typename F> bool function(const char *name, F fn) { (void)name; (void)fn; return true; }
+};
+extern CloudClass Particle;
+
+//SYSTEM
+// Reset reasons, as Device OS numbers them. Every simulation run starts from
+// power-up.
+enum System_Reset_Reason {
+  RESET_REASON_NONE = 0,
+  RESET_REASON_UNKNOWN = 10,
+  RESET_REASON_PIN_RESET = 20,
+  RESET_REASON_POWER_MANAGEMENT = 30,
+  RESET_REASON_POWER_DOWN = 40,
+  RESET_REASON_POWER_BROWNOUT = 50,
+  RESET_REASON_WATCHDOG = 60,
+  RESET_REASON_UPDATE = 70,
+  RESET_REASON_PANIC = 130,
+  RESET_REASON_USER = 140
+};
+
+class SystemClass {
+  public:
+    String version();
+    uint32_t freeMemory();
+    void reset();
+    int resetReason() { return RESET_REASON_POWER_DOWN; }
+    unsigned long uptime() { return millis() / 1000; }
+};
+extern SystemClass System;
+
+//WATCHDOG
+// The hardware watchdog. If it is started and not refreshed within its
+// timeout of virtual time, the simulation stops with exit status 4.
+class WatchdogConfiguration {
+  public:
+    WatchdogConfiguration &timeout(system_tick_t ms) { _timeoutMs = ms; return *this; }
+    system_tick_t timeout() const { return _timeoutMs; }
+
+  private:
+    system_tick_t _timeoutMs = 0;
+};
+
+class WatchdogClass {
+  public:
+    int init(const WatchdogConfiguration &config);
+    int start();
+    int stop();
+    int refresh();
+};
+extern WatchdogClass Watchdog;
+
+//THREADS
+// Threads run one at a time on the virtual clock: the running thread keeps
+// going until it spends virtual time (delay(), an I2C or SPI transfer,
+// os_thread_delay_until(), os_thread_yield()), then whichever thread is due
+// first runs, the clock jumping to its wake time. Runs stay repeatable.
+// Mutex does not lock: the firmware never spends time while holding one.
+typedef uint8_t os_thread_prio_t;
+typedef void (*os_thread_fn_t)(void *param);
+#define OS_THREAD_PRIORITY_DEFAULT 2
+#define OS_THREAD_STACK_SIZE_DEFAULT 3072
+
+class Thread {
+  public:
+    Thread(const char *name, os_thread_fn_t function, void *param=nullptr,
+           os_thread_prio_t priority=OS_THREAD_PRIORITY_DEFAULT, size_t stackSize=OS_THREAD_STACK_SIZE_DEFAULT);
+    bool isValid() const { return true; }
+    bool isCurrent() const;
+
+  private:
+    struct SimThread *_thread;
+};
+
+// Sleeps until `*previousWakeTime + timeIncrement`, and moves
+// *previousWakeTime on by the increment. Returns at once if that has passed.
+int os_thread_delay_until(system_tick_t *previousWakeTime, system_tick_t timeIncrement);
+void os_thread_yield();
+
+class Mutex {
+  public:
+    void lock() {}
+    void unlock() {}
+    bool trylock() { return true; }
+};
+
+// Heap statistics, as core_hal.h declares them.
+typedef struct {
+  uint16_t size;
+  uint16_t flags;
+  uint32_t freeheap;
+  uint32_t total_init_heap;
+  uint32_t total_heap;
+  uint32_t max_used_heap;
+  uint32_t user_static_ram;
+  uint32_t largest_free_block_heap;
+  uint32_t max_blocks_heap;
+} runtime_info_t;
+int HAL_Core_Runtime_Info(runtime_info_t *info, void *reserved);
+
+class TimeClass {
+  public:
+    time_t now();
+    time_t local();                      // now() shifted by the zone
+    bool isValid();
+    void zone(float offset) { _zone = offset; }
+    float zone() { return _zone; }
+    void setTime(time_t t);
+    String timeStr(time_t t=0);
+    int hour(), minute(), second(), day(), month(), year(), weekday();
+
+  private:
+    struct tm localTm(time_t t);
+    float _zone = 0;
+};
+extern TimeClass Time;
+
+//EEPROM
+// 4 KB of emulated EEPROM as on the P2, kept in a file in the sim directory.
+class EEPROMClass {
+  public:
+    static const size_t SIZE = 4096;
+
+    uint8_t read(int address) const;
+    void write(int address, uint8_t value);
+    size_t length() const { return SIZE; }
+    void clear();
+
+    template <typename T> T &get(int address, T &value) {
+      readBlock(address, &value, sizeof(T));
+      return value;
+    }
+    template <typename T> const T &put(int address, const T &value) {
+      writeBlock(address, &value, sizeof(T));
+      return value;
+    }
+
+  private:
+    void readBlock(int address, void *data, size_t size);
+    void writeBlock(int address, const void *data, size_t size);
+};
+extern EEPROMClass EEPROM;
+
+//I2C
+// The bus is shared by the simulated devices registered with SimHal. A
+// transfer takes 10 bit times per byte at the set speed (100 us at 100 kHz).
+// While a device holds SDA low (SimHal::setI2CStuckAt()) every transfer
+// fails after the HAL's 100 ms timeout, until SCL is clocked by hand.
+#define CLOCK_SPEED_100KHZ 100000
+#define CLOCK_SPEED_400KHZ 400000
+
+class TwoWire : public Stream {
+  public:
+    static const size_t BUFFER_SIZE = 32;
+
+    void begin();
+    void end() { _enabled = false; }
+    bool lock() { return true; }
+    bool unlock() { return true; }
+    bool isEnabled() { return _enabled; }
+    void setSpeed(uint32_t speed) { _byteUs = 10000000 / speed; }
+    void setClock(uint32_t speed) { setSpeed(speed); }
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(bool stop=true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop=true);
+    uint8_t requestFrom(int address, int quantity, int stop=true) { return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)stop); }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override { return _rxLength - _rxPos; }
+    int read() override { return _rxPos < _rxLength ? _rx[_rxPos++] : -1; }
+    int peek() override { return _rxPos < _rxLength ? _rx[_rxPos] : -1; }
+    void flush() override {}
+
+  private:
+    bool _enabled = false;
+    uint32_t _byteUs = 100;
+    uint8_t _address = 0;
+    uint8_t _tx[BUFFER_SIZE];
+    uint8_t _txLength = 0;
+    bool _transmitting = false;
+    uint8_t _rx[BUFFER_SIZE];
+    uint8_t _rxLength = 0;
+    uint8_t _rxPos = 0;
+};
+extern TwoWire Wire;
+
+//SPI
+enum {
+  HAL_SPI_INTERFACE1 = 0,
+  HAL_SPI_INTERFACE2 = 1,
+  HAL_PLATFORM_SPI_NUM = 2
+};
+typedef int hal_spi_interface_t;
+#define SPI_MODE_MASTER 0
+#define SPI_MODE_SLAVE 1
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+#define SPI_CLOCK_DIV2 0
+#define SPI_CLOCK_DIV4 1
+#define SPI_CLOCK_DIV8 2
+#define SPI_CLOCK_DIV16 3
+#define SPI_CLOCK_DIV32 4
+#define SPI_CLOCK_DIV64 5
+#define SPI_CLOCK_DIV128 6
+#define SPI_CLOCK_DIV256 7
+
+#define HAL_SPI_CONFIG_VERSION 1
+#define HAL_SPI_CONFIG_FLAG_MOSI_ONLY 0x01
+typedef struct hal_spi_config_t {
+  uint16_t size;
+  uint16_t version;
+  uint32_t flags;
+} hal_spi_config_t;
+int hal_spi_begin_ext(hal_spi_interface_t spi, uint16_t mode, uint16_t pin, const hal_spi_config_t *config);
+
+class SPISettings {
+  public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) { (void)clock; (void)bitOrder; (void)dataMode; }
+};
+
+typedef void (*wiring_spi_dma_transfercomplete_callback_t)(void);
+
+// Records what is clocked out; SimHal hands each transfer to the registered
+// listener (the NeoPixel strip on SPI1).
+class SPIClass {
+  public:
+    explicit SPIClass(hal_spi_interface_t spi) : _interface(spi) {}
+
+    hal_spi_interface_t interface() const { return _interface; }
+    void begin() {}
+    void begin(uint16_t ssPin) { (void)ssPin; }
+    void end() {}
+    void setBitOrder(uint8_t order) { (void)order; }
+    void setDataMode(uint8_t mode) { (void)mode; }
+    void setClockDivider(uint8_t divider) { (void)divider; }
+    unsigned setClockSpeed(unsigned value, unsigned scale=1) { _clock = value * scale; return _clock; }
+    int32_t beginTransaction() { return 0; }
+    int32_t beginTransaction(const SPISettings &settings) { (void)settings; return 0; }
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data);
+    void transfer(const void *tx, void *rx, size_t length, wiring_spi_dma_transfercomplete_callback_t callback);
+
+  private:
+    hal_spi_interface_t _interface;
+    unsigned _clock = 0;
+};
+extern SPIClass SPI;
+extern SPIClass SPI1;
+
+#endif // _SIM_PARTICLE_H_
@@ -0,0 +1,345 @@
+/*
+ * SimDevices.cpp
+ */
+
+#include "SimDevices.h"
+
+//BME280
+// Trimming values from a production part, in the register layout of the
+// datasheet (section 4.2.2).
+static const uint16_t DIG_T1 = 28485;
+static const int16_t DIG_T2 = 26735, DIG_T3 = 50;
+static const uint16_t DIG_P1 = 36738;
+static const int16_t DIG_P2 = -10635, DIG_P3 = 3024, DIG_P4 = 6980, DIG_P5 = -4, DIG_P6 = -7,
+                     DIG_P7 = 9900, DIG_P8 = -10230, DIG_P9 = 4285;
+static const uint8_t DIG_H1 = 75, DIG_H3 = 0;
+static const int16_t DIG_H2 = 359, DIG_H4 = 337, DIG_H5 = 0;
+static const int8_t DIG_H6 = 30;
+
+static void put16(uint8_t *regs, uint8_t reg, uint16_t value) {
+  regs[reg] = value & 0xFF;
+  regs[reg + 1] = value >> 8;
+}
+
+SimBME280::SimBME280() {
+  memset(_regs, 0, sizeof(_regs));
+  _pointer = 0;
+  _regs[0xD0] = 0x60;   // chip id
+  put16(_regs, 0x88, DIG_T1);
+  put16(_regs, 0x8A, DIG_T2);
+  put16(_regs, 0x8C, DIG_T3);
+  put16(_regs, 0x8E, DIG_P1);
+  put16(_regs, 0x90, DIG_P2);
+  put16(_regs, 0x92, DIG_P3);
+  put16(_regs, 0x94, DIG_P4);
+  put16(_regs, 0x96, DIG_P5);
+  put16(_regs, 0x98, DIG_P6);
+  put16(_regs, 0x9A, DIG_P7);
+  put16(_regs, 0x9C, DIG_P8);
+  put16(_regs, 0x9E, DIG_P9);
+  _regs[0xA1] = DIG_H1;
+  put16(_regs, 0xE1, DIG_H2);
+  _regs[0xE3] = DIG_H3;
+  _regs[0xE4] = DIG_H4 >> 4;
+  _regs[0xE5] = (DIG_H4 & 0x0F) | (DIG_H5 & 0x0F) << 4;
+  _regs[0xE6] = DIG_H5 >> 4;
+  _regs[0xE7] = DIG_H6;
+  set(22, 50, 101325);
+}
+
+// The compensation formulas of the Adafruit driver, so set() can search for
+// the raw values that read back as the requested ones.
+int32_t SimBME280::tFine(int32_t adcT) const {
+  int32_t var1 = (((adcT >> 3) - ((int32_t)DIG_T1 << 1)) * ((int32_t)DIG_T2)) >> 11;
+  int32_t var2 = (((((adcT >> 4) - (int32_t)DIG_T1) * ((adcT >> 4) - (int32_t)DIG_T1)) >> 12) * (int32_t)DIG_T3) >> 14;
+  return var1 + var2;
+}
+
+float SimBME280::temperature(int32_t adcT) const {
+  return ((tFine(adcT) * 5 + 128) >> 8) / 100.0f;
+}
+
+float SimBME280::humidity(int32_t adcH, int32_t fine) const {
+  int32_t v = fine - 76800;
+
+  v = (((((adcH << 14) - ((int32_t)DIG_H4 << 20) - ((int32_t)DIG_H5 * v)) + 16384) >> 15) *
+       (((((((v * (int32_t)DIG_H6) >> 10) * (((v * (int32_t)DIG_H3) >> 11) + 32768)) >> 10) + 2097152) *
+         (int32_t)DIG_H2 + 8192) >> 14));
+  v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)DIG_H1) >> 4);
+  v = v < 0 ? 0 : v;
+  v = v > 419430400 ? 419430400 : v;
+  return (v >> 12) / 1024.0f;
+}
+
+double SimBME280::pressure(int32_t adcP, int32_t fine) const {
+  int64_t var1, var2, p;
+
+  var1 = (int64_t)fine - 128000;
+  var2 = var1 * var1 * (int64_t)DIG_P6;
+  var2 = var2 + ((var1 * (int64_t)DIG_P5) << 17);
+  var2 = var2 + ((int64_t)DIG_P4 << 35);
+  var1 = ((var1 * var1 * (int64_t)DIG_P3) >> 8) + ((var1 * (int64_t)DIG_P2) << 12);
+  var1 = ((((int64_t)1) << 47) + var1) * (int64_t)DIG_P1 >> 33;
+  if (var1 == 0) {
+    return 0;
+  }
+  p = 1048576 - adcP;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = ((int64_t)DIG_P9 * (p >> 13) * (p >> 13)) >> 25;
+  var2 = ((int64_t)DIG_P8 * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + ((int64_t)DIG_P7 << 4);
+  return p / 256.0;
+}
+
+void SimBME280::set(float tempC, float humidRH, float pressurePa) {
+  int32_t lo, hi, mid, adcT, adcH, adcP, fine;
+
+  // Temperature and humidity rise with their ADC value, pressure falls.
+  for (lo = 0, hi = (1 << 20) - 1; lo < hi;) {
+    mid = (lo + hi) / 2;
+    if (temperature(mid) < tempC) lo = mid + 1; else hi = mid;
+  }
+  adcT = lo;
+  fine = tFine(adcT);
+  for (lo = 0, hi = 0xFFFF; lo < hi;) {
+    mid = (lo + hi) / 2;
+    if (humidity(mid, fine) < humidRH) lo = mid + 1; else hi = mid;
+  }
+  adcH = lo;
+  for (lo = 0, hi = (1 << 20) - 1; lo < hi;) {
+    mid = (lo + hi) / 2;
+    if (pressure(mid, fine) > pressurePa) lo = mid + 1; else hi = mid;
+  }
+  adcP = lo;
+
+  _regs[0xF7] = adcP >> 12;
+  _regs[0xF8] = adcP >> 4;
+  _regs[0xF9] = (adcP & 0x0F) << 4;
+  _regs[0xFA] = adcT >> 12;
+  _regs[0xFB] = adcT >> 4;
+  _regs[0xFC] = (adcT & 0x0F) << 4;
+  _regs[0xFD] = adcH >> 8;
+  _regs[0xFE] = adcH & 0xFF;
+}
+
+void SimBME280::load(uint8_t reg, const uint8_t *data, uint8_t length) {
+  memcpy(_regs + reg, data, std::min<size_t>(length, sizeof(_regs) - reg));
+}
+
+// First byte selects the register, the rest are written from there on.
+void SimBME280::write(const uint8_t *data, uint8_t length) {
+  if (length == 0) {
+    return;
+  }
+  _pointer = data[0];
+  for (uint8_t i = 1; i < length; i++) {
+    if (_pointer == 0xE0 || _pointer >= 0xF2) {   // only reset and control registers are writable
+      _regs[_pointer] = data[i];
+    }
+    _pointer++;
+  }
+  _regs[0xE0] = 0;
+  _regs[0xF3] = 0;   // never busy
+}
+
+uint8_t SimBME280::read(uint8_t *data, uint8_t length) {
+  for (uint8_t i = 0; i < length; i++) {
+    data[i] = _regs[_pointer++];
+  }
+  return length;
+}
+
+//SSD1306
+void SimSSD1306::write(const uint8_t *data, uint8_t length) {
+  if (length == 0) {
+    return;
+  }
+  // Control byte 0x40 starts display data, anything else is a command.
+  if (data[0] == 0x40) {
+    dataBytes += length - 1;
+  }
+  else {
+    commands++;
+  }
+}
+
+uint8_t SimSSD1306::read(uint8_t *data, uint8_t length) {
+  memset(data, 0, length);
+  return length;
+}
+
+//NEOPIXEL
+uint32_t SimNeoPixel::shows = 0;
+uint8_t SimNeoPixel::count = 0;
+uint32_t SimNeoPixel::colors[SimNeoPixel::MAX_PIXELS];
+
+// Each data bit is sent as the 3 bit symbol 110 (one) or 100 (zero), so a
+// colour byte takes 3 SPI bytes, between runs of zero bytes for the reset.
+void SimNeoPixel::onSpi(hal_spi_interface_t spi, const uint8_t *data, size_t length) {
+  uint8_t grb[3];
+  size_t pos = 0;
+  uint8_t n = 0, channel = 0;
+
+  if (spi != HAL_SPI_INTERFACE2) {
+    return;
+  }
+  while (pos < length && data[pos] == 0) {
+    pos++;
+  }
+  for (; pos + 3 <= length && data[pos] != 0 && n < MAX_PIXELS; pos += 3) {
+    uint32_t bits = (uint32_t)data[pos] << 16 | (uint32_t)data[pos + 1] << 8 | data[pos + 2];
+    uint8_t value = 0;
+    for (int8_t symbol = 7; symbol >= 0; symbol--) {
+      value = value << 1 | ((bits >> (symbol * 3 + 1)) & 1);
+    }
+    grb[channel++] = value;
+    if (channel == 3) {
+      colors[n++] = (uint32_t)grb[1] << 16 | (uint32_t)grb[0] << 8 | grb[2];
+      channel = 0;
+    }
+  }
+  count = n;
+  shows++;
+}
+
+//PLANT
+static const uint32_t STEP_MS = 100;
+static const uint32_t TRANSPORT_STEPS = 45000 / STEP_MS;   // pumped water takes 45 s to arrive
+static const float INFILTRATION_TAU_S = 60;
+static const float FIELD_CAPACITY = 2600;
+
+static SimPlantConfig plant;
+static SimBME280 *plantBme = nullptr;
+static float soilMoisture, reservoirLevel, surfaceWater;
+static float transit[TRANSPORT_STEPS];
+static uint32_t transitPos;
+static uint64_t lastUs, lastPumpUs, lastBmeUs;
+static uint32_t noiseState = 1;
+
+static float noise(float amplitude) {
+  noiseState = noiseState * 1103515245 + 12345;
+  return ((noiseState >> 16) & 0x7FFF) / 32767.0f * 2 * amplitude - amplitude;
+}
+
+static int32_t plantAnalog(uint16_t pin);
+
+namespace SimPlant {
+
+void begin(const SimPlantConfig &config, SimBME280 *bme) {
+  plant = config;
+  plantBme = bme;
+  soilMoisture = config.moisture;
+  reservoirLevel = config.reservoir;
+  surfaceWater = 0;
+  memset(transit, 0, sizeof(transit));
+  transitPos = 0;
+  lastUs = SimHal::nowUs();
+  lastPumpUs = SimHal::pinHighUs(config.pumpPin);
+  lastBmeUs = 0;
+  SimHal::setAnalogSource(plantAnalog);
+  update();
+}
+
+void update() {
+  uint64_t now = SimHal::nowUs();
+  uint64_t pumpUs = SimHal::pinHighUs(plant.pumpPin);
+  uint32_t steps = (now - lastUs) / (STEP_MS * 1000);
+  float pumpedPerStep, dt = STEP_MS / 1000.0f;
+  float day = 2 * M_PI * (Time.now() % 86400) / 86400.0f;
+
+  if (steps == 0) {
+    return;
+  }
+  // Pump time since the last update, spread evenly over the steps.
+  pumpedPerStep = (pumpUs - lastPumpUs) / 1000.0f / steps;
+  reservoirLevel -= (pumpUs - lastPumpUs) / 1e6f * plant.reservoirPerPumpSecond;
+  if (reservoirLevel < 0) {
+    reservoirLevel = 0;
+  }
+  lastPumpUs = pumpUs;
+  lastUs += (uint64_t)steps * STEP_MS * 1000;
+
+  for (uint32_t s = 0; s < steps; s++) {
+    float evaporation = (0.6f + 0.8f * fmaxf(0, sinf(day))) / 60;   // counts per second
+    float infiltrate = surfaceWater * dt / INFILTRATION_TAU_S;
+
+    surfaceWater += transit[transitPos];
+    transit[transitPos] = pumpedPerStep * plant.countsPerPumpMs;
+    transitPos = (transitPos + 1) % TRANSPORT_STEPS;
+    surfaceWater -= infiltrate;
+    soilMoisture += infiltrate - evaporation * dt;
+    if (soilMoisture > FIELD_CAPACITY) {
+      soilMoisture = FIELD_CAPACITY;
+    }
+  }
+
+  // The BME280 follows the day: warmest mid-afternoon, driest then too.
+  if (plantBme && now - lastBmeUs >= 10000000) {
+    lastBmeUs = now;
+    plantBme->set(22 + 3 * sinf(day) + noise(0.05f), 50 - 8 * sinf(day) + noise(0.2f), 101325 + noise(20));
+  }
+}
+
+float moisture() {
+  return soilMoisture;
+}
+
+float reservoir() {
+  return reservoirLevel;
+}
+
+} // namespace SimPlant
+
+static int32_t plantAnalog(uint16_t pin) {
+  SimPlant::update();
+  if (pin == plant.moisturePin) {
+    return (int32_t)constrain(soilMoisture + noise(5), 0.0f, 4095.0f);
+  }
+  if (pin == plant.waterPin) {
+    // The level probe only conducts while it is powered.
+    return digitalRead(plant.waterPowerPin) ? (int32_t)(reservoirLevel * 5.2f + noise(2)) : 0;
+  }
+  if (pin == plant.airPin) {
+    return (int32_t)(plant.airBaseline + noise(8));
+  }
+  return 0;
+}
+
+//BUTTON
+namespace SimButton {
+
+struct Edge {
+  uint64_t atUs;
+  uint8_t level;
+};
+static uint16_t buttonPin;
+static std::vector<Edge> edges;     // in time order
+static size_t nextEdge;
+
+void begin(uint16_t pin) {
+  buttonPin = pin;
+  SimHal::setDigitalInput(pin, HIGH);
+}
+
+void press(uint64_t atUs, uint32_t holdMs) {
+  uint64_t releaseUs = atUs + holdMs * 1000ULL;
+
+  for (uint8_t level : { LOW, HIGH, LOW }) {
+    edges.push_back({ atUs, level });
+    atUs += 1000;
+  }
+  for (uint8_t level : { HIGH, LOW, HIGH }) {
+    edges.push_back({ releaseUs, level });
+    releaseUs += 1000;
+  }
+  std::stable_sort(edges.begin() + nextEdge, edges.end(),
+                   [](const Edge &a, const Edge &b) { return a.atUs < b.atUs; });
+}
+
+void update() {
+  while (nextEdge < edges.size() && edges[nextEdge].atUs <= SimHal::nowUs()) {
+    SimHal::setDigitalInput(buttonPin, edges[nextEdge++].level);
+  }
+}
+
+} // namespace SimButton
@@ -0,0 +1,94 @@
+/*
+ * SimDevices.h
+ * Models of the hardware around the P2 for the simulation: the BME280 and
+ * SSD1306 on I2C, the NeoPixel ring on SPI1, and a pot whose soil moisture
+ * and reservoir respond to the pump. Readings are deterministic for a given
+ * seed.
+ */
+
+#ifndef _SIMDEVICES_H_
+#define _SIMDEVICES_H_
+
+#include "SimHal.h"
+
+// BME280 register file. Readings are set in physical units and turned into
+// raw ADC values that the Adafruit driver's compensation maps back to them.
+class SimBME280 : public SimI2CDevice {
+  public:
+    SimBME280();
+
+    void set(float tempC, float humidRH, float pressurePa);
+    // Load registers as captured from a real part (trace replay).
+    void load(uint8_t reg, const uint8_t *data, uint8_t length);
+
+    void write(const uint8_t *data, uint8_t length) override;
+    uint8_t read(uint8_t *data, uint8_t length) override;
+
+  private:
+    int32_t tFine(int32_t adcT) const;
+    float temperature(int32_t adcT) const;
+    float humidity(int32_t adcH, int32_t tFine) const;
+    double pressure(int32_t adcP, int32_t tFine) const;
+
+    uint8_t _regs[256];
+    uint8_t _pointer;
+};
+
+// Accepts commands and display data; only counts them.
+class SimSSD1306 : public SimI2CDevice {
+  public:
+    void write(const uint8_t *data, uint8_t length) override;
+    uint8_t read(uint8_t *data, uint8_t length) override;
+
+    uint32_t commands = 0;
+    uint32_t dataBytes = 0;
+};
+
+// Decodes the WS2812B bit stream the NeoPixel library clocks out of SPI1.
+struct SimNeoPixel {
+  static const uint8_t MAX_PIXELS = 64;
+
+  static void onSpi(hal_spi_interface_t spi, const uint8_t *data, size_t length);
+
+  static uint32_t shows;
+  static uint8_t count;
+  static uint32_t colors[MAX_PIXELS];    // 0xRRGGBB after the last show()
+};
+
+// The pot: soil moisture falls with evaporation and rises, with a delay,
+// after the pump runs; the reservoir empties as it pumps. Also supplies the
+// air quality sensor's analog output.
+struct SimPlantConfig {
+  uint16_t pumpPin = D16;
+  uint16_t moisturePin = A1;
+  uint16_t waterPin = A3;
+  uint16_t waterPowerPin = D3;
+  uint16_t airPin = A0;
+  uint16_t buttonPin = D19;
+  float moisture = 1250;             // starting reading (lower = drier)
+  float reservoir = 90;              // starting reservoir %
+  float reservoirPerPumpSecond = 0.05f;
+  float countsPerPumpMs = 0.1f;
+  float airBaseline = 150;
+};
+
+namespace SimPlant {
+  void begin(const SimPlantConfig &config, SimBME280 *bme);
+  // Brings the model up to the current virtual time. analogRead() does this
+  // itself; call it before reading the state directly.
+  void update();
+  float moisture();
+  float reservoir();
+}
+
+// The push button on the pot, between its pin and ground. Each press and
+// release bounces for a couple of ms.
+namespace SimButton {
+  void begin(uint16_t pin);
+  // Press at `atUs` for `holdMs`. Presses may be added in any order.
+  void press(uint64_t atUs, uint32_t holdMs);
+  // Applies the edges due by now; call between loop() passes.
+  void update();
+}
+
+#endif // _SIMDEVICES_H_
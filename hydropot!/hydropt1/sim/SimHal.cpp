@@ -0,0 +1,1493 @@
+/*
+ * SimHal.cpp
+ * Implementation of the mock Device OS declared in Particle.h, plus the
+ * SimHal controls. Firmware threads (Thread) are host threads, but only one
+ * runs at a time, handing over whenever it waits on the virtual clock (see
+ * THREADS below), so the mock needs no locking of its own.
+ *
+ * Filesystem calls are redirected at link time (-Wl,--wrap=open etc, see
+ * CMakeLists.txt) so the firmware's absolute LittleFS paths land under the
+ * sim root instead of the host's /usr.
+ */
+
+// Before the mock's min/max macros, which these headers' own min()/max() clash with
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "SimHal.h"
+
+#include <execinfo.h>
+#include <limits.h>
+#include <malloc.h>
+#include <new>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+//CLOCK AND PINS
+static uint64_t clockUs = 0;
+static time_t epoch = 1760000000;     // wall time at boot, once "synced"
+static unsigned networkWaitMs = 10;
+
+// Hardware watchdog: when running, it expires at watchdogDueUs.
+static bool watchdogRunning = false;
+static uint64_t watchdogTimeoutUs = 0;
+static uint64_t watchdogDueUs = 0;
+
+// Move the virtual clock forward to `us`, unless it is there already. A
+// watchdog that expires on the way resets the device, which ends the run.
+static void moveClock(uint64_t us) {
+  if (us <= clockUs) {
+    return;
+  }
+  if (watchdogRunning && us >= watchdogDueUs) {
+    clockUs = watchdogDueUs;
+    fprintf(stderr, "sim: watchdog reset at %llu ms\n", (unsigned long long)(clockUs / 1000));
+    fflush(stdout);
+    exit(4);
+  }
+  clockUs = us;
+}
+
+struct SimPin {
+  PinMode mode = PIN_MODE_NONE;
+  uint8_t level = LOW;
+  int32_t analog = 0;
+  uint64_t highSince = 0;
+  uint64_t highUs = 0;
+  bool driven = false;            // by SimHal::setDigitalInput(); otherwise the pull resistor decides
+  wiring_interrupt_handler_t isr;
+  InterruptMode isrMode = 0;
+};
+static SimPin pins[SIM_PIN_COUNT];
+static SimAnalogSource analogSource = nullptr;
+
+static SimI2CDevice *i2cDevices[128];
+static SimSpiListener spiListener = nullptr;
+
+static bool wifiAvailable = true;
+static bool wifiOn = false;
+static bool wifiJoining = false;
+static bool wifiJoined = false;
+static bool wifiScan = false;         // credentials written since the last join
+static uint64_t wifiJoinAt = 0;
+static bool wifiLoaded = false;
+static char wifiSsid[33];             // stored credentials, "" for none
+static bool timeSynced = false;
+
+// Sockets waiting for a reply, see waitForNetwork(). Fixed size so the mock
+// itself never allocates inside loop() (see the heap check).
+static struct pollfd awaitingSockets[8];
+static size_t awaitingCount = 0;
+static std::string rootDir = "sim-fs";
+
+static uint32_t randomState = 1;
+
+// The only peer is an MQTT broker. These are the packets it answers: CONNECT,
+// SUBSCRIBE, UNSUBSCRIBE, PINGREQ and PUBLISH with QoS 1 or 2.
+static bool expectsReply(const uint8_t *data, size_t length) {
+  uint8_t type = length ? data[0] >> 4 : 0;
+  return type == 1 || type == 8 || type == 10 || type == 12 || (type == 3 && (data[0] & 0x06));
+}
+
+static void awaitReply(int fd, bool waiting) {
+  size_t n = 0;
+
+  while (n < awaitingCount && awaitingSockets[n].fd != fd) {
+    n++;
+  }
+  if (waiting && n == awaitingCount && awaitingCount < sizeof(awaitingSockets) / sizeof(awaitingSockets[0])) {
+    awaitingSockets[awaitingCount++] = { fd, POLLIN, 0 };
+  }
+  else if (!waiting && n < awaitingCount) {
+    awaitingSockets[n] = awaitingSockets[--awaitingCount];
+  }
+}
+
+// Sockets that have sent a request and not yet heard back. Only these make
+// delay() wait in real time, so a local broker's reply arrives within the
+// virtual delay the firmware spends waiting for it, while idle connections
+// and fire-and-forget publishes cost no real time.
+static void waitForNetwork(unsigned long ms) {
+  if (networkWaitMs == 0 || awaitingCount == 0) {
+    return;
+  }
+  if (::poll(awaitingSockets, awaitingCount, (int)std::min<unsigned long>(ms, networkWaitMs)) == 0) {
+    awaitingCount = 0;   // nothing is coming; stop waiting until the next request
+  }
+}
+
+//THREADS
+// Each thread waits on its own condition until it is handed the clock. The
+// main thread (setup()/loop()) is threads[0]. Kept on the heap and never
+// freed: firmware threads run forever and are abandoned at exit.
+struct SimThread {
+  std::condition_variable wake;
+  uint64_t wakeAt = 0;            // virtual time it is waiting for
+  os_thread_fn_t function = nullptr;
+  void *param = nullptr;
+  bool started = false;           // its host thread is up and waiting
+};
+static std::mutex &schedulerLock = *new std::mutex;
+static SimThread *threads[8] = { new SimThread };
+static size_t threadCount = 1;
+static SimThread *running = threads[0];
+
+// Wait until virtual time `until`, letting every thread due before then run
+// first, in order of wake time. On a tie the thread already running carries on.
+static void sleepUntil(uint64_t until) {
+  std::unique_lock<std::mutex> lock(schedulerLock);
+  SimThread *self = running;
+
+  self->wakeAt = until;
+  for (;;) {
+    SimThread *next = self;
+    for (size_t t = 0; t < threadCount; t++) {
+      if (threads[t]->wakeAt < next->wakeAt) {
+        next = threads[t];
+      }
+    }
+    if (next == self) {
+      moveClock(until);
+      return;
+    }
+    moveClock(next->wakeAt);
+    running = next;
+    next->wake.notify_one();
+    self->wake.wait(lock, [self] { return running == self; });
+  }
+}
+
+static void threadMain(SimThread *self) {
+  {
+    std::unique_lock<std::mutex> lock(schedulerLock);
+    self->started = true;
+    self->wake.notify_one();
+    self->wake.wait(lock, [self] { return running == self; });
+  }
+  self->function(self->param);
+  // Returned: never due again.
+  sleepUntil(UINT64_MAX);
+}
+
+Thread::Thread(const char *name, os_thread_fn_t function, void *param, os_thread_prio_t priority, size_t stackSize) {
+  (void)name; (void)priority; (void)stackSize;
+  if (threadCount == sizeof(threads) / sizeof(threads[0])) {
+    fprintf(stderr, "sim: too many threads\n");
+    abort();
+  }
+  _thread = new SimThread;
+  _thread->wakeAt = clockUs;      // runs as soon as the creator waits
+  _thread->function = function;
+  _thread->param = param;
+  threads[threadCount++] = _thread;
+  std::thread(threadMain, _thread).detach();
+  // Whatever the host allocates to start a thread is done before this
+  // returns, so it counts as the creator's, not as a later leak.
+  std::unique_lock<std::mutex> lock(schedulerLock);
+  _thread->wake.wait(lock, [this] { return _thread->started; });
+}
+
+bool Thread::isCurrent() const {
+  return running == _thread;
+}
+
+int os_thread_delay_until(system_tick_t *previousWakeTime, system_tick_t timeIncrement) {
+  int32_t aheadMs;
+
+  *previousWakeTime += timeIncrement;
+  aheadMs = (int32_t)(*previousWakeTime - (system_tick_t)millis());
+  if (aheadMs > 0) {
+    sleepUntil((clockUs / 1000 + aheadMs) * 1000);
+  }
+  return 0;
+}
+
+// Lets any thread due now run first.
+void os_thread_yield() {
+  sleepUntil(clockUs + 1);
+}
+
+unsigned long millis() {
+  return (unsigned long)(clockUs / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)clockUs;
+}
+
+void delay(unsigned long ms) {
+  SimHal::advanceUs((uint64_t)ms * 1000);
+  waitForNetwork(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+  SimHal::advanceUs(us);
+}
+
+// A device holding SDA low, see SimHal::setI2CStuckAt().
+static const uint64_t I2C_TIMEOUT_US = 100000;    // Device OS gives up on a transfer
+static const uint8_t I2C_STUCK_CLOCKS = 4;        // the rest of the byte it was sending
+static uint64_t i2cStuckAtUs = UINT64_MAX;
+static bool sdaHeld = false;
+static uint8_t sdaReleaseClocks = 0;
+
+static void holdSda() {
+  sdaHeld = true;
+  sdaReleaseClocks = I2C_STUCK_CLOCKS;
+  i2cStuckAtUs = UINT64_MAX;
+}
+
+static SimPin *pin(uint16_t p) {
+  return p < SIM_PIN_COUNT ? &pins[p] : nullptr;
+}
+
+void pinMode(uint16_t p, PinMode mode) {
+  if (SimPin *sp = pin(p)) {
+    sp->mode = mode;
+    if (!sp->driven && (mode == INPUT_PULLUP || mode == INPUT_PULLDOWN)) {
+      sp->level = mode == INPUT_PULLUP ? HIGH : LOW;
+    }
+  }
+}
+
+bool attachInterrupt(uint16_t p, wiring_interrupt_handler_t handler, InterruptMode mode, int8_t priority,
+                     uint8_t subpriority) {
+  SimPin *sp = pin(p);
+
+  (void)priority; (void)subpriority;
+  if (!sp) {
+    return false;
+  }
+  sp->isr = handler;
+  sp->isrMode = mode;
+  return true;
+}
+
+void detachInterrupt(uint16_t p) {
+  if (SimPin *sp = pin(p)) {
+    sp->isr = nullptr;
+  }
+}
+
+PinMode getPinMode(uint16_t p) {
+  SimPin *sp = pin(p);
+  return sp ? sp->mode : PIN_MODE_NONE;
+}
+
+void digitalWrite(uint16_t p, uint8_t value) {
+  SimPin *sp = pin(p);
+
+  if (!sp) {
+    return;
+  }
+  value = value ? HIGH : LOW;
+  if (p == SCL && value && !sp->level && (sp->mode == OUTPUT || sp->mode == OUTPUT_OPEN_DRAIN) && sdaHeld && --sdaReleaseClocks == 0) {
+    sdaHeld = false;
+  }
+  if (value && !sp->level) {
+    sp->highSince = clockUs;
+  }
+  else if (!value && sp->level) {
+    sp->highUs += clockUs - sp->highSince;
+  }
+  sp->level = value;
+}
+
+int32_t digitalRead(uint16_t p) {
+  SimPin *sp = pin(p);
+
+  // SDA has its pull-up on the board; open drain, either side can pull it low
+  if (p == SDA && sp->mode != OUTPUT) {
+    return sdaHeld || (sp->mode == OUTPUT_OPEN_DRAIN && !sp->level) ? LOW : HIGH;
+  }
+  return sp ? sp->level : LOW;
+}
+
+int32_t analogRead(uint16_t p) {
+  SimPin *sp = pin(p);
+
+  if (!sp) {
+    return 0;
+  }
+  return analogSource ? analogSource(p) : sp->analog;
+}
+
+void analogWrite(uint16_t p, uint32_t value) {
+  digitalWrite(p, value ? HIGH : LOW);
+}
+
+void shiftOut(uint16_t dataPin, uint16_t clockPin, uint8_t bitOrder, uint8_t val) {
+  (void)dataPin; (void)clockPin; (void)bitOrder; (void)val;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+// Deterministic, so runs repeat exactly.
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  randomState = randomState * 1103515245 + 12345;
+  return (long)((randomState >> 1) % (unsigned long)max);
+}
+
+long random(long min, long max) {
+  return max <= min ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned int seed) {
+  randomState = seed ? seed : 1;
+}
+
+int map(int value, int fromStart, int fromEnd, int toStart, int toEnd) {
+  if (fromEnd == fromStart) {
+    return toStart;
+  }
+  return (value - fromStart) * (toEnd - toStart) / (fromEnd - fromStart) + toStart;
+}
+
+double map(double value, double fromStart, double fromEnd, double toStart, double toEnd) {
+  if (fromEnd == fromStart) {
+    return toStart;
+  }
+  return (value - fromStart) * (toEnd - toStart) / (fromEnd - fromStart) + toStart;
+}
+
+static char *unsignedToA(unsigned long value, char *out, int radix) {
+  char tmp[sizeof(unsigned long) * 8 + 1];
+  int n = 0;
+
+  if (radix < 2 || radix > 36) {
+    radix = 10;
+  }
+  do {
+    int digit = value % radix;
+    tmp[n++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= radix;
+  } while (value);
+  for (int i = 0; i < n; i++) {
+    out[i] = tmp[n - 1 - i];
+  }
+  out[n] = 0;
+  return out;
+}
+
+char *ultoa(unsigned long value, char *out, int radix) {
+  return unsignedToA(value, out, radix);
+}
+
+char *utoa(unsigned value, char *out, int radix) {
+  return unsignedToA(value, out, radix);
+}
+
+char *ltoa(long value, char *out, int radix) {
+  if (value < 0 && radix == 10) {
+    out[0] = '-';
+    unsignedToA(-(unsigned long)value, out + 1, radix);
+    return out;
+  }
+  return unsignedToA((unsigned long)value, out, radix);
+}
+
+char *itoa(int value, char *out, int radix) {
+  return ltoa(value, out, radix);
+}
+
+bool simWaitFor(bool (*poll)(void *), void *context, unsigned long timeout) {
+  unsigned long start = millis();
+
+  while (!poll(context)) {
+    if (millis() - start >= timeout) {
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+//STRING
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) {
+  char buf[sizeof(long) * 8 + 2];
+  _s = ltoa(value, buf, base);
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char buf[sizeof(long) * 8 + 1];
+  _s = ultoa(value, buf, base);
+}
+
+String::String(float value, int decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, int decimalPlaces) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+  _s = buf;
+}
+
+bool String::endsWith(const String &s) const {
+  return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = _s.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &s, unsigned int from) const {
+  size_t pos = _s.find(s._s, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = _s.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+  return substring(from, _s.size());
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  if (from >= _s.size()) {
+    return String();
+  }
+  return String(_s.substr(from, std::min<size_t>(to, _s.size()) - from));
+}
+
+void String::toCharArray(char *buf, unsigned int size, unsigned int index) const {
+  getBytes((unsigned char *)buf, size, index);
+}
+
+void String::getBytes(unsigned char *buf, unsigned int size, unsigned int index) const {
+  size_t n;
+
+  if (!size || !buf) {
+    return;
+  }
+  n = index < _s.size() ? std::min<size_t>(size - 1, _s.size() - index) : 0;
+  memcpy(buf, _s.data() + index, n);
+  buf[n] = 0;
+}
+
+String &String::remove(unsigned int index) {
+  if (index < _s.size()) {
+    _s.erase(index);
+  }
+  return *this;
+}
+
+String &String::remove(unsigned int index, unsigned int count) {
+  if (index < _s.size()) {
+    _s.erase(index, count);
+  }
+  return *this;
+}
+
+String &String::replace(const String &find, const String &with) {
+  size_t pos = 0;
+
+  if (find._s.empty()) {
+    return *this;
+  }
+  while ((pos = _s.find(find._s, pos)) != std::string::npos) {
+    _s.replace(pos, find._s.size(), with._s);
+    pos += with._s.size();
+  }
+  return *this;
+}
+
+String &String::toLowerCase() {
+  for (char &c : _s) {
+    c = tolower((unsigned char)c);
+  }
+  return *this;
+}
+
+String &String::toUpperCase() {
+  for (char &c : _s) {
+    c = toupper((unsigned char)c);
+  }
+  return *this;
+}
+
+String &String::trim() {
+  size_t start = _s.find_first_not_of(" \t\r\n");
+  size_t end = _s.find_last_not_of(" \t\r\n");
+  _s = start == std::string::npos ? std::string() : _s.substr(start, end - start + 1);
+  return *this;
+}
+
+//PRINT
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(long value, int base) {
+  char buf[sizeof(long) * 8 + 2];
+  return write(ltoa(value, buf, base));
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char buf[sizeof(long) * 8 + 1];
+  return write(ultoa(value, buf, base));
+}
+
+size_t Print::print(double value, int digits) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, value);
+  return write(buf);
+}
+
+size_t Print::vprintf(bool newline, const char *format, va_list args) {
+  char buf[256];
+  va_list copy;
+  size_t n;
+  int len;
+
+  va_copy(copy, args);
+  len = vsnprintf(buf, sizeof(buf), format, copy);
+  va_end(copy);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len < sizeof(buf)) {
+    n = write((const uint8_t *)buf, len);
+  }
+  else {
+    // On the stack, as Device OS does it
+    char big[len + 1];
+    vsnprintf(big, sizeof(big), format, args);
+    n = write((const uint8_t *)big, len);
+  }
+  return newline ? n + println() : n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  va_list args;
+  size_t n;
+
+  va_start(args, format);
+  n = vprintf(false, format, args);
+  va_end(args);
+  return n;
+}
+
+size_t Print::printlnf(const char *format, ...) {
+  va_list args;
+  size_t n;
+
+  va_start(args, format);
+  n = vprintf(true, format, args);
+  va_end(args);
+  return n;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  unsigned long start = millis();
+
+  while (count < length && millis() - start < _timeout) {
+    if (available()) {
+      buffer[count++] = read();
+      start = millis();
+    }
+    else {
+      delay(1);
+    }
+  }
+  return count;
+}
+
+USBSerial Serial;
+static int serialInput = -1;      // byte read ahead from stdin, -1 if none
+static bool serialEof = false;
+
+int USBSerial::available() {
+  struct pollfd pfd = { 0, POLLIN, 0 };
+  unsigned char c;
+
+  if (serialInput < 0 && !serialEof && poll(&pfd, 1, 0) > 0) {
+    if (::read(0, &c, 1) == 1) {
+      serialInput = c;
+    }
+    else {
+      serialEof = true;
+    }
+  }
+  return serialInput >= 0;
+}
+
+int USBSerial::read() {
+  int c = peek();
+
+  serialInput = -1;
+  return c;
+}
+
+int USBSerial::peek() {
+  return available() ? serialInput : -1;
+}
+
+size_t USBSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t USBSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void USBSerial::flush() {
+  fflush(stdout);
+}
+
+//LOGGING
+static LogLevel logLevel = LOG_LEVEL_NONE;
+const Logger Log;
+
+SerialLogHandler::SerialLogHandler(LogLevel level) {
+  logLevel = level;
+}
+
+// Same layout as the Device OS serial log handler.
+void Logger::log(LogLevel level, const char *format, va_list args) const {
+  const char *name;
+
+  if (level < logLevel) {
+    return;
+  }
+  switch (level) {
+    case LOG_LEVEL_TRACE: name = "TRACE"; break;
+    case LOG_LEVEL_INFO:  name = "INFO"; break;
+    case LOG_LEVEL_WARN:  name = "WARN"; break;
+    default:              name = "ERROR"; break;
+  }
+  Serial.printf("%010lu [app] %s: ", millis(), name);
+  Serial.vprintf(true, format, args);
+}
+
+#define LOGGER_METHOD(method, level) \
+  void Logger::method(const char *format, ...) const { \
+    va_list args; \
+    va_start(args, format); \
+    log(level, format, args); \
+    va_end(args); \
+  }
+LOGGER_METHOD(trace, LOG_LEVEL_TRACE)
+LOGGER_METHOD(info, LOG_LEVEL_INFO)
+LOGGER_METHOD(warn, LOG_LEVEL_WARN)
+LOGGER_METHOD(error, LOG_LEVEL_ERROR)
+
+//NETWORK
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buf);
+}
+
+TCPClient::TCPClient() {
+  _fd = -1;
+  _closed = false;
+}
+
+TCPClient::~TCPClient() {
+  stop();
+}
+
+int TCPClient::connect(const char *host, uint16_t port) {
+  struct addrinfo hints = {}, *result, *ai;
+  char service[8];
+  int one = 1;
+
+  stop();
+  if (!WiFi.ready()) {
+    return 0;
+  }
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &result) != 0) {
+    return 0;
+  }
+  for (ai = result; ai && _fd < 0; ai = ai->ai_next) {
+    _fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (_fd >= 0 && ::connect(_fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(_fd);
+      _fd = -1;
+    }
+  }
+  freeaddrinfo(result);
+  if (_fd < 0) {
+    return 0;
+  }
+  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+  setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  _closed = false;
+  return 1;
+}
+
+int TCPClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+// Notice a peer close or socket error without consuming data.
+void TCPClient::poll() {
+  uint8_t c;
+  ssize_t r;
+
+  if (_fd < 0 || _closed) {
+    return;
+  }
+  r = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    _closed = true;
+  }
+}
+
+// Like the device, still "connected" while received data is left to read.
+uint8_t TCPClient::connected() {
+  poll();
+  return _fd >= 0 && (!_closed || available() > 0);
+}
+
+void TCPClient::stop() {
+  if (_fd >= 0) {
+    awaitReply(_fd, false);
+    close(_fd);
+  }
+  _fd = -1;
+  _closed = false;
+}
+
+int TCPClient::available() {
+  int n = 0;
+
+  if (_fd < 0 || ioctl(_fd, FIONREAD, &n) != 0) {
+    return 0;
+  }
+  return n;
+}
+
+int TCPClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int TCPClient::read(uint8_t *buffer, size_t size) {
+  ssize_t r;
+
+  if (_fd < 0) {
+    return -1;
+  }
+  r = recv(_fd, buffer, size, MSG_DONTWAIT);
+  if (r == 0) {
+    _closed = true;
+  }
+  if (r > 0) {
+    awaitReply(_fd, false);
+  }
+  return r > 0 ? (int)r : -1;
+}
+
+int TCPClient::peek() {
+  uint8_t c;
+  return _fd >= 0 && recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+size_t TCPClient::write(const uint8_t *buffer, size_t size) {
+  size_t sent = 0;
+
+  if (_fd >= 0 && expectsReply(buffer, size)) {
+    awaitReply(_fd, true);
+  }
+  while (sent < size && _fd >= 0 && !_closed) {
+    ssize_t r = send(_fd, buffer + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (r > 0) {
+      sent += r;
+    }
+    else if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = { _fd, POLLOUT, 0 };
+      if (::poll(&pfd, 1, 1000) <= 0) {
+        break;
+      }
+    }
+    else {
+      _closed = true;
+    }
+  }
+  return sent;
+}
+
+WiFiClass WiFi;
+CloudClass Particle;
+
+static void wifiPath(char *out) {
+  snprintf(out, PATH_MAX, "%s/wifi", rootDir.c_str());
+}
+
+static void wifiLoad() {
+  char path[PATH_MAX];
+  FILE *f;
+
+  if (wifiLoaded) {
+    return;
+  }
+  wifiLoaded = true;
+  wifiSsid[0] = 0;
+  wifiPath(path);
+  if ((f = fopen(path, "r"))) {
+    if (fgets(wifiSsid, sizeof(wifiSsid), f)) {
+      wifiSsid[strcspn(wifiSsid, "\n")] = 0;
+    }
+    fclose(f);
+  }
+}
+
+static void wifiSave() {
+  char path[PATH_MAX];
+  FILE *f;
+
+  wifiPath(path);
+  if ((f = fopen(path, "w"))) {
+    fprintf(f, "%s\n", wifiSsid);
+    fclose(f);
+  }
+}
+
+void WiFiClass::on() {
+  wifiOn = true;
+}
+
+void WiFiClass::off() {
+  wifiOn = false;
+  wifiJoining = false;
+  wifiJoined = false;
+}
+
+void WiFiClass::connect() {
+  on();
+  if (!wifiJoining && !wifiJoined) {
+    wifiJoining = true;
+    wifiJoinAt = SimHal::nowUs() + (wifiScan ? 4000000 : 1000000);
+  }
+}
+
+void WiFiClass::disconnect() {
+  wifiJoining = false;
+  wifiJoined = false;
+}
+
+bool WiFiClass::connecting() {
+  return wifiOn && wifiJoining;
+}
+
+// The join completes once its time is up, with credentials and a network.
+bool WiFiClass::ready() {
+  if (wifiJoining && SimHal::nowUs() >= wifiJoinAt && hasCredentials() && wifiAvailable) {
+    wifiJoining = false;
+    wifiJoined = true;
+    wifiScan = false;
+    timeSynced = true;
+  }
+  return wifiOn && wifiJoined && wifiAvailable;
+}
+
+bool WiFiClass::setCredentials(const char *ssid, const char *password) {
+  (void)password;
+  if (!ssid || !*ssid) {
+    return false;
+  }
+  wifiLoad();
+  snprintf(wifiSsid, sizeof(wifiSsid), "%s", ssid);
+  wifiSave();
+  wifiScan = true;
+  return true;
+}
+
+bool WiFiClass::hasCredentials() {
+  wifiLoad();
+  return wifiSsid[0] != 0;
+}
+
+bool WiFiClass::clearCredentials() {
+  wifiLoad();
+  wifiSsid[0] = 0;
+  wifiSave();
+  return true;
+}
+
+int WiFiClass::getCredentials(WiFiAccessPoint *results, size_t count) {
+  if (!hasCredentials() || count == 0) {
+    return 0;
+  }
+  memset(results, 0, sizeof(*results));
+  results->size = sizeof(*results);
+  snprintf(results->ssid, sizeof(results->ssid), "%s", wifiSsid);
+  results->ssidLength = strlen(wifiSsid);
+  results->security = WLAN_SEC_WPA2;
+  return 1;
+}
+
+IPAddress WiFiClass::localIP() {
+  return ready() ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+int WiFiClass::RSSI() {
+  return ready() ? -55 : 2;   // 2: not connected, as on the device
+}
+
+//SYSTEM
+SystemClass System;
+
+String SystemClass::version() {
+  return String("sim");
+}
+
+static const size_t P2_HEAP = 3 * 1024 * 1024;
+
+// What the firmware would have left of the P2's heap, given what the process
+// has allocated so far.
+uint32_t SystemClass::freeMemory() {
+  size_t used = mallinfo2().uordblks;
+  return used < P2_HEAP ? P2_HEAP - used : 0;
+}
+
+// The largest free block is approximated as the untouched part of the P2 heap
+// plus the free space at the top of the process heap; holes lower down are
+// what fragmentation costs.
+int HAL_Core_Runtime_Info(runtime_info_t *info, void *reserved) {
+  struct mallinfo2 mi = mallinfo2();
+  static size_t maxUsed = 0;
+
+  (void)reserved;
+  if (mi.uordblks > maxUsed) {
+    maxUsed = mi.uordblks;
+  }
+  info->flags = 0;
+  info->freeheap = System.freeMemory();
+  info->total_init_heap = P2_HEAP;
+  info->total_heap = P2_HEAP;
+  info->max_used_heap = maxUsed;
+  info->user_static_ram = 0;
+  info->largest_free_block_heap = (mi.arena < P2_HEAP ? P2_HEAP - mi.arena : 0) + mi.keepcost;
+  if (info->largest_free_block_heap > info->freeheap) {
+    info->largest_free_block_heap = info->freeheap;
+  }
+  info->max_blocks_heap = 0;
+  return 0;
+}
+
+void SystemClass::reset() {
+  Serial.println("System.reset() - simulation stopped");
+  Serial.flush();
+  exit(0);
+}
+
+//WATCHDOG
+WatchdogClass Watchdog;
+
+int WatchdogClass::init(const WatchdogConfiguration &config) {
+  watchdogTimeoutUs = (uint64_t)config.timeout() * 1000;
+  return 0;
+}
+
+int WatchdogClass::start() {
+  watchdogRunning = watchdogTimeoutUs > 0;
+  watchdogDueUs = clockUs + watchdogTimeoutUs;
+  return 0;
+}
+
+int WatchdogClass::stop() {
+  watchdogRunning = false;
+  return 0;
+}
+
+int WatchdogClass::refresh() {
+  watchdogDueUs = clockUs + watchdogTimeoutUs;
+  return 0;
+}
+
+TimeClass Time;
+
+time_t TimeClass::now() {
+  return epoch + (time_t)(clockUs / 1000000);
+}
+
+bool TimeClass::isValid() {
+  return timeSynced;
+}
+
+void TimeClass::setTime(time_t t) {
+  epoch = t - (time_t)(clockUs / 1000000);
+  timeSynced = true;
+}
+
+time_t TimeClass::local() {
+  return now() + (time_t)(_zone * 3600);
+}
+
+struct tm TimeClass::localTm(time_t t) {
+  struct tm tm;
+  time_t shifted = t + (time_t)(_zone * 3600);
+  gmtime_r(&shifted, &tm);
+  return tm;
+}
+
+// "Wed May 21 01:08:47 2014", as Time.timeStr() formats it.
+String TimeClass::timeStr(time_t t) {
+  char buf[32];
+  struct tm tm = localTm(t ? t : now());
+  strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S %Y", &tm);
+  return String(buf);
+}
+
+int TimeClass::hour() { return localTm(now()).tm_hour; }
+int TimeClass::minute() { return localTm(now()).tm_min; }
+int TimeClass::second() { return localTm(now()).tm_sec; }
+int TimeClass::day() { return localTm(now()).tm_mday; }
+int TimeClass::month() { return localTm(now()).tm_mon + 1; }
+int TimeClass::year() { return localTm(now()).tm_year + 1900; }
+int TimeClass::weekday() { return localTm(now()).tm_wday + 1; }
+
+//EEPROM
+EEPROMClass EEPROM;
+static uint8_t eepromData[EEPROMClass::SIZE];
+static bool eepromLoaded = false;
+
+static std::string eepromPath() {
+  return rootDir + "/eeprom.bin";
+}
+
+static void eepromLoad() {
+  FILE *f;
+
+  if (eepromLoaded) {
+    return;
+  }
+  eepromLoaded = true;
+  memset(eepromData, 0xFF, sizeof(eepromData));   // erased
+  if ((f = fopen(eepromPath().c_str(), "rb"))) {
+    if (fread(eepromData, 1, sizeof(eepromData), f) != sizeof(eepromData)) {
+      memset(eepromData, 0xFF, sizeof(eepromData));
+    }
+    fclose(f);
+  }
+}
+
+static void eepromSave() {
+  FILE *f = fopen(eepromPath().c_str(), "wb");
+
+  if (f) {
+    fwrite(eepromData, 1, sizeof(eepromData), f);
+    fclose(f);
+  }
+}
+
+uint8_t EEPROMClass::read(int address) const {
+  eepromLoad();
+  return address >= 0 && (size_t)address < SIZE ? eepromData[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  writeBlock(address, &value, 1);
+}
+
+void EEPROMClass::clear() {
+  eepromLoad();
+  memset(eepromData, 0xFF, sizeof(eepromData));
+  eepromSave();
+}
+
+void EEPROMClass::readBlock(int address, void *data, size_t size) {
+  eepromLoad();
+  for (size_t i = 0; i < size; i++) {
+    ((uint8_t *)data)[i] = read(address + i);
+  }
+}
+
+void EEPROMClass::writeBlock(int address, const void *data, size_t size) {
+  eepromLoad();
+  if (address < 0 || (size_t)address + size > SIZE) {
+    return;
+  }
+  memcpy(eepromData + address, data, size);
+  eepromSave();
+}
+
+//I2C
+TwoWire Wire;
+
+void TwoWire::begin() {
+  _enabled = true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address;
+  _txLength = 0;
+  _transmitting = true;
+}
+
+size_t TwoWire::write(uint8_t c) {
+  if (!_transmitting || _txLength >= BUFFER_SIZE) {
+    return 0;
+  }
+  _tx[_txLength++] = c;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+
+  while (n < size && write(buffer[n])) {
+    n++;
+  }
+  return n;
+}
+
+// 0 = success, 2 = address not acknowledged, as Wire reports them.
+uint8_t TwoWire::endTransmission(bool stop) {
+  SimI2CDevice *device = _address < 128 ? i2cDevices[_address] : nullptr;
+
+  (void)stop;
+  _transmitting = false;
+  if (!_enabled) {
+    return 2;
+  }
+  if (sdaHeld) {
+    SimHal::advanceUs(I2C_TIMEOUT_US);
+    return 4;
+  }
+  // Address byte included. A missing device still costs the address byte.
+  if (!device) {
+    SimHal::advanceUs(_byteUs);
+    return 2;
+  }
+  SimHal::advanceUs(_byteUs * (_txLength + 1));
+  device->write(_tx, _txLength);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t stop) {
+  SimI2CDevice *device = address < 128 ? i2cDevices[address] : nullptr;
+
+  (void)stop;
+  _rxLength = _rxPos = 0;
+  if (!_enabled || !device) {
+    return 0;
+  }
+  if (sdaHeld) {
+    SimHal::advanceUs(I2C_TIMEOUT_US);
+    return 0;
+  }
+  _rxLength = device->read(_rx, std::min<size_t>(quantity, BUFFER_SIZE));
+  SimHal::advanceUs(_byteUs * (_rxLength + 1));
+  if (clockUs >= i2cStuckAtUs) {
+    holdSda();
+  }
+  return _rxLength;
+}
+
+//SPI
+SPIClass SPI(HAL_SPI_INTERFACE1);
+SPIClass SPI1(HAL_SPI_INTERFACE2);
+
+int hal_spi_begin_ext(hal_spi_interface_t spi, uint16_t mode, uint16_t pin, const hal_spi_config_t *config) {
+  (void)spi; (void)mode; (void)pin; (void)config;
+  return 0;
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  if (spiListener) {
+    spiListener(_interface, &data, 1);
+  }
+  return 0xFF;
+}
+
+void SPIClass::transfer(const void *tx, void *rx, size_t length, wiring_spi_dma_transfercomplete_callback_t callback) {
+  if (tx && spiListener) {
+    spiListener(_interface, (const uint8_t *)tx, length);
+  }
+  if (rx) {
+    memset(rx, 0xFF, length);
+  }
+  if (_clock) {
+    SimHal::advanceUs((uint64_t)length * 8 * 1000000 / _clock);
+  }
+  if (callback) {
+    callback();
+  }
+}
+
+//FILESYSTEM
+// Maps an absolute device path onto the sim root. Relative paths are left
+// alone. Uses a caller's fixed buffer, so the heap check below only sees the
+// firmware's own allocations.
+static const char *mapPath(const char *path, char *out) {
+  if (!path || path[0] != '/' || (size_t)snprintf(out, PATH_MAX, "%s%s", rootDir.c_str(), path) >= PATH_MAX) {
+    return path;
+  }
+  return out;
+}
+
+extern "C" {
+  int __real_open(const char *path, int flags, ...);
+  int __real_mkdir(const char *path, mode_t mode);
+  int __real_unlink(const char *path);
+  int __real_rename(const char *from, const char *to);
+
+  int __wrap_open(const char *path, int flags, ...) {
+    char mapped[PATH_MAX];
+    mode_t mode = 0;
+
+    if (flags & O_CREAT) {
+      va_list args;
+      va_start(args, flags);
+      mode = va_arg(args, int);
+      va_end(args);
+    }
+    return __real_open(mapPath(path, mapped), flags, mode);
+  }
+
+  int __wrap_mkdir(const char *path, mode_t mode) {
+    char mapped[PATH_MAX];
+    return __real_mkdir(mapPath(path, mapped), mode);
+  }
+
+  int __wrap_unlink(const char *path) {
+    char mapped[PATH_MAX];
+    return __real_unlink(mapPath(path, mapped));
+  }
+
+  int __wrap_rename(const char *from, const char *to) {
+    char mappedFrom[PATH_MAX], mappedTo[PATH_MAX];
+    return __real_rename(mapPath(from, mappedFrom), mapPath(to, mappedTo));
+  }
+}
+
+//HEAP CHECK
+// malloc, calloc and realloc are wrapped at link time as well, and operator
+// new is replaced, so every allocation made by the firmware and its libraries
+// passes through here. While the check is on (after setup(), in any thread),
+// allocations are counted and the first few call sites reported.
+static bool heapCheck = false;
+static uint64_t heapAllocations = 0;
+static void *heapCallers[8];
+static size_t heapCallerCount = 0;
+
+static void heapAllocated(void *caller, size_t size) {
+  void *frames[16];
+  int depth;
+
+  if (!heapCheck) {
+    return;
+  }
+  heapAllocations++;
+  for (size_t n = 0; n < heapCallerCount; n++) {
+    if (heapCallers[n] == caller) {
+      return;
+    }
+  }
+  if (heapCallerCount == sizeof(heapCallers) / sizeof(heapCallers[0])) {
+    return;
+  }
+  heapCallers[heapCallerCount++] = caller;
+  // backtrace_symbols_fd() does not allocate, so it is safe in here.
+  heapCheck = false;
+  fprintf(stderr, "heap check: %zu byte allocation at %lu ms:\n", size, millis());
+  depth = backtrace(frames, 16);
+  backtrace_symbols_fd(frames + 1, depth - 1, 2);
+  heapCheck = true;
+}
+
+extern "C" {
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t count, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+
+  void *__wrap_malloc(size_t size) {
+    heapAllocated(__builtin_return_address(0), size);
+    return __real_malloc(size);
+  }
+
+  void *__wrap_calloc(size_t count, size_t size) {
+    heapAllocated(__builtin_return_address(0), count * size);
+    return __real_calloc(count, size);
+  }
+
+  void *__wrap_realloc(void *ptr, size_t size) {
+    heapAllocated(__builtin_return_address(0), size);
+    return __real_realloc(ptr, size);
+  }
+}
+
+void *operator new(size_t size) {
+  void *ptr;
+
+  heapAllocated(__builtin_return_address(0), size);
+  ptr = __real_malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+//SIMHAL CONTROLS
+namespace SimHal {
+
+void setHeapCheck(bool on) {
+  static bool unwinderLoaded = false;
+
+  if (on && !unwinderLoaded) {
+    // The first backtrace() loads the unwinder, which allocates.
+    void *frame;
+    backtrace(&frame, 1);
+    unwinderLoaded = true;
+  }
+  heapCheck = on;
+}
+
+uint64_t heapAllocationsChecked() {
+  return heapAllocations;
+}
+
+uint64_t nowUs() {
+  return clockUs;
+}
+
+void advanceUs(uint64_t us) {
+  if (threadCount == 1) {
+    moveClock(clockUs + us);
+  }
+  else {
+    sleepUntil(clockUs + us);
+  }
+}
+
+void setEpoch(time_t t) {
+  epoch = t;
+}
+
+void setNetworkWait(unsigned ms) {
+  networkWaitMs = ms;
+}
+
+void setAnalogSource(SimAnalogSource source) {
+  analogSource = source;
+}
+
+void setAnalog(uint16_t p, int32_t value) {
+  if (SimPin *sp = pin(p)) {
+    sp->analog = value;
+  }
+}
+
+void setI2CStuckAt(uint64_t us) {
+  if (us == 0) {
+    holdSda();
+  }
+  else {
+    i2cStuckAtUs = us;
+  }
+}
+
+void setDigitalInput(uint16_t p, uint8_t level) {
+  SimPin *sp = pin(p);
+
+  if (!sp) {
+    return;
+  }
+  level = level ? HIGH : LOW;
+  sp->driven = true;
+  if (level == sp->level) {
+    return;
+  }
+  sp->level = level;
+  if (sp->isr && (sp->isrMode == CHANGE || (sp->isrMode == RISING) == (level == HIGH))) {
+    sp->isr();
+  }
+}
+
+uint8_t pinLevel(uint16_t p) {
+  return digitalRead(p);
+}
+
+uint64_t pinHighUs(uint16_t p) {
+  SimPin *sp = pin(p);
+
+  if (!sp) {
+    return 0;
+  }
+  return sp->highUs + (sp->level ? clockUs - sp->highSince : 0);
+}
+
+void attachI2C(uint8_t address, SimI2CDevice *device) {
+  if (address < 128) {
+    i2cDevices[address] = device;
+  }
+}
+
+void setSpiListener(SimSpiListener listener) {
+  spiListener = listener;
+}
+
+void setWiFiAvailable(bool available) {
+  wifiAvailable = available;
+}
+
+void setRoot(const char *dir) {
+  std::string path;
+
+  rootDir = dir;
+  // mkdir -p the root and the LittleFS /usr directory under it.
+  for (size_t i = 1; i <= rootDir.size(); i++) {
+    if (i == rootDir.size() || rootDir[i] == '/') {
+      __real_mkdir(rootDir.substr(0, i).c_str(), 0777);
+    }
+  }
+  path = rootDir + "/usr";
+  __real_mkdir(path.c_str(), 0777);
+  eepromLoaded = false;
+  wifiLoaded = false;
+}
+
+const char *root() {
+  return rootDir.c_str();
+}
+
+} // namespace SimHal
@@ -0,0 +1,64 @@
+/*
+ * SimHal.h
+ * Control side of the mock Device OS: the virtual clock, pin levels, the
+ * simulated I2C bus and where the emulated flash lives. The firmware never
+ * sees this header; sim_main.cpp and the device models use it to drive
+ * and observe the firmware.
+ */
+
+#ifndef _SIMHAL_H_
+#define _SIMHAL_H_
+
+#include "Particle.h"
+
+// A device on the simulated I2C bus. write() gets each transmission (register
+// address first, as the drivers send it), read() fills a requestFrom().
+class SimI2CDevice {
+  public:
+    virtual ~SimI2CDevice() {}
+    virtual void write(const uint8_t *data, uint8_t length) = 0;
+    virtual uint8_t read(uint8_t *data, uint8_t length) = 0;
+};
+
+typedef void (*SimSpiListener)(hal_spi_interface_t spi, const uint8_t *data, size_t length);
+typedef int32_t (*SimAnalogSource)(uint16_t pin);
+
+namespace SimHal {
+  // Clock. Time only moves when advanced, by delay() or by the caller.
+  uint64_t nowUs();
+  void advanceUs(uint64_t us);
+  void setEpoch(time_t epoch);         // wall time at millis() == 0
+  // Longest real time, in ms, a delay() may spend waiting on a socket that
+  // sent a request, so a broker on localhost gets to answer. 0 never waits.
+  void setNetworkWait(unsigned ms);
+
+  // Pins.
+  void setAnalogSource(SimAnalogSource source);
+  void setAnalog(uint16_t pin, int32_t value);   // used when no source is set
+  void setDigitalInput(uint16_t pin, uint8_t level);
+  uint8_t pinLevel(uint16_t pin);                // what the firmware last wrote
+  // Total virtual time a pin has been driven HIGH, for duty-cycle checks.
+  uint64_t pinHighUs(uint16_t pin);
+
+  // Buses.
+  void attachI2C(uint8_t address, SimI2CDevice *device);
+  // From `us` on, the next device read from is left holding SDA low, as if
+  // reset or glitched mid-byte; 0 holds it from power on. It lets go after a
+  // few SCL clocks with Wire stopped.
+  void setI2CStuckAt(uint64_t us);
+  void setSpiListener(SimSpiListener listener);
+
+  // Heap. While on, every allocation is counted and the first few call sites
+  // printed with a backtrace; sim_main turns it on once setup() is done.
+  void setHeapCheck(bool on);
+  uint64_t heapAllocationsChecked();
+
+  // Network and filesystem.
+  void setWiFiAvailable(bool available);
+  // Absolute paths opened by the firmware ("/usr/...") are placed under this
+  // directory, which is also where the EEPROM image is kept.
+  void setRoot(const char *dir);
+  const char *root();
+}
+
+#endif // _SIMHAL_H_
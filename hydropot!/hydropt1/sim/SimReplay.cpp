@@ -0,0 +1,144 @@
+/*
+ * SimReplay.cpp
+ */
+
+#include "SimReplay.h"
+#include "SensorTrace.h"
+
+static std::vector<TraceSample> trace;
+static uint8_t calibration[SENSOR_TRACE_CALBYTES];
+static bool hasCalibration = false;
+static size_t current = 0;      // sample the analog inputs come from
+static size_t nextBme = 0;      // first sample whose BME280 registers are not loaded yet
+static SimBME280 *replayBme = nullptr;
+
+// The analog readings in a sample were taken during the pass that ends with
+// its timestamp, so a read at time t gets the first sample at or after t.
+// The BME280 registers were read as the line was written and hold from then
+// on, so the registers at t come from the last sample before t.
+static const TraceSample &sampleNow() {
+  uint32_t now = millis();
+
+  while (current + 1 < trace.size() && trace[current].ms < now) {
+    current++;
+  }
+  while (nextBme < trace.size() && trace[nextBme].ms < now) {
+    if (replayBme && trace[nextBme].hasBme) {
+      replayBme->load(0xF7, trace[nextBme].bme, SENSOR_TRACE_BMEBYTES);
+    }
+    nextBme++;
+  }
+  return trace[current];
+}
+
+// The BME280 as seen through the trace: registers catch up with the clock
+// before each transfer.
+class ReplayBME280 : public SimI2CDevice {
+  public:
+    void write(const uint8_t *data, uint8_t length) override {
+      sampleNow();
+      replayBme->write(data, length);
+    }
+    uint8_t read(uint8_t *data, uint8_t length) override {
+      sampleNow();
+      return replayBme->read(data, length);
+    }
+};
+static ReplayBME280 replayDevice;
+
+// Pins as wired in hydropt1.cpp; the level probe only reads while powered.
+static int32_t replayAnalog(uint16_t pin) {
+  const TraceSample &sample = sampleNow();
+
+  switch (pin) {
+    case A0: return sample.air;
+    case A1: return sample.moisture;
+    case A3: return digitalRead(D3) ? sample.water : 0;
+  }
+  return 0;
+}
+
+namespace SimReplay {
+
+bool load(const char *path) {
+  FILE *f = fopen(path, "r");
+  char line[256];
+  TraceSample sample;
+  uint8_t cal[SENSOR_TRACE_CALBYTES];
+  unsigned long lineNo = 0, invalid = 0, backwards = 0;
+
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  trace.clear();
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    switch (traceParse(line, sample, cal)) {
+      case TRACE_SAMPLE:
+        // A device reset restarts millis(); keep the first run only.
+        if (!trace.empty() && sample.ms < trace.back().ms) {
+          backwards++;
+          break;
+        }
+        trace.push_back(sample);
+        break;
+      case TRACE_CALIBRATION:
+        if (!hasCalibration) {
+          memcpy(calibration, cal, sizeof(calibration));
+          hasCalibration = true;
+        }
+        break;
+      case TRACE_INVALID:
+        if (invalid++ == 0) {
+          fprintf(stderr, "%s:%lu: not a version %d trace line\n", path, lineNo, SENSOR_TRACE_VERSION);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  fclose(f);
+
+  if (trace.empty()) {
+    fprintf(stderr, "%s: no trace samples\n", path);
+    return false;
+  }
+  if (invalid || backwards) {
+    fprintf(stderr, "%s: skipped %lu invalid lines and %lu samples after a reset\n", path, invalid, backwards);
+  }
+  if (!hasCalibration) {
+    fprintf(stderr, "%s: no BME280 calibration, replaying the simulated BME280\n", path);
+  }
+  return true;
+}
+
+void begin(SimBME280 *bme, uint8_t address) {
+  current = 0;
+  nextBme = 0;
+  replayBme = hasCalibration ? bme : nullptr;
+  if (replayBme) {
+    replayBme->load(0x88, calibration, 26);
+    replayBme->load(0xE1, calibration + 26, 7);
+    // Until the first sample, the best guess is the first reading.
+    for (const TraceSample &sample : trace) {
+      if (sample.hasBme) {
+        replayBme->load(0xF7, sample.bme, SENSOR_TRACE_BMEBYTES);
+        break;
+      }
+    }
+    SimHal::attachI2C(address, &replayDevice);
+  }
+  SimHal::setAnalogSource(replayAnalog);
+  sampleNow();
+}
+
+size_t samples() {
+  return trace.size();
+}
+
+uint32_t lastMs() {
+  return trace.empty() ? 0 : trace.back().ms;
+}
+
+} // namespace SimReplay
@@ -0,0 +1,26 @@
+/*
+ * SimReplay.h
+ * Feeds a captured sensor trace (see src/SensorTrace.h) to the firmware in
+ * place of the plant model. Readings are held from one sample to the next
+ * by timestamp, so the firmware sees what the device saw at the same
+ * millis(), however its own loop timing differs. The trace is open loop:
+ * the pump does not change what is replayed.
+ */
+
+#ifndef _SIMREPLAY_H_
+#define _SIMREPLAY_H_
+
+#include "SimDevices.h"
+
+namespace SimReplay {
+  // Reads a trace or a whole serial log containing one. Returns false, with
+  // a message on stderr, if it holds no usable samples.
+  bool load(const char *path);
+  // Takes over the analog pins and, if the trace has calibration, the BME280
+  // at `address`.
+  void begin(SimBME280 *bme, uint8_t address);
+  size_t samples();
+  uint32_t lastMs();   // millis() of the last sample
+}
+
+#endif // _SIMREPLAY_H_
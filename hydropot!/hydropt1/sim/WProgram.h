@@ -0,0 +1,6 @@
+/*
+ * WProgram.h
+ * Device OS compatibility header; everything is in the sim Particle.h.
+ */
+
+#include "Particle.h"
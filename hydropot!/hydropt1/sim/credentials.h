@@ -0,0 +1,18 @@
+/*
+ * credentials.h
+ * Simulation credentials: the firmware talks to an MQTT broker on this
+ * machine (e.g. mosquitto on port 1883). Not used by the device build.
+ */
+
+#ifndef _CREDENTIALS_H_
+#define _CREDENTIALS_H_
+
+#define AIO_SERVER      "127.0.0.1"
+#define AIO_SERVERPORT  1883
+#define AIO_USERNAME    "sim"
+#define AIO_KEY         "sim"
+
+#define WIFI_SSID       "sim"
+#define WIFI_PASSWORD   "sim"
+
+#endif // _CREDENTIALS_H_
@@ -0,0 +1,164 @@
+/*
+ * sim_main.cpp
+ * Runs the firmware (src/hydropt1.cpp, unchanged) on the host: setup() once,
+ * then loop() until the requested amount of virtual time has passed. Serial
+ * output goes to stdout; a summary of the run goes to stderr at the end.
+ *
+ * Usage: hydropot_sim [options]
+ *   --seconds N      virtual time to run (default 3600, or to the end of a replayed trace);
+ *                    also --minutes, --hours, --days
+ *   --replay FILE    take the sensor readings from a trace captured on a device built
+ *                    with SENSOR_TRACE 1 (see src/SensorTrace.h) instead of the plant model
+ *   --root DIR       where /usr/... files and the EEPROM image live (default sim-fs)
+ *   --net-wait MS    real time a delay() may wait for a broker reply (default 10, 0 = none)
+ *   --loop-us N      virtual time Device OS takes between loop() passes (default 1000)
+ *   --offline        no WiFi, so MQTT never connects
+ *   --moisture N     starting soil moisture reading (default 1250)
+ *   --reservoir N    starting reservoir level in % (default 90)
+ *   --quiet          discard Serial output
+ *   --press S[:MS]   press the button on the pot at S seconds (fractions allowed) for MS ms
+ *                    (default 150); may be given more than once
+ *   --i2c-stuck S    from S seconds (0: from power on) the next I2C device read is left
+ *                    holding SDA low, for the firmware's bus recovery to free
+ *   --heap-check     exit with status 3 if anything allocated from the heap after
+ *                    setup(), in loop() or the control task (the first call sites
+ *                    are printed either way)
+ *
+ * A hardware watchdog left to expire ends the run with exit status 4.
+ *
+ * MQTT goes to AIO_SERVER:AIO_SERVERPORT from sim/credentials.h, 127.0.0.1:1883.
+ */
+
+#include <chrono>
+#include <sys/resource.h>
+
+#include "SimDevices.h"
+#include "SimReplay.h"
+
+void setup();
+void loop();
+
+static SimBME280 bme;
+static SimSSD1306 oled;
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [--seconds|--minutes|--hours|--days N] [--replay FILE] [--root DIR]\n"
+                  "       [--net-wait MS] [--loop-us N] [--offline] [--moisture N] [--reservoir N] [--quiet]\n"
+                  "       [--press S[:MS]] [--i2c-stuck S] [--heap-check]\n", name);
+  exit(2);
+}
+
+// User plus system CPU time of this process, in seconds.
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv) {
+  uint64_t durationUs = 0;
+  uint64_t loopUs = 1000;
+  const char *root = "sim-fs";
+  const char *replay = nullptr;
+  bool quiet = false;
+  bool heapCheck = false;
+  SimPlantConfig plant;
+  uint64_t passes = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!strcmp(arg, "--offline")) {
+      SimHal::setWiFiAvailable(false);
+      continue;
+    }
+    if (!strcmp(arg, "--quiet")) {
+      quiet = true;
+      continue;
+    }
+    if (!strcmp(arg, "--heap-check")) {
+      heapCheck = true;
+      continue;
+    }
+    if (!value) {
+      usage(argv[0]);
+    }
+    i++;
+    if (!strcmp(arg, "--seconds")) durationUs = strtoull(value, NULL, 10) * 1000000ULL;
+    else if (!strcmp(arg, "--minutes")) durationUs = strtoull(value, NULL, 10) * 60000000ULL;
+    else if (!strcmp(arg, "--hours")) durationUs = strtoull(value, NULL, 10) * 3600000000ULL;
+    else if (!strcmp(arg, "--days")) durationUs = strtoull(value, NULL, 10) * 86400000000ULL;
+    else if (!strcmp(arg, "--replay")) replay = value;
+    else if (!strcmp(arg, "--root")) root = value;
+    else if (!strcmp(arg, "--net-wait")) SimHal::setNetworkWait(atoi(value));
+    else if (!strcmp(arg, "--loop-us")) loopUs = strtoull(value, NULL, 10);
+    else if (!strcmp(arg, "--moisture")) plant.moisture = atof(value);
+    else if (!strcmp(arg, "--reservoir")) plant.reservoir = atof(value);
+    else if (!strcmp(arg, "--press")) {
+      const char *hold = strchr(value, ':');
+      SimButton::press((uint64_t)(atof(value) * 1e6), hold ? atoi(hold + 1) : 150);
+    }
+    else if (!strcmp(arg, "--i2c-stuck")) SimHal::setI2CStuckAt(strtoull(value, NULL, 10) * 1000000ULL);
+    else usage(argv[0]);
+  }
+  if (quiet && !freopen("/dev/null", "w", stdout)) {
+    perror("/dev/null");
+    return 1;
+  }
+
+  SimHal::setRoot(root);
+  SimHal::attachI2C(0x77, &bme);
+  SimHal::attachI2C(0x3D, &oled);
+  SimHal::setSpiListener(SimNeoPixel::onSpi);
+  SimButton::begin(plant.buttonPin);
+  if (replay) {
+    if (!SimReplay::load(replay)) {
+      return 1;
+    }
+    SimReplay::begin(&bme, 0x77);
+    if (!durationUs) {
+      durationUs = (SimReplay::lastMs() + 1000ULL) * 1000;
+    }
+  }
+  else {
+    SimPlant::begin(plant, &bme);
+  }
+  if (!durationUs) {
+    durationUs = 3600ULL * 1000000;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  double startCpu = cpuSeconds();
+  setup();
+  // On from here to the end: the control task runs while loop() waits.
+  SimHal::setHeapCheck(true);
+  while (SimHal::nowUs() < durationUs) {
+    loop();
+    passes++;
+    SimHal::advanceUs(loopUs);
+    SimButton::update();
+  }
+  SimHal::setHeapCheck(false);
+  double realS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpuS = cpuSeconds() - startCpu;
+  double hours = SimHal::nowUs() / 3.6e9;
+  fflush(stdout);
+
+  fprintf(stderr, "\n%.1f h simulated in %.2f s (%.0fx), %llu loop() passes, %.1f us real per pass\n",
+          hours, realS, hours * 3600 / realS, (unsigned long long)passes, passes ? realS * 1e6 / passes : 0.0);
+  fprintf(stderr, "CPU %.3f s per simulated hour\n", cpuS / hours);
+  if (replay) {
+    fprintf(stderr, "replayed %lu samples, pump on %.1f s\n", (unsigned long)SimReplay::samples(),
+            SimHal::pinHighUs(plant.pumpPin) / 1e6);
+  }
+  else {
+    SimPlant::update();
+    fprintf(stderr, "pump on %.1f s, soil moisture %.0f, reservoir %.1f%%\n", SimHal::pinHighUs(plant.pumpPin) / 1e6,
+            SimPlant::moisture(), SimPlant::reservoir());
+  }
+  fprintf(stderr, "%lu NeoPixel updates, %lu display commands, %lu display bytes\n", (unsigned long)SimNeoPixel::shows,
+          (unsigned long)oled.commands, (unsigned long)oled.dataBytes);
+  uint64_t allocations = SimHal::heapAllocationsChecked();
+  fprintf(stderr, "%llu heap allocations after setup()\n", (unsigned long long)allocations);
+  return heapCheck && allocations ? 3 : 0;
+}
@@ -0,0 +1,6 @@
+/*
+ * spark_wiring_usbserial.h
+ * Device OS compatibility header; everything is in the sim Particle.h.
+ */
+
+#include "Particle.h"
@@ -0,0 +1,35 @@
+/*
+ * ClockText.cpp
+ */
+
+#include "ClockText.h"
+
+#include <string.h>
+
+static void putTwo(char *out, int value) {
+  out[0] = '0' + value / 10;
+  out[1] = '0' + value % 10;
+}
+
+ClockText::ClockText() {
+  _shown = -1;
+  strcpy(_time, "00:00:00");
+  strcpy(_dateTime, "Thu Jan  1 00:00:00 1970");
+}
+
+bool ClockText::update(time_t local) {
+  struct tm tm;
+
+  if (local == _shown) {
+    return false;
+  }
+  _shown = local;
+  gmtime_r(&local, &tm);
+  putTwo(_time, tm.tm_hour);
+  putTwo(_time + 3, tm.tm_min);
+  putTwo(_time + 6, tm.tm_sec);
+  // The date part only changes at midnight, but strftime into a fixed
+  // buffer is cheap and does not allocate.
+  strftime(_dateTime, sizeof(_dateTime), "%a %b %e %H:%M:%S %Y", &tm);
+  return true;
+}
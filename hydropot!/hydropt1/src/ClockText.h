@@ -0,0 +1,35 @@
+/*
+ * ClockText.h
+ * The time of day as text for the display and the Serial report, kept in
+ * fixed buffers and reformatted only when the second changes, so loop() no
+ * longer builds heap Strings from Time.timeStr() on every pass.
+ *
+ *   time()      "01:54:22"
+ *   dateTime()  "Thu Oct  9 01:54:22 2025", the same layout as Time.timeStr()
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _CLOCKTEXT_H_
+#define _CLOCKTEXT_H_
+
+#include <time.h>
+
+class ClockText {
+  public:
+    ClockText();
+
+    // `local` is seconds since 1970 in local time (Time.local()). Returns true
+    // if the text changed.
+    bool update(time_t local);
+
+    const char *time() const { return _time; }
+    const char *dateTime() const { return _dateTime; }
+
+  private:
+    time_t _shown;
+    char _time[9];
+    char _dateTime[25];
+};
+
+#endif // _CLOCKTEXT_H_
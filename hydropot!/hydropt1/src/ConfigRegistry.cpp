@@ -0,0 +1,281 @@
+/*
+ * ConfigRegistry.cpp
+ * EEPROM layout at the registry address: Header, then one 4 byte value per
+ * parameter in table order.
+ */
+
+#include "ConfigRegistry.h"
+
+static const uint32_t CONFIG_MAGIC = 0x48504346;  // "HPCF"
+
+ConfigRegistry::ConfigRegistry(ConfigParam *params, uint8_t count, int eepromAddress) {
+  _params = params;
+  _count = count < CONFIG_MAX_PARAMS ? count : CONFIG_MAX_PARAMS;
+  _address = eepromAddress;
+  _onChange = NULL;
+  _validate = NULL;
+}
+
+void ConfigRegistry::begin() {
+  Header hdr;
+  uint8_t id;
+  bool valid;
+
+  restoreDefaults();
+
+  EEPROM.get(_address, hdr);
+  valid = hdr.magic == CONFIG_MAGIC && hdr.schema == schemaHash() && hdr.count == _count;
+  if (valid) {
+    for (id = 0; id < _count; id++) {
+      EEPROM.get(_address + sizeof(Header) + id * 4, _params[id].value);
+    }
+    valid = hdr.crc == valuesCrc();
+  }
+
+  // Reject the whole block on any mismatch, then each value individually, so a
+  // table change or a corrupt cell can never push a parameter out of range.
+  if (!valid) {
+    Log.info("ConfigRegistry: no saved configuration, using defaults");
+    restoreDefaults();
+    return;
+  }
+  for (id = 0; id < _count; id++) {
+    float v = _params[id].type == CONFIG_INT ? (float)_params[id].value.i : _params[id].value.f;
+    if (!(v >= _params[id].minValue && v <= _params[id].maxValue)) {
+      Log.warn("ConfigRegistry: saved %s out of range, using default", _params[id].key);
+      setValue(id, _params[id].defaultValue, false);
+    }
+  }
+  Log.info("ConfigRegistry: loaded %u parameters", _count);
+}
+
+int32_t ConfigRegistry::getInt(uint8_t id) const {
+  return _params[id].type == CONFIG_INT ? _params[id].value.i : (int32_t)_params[id].value.f;
+}
+
+float ConfigRegistry::getFloat(uint8_t id) const {
+  return _params[id].type == CONFIG_FLOAT ? _params[id].value.f : (float)_params[id].value.i;
+}
+
+bool ConfigRegistry::set(uint8_t id, float value) {
+  if (id >= _count || !(value >= _params[id].minValue && value <= _params[id].maxValue)) {
+    return false;
+  }
+  if (setValue(id, value, true)) {
+    save();
+  }
+  return true;
+}
+
+int ConfigRegistry::applyUpdate(const char *text, uint16_t len) {
+  ConfigValue staged[CONFIG_MAX_PARAMS];
+  const char *p = text;
+  const char *end = text + len;
+  int count = 0;
+  bool rejected = false;
+  uint8_t id;
+
+  // Parse the whole update into a copy of the values first
+  for (id = 0; id < _count; id++) {
+    staged[id] = _params[id].value;
+  }
+
+  while (p < end) {
+    const char *tokenEnd = (const char *)memchr(p, ';', end - p);
+    if (!tokenEnd) {
+      tokenEnd = end;
+    }
+    const char *eq = (const char *)memchr(p, '=', tokenEnd - p);
+
+    if (!eq) {
+      if (tokenEnd - p == 8 && strncmp(p, "defaults", 8) == 0) {
+        for (id = 0; id < _count; id++) {
+          staged[id] = toValue(id, _params[id].defaultValue);
+        }
+      } else if (tokenEnd > p) {
+        rejected = true;
+      }
+      p = tokenEnd + 1;
+      continue;
+    }
+
+    char number[16];
+    char *parsedEnd;
+    int found = find(p, eq - p);
+    uint16_t numlen = tokenEnd - eq - 1;
+
+    if (found < 0 || numlen == 0 || numlen >= sizeof(number)) {
+      Log.warn("ConfigRegistry: unknown or malformed entry '%.*s'", (int)(tokenEnd - p), p);
+      rejected = true;
+      p = tokenEnd + 1;
+      continue;
+    }
+    id = found;
+    memcpy(number, eq + 1, numlen);
+    number[numlen] = 0;
+
+    float value;
+    if (_params[id].type == CONFIG_INT) {
+      value = strtol(number, &parsedEnd, 10);
+    } else {
+      value = strtof(number, &parsedEnd);
+    }
+    if (*parsedEnd != 0 || !(value >= _params[id].minValue && value <= _params[id].maxValue)) {
+      Log.warn("ConfigRegistry: rejected %s=%s (range %g..%g)", _params[id].key, number,
+               _params[id].minValue, _params[id].maxValue);
+      rejected = true;
+    } else {
+      staged[id] = toValue(id, value);
+    }
+    p = tokenEnd + 1;
+  }
+  if (rejected) {
+    return -1;
+  }
+
+  // Swap the staged values in, keeping the old ones, and check them together
+  for (id = 0; id < _count; id++) {
+    ConfigValue old = _params[id].value;
+    _params[id].value = staged[id];
+    staged[id] = old;
+  }
+  if (_validate && !_validate()) {
+    Log.warn("ConfigRegistry: update rejected as a whole");
+    for (id = 0; id < _count; id++) {
+      _params[id].value = staged[id];
+    }
+    return -1;
+  }
+
+  for (id = 0; id < _count; id++) {
+    if (differs(id, _params[id].value, staged[id])) {
+      changed(id);
+      count++;
+    }
+  }
+  if (count > 0) {
+    save();
+  }
+  return count;
+}
+
+void ConfigRegistry::restoreDefaults() {
+  for (uint8_t id = 0; id < _count; id++) {
+    setValue(id, _params[id].defaultValue, false);
+  }
+}
+
+bool ConfigRegistry::save() {
+  Header hdr;
+
+  for (uint8_t id = 0; id < _count; id++) {
+    EEPROM.put(_address + sizeof(Header) + id * 4, _params[id].value);
+  }
+  hdr.magic = CONFIG_MAGIC;
+  hdr.schema = schemaHash();
+  hdr.count = _count;
+  hdr.crc = valuesCrc();
+  EEPROM.put(_address, hdr);
+  return true;
+}
+
+uint16_t ConfigRegistry::format(char *buf, uint16_t size) const {
+  uint16_t len = 0;
+  int n;
+
+  if (size == 0) {
+    return 0;
+  }
+  buf[0] = 0;
+  for (uint8_t id = 0; id < _count; id++) {
+    if (_params[id].type == CONFIG_INT) {
+      n = snprintf(buf + len, size - len, "%s%s=%ld", id ? ";" : "", _params[id].key, (long)_params[id].value.i);
+    } else {
+      n = snprintf(buf + len, size - len, "%s%s=%g", id ? ";" : "", _params[id].key, _params[id].value.f);
+    }
+    if (n < 0 || len + n >= size) {
+      buf[len] = 0;  // drop the partial entry
+      break;
+    }
+    len += n;
+  }
+  return len;
+}
+
+uint16_t ConfigRegistry::storageSize() const {
+  return sizeof(Header) + _count * 4;
+}
+
+int ConfigRegistry::find(const char *key, uint8_t keylen) const {
+  for (uint8_t id = 0; id < _count; id++) {
+    if (strlen(_params[id].key) == keylen && strncmp(_params[id].key, key, keylen) == 0) {
+      return id;
+    }
+  }
+  return -1;
+}
+
+// Store a value already known to be in range. Returns true if it changed.
+bool ConfigRegistry::setValue(uint8_t id, float value, bool notify) {
+  ConfigValue v = toValue(id, value);
+  bool different = differs(id, _params[id].value, v);
+
+  _params[id].value = v;
+  if (different && notify) {
+    changed(id);
+  }
+  return different;
+}
+
+// A value as parameter id stores it, ints rounded to the nearest.
+ConfigValue ConfigRegistry::toValue(uint8_t id, float value) const {
+  ConfigValue v;
+
+  if (_params[id].type == CONFIG_INT) {
+    v.i = (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+  } else {
+    v.f = value;
+  }
+  return v;
+}
+
+bool ConfigRegistry::differs(uint8_t id, const ConfigValue &a, const ConfigValue &b) const {
+  return _params[id].type == CONFIG_INT ? a.i != b.i : a.f != b.f;
+}
+
+void ConfigRegistry::changed(uint8_t id) {
+  Log.info("ConfigRegistry: %s changed", _params[id].key);
+  if (_onChange) {
+    _onChange(id);
+  }
+}
+
+// FNV-1a over every key and type, so renaming, reordering or retyping the
+// table invalidates what was saved with the old one.
+uint32_t ConfigRegistry::schemaHash() const {
+  uint32_t h = 2166136261UL;
+
+  for (uint8_t id = 0; id < _count; id++) {
+    for (const char *k = _params[id].key; *k; k++) {
+      h = (h ^ (uint8_t)*k) * 16777619UL;
+    }
+    h = (h ^ (uint8_t)_params[id].type) * 16777619UL;
+  }
+  return h;
+}
+
+// CRC-16/CCITT of the values as stored.
+uint16_t ConfigRegistry::valuesCrc() const {
+  uint16_t crc = 0xFFFF;
+
+  for (uint8_t id = 0; id < _count; id++) {
+    const uint8_t *b = (const uint8_t *)&_params[id].value;
+    for (uint8_t i = 0; i < 4; i++) {
+      crc ^= (uint16_t)b[i] << 8;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,98 @@
+/*
+ * ConfigRegistry.h
+ * Typed, range-checked operating parameters that persist in EEPROM and can be
+ * changed at run time through one MQTT config topic, so a fleet of pots can be
+ * tuned without reflashing.
+ *
+ * Update encoding (one message, any subset of keys, applied as a whole):
+ *   "mt=900;wl=25;pi=60000"      set values
+ *   "defaults"                   restore every parameter to its default
+ * An update with any value outside its parameter's range, or that the
+ * validate callback turns down, is rejected and every old value is kept.
+ */
+
+#ifndef _CONFIGREGISTRY_H_
+#define _CONFIGREGISTRY_H_
+
+#include "Particle.h"
+
+enum ConfigType {
+  CONFIG_INT,
+  CONFIG_FLOAT
+};
+
+// Parameters a registry can hold; an update is staged in this many values.
+static const uint8_t CONFIG_MAX_PARAMS = 32;
+
+union ConfigValue {
+  int32_t i;
+  float f;
+};
+
+struct ConfigParam {
+  const char *key;      // short key used on the config topic
+  ConfigType type;
+  float minValue;
+  float maxValue;
+  float defaultValue;
+  ConfigValue value;
+};
+
+// Called after a parameter changed, with its index in the table.
+typedef void (*ConfigChangeCallback)(uint8_t id);
+// Checks the values an update would leave, which getInt() and getFloat()
+// return while it runs. Return false to reject the whole update.
+typedef bool (*ConfigValidateCallback)();
+
+class ConfigRegistry {
+  public:
+    ConfigRegistry(ConfigParam *params, uint8_t count, int eepromAddress=0);
+
+    // Load saved values (falling back to defaults for anything missing or
+    // invalid). Call once from setup().
+    void begin();
+
+    int32_t getInt(uint8_t id) const;
+    float getFloat(uint8_t id) const;
+    bool set(uint8_t id, float value);
+
+    // Apply an update in the encoding above and save it once if anything
+    // changed. Returns the number of parameters changed, or -1 if any token
+    // or the validate callback rejected it, in which case nothing changed.
+    int applyUpdate(const char *text, uint16_t len);
+    void restoreDefaults();
+    bool save();
+
+    // Write the current values in the update encoding.
+    uint16_t format(char *buf, uint16_t size) const;
+
+    void setChangeCallback(ConfigChangeCallback callback) { _onChange = callback; }
+    void setValidateCallback(ConfigValidateCallback callback) { _validate = callback; }
+    uint8_t count() const { return _count; }
+    // Bytes of EEPROM used, for placing other data after the registry.
+    uint16_t storageSize() const;
+
+  private:
+    struct Header {
+      uint32_t magic;
+      uint32_t schema;   // hash of the keys and types, so a new table resets
+      uint16_t count;
+      uint16_t crc;
+    };
+
+    int find(const char *key, uint8_t keylen) const;
+    bool setValue(uint8_t id, float value, bool notify);
+    ConfigValue toValue(uint8_t id, float value) const;
+    bool differs(uint8_t id, const ConfigValue &a, const ConfigValue &b) const;
+    void changed(uint8_t id);
+    uint32_t schemaHash() const;
+    uint16_t valuesCrc() const;
+
+    ConfigParam *_params;
+    uint8_t _count;
+    int _address;
+    ConfigChangeCallback _onChange;
+    ConfigValidateCallback _validate;
+};
+
+#endif // _CONFIGREGISTRY_H_
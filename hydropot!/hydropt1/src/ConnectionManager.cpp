@@ -0,0 +1,131 @@
+/*
+ * ConnectionManager.cpp
+ */
+
+#include "ConnectionManager.h"
+
+ConnectionManager::ConnectionManager(Adafruit_MQTT *mqtt, unsigned int minInterval, unsigned int maxInterval,
+                                     unsigned int pingInterval) {
+  _mqtt = mqtt;
+  _state = WAITING_FOR_NETWORK;
+  _minInterval = minInterval;
+  _maxInterval = maxInterval;
+  _pingInterval = pingInterval;
+  _retryDelay = 0;
+  _retryStart = 0;
+  _lastPing = 0;
+  _connectedAt = 0;
+  _consecutiveFailures = 0;
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void ConnectionManager::loop() {
+  switch (_state) {
+    case WAITING_FOR_NETWORK:
+      if (WiFi.ready()) {
+        // First attempt right away, later ones follow the backoff schedule.
+        _state = BACKOFF;
+        _retryStart = millis();
+        _retryDelay = 0;
+      }
+      break;
+
+    case BACKOFF:
+      if (!WiFi.ready()) {
+        _state = WAITING_FOR_NETWORK;
+      }
+      else if ((millis() - _retryStart) >= _retryDelay) {
+        attempt();
+      }
+      break;
+
+    case CONNECTED:
+      if (!_mqtt->connected()) {
+        Log.warn("MQTT connection lost");
+        lost();
+      }
+      else if ((millis() - _lastPing) > _pingInterval) {
+        _lastPing = millis();
+        if (!_mqtt->ping()) {
+          Log.warn("MQTT ping failed, disconnecting");
+          _stats.pingFailures++;
+          _mqtt->disconnect();
+          lost();
+        }
+      }
+      break;
+  }
+}
+
+void ConnectionManager::attempt() {
+  int8_t ret;
+
+  _stats.attempts++;
+  Log.info("Connecting to MQTT (attempt %lu)...", (unsigned long)_stats.attempts);
+  ret = _mqtt->connect();
+  _stats.lastError = ret;
+
+  if (ret == 0) {
+    Log.info("MQTT connected");
+    _stats.successes++;
+    _consecutiveFailures = 0;
+    _connectedAt = millis();
+    _lastPing = millis();
+    _state = CONNECTED;
+    return;
+  }
+
+  Log.warn("MQTT connect failed: %s", _mqtt->connectErrorString(ret));
+  _stats.failures++;
+  _mqtt->disconnect();
+  if (_consecutiveFailures < 31) {
+    _consecutiveFailures++;
+  }
+  scheduleRetry();
+}
+
+void ConnectionManager::lost() {
+  _stats.disconnects++;
+  _stats.connectedMs += millis() - _connectedAt;
+  _consecutiveFailures = 0;
+  scheduleRetry();
+}
+
+// Exponential backoff with "equal jitter": the delay is drawn from the upper
+// half of the current interval so a fleet of pots that lost the broker at the
+// same moment does not reconnect in lock step.
+void ConnectionManager::scheduleRetry() {
+  unsigned long interval = _minInterval;
+  uint8_t n;
+
+  for (n = 0; n < _consecutiveFailures && interval < _maxInterval; n++) {
+    interval *= 2;
+  }
+  if (interval > _maxInterval) {
+    interval = _maxInterval;
+  }
+
+  _retryDelay = interval / 2 + random(interval / 2 + 1);
+  _retryStart = millis();
+  _state = WiFi.ready() ? BACKOFF : WAITING_FOR_NETWORK;
+  Log.info("MQTT retry in %u ms", _retryDelay);
+}
+
+unsigned int ConnectionManager::retryIn() const {
+  unsigned int elapsed;
+
+  if (_state != BACKOFF) {
+    return 0;
+  }
+  elapsed = millis() - _retryStart;
+  return elapsed >= _retryDelay ? 0 : _retryDelay - elapsed;
+}
+
+const char *ConnectionManager::stateName() const {
+  switch (_state) {
+    case WAITING_FOR_NETWORK: return "waiting for network";
+    case BACKOFF:             return "backing off";
+    case CONNECTED:           return "connected";
+  }
+  return "unknown";
+}
@@ -0,0 +1,66 @@
+/*
+ * ConnectionManager.h
+ * MQTT connection state machine. loop() is called once per pass of the main
+ * loop and makes at most one connect attempt or keep-alive ping, so the pump,
+ * display and sensors keep running while the broker is down. The attempt
+ * itself blocks: Adafruit_MQTT::connect() waits for the TCP connect and then
+ * for the CONNACK and SUBACKs (see LOOP_DEADLINE_MS in hydropt1.cpp).
+ * Failed attempts back off exponentially with jitter up to a maximum interval.
+ */
+
+#ifndef _CONNECTIONMANAGER_H_
+#define _CONNECTIONMANAGER_H_
+
+#include "Particle.h"
+#include "Adafruit_MQTT.h"
+
+// Connection-quality counters, since boot.
+struct ConnectionStats {
+  uint32_t attempts;          // connect() calls
+  uint32_t successes;
+  uint32_t failures;
+  uint32_t disconnects;       // established connections that were lost
+  uint32_t pingFailures;
+  int8_t lastError;           // last connect() return code, 0 if none
+  unsigned long connectedMs;  // total time spent connected, excluding the current session
+};
+
+class ConnectionManager {
+  public:
+    enum State {
+      WAITING_FOR_NETWORK,    // WiFi not ready, nothing to do
+      BACKOFF,                // waiting for the next connect attempt
+      CONNECTED
+    };
+
+    ConnectionManager(Adafruit_MQTT *mqtt, unsigned int minInterval=1000, unsigned int maxInterval=300000,
+                      unsigned int pingInterval=60000);
+
+    void loop();
+
+    bool connected() const { return _state == CONNECTED; }
+    State state() const { return _state; }
+    const char *stateName() const;
+    const ConnectionStats &stats() const { return _stats; }
+    // Time until the next connect attempt, 0 if connected or due now.
+    unsigned int retryIn() const;
+
+  private:
+    void attempt();
+    void scheduleRetry();
+    void lost();
+
+    Adafruit_MQTT *_mqtt;
+    State _state;
+    unsigned int _minInterval;
+    unsigned int _maxInterval;
+    unsigned int _pingInterval;
+    unsigned int _retryDelay;
+    unsigned int _retryStart;
+    unsigned int _lastPing;
+    unsigned int _connectedAt;
+    uint8_t _consecutiveFailures;
+    ConnectionStats _stats;
+};
+
+#endif // _CONNECTIONMANAGER_H_
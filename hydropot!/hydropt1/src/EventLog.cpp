@@ -0,0 +1,425 @@
+/*
+ * EventLog.cpp
+ */
+
+#include "EventLog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t TOKEN = 60000;    // one record, in tokens (ms per minute)
+static const char *const LEVEL_NAMES[] = { "TRACE", "INFO", "WARN", "ERROR" };
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Append a varint; returns the new length, or 0 if it does not fit.
+static uint16_t putVarint(uint8_t *buf, uint16_t len, uint32_t value) {
+  do {
+    if (len >= EVENT_LOG_RECORD) {
+      return 0;
+    }
+    buf[len++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+    value >>= 7;
+  } while (value);
+  return len;
+}
+
+// Read a varint at `pos`; returns false past `end` or on an overlong one.
+static bool getVarint(const uint8_t *buf, uint16_t &pos, uint16_t end, uint32_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (pos >= end) {
+      return false;
+    }
+    uint8_t b = buf[pos++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Skip flags, width and precision of the conversion after a '%'. Sets `isLong`
+// for an 'l' length modifier and returns the conversion character.
+static const char *conversion(const char *p, bool &isLong) {
+  isLong = false;
+  while (*p && strchr("-+ #0123456789.", *p)) {
+    p++;
+  }
+  while (*p == 'l' || *p == 'h' || *p == 'z') {
+    isLong |= *p == 'l';
+    p++;
+  }
+  return p;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+const char *eventLevelName(EventLevel level) {
+  return level <= EVENT_ERROR ? LEVEL_NAMES[level] : "?";
+}
+
+size_t eventRecordToHex(const uint8_t *record, uint16_t length, char *line, size_t size) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  if (size < 2 + 2 * (size_t)length) {
+    return 0;
+  }
+  line[0] = '#';
+  for (uint16_t i = 0; i < length; i++) {
+    line[1 + 2 * i] = HEX_DIGITS[record[i] >> 4];
+    line[2 + 2 * i] = HEX_DIGITS[record[i] & 0xF];
+  }
+  line[1 + 2 * length] = 0;
+  return 1 + 2 * length;
+}
+
+uint16_t eventRecordFromHex(const char *line, uint8_t *record) {
+  uint16_t length = 0;
+  int hi, lo;
+
+  if (line[0] != '#') {
+    return 0;
+  }
+  for (line++; (hi = hexValue(line[0])) >= 0; line += 2) {
+    lo = hexValue(line[1]);
+    if (lo < 0 || length >= EVENT_LOG_RECORD) {
+      return 0;
+    }
+    record[length++] = (hi << 4) | lo;
+  }
+  while (*line == '\r' || *line == '\n' || *line == ' ') {
+    line++;
+  }
+  return *line == 0 && length >= 3 && record[0] + 1 == length ? length : 0;
+}
+
+EventLog::EventLog(uint8_t *buffer, uint16_t size, const EventDef *events, uint8_t eventCount,
+                   EventCategory *categories, uint8_t categoryCount) {
+  _buf = buffer;
+  _size = size;
+  _head = 0;
+  _used = 0;
+  _events = events;
+  _eventCount = eventCount;
+  _categories = categories;
+  _categoryCount = categoryCount;
+  _level = EVENT_INFO;
+  _dropped = 0;
+  _droppedTotal = 0;
+  for (uint8_t c = 0; c < _categoryCount; c++) {
+    _categories[c].tokens = (uint32_t)_categories[c].burst * TOKEN;
+    _categories[c].lastRefill = 0;
+    _categories[c].suppressed = 0;
+  }
+}
+
+bool EventLog::add(uint32_t nowMs, uint8_t event, ...) {
+  va_list args;
+  bool added;
+
+  va_start(args, event);
+  added = addv(nowMs, event, args);
+  va_end(args);
+  return added;
+}
+
+bool EventLog::addv(uint32_t nowMs, uint8_t event, va_list args) {
+  uint8_t record[EVENT_LOG_RECORD];
+  uint16_t len;
+  bool isLong;
+
+  if (event < EVENT_FIRST || event - EVENT_FIRST >= _eventCount) {
+    return false;
+  }
+  const EventDef &def = _events[event - EVENT_FIRST];
+  if (def.level < _level || !allowed(def.category, nowMs)) {
+    return false;
+  }
+
+  record[1] = event;
+  len = putVarint(record, 2, nowMs);
+  for (const char *p = def.format; *p && len; p++) {
+    if (*p != '%' || *++p == '%') {
+      continue;
+    }
+    p = conversion(p, isLong);
+    switch (*p) {
+      case 'd':
+      case 'i':
+        len = putVarint(record, len, zigzag(isLong ? (int32_t)va_arg(args, long) : va_arg(args, int)));
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'c':
+        len = putVarint(record, len, isLong ? (uint32_t)va_arg(args, unsigned long) : va_arg(args, unsigned));
+        break;
+      case 'f':
+      case 'e':
+      case 'g': {
+        float value = va_arg(args, double);
+        if (len + 4 > EVENT_LOG_RECORD) {
+          return false;
+        }
+        memcpy(record + len, &value, 4);
+        len += 4;
+        break;
+      }
+      case 's': {
+        const char *value = va_arg(args, const char *);
+        size_t n = value ? strnlen(value, EVENT_LOG_STRING) : 0;
+        if (len + 1 + n > EVENT_LOG_RECORD) {
+          return false;
+        }
+        record[len++] = n;
+        memcpy(record + len, value, n);
+        len += n;
+        break;
+      }
+      default:
+        return false;    // not a conversion this log can store
+    }
+  }
+  if (!len) {
+    return false;
+  }
+  record[0] = len - 1;
+  notices(nowMs);
+  return store(record, len);
+}
+
+// Refill the category's bucket and take a token. A record let through after
+// some were suppressed is preceded by a notice of how many.
+bool EventLog::allowed(uint8_t category, uint32_t nowMs) {
+  uint8_t record[EVENT_LOG_RECORD];
+  uint16_t len;
+
+  if (category >= _categoryCount) {
+    return false;
+  }
+  EventCategory &cat = _categories[category];
+  if (cat.perMinute == 0) {
+    return true;
+  }
+  uint64_t tokens = cat.tokens + (uint64_t)(nowMs - cat.lastRefill) * cat.perMinute;
+  uint64_t full = (uint64_t)cat.burst * TOKEN;
+  cat.tokens = tokens < full ? tokens : full;
+  cat.lastRefill = nowMs;
+  if (cat.tokens < TOKEN) {
+    cat.suppressed++;
+    return false;
+  }
+  cat.tokens -= TOKEN;
+
+  if (cat.suppressed) {
+    record[1] = EVENT_SUPPRESSED;
+    len = putVarint(record, 2, nowMs);
+    len = putVarint(record, len, category);
+    len = putVarint(record, len, cat.suppressed);
+    record[0] = len - 1;
+    if (store(record, len)) {
+      cat.suppressed = 0;
+    }
+  }
+  return true;
+}
+
+// Before the next record: say how many were lost to a full ring.
+void EventLog::notices(uint32_t nowMs) {
+  uint8_t record[EVENT_LOG_RECORD];
+  uint16_t len;
+  uint32_t dropped = _dropped;
+
+  if (!dropped) {
+    return;
+  }
+  record[1] = EVENT_DROPPED;
+  len = putVarint(record, 2, nowMs);
+  len = putVarint(record, len, dropped);
+  record[0] = len - 1;
+  if (store(record, len)) {
+    // store() counts its own failures, so only clear what was reported.
+    _dropped -= dropped;
+  }
+}
+
+bool EventLog::store(const uint8_t *record, uint16_t length) {
+  if (_size - _used < length) {
+    _dropped++;
+    _droppedTotal++;
+    return false;
+  }
+  for (uint16_t i = 0, pos = (_head + _used) % _size; i < length; i++, pos = pos + 1 == _size ? 0 : pos + 1) {
+    _buf[pos] = record[i];
+  }
+  _used += length;
+  return true;
+}
+
+uint16_t EventLog::peek(uint8_t *record) const {
+  uint16_t length;
+
+  if (_used == 0) {
+    return 0;
+  }
+  length = _buf[_head] + 1;
+  for (uint16_t i = 0, pos = _head; i < length; i++, pos = pos + 1 == _size ? 0 : pos + 1) {
+    record[i] = _buf[pos];
+  }
+  return length;
+}
+
+void EventLog::pop() {
+  uint16_t length;
+
+  if (_used == 0) {
+    return;
+  }
+  length = _buf[_head] + 1;
+  _head = (_head + length) % _size;
+  _used -= length;
+}
+
+size_t EventLog::format(const uint8_t *record, uint16_t length, char *text, size_t size, uint32_t &ms,
+                        EventLevel &level, const char *&category) const {
+  uint16_t pos = 2;
+  size_t out = 0;
+  uint32_t a, b;
+  char spec[16];
+  bool isLong;
+  int n;
+
+  if (length < 3 || record[0] + 1 != length || size == 0 || !getVarint(record, pos, length, ms)) {
+    return 0;
+  }
+  text[0] = 0;
+  if (record[1] == EVENT_DROPPED) {
+    if (!getVarint(record, pos, length, a)) {
+      return 0;
+    }
+    level = EVENT_WARN;
+    category = "log";
+    n = snprintf(text, size, "%lu records dropped, log buffer full", (unsigned long)a);
+    return n > 0 && (size_t)n < size ? n : 0;
+  }
+  if (record[1] == EVENT_SUPPRESSED) {
+    if (!getVarint(record, pos, length, a) || !getVarint(record, pos, length, b) || a >= _categoryCount) {
+      return 0;
+    }
+    level = EVENT_WARN;
+    category = _categories[a].name;
+    n = snprintf(text, size, "%lu records suppressed by the rate limit", (unsigned long)b);
+    return n > 0 && (size_t)n < size ? n : 0;
+  }
+  if (record[1] < EVENT_FIRST || record[1] - EVENT_FIRST >= _eventCount) {
+    return 0;
+  }
+
+  const EventDef &def = _events[record[1] - EVENT_FIRST];
+  level = def.level;
+  category = def.category < _categoryCount ? _categories[def.category].name : "?";
+  for (const char *p = def.format; *p; p++) {
+    if (*p != '%' || p[1] == '%') {
+      // Literal text ("%%" prints as one '%')
+      if (out + 1 >= size) {
+        return 0;
+      }
+      text[out++] = *p;
+      p += *p == '%';
+      continue;
+    }
+    // Rebuild the conversion with its flags, width and precision, the
+    // argument widened to what is passed below.
+    const char *start = p;
+    const char *conv = conversion(p + 1, isLong);
+    const char *flagsEnd = conv;
+    while (flagsEnd > start && (flagsEnd[-1] == 'l' || flagsEnd[-1] == 'h' || flagsEnd[-1] == 'z')) {
+      flagsEnd--;
+    }
+    if ((size_t)(flagsEnd - start) + 3 > sizeof(spec)) {
+      return 0;
+    }
+    memcpy(spec, start, flagsEnd - start);
+    n = flagsEnd - start;
+    switch (*conv) {
+      case 'd':
+      case 'i':
+        spec[n++] = 'l';
+        spec[n++] = *conv;
+        spec[n] = 0;
+        if (!getVarint(record, pos, length, a)) {
+          return 0;
+        }
+        n = snprintf(text + out, size - out, spec, (long)unzigzag(a));
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+        spec[n++] = 'l';
+        spec[n++] = *conv;
+        spec[n] = 0;
+        if (!getVarint(record, pos, length, a)) {
+          return 0;
+        }
+        n = snprintf(text + out, size - out, spec, (unsigned long)a);
+        break;
+      case 'c':
+        spec[n++] = 'c';
+        spec[n] = 0;
+        if (!getVarint(record, pos, length, a)) {
+          return 0;
+        }
+        n = snprintf(text + out, size - out, spec, (int)a);
+        break;
+      case 'f':
+      case 'e':
+      case 'g': {
+        float value;
+        spec[n++] = *conv;
+        spec[n] = 0;
+        if (pos + 4 > length) {
+          return 0;
+        }
+        memcpy(&value, record + pos, 4);
+        pos += 4;
+        n = snprintf(text + out, size - out, spec, (double)value);
+        break;
+      }
+      case 's': {
+        char value[EVENT_LOG_STRING + 1];
+        spec[n++] = 's';
+        spec[n] = 0;
+        if (pos >= length || record[pos] > EVENT_LOG_STRING || pos + 1 + record[pos] > length) {
+          return 0;
+        }
+        memcpy(value, record + pos + 1, record[pos]);
+        value[record[pos]] = 0;
+        pos += 1 + record[pos];
+        n = snprintf(text + out, size - out, spec, value);
+        break;
+      }
+      default:
+        return 0;
+    }
+    if (n < 0 || (size_t)n >= size - out) {
+      return 0;
+    }
+    out += n;
+    p = conv;
+  }
+  text[out] = 0;
+  return pos == length ? out : 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * EventLog.h
+ * Structured logging that never holds up loop(). A log call stores a compact
+ * binary record (event id, time and the raw arguments) in a RAM ring; the
+ * text is only produced when the ring is drained, a few records at a time,
+ * as the Serial port has room. Each event belongs to a category with its own
+ * rate limit, and events below the current level are not stored at all.
+ *
+ * Record:
+ *   byte     length of the rest
+ *   byte     event id
+ *   varint   millis() when logged
+ *   per conversion in the event's format:
+ *            %d %i          varint zigzag(value)
+ *            %u %x %X %c    varint value
+ *            %f %e %g       4 byte float, little endian
+ *            %s             length byte + up to EVENT_LOG_STRING bytes
+ * Varints are LEB128, as in TelemetryFrame. A typical record is 6-12 bytes
+ * against 40-100 bytes of text.
+ *
+ * The event table holds the format strings, so records can only be turned
+ * back into text with the same table: the firmware does it when draining as
+ * text, and tools/log_decode does it for records sent as binary, one
+ * "#<hex>" line each.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _EVENTLOG_H_
+#define _EVENTLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#define EVENT_LOG_RECORD 96     // longest record, including the length byte
+#define EVENT_LOG_STRING 24     // longest %s argument kept
+
+// Same order and names as Device OS log levels.
+enum EventLevel {
+  EVENT_TRACE,
+  EVENT_INFO,
+  EVENT_WARN,
+  EVENT_ERROR
+};
+
+// Ids 0 and 1 are the log's own notices; a table's events start at
+// EVENT_FIRST.
+enum {
+  EVENT_DROPPED,          // records lost because the ring was full
+  EVENT_SUPPRESSED,       // records held back by a category's rate limit
+  EVENT_FIRST
+};
+
+struct EventDef {
+  uint8_t category;
+  EventLevel level;
+  const char *format;     // printf format; only the conversions listed above
+};
+
+// Token bucket per category: up to `burst` records at once, refilled at
+// `perMinute`. perMinute 0 means no limit.
+struct EventCategory {
+  const char *name;
+  uint16_t perMinute;
+  uint8_t burst;
+  // Run time state
+  uint32_t tokens;        // in 1/60000ths of a record
+  uint32_t lastRefill;
+  uint32_t suppressed;
+};
+
+class EventLog {
+  public:
+    // `events[0]` is event EVENT_FIRST. The ring lives in `buffer`.
+    EventLog(uint8_t *buffer, uint16_t size, const EventDef *events, uint8_t eventCount,
+             EventCategory *categories, uint8_t categoryCount);
+
+    void setLevel(EventLevel level) { _level = level; }
+    EventLevel level() const { return _level; }
+
+    // Store an event. The arguments follow its format, as for printf.
+    // Returns false if it was filtered, rate limited or did not fit.
+    bool add(uint32_t nowMs, uint8_t event, ...);
+    bool addv(uint32_t nowMs, uint8_t event, va_list args);
+
+    // Oldest record, copied to `record` (EVENT_LOG_RECORD bytes). Returns its
+    // length, or 0 if the ring is empty. pop() discards it.
+    uint16_t peek(uint8_t *record) const;
+    void pop();
+    uint16_t used() const { return _used; }
+    uint32_t dropped() const { return _droppedTotal; }
+
+    // Render a record as "<text>", and give its time, level and category.
+    // Returns the text length, or 0 if the record is not valid for the tables.
+    size_t format(const uint8_t *record, uint16_t length, char *text, size_t size, uint32_t &ms,
+                  EventLevel &level, const char *&category) const;
+
+  private:
+    bool allowed(uint8_t category, uint32_t nowMs);
+    bool store(const uint8_t *record, uint16_t length);
+    void notices(uint32_t nowMs);
+
+    uint8_t *_buf;
+    uint16_t _size;
+    uint16_t _head;         // oldest byte
+    uint16_t _used;
+    const EventDef *_events;
+    uint8_t _eventCount;
+    EventCategory *_categories;
+    uint8_t _categoryCount;
+    EventLevel _level;
+    uint32_t _dropped;      // since the last EVENT_DROPPED notice
+    uint32_t _droppedTotal;
+};
+
+// Names for EventLevel, as Device OS prints them.
+const char *eventLevelName(EventLevel level);
+
+// A record as a Serial line, "#" and its bytes in hex, for draining in binary.
+// Returns the line length (no newline added), or 0 if it does not fit.
+size_t eventRecordToHex(const uint8_t *record, uint16_t length, char *line, size_t size);
+
+// The record in such a line, ignoring trailing whitespace. Returns its
+// length, or 0 if the line is not one (other Serial output).
+uint16_t eventRecordFromHex(const char *line, uint8_t *record);
+
+#endif // _EVENTLOG_H_
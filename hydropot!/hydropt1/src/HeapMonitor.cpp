@@ -0,0 +1,47 @@
+/*
+ * HeapMonitor.cpp
+ */
+
+#include "HeapMonitor.h"
+
+#include <stdio.h>
+
+HeapMonitor::HeapMonitor() {
+  _free = 0;
+  _largest = 0;
+  _minFree = 0;
+  _minLargest = 0;
+  _baseline = 0;
+  _hasBaseline = false;
+  _sampled = false;
+}
+
+void HeapMonitor::sample(uint32_t freeBytes, uint32_t largestBlock) {
+  _free = freeBytes;
+  _largest = largestBlock;
+  if (!_sampled || freeBytes < _minFree) {
+    _minFree = freeBytes;
+  }
+  if (!_sampled || largestBlock < _minLargest) {
+    _minLargest = largestBlock;
+  }
+  _sampled = true;
+}
+
+void HeapMonitor::setBaseline() {
+  _baseline = _free;
+  _hasBaseline = _sampled;
+}
+
+uint8_t HeapMonitor::fragmentation() const {
+  if (_free == 0 || _largest >= _free) {
+    return 0;
+  }
+  return (uint64_t)(_free - _largest) * 100 / _free;
+}
+
+size_t HeapMonitor::format(char *buf, size_t size) const {
+  int n = snprintf(buf, size, "\"heap\":[%lu,%lu,%lu,%lu,%u,%ld]", (unsigned long)_free, (unsigned long)_minFree,
+                   (unsigned long)_largest, (unsigned long)_minLargest, fragmentation(), (long)drift());
+  return n > 0 && (size_t)n < size ? n : 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * HeapMonitor.h
+ * Watches the heap for leaks and fragmentation. The P2 has no MMU, so a heap
+ * that fragments can fail an allocation with plenty of memory free; what
+ * matters is that free memory and the largest free block stay flat once
+ * setup() is done.
+ *
+ * Feed it readings of the free heap and the largest free block (from
+ * HAL_Core_Runtime_Info() on the device). No Particle APIs are used here, so
+ * it also builds on the host.
+ */
+
+#ifndef _HEAPMONITOR_H_
+#define _HEAPMONITOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+class HeapMonitor {
+  public:
+    HeapMonitor();
+
+    void sample(uint32_t freeBytes, uint32_t largestBlock);
+    // Take the latest reading as the level the heap should stay at, e.g. at
+    // the end of setup().
+    void setBaseline();
+
+    uint32_t freeBytes() const { return _free; }
+    uint32_t largestBlock() const { return _largest; }
+    // Lowest readings since boot.
+    uint32_t minFree() const { return _minFree; }
+    uint32_t minLargest() const { return _minLargest; }
+    // Free bytes now minus at the baseline; negative means the heap grew.
+    int32_t drift() const { return _hasBaseline ? (int32_t)(_free - _baseline) : 0; }
+    // Percent of the free heap outside the largest free block.
+    uint8_t fragmentation() const;
+
+    // "heap":[free,minFree,largest,minLargest,fragmentation,drift], as a
+    // member of a JSON object. Returns the length, or 0 if it does not fit.
+    size_t format(char *buf, size_t size) const;
+
+  private:
+    uint32_t _free;
+    uint32_t _largest;
+    uint32_t _minFree;
+    uint32_t _minLargest;
+    uint32_t _baseline;
+    bool _hasBaseline;
+    bool _sampled;
+};
+
+#endif // _HEAPMONITOR_H_
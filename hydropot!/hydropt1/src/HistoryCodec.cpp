@@ -0,0 +1,158 @@
+/*
+ * HistoryCodec.cpp
+ */
+
+#include "HistoryCodec.h"
+
+#include <math.h>
+#include <string.h>
+
+static const uint32_t MISSING = 0x80000000UL;   // INT32_MIN, never produced by scaling
+
+struct BitWriter {
+  uint8_t *buf;
+  uint32_t bit;
+
+  void put(uint32_t value, uint8_t bits) {
+    while (bits > 0) {
+      bits--;
+      uint8_t mask = 0x80 >> (bit & 7);
+      if ((bit & 7) == 0) {
+        buf[bit >> 3] = 0;
+      }
+      if ((value >> bits) & 1) {
+        buf[bit >> 3] |= mask;
+      }
+      bit++;
+    }
+  }
+};
+
+struct BitReader {
+  const uint8_t *data;
+  uint32_t bits;   // available
+  uint32_t bit;
+
+  bool get(uint8_t count, uint32_t &value) {
+    if (bit + count > bits) {
+      return false;
+    }
+    value = 0;
+    while (count > 0) {
+      count--;
+      value = (value << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+      bit++;
+    }
+    return true;
+  }
+};
+
+static void putDiff(BitWriter &w, int32_t d) {
+  if (d == 0) {
+    w.put(0, 1);
+  } else if (d >= -63 && d <= 64) {
+    w.put(0x2, 2);
+    w.put(d + 63, 7);
+  } else if (d >= -255 && d <= 256) {
+    w.put(0x6, 3);
+    w.put(d + 255, 9);
+  } else if (d >= -2047 && d <= 2048) {
+    w.put(0xE, 4);
+    w.put(d + 2047, 12);
+  } else {
+    w.put(0xF, 4);
+    w.put((uint32_t)d, 32);
+  }
+}
+
+static bool getDiff(BitReader &r, uint32_t &d) {
+  static const uint8_t WIDTH[4] = { 7, 9, 12, 32 };
+  static const int32_t OFFSET[4] = { 63, 255, 2047, 0 };
+  uint32_t bit;
+  uint8_t ones = 0;
+
+  // Count the leading 1s of the prefix (at most four).
+  while (ones < 4) {
+    if (!r.get(1, bit)) {
+      return false;
+    }
+    if (!bit) {
+      break;
+    }
+    ones++;
+  }
+  if (ones == 0) {
+    d = 0;
+    return true;
+  }
+  if (!r.get(WIDTH[ones - 1], d)) {
+    return false;
+  }
+  d -= OFFSET[ones - 1];
+  return true;
+}
+
+static uint32_t scaleValue(float value, float scale) {
+  float v = value * scale;
+
+  if (!(v == v)) {
+    return MISSING;
+  }
+  if (v >= 2147483647.0f) {
+    return 2147483647UL;
+  }
+  if (v <= -2147483647.0f) {
+    return (uint32_t)-2147483647L;
+  }
+  return (uint32_t)(int32_t)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+HistoryCodec::HistoryCodec(uint8_t metrics, const float *scales) {
+  _metrics = metrics > HISTORY_MAXMETRICS ? HISTORY_MAXMETRICS : metrics;
+  for (uint8_t m = 0; m < _metrics; m++) {
+    _scales[m] = scales[m];
+  }
+  reset();
+}
+
+void HistoryCodec::reset() {
+  _lastTime = 0;
+  _lastDelta = 0;
+  memset(_lastValue, 0, sizeof(_lastValue));
+}
+
+uint16_t HistoryCodec::encode(uint32_t timestamp, const float *values, uint8_t *buf) {
+  BitWriter w = { buf, 0 };
+  uint32_t delta = timestamp - _lastTime;
+
+  putDiff(w, (int32_t)(delta - _lastDelta));
+  _lastTime = timestamp;
+  _lastDelta = delta;
+
+  for (uint8_t m = 0; m < _metrics; m++) {
+    uint32_t v = scaleValue(values[m], _scales[m]);
+    putDiff(w, (int32_t)(v - _lastValue[m]));
+    _lastValue[m] = v;
+  }
+  return (w.bit + 7) / 8;
+}
+
+uint16_t HistoryCodec::decode(const uint8_t *data, uint16_t len, uint32_t &timestamp, float *values) {
+  BitReader r = { data, (uint32_t)len * 8, 0 };
+  uint32_t diffs[1 + HISTORY_MAXMETRICS];
+
+  for (uint8_t f = 0; f <= _metrics; f++) {
+    if (!getDiff(r, diffs[f])) {
+      return 0;
+    }
+  }
+
+  _lastDelta += diffs[0];
+  _lastTime += _lastDelta;
+  timestamp = _lastTime;
+  for (uint8_t m = 0; m < _metrics; m++) {
+    _lastValue[m] += diffs[1 + m];
+    values[m] = _lastValue[m] == MISSING ? NAN : (int32_t)_lastValue[m] / _scales[m];
+  }
+  return (r.bit + 7) / 8;
+}
@@ -0,0 +1,89 @@
+/*
+ * HistoryCodec.h
+ * Record encoding and file layout of the long-term sensor history kept by
+ * HistoryLog, in the style of Facebook's Gorilla:
+ *
+ *   timestamp   delta-of-delta against the previous record
+ *   values      each scaled to an integer, delta against the previous record
+ *
+ * Each difference is written with a variable-width bit prefix:
+ *   0                     zero
+ *   10   + 7 bits         -63 .. 64
+ *   110  + 9 bits         -255 .. 256
+ *   1110 + 12 bits        -2047 .. 2048
+ *   1111 + 32 bits        anything else
+ * and every record is padded to a whole byte, so a torn write at the end of a
+ * segment only loses the record being written. A steady per-minute record of
+ * four sensors is typically 4-5 bytes.
+ *
+ * A segment file is a HistorySegmentHeader followed by records; the first
+ * record after the header is encoded against zero, so each segment decodes on
+ * its own. The index file is a HistoryIndexHeader followed by one
+ * HistoryIndexEntry per closed segment, oldest first.
+ *
+ * No Particle APIs are used here, so tools/ can read the files on a PC.
+ */
+
+#ifndef _HISTORYCODEC_H_
+#define _HISTORYCODEC_H_
+
+#include <stdint.h>
+
+#define HISTORY_MAXMETRICS 8
+#define HISTORY_NAMELEN 8
+// Worst case: 36 bits for the timestamp and for each value, padded to a byte.
+#define HISTORY_MAXRECORD ((36 * (1 + HISTORY_MAXMETRICS) + 7) / 8)
+
+#define HISTORY_SEGMENT_MAGIC 0x48504853  // "HPHS"
+#define HISTORY_INDEX_MAGIC 0x48504849    // "HPHI"
+#define HISTORY_VERSION 1
+
+struct HistorySegmentHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t metrics;
+  uint8_t reserved;
+  uint32_t id;
+  char names[HISTORY_MAXMETRICS][HISTORY_NAMELEN];
+  float scales[HISTORY_MAXMETRICS];   // stored integer = value * scale
+};
+
+struct HistoryIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;       // closed segments listed after the header
+  uint32_t activeId;    // segment currently being appended to
+};
+
+struct HistoryIndexEntry {
+  uint32_t id;
+  uint32_t firstTime;
+  uint32_t lastTime;
+  uint32_t records;
+};
+
+class HistoryCodec {
+  public:
+    HistoryCodec(uint8_t metrics, const float *scales);
+
+    // Forget the previous record, as at the start of a segment.
+    void reset();
+
+    // Encode one record. Returns the bytes written, at most HISTORY_MAXRECORD.
+    // NaN values are stored as "missing" and decode back to NaN.
+    uint16_t encode(uint32_t timestamp, const float *values, uint8_t *buf);
+    // Decode one record. Returns the bytes consumed, or 0 if `len` does not
+    // hold a complete record (the codec state is then unchanged).
+    uint16_t decode(const uint8_t *data, uint16_t len, uint32_t &timestamp, float *values);
+
+    uint8_t metrics() const { return _metrics; }
+
+  private:
+    uint8_t _metrics;
+    float _scales[HISTORY_MAXMETRICS];
+    uint32_t _lastTime;
+    uint32_t _lastDelta;
+    uint32_t _lastValue[HISTORY_MAXMETRICS];
+};
+
+#endif // _HISTORYCODEC_H_
@@ -0,0 +1,368 @@
+/*
+ * HistoryLog.cpp
+ * The index is only rewritten when a segment closes; the state of the active
+ * segment (record count, time range and the codec's delta references) is
+ * rebuilt on boot by decoding it, so appends never touch anything but the
+ * segment file.
+ */
+
+#include "HistoryLog.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Result of decoding one segment file.
+struct SegmentScan {
+  uint32_t records;
+  uint32_t delivered;
+  uint32_t firstTime;
+  uint32_t lastTime;
+  bool complete;         // ended on a record boundary
+  bool stopped;          // the callback asked to stop
+};
+
+static bool readSegmentHeader(int fd, HistorySegmentHeader &hdr) {
+  return lseek(fd, 0, SEEK_SET) == 0 && read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+         hdr.magic == HISTORY_SEGMENT_MAGIC && hdr.version == HISTORY_VERSION &&
+         hdr.metrics > 0 && hdr.metrics <= HISTORY_MAXMETRICS;
+}
+
+// Decode every record after the header, passing those in [from, to] to
+// `callback` (if any).
+static SegmentScan scanSegment(int fd, HistoryCodec &codec, uint32_t from, uint32_t to,
+                               HistoryRecordCallback callback) {
+  SegmentScan scan;
+  uint8_t chunk[128];
+  uint16_t len = 0;
+  float values[HISTORY_MAXMETRICS];
+  uint32_t t;
+
+  memset(&scan, 0, sizeof(scan));
+  codec.reset();
+  if (lseek(fd, sizeof(HistorySegmentHeader), SEEK_SET) < 0) {
+    return scan;
+  }
+
+  while (!scan.stopped) {
+    int n = read(fd, chunk + len, sizeof(chunk) - len);
+    uint16_t pos = 0;
+    uint16_t used;
+
+    if (n > 0) {
+      len += n;
+    }
+    while (!scan.stopped && (used = codec.decode(chunk + pos, len - pos, t, values)) > 0) {
+      pos += used;
+      if (scan.records++ == 0) {
+        scan.firstTime = t;
+      }
+      scan.lastTime = t;
+      if (callback && t >= from && t <= to) {
+        scan.delivered++;
+        scan.stopped = !callback(t, values, codec.metrics());
+      }
+    }
+    memmove(chunk, chunk + pos, len - pos);
+    len -= pos;
+    if (n <= 0) {
+      scan.complete = len == 0;
+      break;
+    }
+  }
+  return scan;
+}
+
+HistoryLog::HistoryLog(const char *dir, uint8_t metrics, const char *const *names, const float *scales,
+                       uint8_t flushEvery)
+  : _codec(metrics, scales) {
+  _dir = dir;
+  _metrics = _codec.metrics();
+  _names = names;
+  _scales = scales;
+  _flushEvery = flushEvery ? flushEvery : 1;
+  _fd = -1;
+  _activeId = 0;
+  _segmentBytes = 0;
+  _segmentRecords = 0;
+  _segmentFirst = 0;
+  _lastTime = 0;
+  _flushedTime = 0;
+  _indexCount = 0;
+  _bufferLen = 0;
+  _bufferRecords = 0;
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool HistoryLog::begin() {
+  char path[64];
+  HistoryIndexHeader hdr;
+  int fd;
+
+  mkdir(_dir, 0777);  // fails harmlessly if it already exists
+
+  snprintf(path, sizeof(path), "%s/index.dat", _dir);
+  fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == HISTORY_INDEX_MAGIC &&
+        hdr.version == HISTORY_VERSION && hdr.count < HISTORY_MAXSEGMENTS &&
+        read(fd, _index, hdr.count * sizeof(HistoryIndexEntry)) == (int)(hdr.count * sizeof(HistoryIndexEntry))) {
+      _indexCount = hdr.count;
+      _activeId = hdr.activeId;
+    }
+    close(fd);
+  }
+
+  if (!openActive()) {
+    Log.error("HistoryLog: cannot open %s (errno %d)", _dir, errno);
+    return false;
+  }
+  Log.info("HistoryLog: %lu records in %u segments", (unsigned long)records(), _indexCount + 1);
+  return true;
+}
+
+// Reopen the active segment and decode it to pick up where it left off.
+bool HistoryLog::openActive() {
+  char path[64];
+  HistorySegmentHeader hdr;
+  SegmentScan scan;
+
+  segmentPath(_activeId, path, sizeof(path));
+  _fd = open(path, O_RDWR | O_CREAT, 0666);
+  if (_fd < 0) {
+    return false;
+  }
+
+  if (!readSegmentHeader(_fd, hdr) || hdr.id != _activeId || hdr.metrics != _metrics ||
+      memcmp(hdr.scales, _scales, _metrics * sizeof(float)) != 0) {
+    // New, or written with a different set of metrics: start it over.
+    close(_fd);
+    _fd = -1;
+    return startSegment();
+  }
+
+  scan = scanSegment(_fd, _codec, 0, 0, NULL);
+  _segmentRecords = scan.records;
+  _segmentFirst = scan.firstTime;
+  _lastTime = scan.lastTime;
+  _flushedTime = _lastTime;
+  _segmentBytes = lseek(_fd, 0, SEEK_END);
+
+  if (!scan.complete) {
+    // A write was torn by a reset. Keep what decoded and continue in a new
+    // segment rather than append after the partial record.
+    Log.warn("HistoryLog: segment %lu ends with a partial record", (unsigned long)_activeId);
+    return rotate();
+  }
+  return true;
+}
+
+bool HistoryLog::startSegment() {
+  char path[64];
+  HistorySegmentHeader hdr;
+
+  segmentPath(_activeId, path, sizeof(path));
+  _fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (_fd < 0) {
+    Log.error("HistoryLog: cannot create %s (errno %d)", path, errno);
+    return false;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = HISTORY_SEGMENT_MAGIC;
+  hdr.version = HISTORY_VERSION;
+  hdr.metrics = _metrics;
+  hdr.id = _activeId;
+  for (uint8_t m = 0; m < _metrics; m++) {
+    strncpy(hdr.names[m], _names[m], HISTORY_NAMELEN);
+    hdr.scales[m] = _scales[m];
+  }
+  if (write(_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+    Log.error("HistoryLog: segment header write failed (errno %d)", errno);
+    return false;
+  }
+  fsync(_fd);
+
+  _stats.writtenBytes += sizeof(hdr);
+  _segmentBytes = sizeof(hdr);
+  _segmentRecords = 0;
+  _segmentFirst = 0;
+  _codec.reset();
+  return true;
+}
+
+// Close the active segment into the index and start the next one.
+bool HistoryLog::rotate() {
+  char path[64];
+
+  flush();
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+
+  if (_segmentRecords > 0) {
+    if (_indexCount == HISTORY_MAXSEGMENTS - 1) {
+      segmentPath(_index[0].id, path, sizeof(path));
+      unlink(path);
+      memmove(_index, _index + 1, (_indexCount - 1) * sizeof(HistoryIndexEntry));
+      _indexCount--;
+    }
+    _index[_indexCount].id = _activeId;
+    _index[_indexCount].firstTime = _segmentFirst;
+    _index[_indexCount].lastTime = _lastTime;
+    _index[_indexCount].records = _segmentRecords;
+    _indexCount++;
+    _activeId++;
+    writeIndex();
+    _stats.rotations++;
+  }
+  return startSegment();
+}
+
+bool HistoryLog::append(uint32_t timestamp, const float *values) {
+  uint16_t len;
+
+  if (_fd < 0) {
+    return false;
+  }
+  if (_segmentRecords > 0 && _segmentBytes + _bufferLen + HISTORY_MAXRECORD > HISTORY_SEGMENT_BYTES) {
+    if (!rotate()) {
+      return false;
+    }
+  }
+
+  len = _codec.encode(timestamp, values, _buffer + _bufferLen);
+  _bufferLen += len;
+  _bufferRecords++;
+  if (_segmentRecords++ == 0) {
+    _segmentFirst = timestamp;
+  }
+  _lastTime = timestamp;
+  _stats.records++;
+  _stats.payloadBytes += len;
+
+  if (_bufferRecords >= _flushEvery || _bufferLen + HISTORY_MAXRECORD > HISTORY_BUFFERSIZE) {
+    return flush();
+  }
+  return true;
+}
+
+bool HistoryLog::flush() {
+  if (_fd < 0 || _bufferLen == 0) {
+    return _fd >= 0;
+  }
+
+  if (lseek(_fd, _segmentBytes, SEEK_SET) < 0 || write(_fd, _buffer, _bufferLen) != _bufferLen) {
+    // The codec has already moved past the lost records, so later deltas
+    // would decode wrongly in this segment: drop them and start a new one.
+    Log.error("HistoryLog: write failed (errno %d), dropping %u records", errno, _bufferRecords);
+    // The segment's range goes back to what is on flash, so the index does
+    // not claim the dropped records
+    _segmentRecords -= _bufferRecords;
+    _lastTime = _flushedTime;
+    if (_segmentRecords == 0) {
+      _segmentFirst = 0;
+    }
+    _bufferLen = 0;
+    _bufferRecords = 0;
+    rotate();
+    return false;
+  }
+  fsync(_fd);
+
+  _segmentBytes += _bufferLen;
+  _flushedTime = _lastTime;
+  _stats.writtenBytes += _bufferLen;
+  _stats.flushes++;
+  _bufferLen = 0;
+  _bufferRecords = 0;
+  return true;
+}
+
+uint32_t HistoryLog::query(uint32_t from, uint32_t to, HistoryRecordCallback callback) {
+  char path[64];
+  HistorySegmentHeader hdr;
+  uint32_t delivered = 0;
+  bool stopped = false;
+
+  flush();
+  for (uint16_t i = 0; i <= _indexCount; i++) {
+    bool active = i == _indexCount;
+    uint32_t id = active ? _activeId : _index[i].id;
+    uint32_t first = active ? _segmentFirst : _index[i].firstTime;
+    uint32_t last = active ? _lastTime : _index[i].lastTime;
+
+    if ((active && _segmentRecords == 0) || last < from || first > to) {
+      continue;
+    }
+    segmentPath(id, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    if (readSegmentHeader(fd, hdr)) {
+      // Decode with the segment's own metrics, which may predate a change.
+      HistoryCodec codec(hdr.metrics, hdr.scales);
+      SegmentScan scan = scanSegment(fd, codec, from, to, callback);
+      delivered += scan.delivered;
+      stopped = scan.stopped;
+    }
+    close(fd);
+    if (stopped) {
+      break;
+    }
+  }
+  return delivered;
+}
+
+uint32_t HistoryLog::records() const {
+  uint32_t total = _segmentRecords;
+
+  for (uint16_t i = 0; i < _indexCount; i++) {
+    total += _index[i].records;
+  }
+  return total;
+}
+
+uint32_t HistoryLog::firstTime() const {
+  return _indexCount > 0 ? _index[0].firstTime : _segmentFirst;
+}
+
+bool HistoryLog::writeIndex() {
+  char path[64];
+  char tmp[64];
+  HistoryIndexHeader hdr;
+  int fd;
+  bool ok;
+
+  snprintf(path, sizeof(path), "%s/index.dat", _dir);
+  snprintf(tmp, sizeof(tmp), "%s/index.tmp", _dir);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    return false;
+  }
+
+  hdr.magic = HISTORY_INDEX_MAGIC;
+  hdr.version = HISTORY_VERSION;
+  hdr.count = _indexCount;
+  hdr.activeId = _activeId;
+  ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+       write(fd, _index, _indexCount * sizeof(HistoryIndexEntry)) == (int)(_indexCount * sizeof(HistoryIndexEntry));
+  fsync(fd);
+  close(fd);
+
+  // rename() replaces the old index atomically, so a reset never leaves a
+  // half-written one behind.
+  if (!ok || rename(tmp, path) != 0) {
+    Log.error("HistoryLog: index write failed (errno %d)", errno);
+    return false;
+  }
+  _stats.writtenBytes += sizeof(hdr) + _indexCount * sizeof(HistoryIndexEntry);
+  return true;
+}
+
+void HistoryLog::segmentPath(uint32_t id, char *path, size_t size) const {
+  snprintf(path, size, "%s/seg%05lu.dat", _dir, (unsigned long)id);
+}
@@ -0,0 +1,100 @@
+/*
+ * HistoryLog.h
+ * Append-only, compressed long-term sensor history on the LittleFS flash
+ * filesystem (weeks of per-minute records), for looking back at what the pot
+ * did during a WiFi outage.
+ *
+ * Records are encoded by HistoryCodec and buffered in RAM, then appended to
+ * the active segment file every `flushEvery` records. A full segment is closed
+ * into the index and a new one started; past `maxSegments` the oldest segment
+ * is deleted. The index holds the time range of each closed segment so a
+ * query only decodes the segments it overlaps.
+ *
+ * Files, under the directory given to the constructor:
+ *   index.dat           HistoryIndexHeader + HistoryIndexEntry[]
+ *   seg<id>.dat         HistorySegmentHeader + records
+ */
+
+#ifndef _HISTORYLOG_H_
+#define _HISTORYLOG_H_
+
+#include "Particle.h"
+#include "HistoryCodec.h"
+
+#ifndef HISTORY_SEGMENT_BYTES
+#define HISTORY_SEGMENT_BYTES 16384
+#endif
+#ifndef HISTORY_MAXSEGMENTS
+#define HISTORY_MAXSEGMENTS 16       // about 5 weeks of 4 metrics per minute
+#endif
+#ifndef HISTORY_BUFFERSIZE
+#define HISTORY_BUFFERSIZE 256
+#endif
+
+// Called for each record matched by a query. Return false to stop.
+typedef bool (*HistoryRecordCallback)(uint32_t timestamp, const float *values, uint8_t count);
+
+// Write counters since boot.
+struct HistoryStats {
+  uint32_t records;
+  uint32_t payloadBytes;   // encoded record bytes
+  uint32_t writtenBytes;   // everything passed to write(): records, headers, index
+  uint32_t flushes;
+  uint32_t rotations;
+};
+
+class HistoryLog {
+  public:
+    HistoryLog(const char *dir, uint8_t metrics, const char *const *names, const float *scales,
+               uint8_t flushEvery=16);
+
+    // Open the index and the active segment, recovering the codec state from
+    // what is already on flash. Returns false if the filesystem is unusable.
+    bool begin();
+
+    bool append(uint32_t timestamp, const float *values);
+    // Write buffered records now (e.g. before a planned reset).
+    bool flush();
+
+    // Call `callback` for every record with from <= timestamp <= to, oldest
+    // first. Flushes first. Returns the number of records delivered.
+    uint32_t query(uint32_t from, uint32_t to, HistoryRecordCallback callback);
+
+    const HistoryStats &stats() const { return _stats; }
+    uint32_t records() const;
+    uint32_t firstTime() const;
+    uint32_t lastTime() const { return _lastTime; }
+
+  private:
+    bool startSegment();
+    bool rotate();
+    bool openActive();
+    bool writeIndex();
+    void segmentPath(uint32_t id, char *path, size_t size) const;
+
+    const char *_dir;
+    uint8_t _metrics;
+    const char *const *_names;
+    const float *_scales;
+    uint8_t _flushEvery;
+    HistoryCodec _codec;
+
+    int _fd;
+    uint32_t _activeId;
+    uint32_t _segmentBytes;     // active segment length on flash
+    uint32_t _segmentRecords;   // including buffered ones
+    uint32_t _segmentFirst;
+    uint32_t _lastTime;
+    uint32_t _flushedTime;      // _lastTime of the records on flash
+
+    HistoryIndexEntry _index[HISTORY_MAXSEGMENTS];
+    uint16_t _indexCount;
+
+    uint8_t _buffer[HISTORY_BUFFERSIZE];
+    uint16_t _bufferLen;
+    uint8_t _bufferRecords;
+
+    HistoryStats _stats;
+};
+
+#endif // _HISTORYLOG_H_
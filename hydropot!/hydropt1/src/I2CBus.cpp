@@ -0,0 +1,135 @@
+/*
+ * I2CBus.cpp
+ */
+
+#include "I2CBus.h"
+
+// 9 clocks finish any byte plus its acknowledge; 5 us per half clock is
+// 100 kHz, which every device takes.
+static const uint8_t RECOVERY_CLOCKS = 9;
+static const unsigned int HALF_CLOCK_US = 5;
+
+I2CBus::I2CBus(TwoWire &wire, pin_t sda, pin_t scl, I2CBusDevice *devices, uint8_t count) : _wire(wire) {
+  _sda = sda;
+  _scl = scl;
+  _devices = devices;
+  _count = count;
+  _speed = CLOCK_SPEED_100KHZ;
+  _recoveries = 0;
+  _failedRecoveries = 0;
+}
+
+void I2CBus::begin(uint32_t speed) {
+  _speed = speed;
+  pinMode(_sda, INPUT_PULLUP);
+  if (digitalRead(_sda) == LOW) {
+    _recoveries++;
+    if (!clockOut()) {
+      _failedRecoveries++;
+    }
+  }
+  _wire.setSpeed(_speed);
+  _wire.begin();
+}
+
+I2CResult I2CBus::run(uint8_t device, I2CTransaction transaction, void *context) {
+  I2CBusDevice &d = _devices[device];
+  I2CResult result;
+
+  _wire.lock();
+  uint32_t start = micros();
+  bool ok = transaction(context);
+  uint32_t us = micros() - start;
+  result = ok ? I2C_OK : I2C_FAILED;
+  if (us > d.timeoutMs * 1000) {
+    d.timeouts++;
+    result = recover() ? I2C_TIMEOUT : I2C_STUCK;
+  }
+  // Under the lock too: other threads update the same device's counts
+  d.transactions++;
+  if (!ok) {
+    d.failures++;
+  }
+  d.totalUs += us;
+  if (us > d.maxUs) {
+    d.maxUs = us;
+  }
+  d.lastUs = us;
+  _wire.unlock();
+  return result;
+}
+
+bool I2CBus::recover() {
+  bool free;
+
+  _wire.end();
+  pinMode(_sda, INPUT_PULLUP);
+  free = clockOut();
+  _recoveries++;
+  if (!free) {
+    _failedRecoveries++;
+  }
+  _wire.setSpeed(_speed);
+  _wire.begin();
+  return free;
+}
+
+// Wire must be stopped and SDA an input. Leaves both pins as inputs. Both
+// are driven open drain, as the bus expects: HIGH lets the pull-up take the
+// line, so a device stretching the clock is not fought.
+bool I2CBus::clockOut() {
+  bool free;
+
+  pinMode(_scl, OUTPUT_OPEN_DRAIN);
+  digitalWrite(_scl, HIGH);
+  delayMicroseconds(HALF_CLOCK_US);
+  for (uint8_t clock = 0; clock < RECOVERY_CLOCKS && digitalRead(_sda) == LOW; clock++) {
+    digitalWrite(_scl, LOW);
+    delayMicroseconds(HALF_CLOCK_US);
+    digitalWrite(_scl, HIGH);
+    delayMicroseconds(HALF_CLOCK_US);
+  }
+  free = digitalRead(_sda) == HIGH;
+  if (free) {
+    // STOP: SDA rises while SCL is high, so every device sees the bus idle
+    digitalWrite(_scl, LOW);
+    pinMode(_sda, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_sda, LOW);
+    delayMicroseconds(HALF_CLOCK_US);
+    digitalWrite(_scl, HIGH);
+    delayMicroseconds(HALF_CLOCK_US);
+    digitalWrite(_sda, HIGH);
+    delayMicroseconds(HALF_CLOCK_US);
+  }
+  pinMode(_sda, INPUT);
+  pinMode(_scl, INPUT);
+  return free;
+}
+
+size_t I2CBus::format(char *buf, size_t size) const {
+  size_t len;
+  int n;
+
+  n = snprintf(buf, size, "\"i2c\":{\"recoveries\":[%lu,%lu]", (unsigned long)_recoveries,
+               (unsigned long)_failedRecoveries);
+  if (n < 0 || (size_t)n >= size) {
+    return 0;
+  }
+  len = n;
+  for (uint8_t device = 0; device < _count; device++) {
+    const I2CBusDevice &d = _devices[device];
+    n = snprintf(buf + len, size - len, ",\"%s\":[%lu,%lu,%lu,%lu,%lu]", d.name, (unsigned long)d.transactions,
+                 (unsigned long)d.failures, (unsigned long)d.timeouts,
+                 (unsigned long)(d.transactions ? d.totalUs / d.transactions : 0), (unsigned long)d.maxUs);
+    if (n < 0 || (size_t)n >= size - len) {
+      return 0;
+    }
+    len += n;
+  }
+  if (len + 1 >= size) {
+    return 0;
+  }
+  buf[len++] = '}';
+  buf[len] = 0;
+  return len;
+}
@@ -0,0 +1,89 @@
+/*
+ * I2CBus.h
+ * One owner for the I2C bus. The BME280 and SSD1306 drivers and the device
+ * discovery all talk to Wire directly; here each exchange with a device runs
+ * as a transaction, a function that has the bus to itself while it runs.
+ * Transactions from different threads wait their turn on the Wire lock
+ * (Device OS queues the waiting threads by priority), so a display burst and
+ * a sensor read never interleave, and nothing holds the bus between them.
+ *
+ * A driver call cannot be cut short, so a transaction's timeout is checked
+ * when it returns: one that took longer than its device allows counts as
+ * timed out and the bus is recovered before it is released. Device OS gives
+ * up on a single transfer after about 100 ms, so a device holding SDA low
+ * costs a transaction a few hundred ms, not a hang.
+ *
+ * Recovery is the standard one for a device left mid-byte by a reset or a
+ * glitch during a read: with Wire stopped, SCL is clocked by hand until the
+ * device lets go of SDA (at most 9 clocks), a STOP is sent and Wire started
+ * again. begin() does the same if SDA is held at boot.
+ *
+ * Each device keeps counts of its transactions, failures and timeouts and
+ * how long they took, for the diagnostics.
+ */
+
+#ifndef _I2CBUS_H_
+#define _I2CBUS_H_
+
+#include "Particle.h"
+
+// Does the device's work with the bus held; returns false if it failed (as
+// far as the driver lets it tell).
+typedef bool (*I2CTransaction)(void *context);
+
+enum I2CResult {
+  I2C_OK,
+  I2C_FAILED,         // the transaction said so
+  I2C_TIMEOUT,        // took longer than allowed; the bus was recovered
+  I2C_STUCK,          // took longer than allowed and SDA is still held low
+};
+
+struct I2CBusDevice {
+  const char *name;
+  uint32_t timeoutMs;             // longest a transaction may take
+  // Run time state, since boot
+  uint32_t transactions;
+  uint32_t failures;
+  uint32_t timeouts;
+  uint64_t totalUs;
+  uint32_t maxUs;
+  uint32_t lastUs;
+};
+
+class I2CBus {
+  public:
+    I2CBus(TwoWire &wire, pin_t sda, pin_t scl, I2CBusDevice *devices, uint8_t count);
+
+    // Free the bus if a device is holding SDA, then start Wire at `speed`.
+    void begin(uint32_t speed);
+
+    // Run `transaction` for `device` (index into the table) with the bus
+    // held, from any thread.
+    I2CResult run(uint8_t device, I2CTransaction transaction, void *context=nullptr);
+
+    // Clock out a device holding SDA and restart Wire. Returns true if SDA
+    // is free. Called by run() after a timeout; take the Wire lock first.
+    bool recover();
+
+    const I2CBusDevice &device(uint8_t device) const { return _devices[device]; }
+    uint32_t recoveries() const { return _recoveries; }
+
+    // "i2c":{"recoveries":[n,failed],"<device>":[transactions,failures,
+    // timeouts,mean us,max us],...}, as a member of a JSON object. Returns
+    // the length, or 0 if it does not fit.
+    size_t format(char *buf, size_t size) const;
+
+  private:
+    bool clockOut();
+
+    TwoWire &_wire;
+    pin_t _sda;
+    pin_t _scl;
+    I2CBusDevice *_devices;
+    uint8_t _count;
+    uint32_t _speed;
+    uint32_t _recoveries;
+    uint32_t _failedRecoveries;
+};
+
+#endif // _I2CBUS_H_
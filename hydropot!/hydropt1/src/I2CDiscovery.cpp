@@ -0,0 +1,135 @@
+/*
+ * I2CDiscovery.cpp
+ * EEPROM layout at the discovery address: one Cache, holding the address each
+ * device was found at (0 = missing) in table order.
+ */
+
+#include "I2CDiscovery.h"
+
+static const uint32_t DISCOVERY_MAGIC = 0x48504932;  // "HPI2"
+
+I2CDiscovery::I2CDiscovery(I2CDevice *devices, uint8_t count, int eepromAddress) {
+  _devices = devices;
+  _count = count < I2C_DISCOVERY_MAX ? count : I2C_DISCOVERY_MAX;
+  _address = eepromAddress;
+  _cacheHit = false;
+  _probes = 0;
+}
+
+bool I2CDiscovery::begin(TwoWire &wire) {
+  Cache cache;
+  uint8_t id;
+  bool all = true;
+
+  _probes = 0;
+  EEPROM.get(_address, cache);
+  _cacheHit = cache.magic == DISCOVERY_MAGIC && cache.schema == schemaHash() && cache.crc == cacheCrc(cache) &&
+              verify(wire, cache);
+  if (_cacheHit) {
+    for (id = 0; id < _count; id++) {
+      _devices[id].address = cache.address[id];
+    }
+    Log.info("I2CDiscovery: device map confirmed (%u probes)", _probes);
+  }
+  else {
+    scan(wire);
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = DISCOVERY_MAGIC;
+    cache.schema = schemaHash();
+    for (id = 0; id < _count; id++) {
+      cache.address[id] = _devices[id].address;
+    }
+    cache.crc = cacheCrc(cache);
+    EEPROM.put(_address, cache);
+    Log.info("I2CDiscovery: full bus scan (%u probes), device map saved", _probes);
+  }
+
+  for (id = 0; id < _count; id++) {
+    if (_devices[id].address) {
+      Log.info("I2CDiscovery: %s at 0x%02X", _devices[id].name, _devices[id].address);
+    }
+    else {
+      Log.warn("I2CDiscovery: %s not found", _devices[id].name);
+      all = false;
+    }
+  }
+  return all;
+}
+
+uint16_t I2CDiscovery::storageSize() const {
+  return sizeof(Cache);
+}
+
+// An address answers if it acknowledges an empty write.
+bool I2CDiscovery::probe(TwoWire &wire, uint8_t address) {
+  _probes++;
+  wire.beginTransmission(address);
+  return wire.endTransmission() == 0;
+}
+
+// The cached map holds if every device answers where it was, and every device
+// that was missing still is (none of its addresses answer).
+bool I2CDiscovery::verify(TwoWire &wire, const Cache &cache) {
+  for (uint8_t id = 0; id < _count; id++) {
+    if (cache.address[id]) {
+      if (!probe(wire, cache.address[id])) {
+        return false;
+      }
+      continue;
+    }
+    for (uint8_t c = 0; c < I2C_DISCOVERY_CANDIDATES; c++) {
+      if (_devices[id].candidates[c] && probe(wire, _devices[id].candidates[c])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Probe the whole bus; each device takes the first of its candidates that
+// answers, in candidate order.
+void I2CDiscovery::scan(TwoWire &wire) {
+  bool present[128] = { false };
+
+  for (uint8_t address = 1; address < 127; address++) {
+    present[address] = probe(wire, address);
+  }
+  for (uint8_t id = 0; id < _count; id++) {
+    _devices[id].address = 0;
+    for (uint8_t c = 0; c < I2C_DISCOVERY_CANDIDATES && !_devices[id].address; c++) {
+      uint8_t address = _devices[id].candidates[c];
+      if (address && address < 128 && present[address]) {
+        _devices[id].address = address;
+      }
+    }
+  }
+}
+
+// FNV-1a over every name and candidate address, as ConfigRegistry does for
+// its keys.
+uint32_t I2CDiscovery::schemaHash() const {
+  uint32_t h = 2166136261UL;
+
+  for (uint8_t id = 0; id < _count; id++) {
+    for (const char *k = _devices[id].name; *k; k++) {
+      h = (h ^ (uint8_t)*k) * 16777619UL;
+    }
+    for (uint8_t c = 0; c < I2C_DISCOVERY_CANDIDATES; c++) {
+      h = (h ^ _devices[id].candidates[c]) * 16777619UL;
+    }
+  }
+  return h;
+}
+
+// CRC-16/CCITT of the stored addresses.
+uint16_t I2CDiscovery::cacheCrc(const Cache &cache) {
+  uint16_t crc = 0xFFFF;
+
+  for (uint8_t i = 0; i < I2C_DISCOVERY_MAX; i++) {
+    crc ^= (uint16_t)cache.address[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
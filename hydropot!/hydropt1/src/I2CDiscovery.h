@@ -0,0 +1,68 @@
+/*
+ * I2CDiscovery.h
+ * Finds the I2C devices at boot without scanning the whole bus. Each device
+ * has a short list of addresses it can be strapped to; the map found last
+ * time is kept in EEPROM, and a boot only checks those addresses (one probe
+ * per device). Only if a device is missing, or turns up somewhere it was not,
+ * does it fall back to probing all 126 addresses, and the new map is saved.
+ *
+ * EEPROM layout at the given address: Cache (see I2CDiscovery.cpp). Place it
+ * after ConfigRegistry::storageSize().
+ */
+
+#ifndef _I2CDISCOVERY_H_
+#define _I2CDISCOVERY_H_
+
+#include "Particle.h"
+
+#define I2C_DISCOVERY_MAX 8             // devices in one table
+#define I2C_DISCOVERY_CANDIDATES 2      // addresses per device
+
+struct I2CDevice {
+  const char *name;
+  uint8_t candidates[I2C_DISCOVERY_CANDIDATES];   // preferred first; 0 = unused
+  // Run time state
+  uint8_t address;                                // where it answered, 0 if missing
+};
+
+class I2CDiscovery {
+  public:
+    I2CDiscovery(I2CDevice *devices, uint8_t count, int eepromAddress=0);
+
+    // Find every device on `wire` (already begun). Returns true if all of
+    // them answered.
+    bool begin(TwoWire &wire=Wire);
+
+    uint8_t address(uint8_t id) const { return _devices[id].address; }
+    bool found(uint8_t id) const { return _devices[id].address != 0; }
+
+    // How the last begin() went: whether the cached map held, and the number
+    // of addresses probed.
+    bool cacheHit() const { return _cacheHit; }
+    uint16_t probes() const { return _probes; }
+
+    // Bytes of EEPROM used, for placing other data after it.
+    uint16_t storageSize() const;
+
+  private:
+    struct Cache {
+      uint32_t magic;
+      uint32_t schema;    // hash of the names and candidates, so a new table rescans
+      uint8_t address[I2C_DISCOVERY_MAX];
+      uint16_t crc;
+    };
+
+    bool probe(TwoWire &wire, uint8_t address);
+    bool verify(TwoWire &wire, const Cache &cache);
+    void scan(TwoWire &wire);
+    uint32_t schemaHash() const;
+    static uint16_t cacheCrc(const Cache &cache);
+
+    I2CDevice *_devices;
+    uint8_t _count;
+    int _address;
+    bool _cacheHit;
+    uint16_t _probes;
+};
+
+#endif // _I2CDISCOVERY_H_
@@ -0,0 +1,190 @@
+/*
+ * IrrigationController.cpp
+ */
+
+#include "IrrigationController.h"
+
+static const uint32_t DAY_MS = 86400000UL;
+static const uint32_t IRRIGATION_DAY_MAGIC = 0x48504944;  // "HPID"
+
+IrrigationController::IrrigationController() : IrrigationController(_ownDay) {
+}
+
+// _ownDay is zeroed first, so a controller with no day of its own starts one.
+IrrigationController::IrrigationController(IrrigationDay &day) : _ownDay(), _day(day) {
+  if (_day.magic != IRRIGATION_DAY_MAGIC || _day.elapsedMs >= DAY_MS) {
+    _day.magic = IRRIGATION_DAY_MAGIC;
+    _day.elapsedMs = 0;
+    _day.pumpMs = 0;
+  }
+  _state = IDLE;
+  _stateStart = 0;
+  _dose = 0;
+  _integral = 0;
+  _dayStart = 0;
+  _dayKnown = false;
+  _stats = IrrigationStats();
+}
+
+bool IrrigationController::setConfig(const IrrigationConfig &config) {
+  if (!validConfig(config)) {
+    return false;
+  }
+  _config = config;
+  return true;
+}
+
+bool IrrigationController::validConfig(const IrrigationConfig &config) {
+  return config.wetThreshold > config.dryThreshold && config.maxDoseMs > 0;
+}
+
+void IrrigationController::update(uint32_t nowMs, int16_t moisture, int16_t waterLevel) {
+  rollDay(nowMs);
+
+  switch (_state) {
+    case IDLE:
+      if (moisture < _config.dryThreshold) {
+        _stats.cycles++;
+        _integral = 0;
+        _dose = 0;
+        if (!startDose(nowMs, moisture, waterLevel)) {
+          // Refused: wait a soak period before trying again rather than
+          // retrying on every pass.
+          _state = SOAKING;
+          _stateStart = nowMs;
+        }
+      }
+      break;
+
+    case DOSING:
+      if (waterLevel <= _config.minWaterLevel || (nowMs - _stateStart) >= _dose) {
+        stopDose(nowMs);
+      }
+      break;
+
+    case SOAKING:
+      if ((nowMs - _stateStart) < _config.soakMs) {
+        break;
+      }
+      if (moisture >= _config.wetThreshold) {
+        _state = IDLE;   // cycle done
+      }
+      else if (!startDose(nowMs, moisture, waterLevel)) {
+        _stateStart = nowMs;
+      }
+      break;
+  }
+}
+
+bool IrrigationController::requestDose(uint32_t nowMs, uint32_t ms, int16_t waterLevel) {
+  rollDay(nowMs);
+  if (_state == DOSING) {
+    return false;
+  }
+  if (waterLevel <= _config.minWaterLevel) {
+    _stats.skippedLowWater++;
+    return false;
+  }
+  _integral = 0;
+  _dose = ms;
+  _day.pumpMs += ms;
+  _state = DOSING;
+  _stateStart = nowMs;
+  _stats.doses++;
+  return true;
+}
+
+bool IrrigationController::cancelDose(uint32_t nowMs) {
+  if (_state != DOSING) {
+    return false;
+  }
+  stopDose(nowMs);
+  return true;
+}
+
+// PI dose on the distance to the wet threshold. The integral grows once per
+// measurement while the soil stays short of the target and is clamped so it
+// alone can never ask for more than maxDoseMs (anti-windup).
+bool IrrigationController::startDose(uint32_t nowMs, int16_t moisture, int16_t waterLevel) {
+  uint32_t remaining;
+  float error, dose;
+
+  if (waterLevel <= _config.minWaterLevel) {
+    _stats.skippedLowWater++;
+    return false;
+  }
+  remaining = _day.pumpMs < _config.dailyCapMs ? _config.dailyCapMs - _day.pumpMs : 0;
+  if (remaining < _config.minDoseMs) {
+    _stats.skippedCap++;
+    return false;
+  }
+
+  error = _config.wetThreshold - moisture;
+  if (error < 0) {
+    error = 0;
+  }
+  _integral += error;
+  if (_config.ki > 0 && _integral > _config.maxDoseMs / _config.ki) {
+    _integral = _config.maxDoseMs / _config.ki;
+  }
+  dose = _config.kp * error + _config.ki * _integral;
+
+  if (dose < _config.minDoseMs) {
+    dose = _config.minDoseMs;
+  }
+  if (dose > _config.maxDoseMs) {
+    dose = _config.maxDoseMs;
+  }
+  if (_dose > 0 && dose > _dose + _config.maxDoseStepMs) {
+    dose = _dose + _config.maxDoseStepMs;
+  }
+  if (dose > remaining) {
+    dose = remaining;
+  }
+
+  _dose = (uint32_t)dose;
+  // Charged now, so a reset part way through still counts the whole dose
+  _day.pumpMs += _dose;
+  _state = DOSING;
+  _stateStart = nowMs;
+  _stats.doses++;
+  return true;
+}
+
+void IrrigationController::stopDose(uint32_t nowMs) {
+  uint32_t elapsed = nowMs - _stateStart;
+
+  if (elapsed > _dose) {
+    elapsed = _dose;
+  }
+  // Counted in dry-run mode too, so the cap behaves as it would for real.
+  // Give back what was charged and did not run.
+  uint32_t unused = _dose - elapsed;
+  _day.pumpMs -= unused < _day.pumpMs ? unused : _day.pumpMs;
+  _stats.pumpMs += elapsed;
+  _state = SOAKING;
+  _stateStart = nowMs;
+}
+
+// The cap covers consecutive 24 hour periods, the first from the first update
+// after a power loss; after a reset, the period it came in goes on.
+void IrrigationController::rollDay(uint32_t nowMs) {
+  if (!_dayKnown) {
+    _dayStart = nowMs - _day.elapsedMs;
+    _dayKnown = true;
+  }
+  while ((nowMs - _dayStart) >= DAY_MS) {
+    _dayStart += DAY_MS;
+    _day.pumpMs = 0;
+  }
+  _day.elapsedMs = nowMs - _dayStart;
+}
+
+const char *IrrigationController::stateName() const {
+  switch (_state) {
+    case IDLE:    return "idle";
+    case DOSING:  return _config.dryRun ? "dosing (dry run)" : "dosing";
+    case SOAKING: return "soaking";
+  }
+  return "unknown";
+}
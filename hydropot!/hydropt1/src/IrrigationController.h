@@ -0,0 +1,120 @@
+/*
+ * IrrigationController.h
+ * Closed-loop watering. Replaces "pulse the pump whenever the soil reads dry"
+ * with cycles of dose -> soak -> measure:
+ *
+ *   IDLE      watching the soil; a cycle starts when moisture falls below
+ *             dryThreshold (and the reservoir and daily cap allow it)
+ *   DOSING    pump on for a dose sized by a PI term on (wetThreshold - moisture)
+ *   SOAKING   pump off for soakMs so the water reaches the sensor
+ *   then      moisture >= wetThreshold ends the cycle, otherwise dose again
+ *
+ * The gap between dry and wet thresholds is the hysteresis band. Doses are
+ * clamped, may only grow by maxDoseStepMs from one dose to the next, and the
+ * pump time per 24 hours is capped. The cap's figures can be kept where they
+ * survive a reset (IrrigationDay), so a watchdog reset does not start a fresh
+ * day. In dry-run mode everything runs except that pumpOn() stays false.
+ *
+ * update() is O(1) and takes the time as an argument, with no Particle APIs,
+ * so the controller runs unchanged on the host (see tools/irrigation_sim.cpp).
+ * Moisture follows the sensor's convention: lower readings are drier.
+ */
+
+#ifndef _IRRIGATIONCONTROLLER_H_
+#define _IRRIGATIONCONTROLLER_H_
+
+#include <stdint.h>
+
+struct IrrigationConfig {
+  int16_t dryThreshold = 1000;        // start a cycle below this reading
+  int16_t wetThreshold = 1300;        // end the cycle at or above this reading
+  uint32_t soakMs = 120000;           // wait after each dose before measuring
+  uint32_t minDoseMs = 200;
+  uint32_t maxDoseMs = 3000;
+  uint32_t maxDoseStepMs = 1000;      // largest increase from one dose to the next
+  float kp = 5.0f;                    // ms of pump per count below wetThreshold
+  float ki = 0.5f;                    // ms per accumulated count, per measurement
+  uint32_t dailyCapMs = 60000;        // pump time allowed per 24 hours
+  int16_t minWaterLevel = 30;         // reservoir % at or below which the pump is locked out
+  bool dryRun = false;
+};
+
+// The daily cap's figures. Meant to live in `retained` memory, so they carry
+// over a reset; they start over after a power loss. A reset's own length is
+// not counted, which only makes that day longer.
+struct IrrigationDay {
+  uint32_t magic;
+  uint32_t elapsedMs;       // into the current 24 hours, at the last update
+  uint32_t pumpMs;          // pump time in them, a dose counted in full as it starts
+};
+
+// Counters since boot.
+struct IrrigationStats {
+  uint32_t cycles;          // cycles started
+  uint32_t doses;           // pump starts (including manual ones)
+  uint32_t pumpMs;          // total pump time
+  uint32_t skippedLowWater; // doses refused for low reservoir
+  uint32_t skippedCap;      // doses refused for the daily cap
+};
+
+class IrrigationController {
+  public:
+    enum State {
+      IDLE,
+      DOSING,
+      SOAKING
+    };
+
+    IrrigationController();
+    // Keeps the daily cap's figures in `day`, which is reset unless it holds
+    // figures from an earlier boot.
+    explicit IrrigationController(IrrigationDay &day);
+
+    // Returns false, keeping the settings in use, if `config` fails
+    // validConfig().
+    bool setConfig(const IrrigationConfig &config);
+    const IrrigationConfig &config() const { return _config; }
+    // The wet threshold must be above the dry one, or a cycle would end as
+    // soon as it started or never, and a dose must be able to run the pump.
+    static bool validConfig(const IrrigationConfig &config);
+
+    // Advance the controller with the latest readings. Call on every control
+    // tick; drive the pump from pumpOn() afterwards.
+    void update(uint32_t nowMs, int16_t moisture, int16_t waterLevel);
+
+    // Start a manual dose of `ms` (the remote water button). Still honours
+    // the reservoir lockout and counts against, but is not limited by, the
+    // daily cap. Returns false if refused.
+    bool requestDose(uint32_t nowMs, uint32_t ms, int16_t waterLevel);
+
+    // End the dose in progress early (the button on the pot); the time it
+    // ran still counts. Returns false if the pump was not on.
+    bool cancelDose(uint32_t nowMs);
+
+    bool pumpOn() const { return _state == DOSING && !_config.dryRun; }
+    // True while dosing even in dry-run mode, for indicators and logs.
+    bool dosing() const { return _state == DOSING; }
+    State state() const { return _state; }
+    const char *stateName() const;
+    uint32_t lastDoseMs() const { return _dose; }
+    uint32_t pumpMsToday() const { return _day.pumpMs; }
+    const IrrigationStats &stats() const { return _stats; }
+
+  private:
+    void rollDay(uint32_t nowMs);
+    bool startDose(uint32_t nowMs, int16_t moisture, int16_t waterLevel);
+    void stopDose(uint32_t nowMs);
+
+    IrrigationConfig _config;
+    State _state;
+    uint32_t _stateStart;
+    uint32_t _dose;           // length of the current or last dose
+    float _integral;
+    IrrigationDay _ownDay;
+    IrrigationDay &_day;
+    uint32_t _dayStart;       // nowMs the current 24 hours started, once known
+    bool _dayKnown;
+    IrrigationStats _stats;
+};
+
+#endif // _IRRIGATIONCONTROLLER_H_
@@ -0,0 +1,65 @@
+/*
+ * LogEvents.cpp
+ */
+
+#include "LogEvents.h"
+
+// In the order of the enum in LogEvents.h.
+const EventDef LOG_EVENTS[LOG_EVENT_COUNT] = {
+  // category       level        format
+  { LOG_STATUS,     EVENT_INFO,  "Time is %s" },
+  { LOG_STATUS,     EVENT_INFO,  "Moisture is %i" },
+  { LOG_STATUS,     EVENT_INFO,  "Water Level: %i (%.1f%%)" },
+  { LOG_STATUS,     EVENT_INFO,  "Temp: %.2f%c (%.2f%cC)" },
+  { LOG_STATUS,     EVENT_INFO,  "Humi: %.2f%c" },
+  { LOG_STATUS,     EVENT_INFO,  "BME280 Status: %s" },
+  { LOG_STATUS,     EVENT_INFO,  "MQTT: %s (attempts %lu, failures %lu, disconnects %lu, retry in %lu ms)" },
+  { LOG_STATUS,     EVENT_INFO,  "Last 15 min: temp %.1f/%.1f/%.1f, moisture %.0f/%.0f/%.0f (min/mean/max)" },
+  { LOG_STATUS,     EVENT_INFO,  "Irrigation: %s, %lu/%lu ms pumped today, %lu doses, %lu skipped (low water), %lu skipped (cap)" },
+  { LOG_STATUS,     EVENT_INFO,  "Heap: %lu free (low %lu), largest block %lu, %u%% fragmented, %+ld since setup" },
+  { LOG_STATUS,     EVENT_INFO,  "Date and Time is %s" },
+  { LOG_STATUS,     EVENT_INFO,  "Sensor value: %i" },
+  { LOG_SENSORS,    EVENT_TRACE, "Air Quality Raw Value: %i, Quality Level: %i" },
+  { LOG_SENSORS,    EVENT_WARN,  "Failed to read from BME280 sensor!" },
+  { LOG_ALERTS,     EVENT_INFO,  "%s" },
+  { LOG_ALERTS,     EVENT_WARN,  "Unknown air quality state: %i (Raw value: %i)" },
+  { LOG_ALERTS,     EVENT_WARN,  "Low water level!" },
+  { LOG_ALERTS,     EVENT_INFO,  "High water level!" },
+  { LOG_MQTT,       EVENT_INFO,  "Published queued sensor data (%u still queued, %lu dropped)" },
+  { LOG_MQTT,       EVENT_INFO,  "Publishing sensor data..." },
+  { LOG_MQTT,       EVENT_INFO,  "Publishing backlog sample from %s" },
+  { LOG_MQTT,       EVENT_INFO,  "Publishing %u sample(s) in a %u byte frame" },
+  { LOG_MQTT,       EVENT_INFO,  "Button State: %d" },
+  { LOG_IRRIGATION, EVENT_INFO,  "Soil moisture %i - pump ON for %lu ms%s" },
+  { LOG_IRRIGATION, EVENT_INFO,  "Pump OFF (%lu of %lu ms used today)" },
+  { LOG_IRRIGATION, EVENT_INFO,  "Remote water pump activation ignored - already watering" },
+  { LOG_IRRIGATION, EVENT_INFO,  "Remote water pump activation! Water level OK (%.1f%%)" },
+  { LOG_IRRIGATION, EVENT_WARN,  "Remote pump activation BLOCKED - water level too low (%.1f%%)" },
+  { LOG_CONFIG,     EVENT_WARN,  "Config update \"%s\" partly rejected" },
+  { LOG_CONFIG,     EVENT_INFO,  "Config update applied (%i changed)" },
+  { LOG_WIFI,       EVENT_INFO,  "WiFi joined in %lu ms (IP %u.%u.%u.%u, %d dBm)" },
+  { LOG_WIFI,       EVENT_INFO,  "WiFi back after %lu ms" },
+  { LOG_WIFI,       EVENT_WARN,  "WiFi lost" },
+  { LOG_CONTROL,    EVENT_WARN,  "Control tick %lu ms late, schedule restarted" },
+  { LOG_SENSORS,    EVENT_WARN,  "I2C %s took %lu ms, bus recovered" },
+  { LOG_SENSORS,    EVENT_ERROR, "I2C %s took %lu ms, SDA still held low after recovery" },
+  { LOG_IRRIGATION, EVENT_INFO,  "Pot button: %s" },
+  { LOG_CONFIG,     EVENT_ERROR, "Irrigation settings not used: wet %i must be above dry %i, dose %lu ms above 0" },
+  { LOG_MQTT,       EVENT_WARN,  "Diagnostics: %u section(s) left out, %u of %u bytes" },
+};
+
+// The status report is 12 records every 1.2 s, so its limit only bites if
+// the report speeds up. Alerts are logged when their state changes, so their
+// limit only bites when a reading flaps across a threshold; a few changes a
+// minute say as much.
+EventCategory LOG_CATEGORIES[LOG_CATEGORY_COUNT] = {
+  // name          per minute  burst
+  { "status",      660,        24 },
+  { "sensors",     12,         4  },
+  { "alerts",      6,          3  },
+  { "mqtt",        60,         10 },
+  { "irrigation",  0,          0  },
+  { "config",      30,         5  },
+  { "wifi",        30,         5  },
+  { "control",     6,          3  },
+};
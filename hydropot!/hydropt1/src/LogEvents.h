@@ -0,0 +1,80 @@
+/*
+ * LogEvents.h
+ * The firmware's log events for EventLog: their categories, levels and
+ * formats. Shared by hydropt1.cpp and tools/log_decode, which must be built
+ * from the same version of this table to decode a capture.
+ *
+ * Add new events at the end, before LOG_EVENT_END, so records captured from
+ * older firmware still decode.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _LOGEVENTS_H_
+#define _LOGEVENTS_H_
+
+#include "EventLog.h"
+
+enum {
+  LOG_STATUS,         // periodic status report
+  LOG_SENSORS,        // sensor readings and read failures
+  LOG_ALERTS,         // air quality and water level alerts
+  LOG_MQTT,           // publishes and incoming messages
+  LOG_IRRIGATION,     // pump and watering decisions, never rate limited
+  LOG_CONFIG,         // remote configuration
+  LOG_WIFI,           // joining and losing the network
+  LOG_CONTROL,        // the control task's schedule
+  LOG_CATEGORY_COUNT
+};
+
+enum {
+  EV_TIME = EVENT_FIRST,
+  EV_MOISTURE,
+  EV_WATER_LEVEL,
+  EV_TEMPERATURE,
+  EV_HUMIDITY,
+  EV_BME_STATUS,
+  EV_MQTT_STATUS,
+  EV_RECENT,
+  EV_IRRIGATION_STATUS,
+  EV_HEAP,
+  EV_DATE_TIME,
+  EV_AIR_VALUE,
+  EV_AIR_READING,
+  EV_BME_FAILED,
+  EV_AIR_ALERT,
+  EV_AIR_UNKNOWN,
+  EV_WATER_LOW,
+  EV_WATER_HIGH,
+  EV_QUEUE_DRAINED,
+  EV_PUBLISH_LIVE,
+  EV_PUBLISH_BACKLOG,
+  EV_PUBLISH_FRAME,
+  EV_WATER_BUTTON,
+  EV_PUMP_ON,
+  EV_PUMP_OFF,
+  EV_REMOTE_BUSY,
+  EV_REMOTE_OK,
+  EV_REMOTE_BLOCKED,
+  EV_CONFIG_REJECTED,
+  EV_CONFIG_APPLIED,
+  EV_WIFI_JOINED,
+  EV_WIFI_REJOINED,
+  EV_WIFI_DROPPED,
+  EV_CONTROL_LATE,
+  EV_I2C_TIMEOUT,
+  EV_I2C_STUCK,
+  EV_POT_BUTTON,
+  EV_IRRIGATION_INVALID,
+  EV_DIAGNOSTICS_FULL,
+  LOG_EVENT_END
+};
+
+#define LOG_EVENT_COUNT (LOG_EVENT_END - EVENT_FIRST)
+
+extern const EventDef LOG_EVENTS[LOG_EVENT_COUNT];
+
+// Names and rate limits. Not const: EventLog keeps each bucket's state here.
+extern EventCategory LOG_CATEGORIES[LOG_CATEGORY_COUNT];
+
+#endif // _LOGEVENTS_H_
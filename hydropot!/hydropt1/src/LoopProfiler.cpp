@@ -0,0 +1,134 @@
+/*
+ * LoopProfiler.cpp
+ */
+
+#include "LoopProfiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Values 0-3 get their own bucket; above that, the two bits after the top set
+// bit pick one of four buckets per power of two.
+static uint8_t bucketOf(uint32_t us) {
+  uint8_t top;
+
+  if (us < 4) {
+    return us;
+  }
+  top = 31 - __builtin_clz(us);
+  return (top - 1) * 4 + ((us >> (top - 2)) & 3);
+}
+
+// Largest value that falls in a bucket.
+static uint32_t bucketTop(uint8_t bucket) {
+  uint8_t top;
+
+  if (bucket < 4) {
+    return bucket;
+  }
+  top = bucket / 4 + 1;
+  return (uint32_t)(((uint64_t)(4 + bucket % 4 + 1) << (top - 2)) - 1);
+}
+
+LoopProfiler::LoopProfiler(ProfileSection *sections, uint8_t count) {
+  _sections = sections;
+  _count = count;
+  for (uint8_t id = 0; id < _count; id++) {
+    _sections[id].running = false;
+  }
+  reset();
+}
+
+void LoopProfiler::start(uint8_t id, uint32_t nowUs) {
+  _sections[id].started = nowUs;
+  _sections[id].running = true;
+}
+
+void LoopProfiler::stop(uint8_t id, uint32_t nowUs) {
+  ProfileSection &section = _sections[id];
+
+  if (section.running) {
+    section.running = false;
+    record(id, nowUs - section.started);
+  }
+}
+
+void LoopProfiler::record(uint8_t id, uint32_t us) {
+  ProfileSection &section = _sections[id];
+
+  section.buckets[bucketOf(us)]++;
+  section.count++;
+  section.total += us;
+  if (us > section.max) {
+    section.max = us;
+  }
+}
+
+ProfileStats LoopProfiler::stats(uint8_t id) const {
+  const ProfileSection &section = _sections[id];
+  ProfileStats stats;
+  // Ranks of the quantiles, 1-based, rounded up.
+  uint32_t rank50 = (section.count + 1) / 2;
+  uint32_t rank99 = section.count - section.count / 100;
+  uint32_t seen = 0;
+  bool median = false;
+
+  stats.count = section.count;
+  stats.max = section.max;
+  stats.total = section.total;
+  stats.p50 = 0;
+  stats.p99 = 0;
+  for (uint8_t b = 0; b < PROFILE_BUCKETS && seen < rank99; b++) {
+    if (section.buckets[b] == 0) {
+      continue;
+    }
+    seen += section.buckets[b];
+    if (!median && seen >= rank50) {
+      stats.p50 = bucketTop(b);
+      median = true;
+    }
+    if (seen >= rank99) {
+      stats.p99 = bucketTop(b);
+    }
+  }
+  if (stats.p50 > stats.max) {
+    stats.p50 = stats.max;
+  }
+  if (stats.p99 > stats.max) {
+    stats.p99 = stats.max;
+  }
+  return stats;
+}
+
+void LoopProfiler::reset() {
+  for (uint8_t id = 0; id < _count; id++) {
+    ProfileSection &section = _sections[id];
+    section.count = 0;
+    section.max = 0;
+    section.total = 0;
+    memset(section.buckets, 0, sizeof(section.buckets));
+  }
+}
+
+size_t LoopProfiler::format(char *buf, size_t size) const {
+  size_t len = 0;
+  int n;
+
+  if (size == 0) {
+    return 0;
+  }
+  buf[0] = 0;
+  for (uint8_t id = 0; id < _count; id++) {
+    ProfileStats s = stats(id);
+    if (s.count == 0) {
+      continue;
+    }
+    n = snprintf(buf + len, size - len, "%s\"%s\":[%lu,%lu,%lu,%lu]", len ? "," : "", _sections[id].name,
+                 (unsigned long)s.count, (unsigned long)s.p50, (unsigned long)s.p99, (unsigned long)s.max);
+    if (n < 0 || (size_t)n >= size - len) {
+      return 0;
+    }
+    len += n;
+  }
+  return len;
+}
@@ -0,0 +1,85 @@
+/*
+ * LoopProfiler.h
+ * Where the time goes in loop(): each named section of the loop gets a
+ * log-scale latency histogram (4 buckets per power of two, so quantiles are
+ * within 25% however long the section takes) plus its count, total and max.
+ * Memory is fixed, about 0.5 KB per section, and recording is a few
+ * instructions, so it can stay in production builds.
+ *
+ * Sections are timed with the PROFILE_START/PROFILE_STOP macros, which read
+ * micros() and compile to nothing when LOOP_PROFILE is 0. Times are µs on any
+ * free-running 32 bit clock; a section may run up to 71 minutes.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _LOOPPROFILER_H_
+#define _LOOPPROFILER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Set to 0 to compile the profiling out entirely.
+#ifndef LOOP_PROFILE
+#define LOOP_PROFILE 1
+#endif
+
+#if LOOP_PROFILE
+#define PROFILE_START(profiler, id) (profiler).start((id), micros())
+#define PROFILE_STOP(profiler, id) (profiler).stop((id), micros())
+#else
+#define PROFILE_START(profiler, id) ((void)0)
+#define PROFILE_STOP(profiler, id) ((void)0)
+#endif
+
+#define PROFILE_BUCKETS 124        // 0-3 µs exact, then 4 per power of two up to 2^32
+
+struct ProfileSection {
+  const char *name;
+  uint32_t started;     // micros() at start()
+  bool running;
+  uint32_t count;
+  uint32_t max;
+  uint64_t total;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+// Summary of one section over the current window. Quantiles are the upper
+// edge of the bucket they fall in, capped at the max.
+struct ProfileStats {
+  uint32_t count;
+  uint32_t p50;
+  uint32_t p99;
+  uint32_t max;
+  uint64_t total;
+  uint32_t mean() const { return count ? total / count : 0; }
+};
+
+class LoopProfiler {
+  public:
+    // `sections` only needs the names filled in; the rest is cleared here.
+    LoopProfiler(ProfileSection *sections, uint8_t count);
+
+    void start(uint8_t id, uint32_t nowUs);
+    // Records the time since start(). Ignored if the section was not started.
+    void stop(uint8_t id, uint32_t nowUs);
+    void record(uint8_t id, uint32_t us);
+
+    ProfileStats stats(uint8_t id) const;
+    const char *name(uint8_t id) const { return _sections[id].name; }
+    uint8_t count() const { return _count; }
+
+    // Starts a new window. Sections in progress keep running.
+    void reset();
+
+    // "name":[count,p50,p99,max],... for every section that ran, in µs, as
+    // members of a JSON object. Returns the length (0 if nothing ran), or 0
+    // if it does not fit.
+    size_t format(char *buf, size_t size) const;
+
+  private:
+    ProfileSection *_sections;
+    uint8_t _count;
+};
+
+#endif // _LOOPPROFILER_H_
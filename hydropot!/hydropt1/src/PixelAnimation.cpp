@@ -0,0 +1,79 @@
+/*
+ * PixelAnimation.cpp
+ */
+
+#include "PixelAnimation.h"
+
+PixelAnimation::PixelAnimation(uint8_t pixels) {
+  _pixels = pixels;
+  _kind = NONE;
+  _color = 0;
+  _idle = 0;
+  _step = 0;
+  _steps = 0;
+  _stepMs = 0;
+  _stepAt = 0;
+  _changed = true;
+}
+
+// Step 1..pixels lights one more pixel; the last step clears them.
+void PixelAnimation::sweep(uint32_t color, uint16_t stepMs, uint32_t nowMs) {
+  start(SWEEP, color, _pixels + 1, stepMs, nowMs);
+}
+
+// Odd steps on, even steps off.
+void PixelAnimation::flash(uint32_t color, uint8_t times, uint16_t onMs, uint32_t nowMs) {
+  start(FLASH, color, times * 2, onMs, nowMs);
+}
+
+void PixelAnimation::setIdle(uint32_t color) {
+  if (color != _idle) {
+    _idle = color;
+    _changed |= _kind == NONE;
+  }
+}
+
+void PixelAnimation::start(Kind kind, uint32_t color, uint16_t steps, uint16_t stepMs, uint32_t nowMs) {
+  if (steps == 0) {
+    return;
+  }
+  _kind = kind;
+  _color = color;
+  _step = 1;
+  _steps = steps;
+  _stepMs = stepMs;
+  _stepAt = nowMs;
+  _changed = true;
+}
+
+bool PixelAnimation::update(uint32_t nowMs) {
+  bool changed = _changed;
+
+  // One step per call at most, so every step is shown even after a late tick.
+  if (_kind != NONE && nowMs - _stepAt >= _stepMs) {
+    _stepAt += _stepMs;
+    if (nowMs - _stepAt >= _stepMs) {
+      _stepAt = nowMs;
+    }
+    if (_step < _steps) {
+      _step++;
+    }
+    else {
+      _kind = NONE;   // the final all-off step has been shown; back to idle
+    }
+    changed = true;
+  }
+  _changed = false;
+  return changed;
+}
+
+uint32_t PixelAnimation::color(uint8_t pixel) const {
+  switch (_kind) {
+    case SWEEP:
+      return _step < _steps && pixel < _step ? _color : 0;
+    case FLASH:
+      return _step % 2 ? _color : 0;
+    default:
+      return _idle;
+  }
+}
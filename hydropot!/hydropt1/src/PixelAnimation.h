@@ -0,0 +1,52 @@
+/*
+ * PixelAnimation.h
+ * The NeoPixel alert patterns as a state machine stepped by the caller, so
+ * showing them never delays the code around it. update() is called on every
+ * tick; when the pattern moves on it returns true and the new colours are
+ * read back with color() and sent to the strip.
+ *
+ *   sweep   light the pixels one by one, then turn them all off
+ *   flash   all pixels on, then off, a number of times
+ *
+ * A flash replaces whatever is showing; a sweep is only started by the caller
+ * when nothing is (see busy()). Between patterns every pixel shows the idle
+ * colour, e.g. blue while the pump runs.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _PIXELANIMATION_H_
+#define _PIXELANIMATION_H_
+
+#include <stdint.h>
+
+class PixelAnimation {
+  public:
+    explicit PixelAnimation(uint8_t pixels);
+
+    void sweep(uint32_t color, uint16_t stepMs, uint32_t nowMs);
+    void flash(uint32_t color, uint8_t times, uint16_t onMs, uint32_t nowMs);
+    void setIdle(uint32_t color);
+    bool busy() const { return _kind != NONE; }
+
+    // Move the pattern on to `nowMs`. Returns true if any pixel changed.
+    bool update(uint32_t nowMs);
+    uint32_t color(uint8_t pixel) const;
+
+  private:
+    enum Kind { NONE, SWEEP, FLASH };
+
+    void start(Kind kind, uint32_t color, uint16_t steps, uint16_t stepMs, uint32_t nowMs);
+
+    uint8_t _pixels;
+    Kind _kind;
+    uint32_t _color;
+    uint32_t _idle;
+    uint16_t _step;         // steps shown so far
+    uint16_t _steps;        // steps in the pattern, the last one being all off
+    uint16_t _stepMs;
+    uint32_t _stepAt;       // when the current step was shown
+    bool _changed;          // something to show that update() has not reported
+};
+
+#endif // _PIXELANIMATION_H_
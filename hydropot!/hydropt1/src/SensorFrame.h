@@ -0,0 +1,37 @@
+/*
+ * SensorFrame.h
+ * One set of readings from the control task, with the irrigation state at
+ * the time. Every frame goes to loop() through an SpscQueue for the sensor
+ * history, and the newest is also kept in a Snapshot for any thread that
+ * only needs the current values.
+ *
+ * Plain data, so it can be copied word by word (see Snapshot.h).
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _SENSORFRAME_H_
+#define _SENSORFRAME_H_
+
+#include <stdint.h>
+
+struct SensorFrame {
+  uint32_t ms;                    // millis() when read
+  float tempC;
+  float tempF;
+  float humidRH;
+  bool bmeOk;                     // false: the three above are defaults
+  int airValue;
+  int quality;                    // AirQualitySensor level, -1 before the first
+  int moisture;
+  int water;                      // raw level probe reading
+  float waterLevel;               // %
+  const char *irrigationState;    // IrrigationController::stateName(), static
+  uint32_t pumpMsToday;
+  uint32_t dailyCapMs;
+  uint32_t doses;
+  uint32_t skippedLowWater;
+  uint32_t skippedCap;
+};
+
+#endif // _SENSORFRAME_H_
@@ -0,0 +1,105 @@
+/*
+ * SensorTrace.cpp
+ */
+
+#include "SensorTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static size_t checked(int len, size_t size) {
+  return len > 0 && (size_t)len < size ? (size_t)len : 0;
+}
+
+static char *putHex(char *out, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    *out++ = HEX_DIGITS[data[i] >> 4];
+    *out++ = HEX_DIGITS[data[i] & 0x0F];
+  }
+  *out = 0;
+  return out;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Exactly `length` bytes of hex, ending the field.
+static bool getHex(const char *in, uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    int hi = hexValue(in[2 * i]), lo = hi < 0 ? -1 : hexValue(in[2 * i + 1]);
+    if (lo < 0) {
+      return false;
+    }
+    data[i] = hi << 4 | lo;
+  }
+  in += 2 * length;
+  return *in == 0 || *in == '\r' || *in == '\n';
+}
+
+size_t traceFormatHeader(char *buf, size_t size) {
+  return checked(snprintf(buf, size, "$HPT,%d", SENSOR_TRACE_VERSION), size);
+}
+
+size_t traceFormatCalibration(char *buf, size_t size, const uint8_t *calibration) {
+  if (size < 3 + 2 * SENSOR_TRACE_CALBYTES + 1) {
+    return 0;
+  }
+  memcpy(buf, "$C,", 3);
+  return putHex(buf + 3, calibration, SENSOR_TRACE_CALBYTES) - buf;
+}
+
+size_t traceFormatSample(char *buf, size_t size, const TraceSample &sample) {
+  char bme[2 * SENSOR_TRACE_BMEBYTES + 1] = "-";
+
+  if (sample.hasBme) {
+    putHex(bme, sample.bme, SENSOR_TRACE_BMEBYTES);
+  }
+  return checked(snprintf(buf, size, "$S,%lu,%d,%d,%d,%s", (unsigned long)sample.ms, sample.air, sample.moisture,
+                          sample.water, bme), size);
+}
+
+TraceLine traceParse(const char *line, TraceSample &sample, uint8_t *calibration) {
+  char *end;
+  long values[3];
+
+  if (line[0] != '$') {
+    return TRACE_OTHER;
+  }
+  if (!strncmp(line, "$HPT,", 5)) {
+    return strtol(line + 5, &end, 10) == SENSOR_TRACE_VERSION ? TRACE_HEADER : TRACE_INVALID;
+  }
+  if (!strncmp(line, "$C,", 3)) {
+    return getHex(line + 3, calibration, SENSOR_TRACE_CALBYTES) ? TRACE_CALIBRATION : TRACE_INVALID;
+  }
+  if (strncmp(line, "$S,", 3)) {
+    return TRACE_OTHER;
+  }
+
+  sample.ms = strtoul(line + 3, &end, 10);
+  for (int i = 0; i < 3; i++) {
+    if (*end != ',') {
+      return TRACE_INVALID;
+    }
+    values[i] = strtol(end + 1, &end, 10);
+  }
+  if (*end != ',') {
+    return TRACE_INVALID;
+  }
+  sample.air = values[0];
+  sample.moisture = values[1];
+  sample.water = values[2];
+  end++;
+  if (*end == '-') {
+    sample.hasBme = false;
+    return TRACE_SAMPLE;
+  }
+  sample.hasBme = getHex(end, sample.bme, SENSOR_TRACE_BMEBYTES);
+  return sample.hasBme ? TRACE_SAMPLE : TRACE_INVALID;
+}
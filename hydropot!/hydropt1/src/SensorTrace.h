@@ -0,0 +1,57 @@
+/*
+ * SensorTrace.h
+ * Text trace of the raw sensor readings, one line per pass of loop(), written
+ * to Serial so it can be captured with `particle serial monitor` and replayed
+ * by the host simulation (hydropot_sim --replay) in virtual time.
+ *
+ *   $HPT,<version>                 header, repeated every SENSOR_TRACE_REPEAT samples
+ *   $C,<66 hex digits>             BME280 trimming registers 0x88-0xA1 then 0xE1-0xE7
+ *   $S,<ms>,<A0>,<A1>,<A3>,<bme>   millis(), the raw analog readings and the
+ *                                  BME280 data registers 0xF7-0xFE as 16 hex
+ *                                  digits, or '-' if the read failed
+ *
+ * Lines that do not start with '$' are other Serial output and are skipped,
+ * so a whole serial log can be replayed as it is.
+ *
+ * No Particle APIs are used here, so the same code builds on the host.
+ */
+
+#ifndef _SENSORTRACE_H_
+#define _SENSORTRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SENSOR_TRACE_VERSION 1
+#define SENSOR_TRACE_CALBYTES 33    // 26 from 0x88, 7 from 0xE1
+#define SENSOR_TRACE_BMEBYTES 8     // 0xF7-0xFE: pressure, temperature, humidity
+#define SENSOR_TRACE_LINE 80        // longest line, including the terminator
+#define SENSOR_TRACE_REPEAT 1000    // samples between header/calibration repeats
+
+struct TraceSample {
+  uint32_t ms;
+  int16_t air;        // A0
+  int16_t moisture;   // A1
+  int16_t water;      // A3, read with the probe powered
+  bool hasBme;
+  uint8_t bme[SENSOR_TRACE_BMEBYTES];
+};
+
+enum TraceLine {
+  TRACE_OTHER,          // not a trace line
+  TRACE_HEADER,
+  TRACE_CALIBRATION,
+  TRACE_SAMPLE,
+  TRACE_INVALID         // a trace line that does not parse, or another version
+};
+
+// Each returns the line length (no newline added), or 0 if it does not fit.
+size_t traceFormatHeader(char *buf, size_t size);
+size_t traceFormatCalibration(char *buf, size_t size, const uint8_t *calibration);
+size_t traceFormatSample(char *buf, size_t size, const TraceSample &sample);
+
+// Classify and decode one line. Fills `sample` for TRACE_SAMPLE and
+// `calibration` (SENSOR_TRACE_CALBYTES) for TRACE_CALIBRATION.
+TraceLine traceParse(const char *line, TraceSample &sample, uint8_t *calibration);
+
+#endif // _SENSORTRACE_H_
@@ -0,0 +1,92 @@
+/*
+ * Snapshot.h
+ * The latest value of a struct, written by one thread and read by any
+ * number of others without locks (a seqlock). The writer bumps a sequence
+ * number to odd, stores the value and bumps it to even again; a reader
+ * copies the value between two reads of the sequence and keeps the copy
+ * only if the number was even and did not change, so it never sees half of
+ * one write and half of another. Writing never waits; reading retries a few
+ * times and then gives up rather than spin.
+ *
+ * On one core a read can only be interrupted by a write if the writer has
+ * the higher priority, and then the retry succeeds. A reader that outranks
+ * the writer may catch it mid-write every time, which is why read() is
+ * bounded.
+ *
+ * The value is held as 32 bit atomic words, so T must be trivially
+ * copyable; keep it to a few dozen bytes.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+template <typename T>
+class Snapshot {
+  static_assert(std::is_trivially_copyable<T>::value, "Snapshot needs a trivially copyable type");
+
+  public:
+    Snapshot() : _sequence(0) {
+      for (size_t w = 0; w < WORDS; w++) {
+        _words[w].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    // Writer side; only ever one writing thread.
+    void write(const T &value) {
+      uint32_t words[WORDS];
+      uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+
+      words[WORDS - 1] = 0;
+      memcpy(words, &value, sizeof(T));
+      _sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      for (size_t w = 0; w < WORDS; w++) {
+        _words[w].store(words[w], std::memory_order_relaxed);
+      }
+      _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Any thread. Copies the latest value to `value` and returns true, or
+    // returns false if nothing has been written yet or a write was in
+    // progress on each of `tries` attempts.
+    bool read(T &value, uint8_t tries = 4) const {
+      uint32_t words[WORDS];
+
+      for (uint8_t attempt = 0; attempt < tries; attempt++) {
+        uint32_t before = _sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+          return false;
+        }
+        if (before & 1) {
+          continue;
+        }
+        for (size_t w = 0; w < WORDS; w++) {
+          words[w] = _words[w].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_sequence.load(std::memory_order_relaxed) == before) {
+          memcpy(&value, words, sizeof(T));
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Writes completed so far; a reader can tell whether anything is new.
+    uint32_t version() const { return _sequence.load(std::memory_order_acquire) / 2; }
+
+  private:
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> _sequence;    // odd while a write is in progress
+    std::atomic<uint32_t> _words[WORDS];
+};
+
+#endif // _SNAPSHOT_H_
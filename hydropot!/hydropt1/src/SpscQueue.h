@@ -0,0 +1,69 @@
+/*
+ * SpscQueue.h
+ * Bounded queue between exactly one producer thread and one consumer thread,
+ * with no locks: each side only writes its own index, and the indexes are
+ * atomics with acquire/release ordering, so an item is fully written before
+ * the consumer can see it. Neither side ever waits; push() fails when the
+ * queue is full and pop() when it is empty.
+ *
+ * Items are copied in and out, so keep them small. N must be a power of two.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+  public:
+    SpscQueue() : _head(0), _tail(0), _dropped(0) {}
+
+    // Producer side. Returns false, and counts the item as dropped, if full.
+    bool push(const T &item) {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+      if (tail - _head.load(std::memory_order_acquire) == N) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      _items[tail & (N - 1)] = item;
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side. Returns false if empty.
+    bool pop(T &item) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+
+      if (head == _tail.load(std::memory_order_acquire)) {
+        return false;
+      }
+      item = _items[head & (N - 1)];
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Either side; only a snapshot, as the other side may move meanwhile.
+    uint16_t size() const {
+      return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    uint16_t capacity() const { return N; }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+  private:
+    // Free-running counts of items pushed and popped; the slot is the count
+    // modulo N.
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _dropped;
+    T _items[N];
+};
+
+#endif // _SPSCQUEUE_H_
@@ -0,0 +1,102 @@
+/*
+ * Supervisor.cpp
+ */
+
+#include "Supervisor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t RESET_LOG_MAGIC = 0x48505357;   // "HPSW"
+
+Supervisor::Supervisor(SupervisedTask *tasks, uint8_t count, ResetLog &log) : _log(log) {
+  _tasks = tasks;
+  _count = count < SUPERVISOR_MAX_TASKS ? count : SUPERVISOR_MAX_TASKS;
+  if (_log.magic != RESET_LOG_MAGIC) {
+    memset(&_log, 0, sizeof(_log));
+    _log.magic = RESET_LOG_MAGIC;
+    _log.lastTask = SUPERVISOR_NO_TASK;
+    _log.pendingTask = SUPERVISOR_NO_TASK;
+  }
+  _watchdogReset = false;
+  _failed = false;
+}
+
+void Supervisor::begin(uint32_t nowMs, bool watchdogReset) {
+  _log.boots++;
+  _watchdogReset = watchdogReset;
+  if (watchdogReset) {
+    _log.watchdogResets++;
+    if (_log.pendingTask < _count) {
+      _log.taskResets[_log.pendingTask]++;
+    }
+    else {
+      _log.unattributed++;
+    }
+    _log.lastTask = _log.pendingTask;
+    _log.lastOverdueMs = _log.pendingOverdueMs;
+  }
+  _log.pendingTask = SUPERVISOR_NO_TASK;
+  _log.pendingOverdueMs = 0;
+
+  for (uint8_t task = 0; task < _count; task++) {
+    _tasks[task].lastCheckIn.store(nowMs, std::memory_order_relaxed);
+    _tasks[task].worstGapMs.store(0, std::memory_order_relaxed);
+  }
+  _failed = false;
+}
+
+void Supervisor::checkIn(uint8_t task, uint32_t nowMs) {
+  SupervisedTask &t = _tasks[task];
+  uint32_t gap = nowMs - t.lastCheckIn.load(std::memory_order_relaxed);
+
+  if (gap > t.worstGapMs.load(std::memory_order_relaxed)) {
+    t.worstGapMs.store(gap, std::memory_order_relaxed);
+  }
+  t.lastCheckIn.store(nowMs, std::memory_order_release);
+}
+
+bool Supervisor::check(uint32_t nowMs) {
+  if (_failed) {
+    return false;
+  }
+  for (uint8_t task = 0; task < _count; task++) {
+    uint32_t gap = nowMs - _tasks[task].lastCheckIn.load(std::memory_order_acquire);
+    // A check-in after nowMs was read looks like a huge gap; it is not late.
+    if ((int32_t)gap > (int32_t)_tasks[task].deadlineMs) {
+      _log.pendingOverdueMs = gap;
+      _log.pendingTask = task;
+      _failed = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Supervisor::format(char *buf, size_t size) const {
+  size_t len;
+  int n;
+
+  n = snprintf(buf, size, "\"supervisor\":{\"boots\":%lu,\"watchdogResets\":%lu,\"unattributed\":%lu",
+               (unsigned long)_log.boots, (unsigned long)_log.watchdogResets, (unsigned long)_log.unattributed);
+  if (n < 0 || (size_t)n >= size) {
+    return 0;
+  }
+  len = n;
+  for (uint8_t task = 0; task < _count; task++) {
+    n = snprintf(buf + len, size - len, ",\"%s\":[%lu,%lu,%lu]", _tasks[task].name,
+                 (unsigned long)_log.taskResets[task],
+                 (unsigned long)_tasks[task].worstGapMs.load(std::memory_order_relaxed),
+                 (unsigned long)_tasks[task].deadlineMs);
+    if (n < 0 || (size_t)n >= size - len) {
+      return 0;
+    }
+    len += n;
+  }
+  if (len + 1 >= size) {
+    return 0;
+  }
+  buf[len++] = '}';
+  buf[len] = 0;
+  return len;
+}
@@ -0,0 +1,93 @@
+/*
+ * Supervisor.h
+ * Deadline supervision of the firmware's threads, in front of the hardware
+ * watchdog. Each supervised task checks in when it completes a pass; one
+ * that has gone longer than its deadline without checking in is overdue.
+ * check() is called about once a second from a thread of its own, and the
+ * watchdog is only refreshed while it returns true, so a single stuck task
+ * (a hung I2C read, a connect that never returns) resets the device even
+ * though the other threads still run.
+ *
+ * Before the watchdog is left to expire, the overdue task and how late it was
+ * are written to a ResetLog in retained RAM. After the reset, begin() counts
+ * the watchdog reset against that task, so the cause can be reported once
+ * the device is back online. A watchdog reset with no task recorded means
+ * the supervising thread itself stopped. Like JoinStats, the figures start
+ * over after a power loss.
+ *
+ * Once a task is found overdue, check() keeps returning false: the reset goes
+ * ahead even if the task comes back in the meantime.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _SUPERVISOR_H_
+#define _SUPERVISOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define SUPERVISOR_MAX_TASKS 4
+#define SUPERVISOR_NO_TASK 0xFF
+
+struct SupervisedTask {
+  const char *name;
+  uint32_t deadlineMs;              // longest allowed time between check-ins
+  // Run time state, written by the task's own thread
+  std::atomic<uint32_t> lastCheckIn;
+  std::atomic<uint32_t> worstGapMs; // longest time between check-ins this boot
+};
+
+// Watchdog resets over all boots since the last power loss. Meant to live in
+// `retained` memory.
+struct ResetLog {
+  uint32_t magic;
+  uint32_t boots;
+  uint32_t watchdogResets;
+  uint32_t unattributed;            // watchdog resets with no overdue task recorded
+  uint32_t taskResets[SUPERVISOR_MAX_TASKS];
+  uint8_t lastTask;                 // overdue task behind the latest watchdog reset
+  uint32_t lastOverdueMs;           // its time since checking in when it was caught
+  // Written by check() just before the watchdog is left to expire
+  uint8_t pendingTask;
+  uint32_t pendingOverdueMs;
+};
+
+class Supervisor {
+  public:
+    // `log` is reset unless it holds figures from an earlier boot.
+    Supervisor(SupervisedTask *tasks, uint8_t count, ResetLog &log);
+
+    // Start supervising: every task has its deadline from `nowMs` to check
+    // in for the first time. `watchdogReset` is whether the watchdog caused
+    // the reset that started this boot.
+    void begin(uint32_t nowMs, bool watchdogReset);
+
+    // From the task's own thread, after each pass.
+    void checkIn(uint8_t task, uint32_t nowMs);
+
+    // True while every task is within its deadline: refresh the watchdog.
+    bool check(uint32_t nowMs);
+
+    // Whether this boot followed a watchdog reset, and the task behind it
+    // (SUPERVISOR_NO_TASK if none was recorded).
+    bool watchdogReset() const { return _watchdogReset; }
+    uint8_t resetTask() const { return _log.lastTask; }
+    const char *taskName(uint8_t task) const { return task < _count ? _tasks[task].name : "unknown"; }
+    const ResetLog &log() const { return _log; }
+
+    // "supervisor":{"boots":n,"watchdogResets":n,"unattributed":n,
+    // "<task>":[resets,worstGapMs,deadlineMs],...}, as a member of a JSON
+    // object. Returns the length, or 0 if it does not fit.
+    size_t format(char *buf, size_t size) const;
+
+  private:
+    SupervisedTask *_tasks;
+    uint8_t _count;
+    ResetLog &_log;
+    bool _watchdogReset;
+    bool _failed;
+};
+
+#endif // _SUPERVISOR_H_
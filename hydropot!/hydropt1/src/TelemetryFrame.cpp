@@ -0,0 +1,147 @@
+/*
+ * TelemetryFrame.cpp
+ */
+
+#include "TelemetryFrame.h"
+
+static int32_t scaleClamp(float value, float scale, int32_t lo, int32_t hi) {
+  float v = value * scale;
+  int32_t r;
+
+  if (!(v == v)) {
+    return 0;  // NaN from a failed sensor read
+  }
+  if (v <= lo) {
+    return lo;
+  }
+  if (v >= hi) {
+    return hi;
+  }
+  r = (int32_t)(v < 0 ? v - 0.5f : v + 0.5f);
+  return r;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+void telemetryPack(const TelemetrySample &sample, TelemetryRecord &record) {
+  record.timestamp = sample.timestamp;
+  record.tempCentiF = scaleClamp(sample.tempF, 100, INT16_MIN, INT16_MAX);
+  record.humidCentiRH = scaleClamp(sample.humidRH, 100, 0, UINT16_MAX);
+  record.moisture = sample.moisture;
+  record.waterLevel = sample.waterLevel;
+  record.airQuality = sample.airQuality;
+}
+
+void telemetryUnpack(const TelemetryRecord &record, TelemetrySample &sample) {
+  sample.timestamp = record.timestamp;
+  sample.tempF = record.tempCentiF / 100.0f;
+  sample.humidRH = record.humidCentiRH / 100.0f;
+  sample.moisture = record.moisture;
+  sample.waterLevel = record.waterLevel;
+  sample.airQuality = record.airQuality;
+}
+
+TelemetryFrameWriter::TelemetryFrameWriter(uint8_t *buf, uint16_t size) {
+  _buf = buf;
+  _size = size;
+  clear();
+}
+
+void TelemetryFrameWriter::clear() {
+  _len = 0;
+  _count = 0;
+  _lastTimestamp = 0;
+  if (_size > 0) {
+    _buf[_len++] = TELEMETRY_FRAME_VERSION;
+  }
+}
+
+bool TelemetryFrameWriter::add(const TelemetrySample &sample) {
+  TelemetryRecord record;
+  uint32_t fields[6];
+  uint8_t encoded[TELEMETRY_FRAME_MAXSAMPLE];
+  uint8_t n = 0;
+
+  // Scale exactly as the queue does, so a sample round-trips identically
+  // whichever path it took.
+  telemetryPack(sample, record);
+  fields[0] = zigzag((int32_t)(record.timestamp - _lastTimestamp));
+  fields[1] = zigzag(record.tempCentiF);
+  fields[2] = record.humidCentiRH;
+  fields[3] = zigzag(record.moisture);
+  fields[4] = zigzag(record.waterLevel);
+  fields[5] = zigzag(record.airQuality);
+
+  for (uint8_t f = 0; f < 6; f++) {
+    uint32_t v = fields[f];
+    while (v >= 0x80) {
+      encoded[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+    }
+    encoded[n++] = v;
+  }
+
+  if (_size == 0 || _len + n > _size) {
+    return false;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    _buf[_len++] = encoded[i];
+  }
+  _lastTimestamp = record.timestamp;
+  _count++;
+  return true;
+}
+
+TelemetryFrameReader::TelemetryFrameReader(const uint8_t *data, uint16_t len) {
+  _data = data;
+  _len = len;
+  _pos = 1;
+  _lastTimestamp = 0;
+  _error = len > 0 && data[0] != TELEMETRY_FRAME_VERSION;
+}
+
+bool TelemetryFrameReader::next(TelemetrySample &sample) {
+  TelemetryRecord record;
+  uint32_t fields[6];
+
+  if (_error || _pos >= _len) {
+    return false;
+  }
+  for (uint8_t f = 0; f < 6; f++) {
+    if (!getVarint(fields[f])) {
+      _error = true;
+      return false;
+    }
+  }
+
+  record.timestamp = _lastTimestamp + (uint32_t)unzigzag(fields[0]);
+  record.tempCentiF = unzigzag(fields[1]);
+  record.humidCentiRH = fields[2];
+  record.moisture = unzigzag(fields[3]);
+  record.waterLevel = unzigzag(fields[4]);
+  record.airQuality = unzigzag(fields[5]);
+  _lastTimestamp = record.timestamp;
+  telemetryUnpack(record, sample);
+  return true;
+}
+
+bool TelemetryFrameReader::getVarint(uint32_t &value) {
+  uint8_t shift = 0;
+
+  value = 0;
+  while (_pos < _len && shift < 35) {
+    uint8_t b = _data[_pos++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+    shift += 7;
+  }
+  return false;
+}
@@ -0,0 +1,96 @@
+/*
+ * TelemetryFrame.h
+ * Compact binary encodings of sensor samples, used instead of the ASCII feed
+ * messages on constrained uplinks and for the records kept in the offline queue.
+ *
+ * Frame (one MQTT payload, any number of samples):
+ *   byte 0        TELEMETRY_FRAME_VERSION
+ *   per sample    varint  zigzag(timestamp - previous timestamp), previous = 0
+ *                 varint  zigzag(tempF * 100)
+ *                 varint  humidRH * 100
+ *                 varint  zigzag(moisture)
+ *                 varint  zigzag(waterLevel)
+ *                 varint  zigzag(airQuality)
+ * Varints are LEB128 (7 bits per byte, low bits first). A 30 second sample
+ * after the first one in a frame is typically 9 bytes, against four text
+ * messages of 60+ bytes each.
+ *
+ * No Particle APIs are used here, so the same code builds on the host for the
+ * decoder in tools/.
+ */
+
+#ifndef _TELEMETRYFRAME_H_
+#define _TELEMETRYFRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_FRAME_VERSION 1
+#define TELEMETRY_FRAME_MAXSAMPLE 18  // worst-case encoded bytes for one sample
+
+// One snapshot of the readings that go out on each publish.
+struct TelemetrySample {
+  uint32_t timestamp;   // Time.now() when taken, 0 if the clock was not synced yet
+  float tempF;
+  float humidRH;
+  int16_t moisture;
+  int16_t waterLevel;   // percent; can exceed 100, the probe's raw 0-520 is only nominal
+  int8_t airQuality;    // AirQualitySensor::slope() code, -1 if unknown
+};
+
+// Fixed-size scaled form of a sample, as stored in the offline queue.
+struct TelemetryRecord {
+  uint32_t timestamp;
+  int16_t tempCentiF;
+  uint16_t humidCentiRH;
+  int16_t moisture;
+  int16_t waterLevel;   // full range: a flooded probe reads well past 127%
+  int8_t airQuality;
+};
+
+void telemetryPack(const TelemetrySample &sample, TelemetryRecord &record);
+void telemetryUnpack(const TelemetryRecord &record, TelemetrySample &sample);
+
+class TelemetryFrameWriter {
+  public:
+    TelemetryFrameWriter(uint8_t *buf, uint16_t size);
+
+    void clear();
+    // Append a sample. Returns false, leaving the frame unchanged, if it does
+    // not fit.
+    bool add(const TelemetrySample &sample);
+
+    const uint8_t *data() const { return _buf; }
+    uint16_t length() const { return _len; }
+    uint16_t count() const { return _count; }
+
+  private:
+    uint8_t *_buf;
+    uint16_t _size;
+    uint16_t _len;
+    uint16_t _count;
+    uint32_t _lastTimestamp;
+};
+
+class TelemetryFrameReader {
+  public:
+    TelemetryFrameReader(const uint8_t *data, uint16_t len);
+
+    // Frame version, 0 for an empty frame.
+    uint8_t version() const { return _len > 0 ? _data[0] : 0; }
+    // Decode the next sample. Returns false at the end of the frame, or if the
+    // version is unknown or the frame is truncated (see error()).
+    bool next(TelemetrySample &sample);
+    bool error() const { return _error; }
+
+  private:
+    bool getVarint(uint32_t &value);
+
+    const uint8_t *_data;
+    uint16_t _len;
+    uint16_t _pos;
+    uint32_t _lastTimestamp;
+    bool _error;
+};
+
+#endif // _TELEMETRYFRAME_H_
@@ -0,0 +1,201 @@
+/*
+ * TelemetryQueue.cpp
+ * File layout: a fixed Header followed by `capacity` TelemetryRecord slots
+ * used as a ring. A slot is always written before the header that makes it
+ * visible, so a reset loses at most the samples pushed since the header was
+ * last written.
+ */
+
+#include "TelemetryQueue.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t QUEUE_MAGIC = 0x48505451;  // "HPTQ"
+static const uint16_t QUEUE_VERSION = 3;   // 2: scaled TelemetryRecord slots, 3: 16 bit water level
+
+TelemetryQueue::TelemetryQueue(const char *path, uint16_t capacity, TelemetryDropPolicy policy) {
+  _path = path;
+  _capacity = capacity;
+  _policy = policy;
+  _fd = -1;
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+  _drainInterval = 2000;
+  _lastDrain = 0;
+  _syncEvery = 8;
+  _unsynced = 0;
+}
+
+TelemetryQueue::~TelemetryQueue() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+bool TelemetryQueue::begin() {
+  char dir[64];
+  const char *slash = strrchr(_path, '/');
+
+  if (slash && slash != _path && (size_t)(slash - _path) < sizeof(dir)) {
+    memcpy(dir, _path, slash - _path);
+    dir[slash - _path] = 0;
+    mkdir(dir, 0777);  // fails harmlessly if it already exists
+  }
+
+  _fd = open(_path, O_RDWR | O_CREAT, 0666);
+  if (_fd < 0) {
+    Log.error("TelemetryQueue: cannot open %s (errno %d)", _path, errno);
+    return false;
+  }
+
+  Header hdr;
+  if (read(_fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+      hdr.magic == QUEUE_MAGIC && hdr.version == QUEUE_VERSION &&
+      hdr.recordSize == sizeof(TelemetryRecord) && hdr.capacity == _capacity &&
+      hdr.head < _capacity && hdr.count <= _capacity) {
+    _head = hdr.head;
+    _count = hdr.count;
+    _dropped = hdr.dropped;
+    Log.info("TelemetryQueue: restored %u queued samples (%lu dropped)", _count, (unsigned long)_dropped);
+    return true;
+  }
+
+  // New file, or one written with a different layout: start empty.
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+  return writeHeader();
+}
+
+bool TelemetryQueue::push(const TelemetrySample &sample) {
+  if (_fd < 0) {
+    return false;
+  }
+
+  if (_count == _capacity) {
+    _dropped++;
+    if (_policy == DROP_NEWEST) {
+      if (++_unsynced >= _syncEvery) {
+        writeHeader();
+      }
+      return false;
+    }
+    // DROP_OLDEST: the new sample takes the oldest slot.
+    _head = (_head + 1) % _capacity;
+    _count--;
+  }
+
+  if (!writeSlot((_head + _count) % _capacity, sample)) {
+    return false;
+  }
+  _count++;
+  if (++_unsynced < _syncEvery) {
+    return true;
+  }
+  return writeHeader();
+}
+
+bool TelemetryQueue::peek(TelemetrySample &sample) {
+  if (_fd < 0 || _count == 0) {
+    return false;
+  }
+  return readSlot(_head, sample);
+}
+
+bool TelemetryQueue::pop(uint16_t n) {
+  if (_fd < 0 || n == 0 || n > _count) {
+    return false;
+  }
+  _head = (_head + n) % _capacity;
+  _count -= n;
+  return writeHeader();
+}
+
+uint16_t TelemetryQueue::drain(TelemetrySendCallback send, uint16_t maxRecords) {
+  TelemetrySample sample;
+  uint16_t sent = 0;
+
+  if (_count == 0 || (millis() - _lastDrain) < _drainInterval) {
+    return 0;
+  }
+  _lastDrain = millis();
+
+  while (sent < maxRecords && sent < _count && readSlot((_head + sent) % _capacity, sample)) {
+    if (!send(sample)) {
+      break;  // leave it and the rest queued, retry on the next drain
+    }
+    sent++;
+  }
+  // Everything acknowledged goes, with one header write
+  if (sent > 0) {
+    pop(sent);
+  }
+  return sent;
+}
+
+uint16_t TelemetryQueue::drainFrame(TelemetryFrameWriter &frame, TelemetryFrameSendCallback send) {
+  TelemetrySample sample;
+  uint16_t n = 0;
+
+  if (_fd < 0 || _count == 0 || (millis() - _lastDrain) < _drainInterval) {
+    return 0;
+  }
+  _lastDrain = millis();
+
+  frame.clear();
+  while (n < _count && readSlot((_head + n) % _capacity, sample) && frame.add(sample)) {
+    n++;
+  }
+  if (n == 0 || !send(frame)) {
+    return 0;
+  }
+  pop(n);
+  return n;
+}
+
+bool TelemetryQueue::writeHeader() {
+  Header hdr;
+
+  hdr.magic = QUEUE_MAGIC;
+  hdr.version = QUEUE_VERSION;
+  hdr.recordSize = sizeof(TelemetryRecord);
+  hdr.capacity = _capacity;
+  hdr.head = _head;
+  hdr.count = _count;
+  hdr.reserved = 0;
+  hdr.dropped = _dropped;
+  _unsynced = 0;
+
+  if (lseek(_fd, 0, SEEK_SET) < 0 || write(_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+    Log.error("TelemetryQueue: header write failed (errno %d)", errno);
+    return false;
+  }
+  fsync(_fd);
+  return true;
+}
+
+bool TelemetryQueue::readSlot(uint16_t slot, TelemetrySample &sample) {
+  off_t offset = sizeof(Header) + (off_t)slot * sizeof(TelemetryRecord);
+  TelemetryRecord record;
+
+  if (lseek(_fd, offset, SEEK_SET) < 0 || read(_fd, &record, sizeof(record)) != sizeof(record)) {
+    return false;
+  }
+  telemetryUnpack(record, sample);
+  return true;
+}
+
+bool TelemetryQueue::writeSlot(uint16_t slot, const TelemetrySample &sample) {
+  off_t offset = sizeof(Header) + (off_t)slot * sizeof(TelemetryRecord);
+  TelemetryRecord record;
+
+  telemetryPack(sample, record);
+  if (lseek(_fd, offset, SEEK_SET) < 0 || write(_fd, &record, sizeof(record)) != sizeof(record)) {
+    Log.error("TelemetryQueue: slot write failed (errno %d)", errno);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,100 @@
+/*
+ * TelemetryQueue.h
+ * Bounded store-and-forward queue for sensor samples, kept in a file on the
+ * LittleFS flash filesystem so readings taken while MQTT or WiFi is down are
+ * published once the connection comes back (and survive a reset).
+ *
+ * To spare the flash, the header (head, count) is not rewritten on every
+ * push: pushes are made durable every syncEvery of them, and samples sent by
+ * a drain are removed with one header write for the whole batch. A reset can
+ * lose up to syncEvery - 1 of the newest queued samples, and never resends a
+ * sample a drain saw acknowledged.
+ */
+
+#ifndef _TELEMETRYQUEUE_H_
+#define _TELEMETRYQUEUE_H_
+
+#include "Particle.h"
+#include "TelemetryFrame.h"
+
+// What to do when a sample is pushed onto a full queue.
+enum TelemetryDropPolicy {
+  DROP_OLDEST,          // overwrite the oldest queued sample (keep recent data)
+  DROP_NEWEST           // reject the new sample (keep the start of the outage)
+};
+
+// Publishes one sample. Return false to leave it queued and stop draining.
+typedef bool (*TelemetrySendCallback)(const TelemetrySample &sample);
+// Publishes a frame of samples. Return false to leave them all queued.
+typedef bool (*TelemetryFrameSendCallback)(const TelemetryFrameWriter &frame);
+
+class TelemetryQueue {
+  public:
+    TelemetryQueue(const char *path, uint16_t capacity, TelemetryDropPolicy policy=DROP_OLDEST);
+    ~TelemetryQueue();
+
+    // Open (or create) the queue file. Returns false if the filesystem is not
+    // usable, in which case push() fails and the caller should publish directly.
+    bool begin();
+
+    // Queue a sample; the header is written once every syncEvery pushes.
+    bool push(const TelemetrySample &sample);
+    bool peek(TelemetrySample &sample);
+    // Remove the n oldest samples and write the header.
+    bool pop(uint16_t n=1);
+
+    // Send at most maxRecords samples, oldest first, but no more often than
+    // once every drain interval. The samples sent before one fails are popped
+    // together. Returns the number of samples sent.
+    uint16_t drain(TelemetrySendCallback send, uint16_t maxRecords=1);
+    // Same, but packs as many samples as fit into one binary frame and sends
+    // them with a single call.
+    uint16_t drainFrame(TelemetryFrameWriter &frame, TelemetryFrameSendCallback send);
+    // The drain interval is what keeps the replay after an outage under the
+    // broker's rate limit: a backlog hours long all wants to go at once on
+    // reconnect. Adafruit IO takes 30 publishes a minute and throttles past
+    // that. Default 2000 ms; see drainIntervalFor().
+    void setDrainInterval(unsigned int msec) { _drainInterval = msec; }
+    // The drain interval that keeps one sample per drain, taking
+    // publishesPerSample publishes, to perMinute publishes a minute.
+    static unsigned int drainIntervalFor(uint16_t publishesPerSample, uint16_t perMinute) {
+      return 60000UL * publishesPerSample / perMinute;
+    }
+    void setDropPolicy(TelemetryDropPolicy policy) { _policy = policy; }
+    void setSyncEvery(uint16_t pushes) { _syncEvery = pushes ? pushes : 1; }
+
+    uint16_t size() const { return _count; }
+    uint16_t capacity() const { return _capacity; }
+    bool isEmpty() const { return _count == 0; }
+    uint32_t dropped() const { return _dropped; }
+
+  private:
+    struct Header {
+      uint32_t magic;
+      uint16_t version;
+      uint16_t recordSize;
+      uint16_t capacity;
+      uint16_t head;
+      uint16_t count;
+      uint16_t reserved;
+      uint32_t dropped;
+    };
+
+    bool writeHeader();
+    bool readSlot(uint16_t slot, TelemetrySample &sample);
+    bool writeSlot(uint16_t slot, const TelemetrySample &sample);
+
+    const char *_path;
+    uint16_t _capacity;
+    TelemetryDropPolicy _policy;
+    int _fd;
+    uint16_t _head;
+    uint16_t _count;
+    uint32_t _dropped;
+    unsigned int _drainInterval;
+    unsigned int _lastDrain;
+    uint16_t _syncEvery;
+    uint16_t _unsynced;       // pushes and drops since the header was written
+};
+
+#endif // _TELEMETRYQUEUE_H_
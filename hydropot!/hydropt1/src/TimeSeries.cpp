@@ -0,0 +1,184 @@
+/*
+ * TimeSeries.cpp
+ */
+
+#include "TimeSeries.h"
+
+static const uint32_t LEVEL_PERIOD[SERIES_LEVELS] = { 60, 900, 3600 };
+
+static uint32_t alignTo(uint32_t t, uint32_t period) {
+  return t - t % period;
+}
+
+void SeriesStats::clear(uint32_t windowStart) {
+  start = windowStart;
+  count = 0;
+  min = 0;
+  max = 0;
+  sum = 0;
+}
+
+void SeriesStats::add(float value) {
+  if (count == 0 || value < min) {
+    min = value;
+  }
+  if (count == 0 || value > max) {
+    max = value;
+  }
+  sum += value;
+  count++;
+}
+
+void SeriesStats::merge(const SeriesStats &other) {
+  if (other.count == 0) {
+    return;
+  }
+  if (count == 0 || other.min < min) {
+    min = other.min;
+  }
+  if (count == 0 || other.max > max) {
+    max = other.max;
+  }
+  sum += other.sum;
+  count += other.count;
+}
+
+TimeSeries::TimeSeries() {
+  SeriesStats *rings[SERIES_LEVELS] = { _minutes, _quarters, _hours };
+  uint8_t capacities[SERIES_LEVELS] = { TIMESERIES_MINUTES, TIMESERIES_QUARTERS, TIMESERIES_HOURS };
+
+  for (uint8_t l = 0; l < SERIES_LEVELS; l++) {
+    _levels[l].period = LEVEL_PERIOD[l];
+    _levels[l].ring = rings[l];
+    _levels[l].capacity = capacities[l];
+    _levels[l].head = 0;
+    _levels[l].count = 0;
+    _levels[l].open.clear();
+  }
+  _rawHead = 0;
+  _rawCount = 0;
+  _interval.clear();
+}
+
+uint8_t TimeSeries::add(uint32_t now, float value) {
+  Level &minute = _levels[SERIES_MINUTE];
+  uint8_t closed = 0;
+
+  _rawValue[_rawHead] = value;
+  _rawTime[_rawHead] = now;
+  _rawHead = (_rawHead + 1) % TIMESERIES_RAW;
+  if (_rawCount < TIMESERIES_RAW) {
+    _rawCount++;
+  }
+
+  if (_interval.count == 0) {
+    _interval.clear(now);
+  }
+  _interval.add(value);
+
+  // Bottom up, so a minute that closes is merged into its quarter before the
+  // quarter itself is checked against the new time.
+  for (uint8_t l = 0; l < SERIES_LEVELS; l++) {
+    closed |= roll(l, now);
+  }
+
+  if (minute.open.count == 0) {
+    minute.open.clear(alignTo(now, minute.period));
+  }
+  minute.open.add(value);
+  return closed;
+}
+
+// Close the open window at a level if `now` is outside it, storing it in the
+// level's ring and merging it into the level above.
+uint8_t TimeSeries::roll(uint8_t level, uint32_t now) {
+  Level &l = _levels[level];
+
+  if (l.open.count == 0 || (now >= l.open.start && now - l.open.start < l.period)) {
+    return 0;
+  }
+
+  l.ring[l.head] = l.open;
+  l.head = (l.head + 1) % l.capacity;
+  if (l.count < l.capacity) {
+    l.count++;
+  }
+  if (level + 1 < SERIES_LEVELS) {
+    feed(level + 1, l.open);
+  }
+  l.open.clear();
+  return 1 << level;
+}
+
+void TimeSeries::feed(uint8_t level, const SeriesStats &window) {
+  Level &l = _levels[level];
+
+  if (l.open.count == 0) {
+    l.open.clear(alignTo(window.start, l.period));
+  }
+  l.open.merge(window);
+}
+
+SeriesStats TimeSeries::current(SeriesLevel level) const {
+  SeriesStats stats;
+
+  stats.clear();
+  for (int l = level; l >= 0; l--) {
+    const SeriesStats &open = _levels[l].open;
+    if (open.count == 0) {
+      continue;
+    }
+    if (stats.count == 0) {
+      stats.start = alignTo(open.start, _levels[level].period);
+    }
+    stats.merge(open);
+  }
+  return stats;
+}
+
+bool TimeSeries::history(SeriesLevel level, uint8_t index, SeriesStats &stats) const {
+  const Level &l = _levels[level];
+
+  if (index >= l.count) {
+    return false;
+  }
+  stats = l.ring[(l.head + l.capacity - 1 - index) % l.capacity];
+  return true;
+}
+
+bool TimeSeries::raw(uint8_t index, float &value, uint32_t &time) const {
+  uint8_t slot;
+
+  if (index >= _rawCount) {
+    return false;
+  }
+  slot = (_rawHead + TIMESERIES_RAW - 1 - index) % TIMESERIES_RAW;
+  value = _rawValue[slot];
+  time = _rawTime[slot];
+  return true;
+}
+
+SeriesStats TimeSeries::takeInterval() {
+  SeriesStats stats = _interval;
+
+  _interval.clear();
+  return stats;
+}
+
+void TimeSeries::rebase(uint32_t offset) {
+  for (uint8_t r = 0; r < _rawCount; r++) {
+    _rawTime[(_rawHead + TIMESERIES_RAW - 1 - r) % TIMESERIES_RAW] += offset;
+  }
+  for (uint8_t l = 0; l < SERIES_LEVELS; l++) {
+    Level &level = _levels[l];
+    for (uint8_t w = 0; w < level.count; w++) {
+      level.ring[(level.head + level.capacity - 1 - w) % level.capacity].start += offset;
+    }
+    if (level.open.count) {
+      level.open.start += offset;
+    }
+  }
+  if (_interval.count) {
+    _interval.start += offset;
+  }
+}
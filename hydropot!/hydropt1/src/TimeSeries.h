@@ -0,0 +1,112 @@
+/*
+ * TimeSeries.h
+ * Fixed-memory history for one sensor metric: a ring of the most recent raw
+ * readings plus cascading 1 minute, 15 minute and 1 hour rollups, each keeping
+ * min, max, mean and count. Every reading taken in loop() is kept in some
+ * form, so spikes between publishes are not lost, while RAM stays bounded
+ * (about 2.6 KB per series with the default sizes).
+ *
+ * Timestamps are seconds on any monotonic clock (Time.now() once synced).
+ * Windows are aligned to multiples of their period and close when a reading
+ * from a later window arrives; a gap in readings simply leaves no entry.
+ * When the clock changes, rebase() moves what is already recorded onto it.
+ *
+ * No Particle APIs are used here, so it also builds on the host.
+ */
+
+#ifndef _TIMESERIES_H_
+#define _TIMESERIES_H_
+
+#include <stdint.h>
+
+#ifndef TIMESERIES_RAW
+#define TIMESERIES_RAW 64          // raw readings kept
+#endif
+#ifndef TIMESERIES_MINUTES
+#define TIMESERIES_MINUTES 60      // 1 minute windows kept (1 hour)
+#endif
+#ifndef TIMESERIES_QUARTERS
+#define TIMESERIES_QUARTERS 16     // 15 minute windows kept (4 hours)
+#endif
+#ifndef TIMESERIES_HOURS
+#define TIMESERIES_HOURS 24        // 1 hour windows kept (1 day)
+#endif
+#if TIMESERIES_RAW > 255 || TIMESERIES_MINUTES > 255 || TIMESERIES_QUARTERS > 255 || TIMESERIES_HOURS > 255
+#error "TimeSeries ring sizes are limited to 255 entries"
+#endif
+
+// Aggregate of the readings in one window.
+struct SeriesStats {
+  uint32_t start;     // window start, seconds
+  uint32_t count;
+  float min;
+  float max;
+  float sum;
+
+  void clear(uint32_t windowStart=0);
+  void add(float value);
+  void merge(const SeriesStats &other);
+  float mean() const { return count ? sum / count : 0; }
+};
+
+enum SeriesLevel {
+  SERIES_MINUTE,
+  SERIES_QUARTER,
+  SERIES_HOUR,
+  SERIES_LEVELS
+};
+
+class TimeSeries {
+  public:
+    TimeSeries();
+
+    // Record a reading. Returns a bit mask of the levels (1 << SeriesLevel)
+    // whose window closed because of it, so callers can act on new rollups.
+    uint8_t add(uint32_t now, float value);
+
+    // The window in progress at a level, including readings not yet rolled
+    // up from the levels below it.
+    SeriesStats current(SeriesLevel level) const;
+    // Closed windows, index 0 the most recent. Returns false past the end.
+    bool history(SeriesLevel level, uint8_t index, SeriesStats &stats) const;
+    uint8_t historySize(SeriesLevel level) const { return _levels[level].count; }
+    // Raw readings, index 0 the most recent.
+    bool raw(uint8_t index, float &value, uint32_t &time) const;
+    uint8_t rawSize() const { return _rawCount; }
+
+    // Everything recorded since the last call, for publishing the aggregate of
+    // a publish interval instead of a single reading.
+    SeriesStats takeInterval();
+
+    // Move everything recorded by `offset` seconds, for a change of clock
+    // (uptime to wall time when it syncs). An open window then closes a
+    // period after its moved start, and the windows after it are aligned.
+    void rebase(uint32_t offset);
+
+  private:
+    struct Level {
+      uint32_t period;
+      SeriesStats *ring;
+      uint8_t capacity;
+      uint8_t head;       // next slot to write
+      uint8_t count;
+      SeriesStats open;   // window in progress
+    };
+
+    uint8_t roll(uint8_t level, uint32_t now);
+    void feed(uint8_t level, const SeriesStats &window);
+
+    float _rawValue[TIMESERIES_RAW];
+    uint32_t _rawTime[TIMESERIES_RAW];
+    uint8_t _rawHead;
+    uint8_t _rawCount;
+
+    SeriesStats _minutes[TIMESERIES_MINUTES];
+    SeriesStats _quarters[TIMESERIES_QUARTERS];
+    SeriesStats _hours[TIMESERIES_HOURS];
+    Level _levels[SERIES_LEVELS];
+
+    SeriesStats _interval;
+};
+
+#endif // _TIMESERIES_H_
@@ -0,0 +1,153 @@
+/*
+ * WiFiBootstrap.cpp
+ * EEPROM layout at the bootstrap address: one Written, the hash of the SSID
+ * and password last given to Device OS.
+ */
+
+#include "WiFiBootstrap.h"
+
+static const uint32_t JOIN_STATS_MAGIC = 0x4850574B;  // "HPWK": with failedBoots
+static const uint32_t WRITTEN_MAGIC = 0x48505743;     // "HPWC"
+
+WiFiBootstrap::WiFiBootstrap(JoinStats &stats, int eepromAddress, uint32_t rewriteAfterMs,
+                             uint8_t rewriteAfterBoots) :
+    _stats(stats) {
+  if (_stats.magic != JOIN_STATS_MAGIC) {
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.magic = JOIN_STATS_MAGIC;
+  }
+  _address = eepromAddress;
+  _rewriteAfterMs = rewriteAfterMs;
+  _rewriteAfterBoots = rewriteAfterBoots;
+  _ssid = NULL;
+  _password = NULL;
+  _started = 0;
+  _late = false;
+  _joined = false;
+  _ready = false;
+  _joinMs = 0;
+}
+
+void WiFiBootstrap::begin(const char *ssid, const char *password, uint32_t nowMs) {
+  _ssid = ssid;
+  _password = password;
+  _started = nowMs;
+  _stats.boots++;
+
+  Written written;
+  EEPROM.get(_address, written);
+  if (!storedFor(ssid)) {
+    Log.info("WiFiBootstrap: no credentials stored for %s, saving them", ssid);
+    writeCredentials();
+  }
+  else if (written.magic != WRITTEN_MAGIC || written.hash != credentialsHash()) {
+    Log.info("WiFiBootstrap: credentials for %s changed, saving them", ssid);
+    writeCredentials();
+  }
+  WiFi.on();
+  WiFi.connect();
+}
+
+WiFiChange WiFiBootstrap::loop(uint32_t nowMs) {
+  bool ready = WiFi.ready();
+  WiFiChange change = WIFI_NO_CHANGE;
+
+  if (ready && !_ready) {
+    uint32_t took = nowMs - _started;
+    if (!_joined) {
+      _joined = true;
+      _joinMs = took;
+      _stats.joins++;
+      _stats.failedBoots = 0;
+      _stats.lastJoinMs = took;
+      _stats.totalJoinMs += took;
+      if (_stats.joins == 1 || took < _stats.minJoinMs) {
+        _stats.minJoinMs = took;
+      }
+      if (took > _stats.maxJoinMs) {
+        _stats.maxJoinMs = took;
+      }
+      change = WIFI_JOINED;
+    }
+    else {
+      _stats.lastRejoinMs = took;
+      change = WIFI_REJOINED;
+    }
+  }
+  else if (!ready && _ready) {
+    _stats.drops++;
+    _started = nowMs;
+    change = WIFI_DROPPED;
+  }
+  else if (!ready && !_joined && !_late && nowMs - _started >= _rewriteAfterMs) {
+    _late = true;
+    _stats.failedBoots++;
+    if (_stats.failedBoots >= _rewriteAfterBoots) {
+      // Boot after boot: Device OS may have lost ours or been given others, write ours once more
+      Log.warn("WiFiBootstrap: not joined after %lu ms on %lu boots, saving the credentials again",
+               (unsigned long)(nowMs - _started), (unsigned long)_stats.failedBoots);
+      _stats.failedBoots = 0;
+      writeCredentials();
+      WiFi.connect();
+    }
+  }
+  _ready = ready;
+  return change;
+}
+
+size_t WiFiBootstrap::format(char *buf, size_t size) const {
+  int n = snprintf(buf, size, "\"wifi\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu]", (unsigned long)_joinMs,
+                   (unsigned long)_stats.lastJoinMs, (unsigned long)_stats.minJoinMs,
+                   (unsigned long)_stats.maxJoinMs,
+                   (unsigned long)(_stats.joins ? _stats.totalJoinMs / _stats.joins : 0),
+                   (unsigned long)_stats.boots, (unsigned long)_stats.joins, (unsigned long)_stats.credentialWrites,
+                   (unsigned long)_stats.drops, (unsigned long)_stats.lastRejoinMs,
+                   (unsigned long)_stats.failedBoots);
+
+  return n > 0 && (size_t)n < size ? n : 0;
+}
+
+uint16_t WiFiBootstrap::storageSize() const {
+  return sizeof(Written);
+}
+
+// Device OS keeps up to 10 networks; only the SSID can be read back.
+bool WiFiBootstrap::storedFor(const char *ssid) {
+  WiFiAccessPoint stored[10];
+  int count;
+
+  if (!WiFi.hasCredentials()) {
+    return false;
+  }
+  count = WiFi.getCredentials(stored, 10);
+  for (int n = 0; n < count; n++) {
+    if (stored[n].ssidLength == strlen(ssid) && memcmp(stored[n].ssid, ssid, stored[n].ssidLength) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// FNV-1a over the SSID, a separator and the password.
+uint32_t WiFiBootstrap::credentialsHash() const {
+  uint32_t h = 2166136261UL;
+
+  for (const char *c = _ssid; *c; c++) {
+    h = (h ^ (uint8_t)*c) * 16777619UL;
+  }
+  h *= 16777619UL;
+  for (const char *c = _password ? _password : ""; *c; c++) {
+    h = (h ^ (uint8_t)*c) * 16777619UL;
+  }
+  return h;
+}
+
+void WiFiBootstrap::writeCredentials() {
+  Written written;
+
+  WiFi.setCredentials(_ssid, _password);
+  _stats.credentialWrites++;
+  written.magic = WRITTEN_MAGIC;
+  written.hash = credentialsHash();
+  EEPROM.put(_address, written);
+}
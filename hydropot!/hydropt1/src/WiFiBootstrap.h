@@ -0,0 +1,100 @@
+/*
+ * WiFiBootstrap.h
+ * Brings WiFi up at boot without holding up setup(). The credentials stored
+ * by Device OS are kept: they are only written when none are stored for the
+ * network, or the SSID and password last written differ from the build's,
+ * so a restart rejoins the known access point straight away instead of
+ * rescanning, and flash is not rewritten every boot. Device OS cannot read
+ * a password back, so a hash of the pair last written is kept in EEPROM.
+ *
+ * If the network has not joined within rewriteAfterMs on rewriteAfterBoots
+ * boots in a row, the credentials are written once more, in case Device OS
+ * lost them or they were replaced from outside the firmware. Counting boots
+ * keeps a router that is down, or slow after the same power cut, from
+ * costing a flash write every boot.
+ *
+ * EEPROM layout at the given address: Written (see WiFiBootstrap.cpp).
+ *
+ * How long each join took is kept in retained RAM, so the figures survive a
+ * reset (OTA update, watchdog, brownout) and show how quickly the device came
+ * back. They start over after a power loss.
+ */
+
+#ifndef _WIFIBOOTSTRAP_H_
+#define _WIFIBOOTSTRAP_H_
+
+#include "Particle.h"
+
+// Join figures over all boots since the last power loss. Meant to live in
+// `retained` memory.
+struct JoinStats {
+  uint32_t magic;
+  uint32_t boots;
+  uint32_t joins;             // boots that got onto the network
+  uint32_t lastJoinMs;        // from begin() to WiFi.ready(), latest boot that joined
+  uint32_t minJoinMs;
+  uint32_t maxJoinMs;
+  uint32_t totalJoinMs;
+  uint32_t credentialWrites;
+  uint32_t drops;             // lost the network after joining
+  uint32_t lastRejoinMs;      // from the latest drop back to WiFi.ready()
+  uint32_t failedBoots;       // boots in a row not joined within rewriteAfterMs
+};
+
+enum WiFiChange {
+  WIFI_NO_CHANGE,
+  WIFI_JOINED,                // first join this boot
+  WIFI_REJOINED,              // back after a drop
+  WIFI_DROPPED
+};
+
+class WiFiBootstrap {
+  public:
+    // `stats` is reset unless it holds figures from an earlier boot.
+    WiFiBootstrap(JoinStats &stats, int eepromAddress, uint32_t rewriteAfterMs=60000,
+                  uint8_t rewriteAfterBoots=3);
+
+    // Check the stored credentials and start joining. Returns at once.
+    void begin(const char *ssid, const char *password, uint32_t nowMs);
+
+    // Follow the join; call from every pass of loop().
+    WiFiChange loop(uint32_t nowMs);
+
+    bool ready() const { return _ready; }
+    // This boot's join time, 0 until joined.
+    uint32_t joinMs() const { return _joinMs; }
+    const JoinStats &stats() const { return _stats; }
+
+    // "wifi":[joinMs,lastJoinMs,minJoinMs,maxJoinMs,meanJoinMs,boots,joins,
+    // credentialWrites,drops,lastRejoinMs,failedBoots], as a member of a JSON
+    // object.
+    // Returns the length, or 0 if it does not fit.
+    size_t format(char *buf, size_t size) const;
+
+    // Bytes of EEPROM used, for placing other data after it.
+    uint16_t storageSize() const;
+
+  private:
+    struct Written {
+      uint32_t magic;
+      uint32_t hash;            // credentialsHash() of the pair last written
+    };
+
+    bool storedFor(const char *ssid);
+    uint32_t credentialsHash() const;
+    void writeCredentials();
+
+    JoinStats &_stats;
+    int _address;
+    uint32_t _rewriteAfterMs;
+    uint8_t _rewriteAfterBoots;
+    const char *_ssid;
+    const char *_password;
+    uint32_t _started;          // begin(), or the latest drop
+    bool _late;                 // counted in failedBoots this boot
+    bool _joined;               // joined at least once this boot
+    bool _ready;
+    uint32_t _joinMs;
+};
+
+#endif // _WIFIBOOTSTRAP_H_
@@ -24,54 +24,395 @@ SerialLogHandler logHandler(LOG_LEVEL_INFO);
 #include "Adafruit_GFX.h"
 #include "neopixel.h"
 #include "Colors.h"
+#include "Button.h"
 #include "Air_Quality_Sensor.h"
 #include <Adafruit_MQTT.h>
 #include "Adafruit_MQTT/Adafruit_MQTT_SPARK.h"
 #include "Adafruit_MQTT/Adafruit_MQTT.h"
 #include "credentials.h"
+#include "TelemetryQueue.h"
+#include "ConnectionManager.h"
+#include "ConfigRegistry.h"
+#include "TimeSeries.h"
+#include "HistoryLog.h"
+#include "IrrigationController.h"
+#include "SensorTrace.h"
+#include "LoopProfiler.h"
+#include "ClockText.h"
+#include "HeapMonitor.h"
+#include "EventLog.h"
+#include "LogEvents.h"
+#include "I2CDiscovery.h"
+#include "I2CBus.h"
+#include "WiFiBootstrap.h"
+#include "SpscQueue.h"
+#include "Snapshot.h"
+#include "SensorFrame.h"
+#include "PixelAnimation.h"
+#include "Supervisor.h"
 
 TCPClient TheClient; 
 
 Adafruit_MQTT_SPARK mqtt(&TheClient,AIO_SERVER,AIO_SERVERPORT,AIO_USERNAME,AIO_KEY);
+// Reconnects with exponential backoff (1 s doubling to 5 min, jittered) without blocking loop()
+ConnectionManager mqttConnection(&mqtt, 1000, 300000);
  
-Adafruit_MQTT_Subscribe WaterButton = Adafruit_MQTT_Subscribe(&mqtt, AIO_USERNAME "/feeds/waterbutton"); 
-Adafruit_MQTT_Publish TEMP = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/temperature");
-Adafruit_MQTT_Publish HUMIDITY = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/humidity");
-Adafruit_MQTT_Publish MOISTURE = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/moisture");
+Adafruit_MQTT_Subscribe WaterButton(&mqtt, AIO_USERNAME "/feeds/waterbutton");
+Adafruit_MQTT_SubscribeBuffer<128> CONFIG(&mqtt, AIO_USERNAME "/feeds/hydropot-config");
+Adafruit_MQTT_Publish CONFIG_STATUS = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/hydropot-config-status");
+Adafruit_MQTT_Publish SUMMARY = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/hydropot-summary");
 Adafruit_MQTT_Publish AIRQUALITY = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/airquality");
 Adafruit_MQTT_Publish WATERLEVEL = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/waterlevel");
+// Backlogged samples go to the feeds' /json topics so they keep their original timestamp
+Adafruit_MQTT_Publish TEMP_JSON = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/temperature/json");
+Adafruit_MQTT_Publish HUMIDITY_JSON = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/humidity/json");
+Adafruit_MQTT_Publish MOISTURE_JSON = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/moisture/json");
+Adafruit_MQTT_Publish WATERLEVEL_JSON = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/waterlevel/json");
+
+// Live samples go out as one CSV message to the feeds' group (temperature, humidity,
+// moisture and waterlevel live in the "default" group); backlog samples are four
+// /json packets collected in one batch, about two 250 byte writes.
+char groupBuffer[96];
+Adafruit_MQTT_Group SENSORS = Adafruit_MQTT_Group(&mqtt, AIO_USERNAME "/groups/default/csv", groupBuffer, sizeof(groupBuffer));
+uint8_t batchBuffer[512];
+Adafruit_MQTT_Batch backlogBatch = Adafruit_MQTT_Batch(&mqtt, batchBuffer, sizeof(batchBuffer));
+
+//STORE-AND-FORWARD TELEMETRY
+const uint16_t TELEMETRY_QUEUE_CAPACITY = 960;       // 8 hours of 30 second samples
+const unsigned long TELEMETRY_STALE_AGE = 60;        // seconds before a sample counts as backlog
+TelemetryQueue telemetryQueue("/usr/telemetry.dat", TELEMETRY_QUEUE_CAPACITY, DROP_OLDEST);
+
+// Set to 1 (here or with -DTELEMETRY_BINARY=1) to publish samples as binary
+// TelemetryFrames (see TelemetryFrame.h) instead of text, for brokers that
+// take binary payloads. Adafruit IO feeds expect text, so it is off by
+// default. Decode with tools/telemetry_decode.
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 0
+#endif
+#if TELEMETRY_BINARY
+uint8_t frameBuffer[128];
+TelemetryFrameWriter telemetryFrame(frameBuffer, sizeof(frameBuffer));
+Adafruit_MQTT_Publish TELEMETRY_FRAME = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/telemetry/frame");
+#endif
+
+// Adafruit IO takes 30 publishes a minute per account. A replayed sample is
+// four /json publishes (one frame with TELEMETRY_BINARY), and the replay keeps
+// to 24 a minute to leave room for the summary, diagnostics and alerts: one
+// sample every 10 s, and no live publishes until the queue is empty.
+const uint16_t AIO_PUBLISHES_PER_MINUTE = 30;
+const uint16_t BACKLOG_PUBLISHES_PER_MINUTE = AIO_PUBLISHES_PER_MINUTE - 6;
+const uint16_t BACKLOG_SAMPLE_PUBLISHES = TELEMETRY_BINARY ? 1 : 4;
+
+// With 1, drivers take their buffers from storage sized at compile time
+// instead of the heap, so nothing is allocated after setup() and memory use
+// stays the same over months of uptime. hydropot_sim --heap-check fails if
+// loop() allocates. 0 gives the drivers' original heap buffers.
+#ifndef STATIC_ALLOCATION
+#define STATIC_ALLOCATION 1
+#endif
+
+// Set to 1 to stream the raw sensor readings over Serial, one line per pass,
+// for replay in the host simulation (see SensorTrace.h). Capture with
+// `particle serial monitor --follow > trace.log`.
+#ifndef SENSOR_TRACE
+#define SENSOR_TRACE 0
+#endif
+
+// Set to 1 to drain the event log as "#<hex>" records instead of text lines,
+// about a quarter of the bytes. Decode a capture with tools/log_decode.
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+//REMOTE CONFIGURATION
+// Send e.g. "mt=900;wl=25;pi=60000" (or "defaults") to the hydropot-config feed.
+// Changes take effect within a control tick and survive a reboot.
+enum {
+  CFG_MOISTURE_THRESHOLD,   // below this reading the soil counts as dry
+  CFG_WATER_LOW,            // % reservoir level under which the pump is locked out
+  CFG_WATER_HIGH,           // % reservoir level that raises the high-water alert
+  CFG_PUBLISH_INTERVAL,     // ms between telemetry samples
+  CFG_WATER_ALERT_INTERVAL, // ms between repeated water level light alerts
+  CFG_PUMP_PULSE,           // longest automatic dose, ms
+  CFG_REMOTE_PUMP,          // ms the pump runs for the Adafruit IO water button
+  CFG_BRIGHTNESS,           // NeoPixel brightness
+  CFG_MOISTURE_WET,         // a watering cycle ends at or above this reading
+  CFG_SOAK,                 // ms between a dose and the next measurement
+  CFG_DAILY_CAP,            // pump ms allowed per 24 hours
+  CFG_KP,                   // dose ms per count below the wet reading
+  CFG_KI,                   // dose ms per accumulated count
+  CFG_DRY_RUN,              // 1 = run the irrigation logic without the pump
+  CFG_COUNT
+};
+ConfigParam configParams[CFG_COUNT] = {
+  // key   type          min     max      default
+  { "mt", CONFIG_INT,    0,      4095,    1000   },
+  { "wl", CONFIG_INT,    0,      100,     30     },
+  { "wh", CONFIG_INT,    0,      100,     80     },
+  { "pi", CONFIG_INT,    5000,   3600000, 30000  },
+  { "wa", CONFIG_INT,    10000,  3600000, 300000 },
+  { "pp", CONFIG_INT,    0,      10000,   3000   },
+  { "rp", CONFIG_INT,    0,      30000,   3000   },
+  { "lb", CONFIG_INT,    0,      255,     50     },
+  { "mw", CONFIG_INT,    0,      4095,    1300   },
+  { "sk", CONFIG_INT,    10000,  3600000, 120000 },
+  { "dc", CONFIG_INT,    0,      600000,  60000  },
+  { "kp", CONFIG_FLOAT,  0,      100,     5      },
+  { "ki", CONFIG_FLOAT,  0,      10,      0.5    },
+  { "dr", CONFIG_INT,    0,      1,       0      },
+};
+ConfigRegistry config(configParams, CFG_COUNT);
+
+//I2C DEVICES
+// Where each device answered last boot is kept in EEPROM after the config, so
+// a boot checks two addresses instead of scanning the whole bus.
+enum {
+  I2C_BME280,
+  I2C_DISPLAY,
+  I2C_COUNT
+};
+I2CDevice i2cDevices[I2C_COUNT] = {
+  // name       addresses, preferred first
+  { "BME280",   { 0x77, 0x76 } },
+  { "SSD1306",  { 0x3D, 0x3C } },
+};
+I2CDiscovery i2c(i2cDevices, I2C_COUNT, config.storageSize());
+
+// After setup() every exchange with a device goes through i2cBus, which gives
+// each its turn on the bus, times it, and frees the bus if a device is left
+// holding SDA low.
+enum {
+  BUS_DISCOVERY,
+  BUS_BME280,
+  BUS_DISPLAY,
+  BUS_COUNT
+};
+I2CBusDevice busDevices[BUS_COUNT] = {
+  // name          timeout ms
+  { "discovery",   250 },         // at boot; a full scan is 126 probes
+  { "bme280",      20 },          // two readings take under 1 ms at 400 kHz
+  { "display",     60 },          // a whole frame takes about 29 ms
+};
+I2CBus i2cBus(Wire, SDA, SCL, busDevices, BUS_COUNT);
+
+//WIFI
+// Joins with the credentials Device OS already has, without blocking setup().
+// Join times are kept across resets in retained RAM, and a hash of the
+// credentials last written in EEPROM after the I2C device map.
+retained JoinStats wifiJoinStats;
+WiFiBootstrap wifi(wifiJoinStats, config.storageSize() + i2c.storageSize());
+
+//BOOT TIMING
+// millis() at the end of each part of setup(), printed when setup() is done.
+enum {
+  BOOT_I2C,           // device discovery and BME280
+  BOOT_DISPLAY,       // OLED showing the splash screen
+  BOOT_SERIAL,        // waiting up to 10 s for a serial monitor
+  BOOT_STORAGE,       // config, history and telemetry queue
+  BOOT_WIFI,          // starting the join, which completes from loop()
+  BOOT_SENSORS,       // air quality sensor and its warm-up
+  BOOT_OUTPUTS,       // pump and NeoPixels
+  BOOT_PHASES
+};
+const char *const BOOT_PHASE_NAMES[BOOT_PHASES] = { "i2c", "display", "serial", "storage", "wifi", "sensors", "outputs" };
+unsigned long bootPhaseEnd[BOOT_PHASES];
+
+// Dose -> soak -> measure watering with hysteresis and a daily cap. The cap's
+// figures are kept across resets in retained RAM, so a watchdog reset does not
+// hand out a fresh day of pump time.
+retained IrrigationDay irrigationDay;
+IrrigationController irrigation(irrigationDay);
+
+//SENSOR HISTORY
+// Every reading taken in loop() goes into these; publishes send the mean over the
+// publish interval and a min/mean/max summary goes out every 15 minutes.
+TimeSeries tempSeries;
+TimeSeries humidSeries;
+TimeSeries moistureSeries;
+TimeSeries waterSeries;
+bool seriesOnWallTime;            // moved from uptime since the clock synced
+
+// Per-minute means kept in flash for weeks, for looking back after an outage.
+// Read a copy of /usr/history on a PC with tools/history_read.
+const char *const HISTORY_NAMES[] = { "tempF", "humidRH", "moisture", "water" };
+const float HISTORY_SCALES[] = { 100, 100, 1, 1 };
+HistoryLog history("/usr/history", 4, HISTORY_NAMES, HISTORY_SCALES, 16);
+
+//LOGGING
+// Messages from loop() and the control task are stored as compact records in
+// a RAM ring and written out by drainLog() only as fast as the USB port takes
+// them, so a slow or missing serial monitor never holds either up. Each category has its own
+// rate limit (LogEvents.cpp). Sending 'v' over Serial toggles TRACE records,
+// e.g. the air quality reading every 500 ms.
+uint8_t logRing[2048];
+EventLog eventLog(logRing, sizeof(logRing), LOG_EVENTS, LOG_EVENT_COUNT, LOG_CATEGORIES, LOG_CATEGORY_COUNT);
+
+// loop() and the control task both log, so adding and draining take turns.
+Mutex logLock;
+
+//CONTROL TASK
+// Sensing, watering, the display and the NeoPixels run in their own thread on
+// a fixed 100 ms tick, at a higher priority than loop(), so nothing the
+// network does (joining, reconnecting, a slow publish) holds up the pump or
+// the alerts. loop() is left with the cloud side: Serial, MQTT, publishing
+// and the flash history. Readings go to loop() as a SensorFrame every 500 ms
+// and commands (the water button) come back, through lock-free queues. The
+// settings the control task uses are copied out of the config registry by
+// loop() whenever they change and handed over as a Snapshot, so the control
+// task never reads the registry while an update rewrites it. Otherwise the
+// two only share the event log, which takes logLock, and the bus and profile
+// counters, which loop() only reads for the diagnostics.
+const uint16_t CONTROL_PERIOD_MS = 100;
+const uint8_t CONTROL_SENSE_TICK = 5;       // readings and alerts every 5th tick
+const uint8_t CONTROL_DISPLAY_TICK = 2;     // display refresh, between the readings
+const size_t CONTROL_STACK = 6144;
+
+enum {
+  CMD_REMOTE_WATER,               // Adafruit IO water button
+  CMD_PROFILE_RESET,              // start a new profile window
+};
+
+// Everything the control task takes from the config registry
+struct ControlConfig {
+  IrrigationConfig irrigation;
+  int32_t waterLow;               // CFG_WATER_LOW
+  int32_t waterHigh;              // CFG_WATER_HIGH
+  uint32_t waterAlertMs;          // CFG_WATER_ALERT_INTERVAL
+  uint32_t remotePumpMs;          // CFG_REMOTE_PUMP
+  uint8_t brightness;             // CFG_BRIGHTNESS
+};
+
+SpscQueue<SensorFrame, 8> sensorFrames;       // every frame, control task -> loop() for the history
+Snapshot<SensorFrame> sensorSnapshot;         // the newest frame, for any thread
+SpscQueue<uint8_t, 16> controlCommands;       // loop() -> control task
+Snapshot<ControlConfig> controlConfig;        // loop() -> control task, on every config change
+bool configUpdating;                          // onConfigMessage() shares the result itself
+Thread *controlThread;
+
+//WATCHDOG
+// The hardware watchdog resets the device unless it is refreshed every
+// WATCHDOG_TIMEOUT_MS, and the supervisor thread only refreshes it while
+// loop() and the control task both keep checking in within their deadlines.
+// The task behind a reset is kept in retained RAM and reported in the first
+// diagnostics after the device is back online.
+const uint32_t WATCHDOG_TIMEOUT_MS = 10000;
+const uint16_t SUPERVISOR_PERIOD_MS = 1000;
+const size_t SUPERVISOR_STACK = 1536;
+// The longest loop() may block in one pass is an MQTT connect attempt
+// (ConnectionManager makes at most one per pass). Adafruit_MQTT::connect()
+// waits for the TCP connect, whose DNS lookup and SYN retries Device OS gives
+// up on within about 30 s, then up to CONNECT_TIMEOUT_MS for the CONNACK and
+// three tries of SUBACK_TIMEOUT_MS for each subscription. The loop deadline
+// allows that plus the rest of a slow pass.
+const uint32_t TCP_CONNECT_WORST_MS = 30000;
+const uint32_t MQTT_CONNECT_WORST_MS = TCP_CONNECT_WORST_MS + CONNECT_TIMEOUT_MS +
+                                       MAXSUBSCRIPTIONS * 3 * SUBACK_TIMEOUT_MS;
+const uint32_t LOOP_DEADLINE_MS = MQTT_CONNECT_WORST_MS + 20000;
+
+enum {
+  TASK_LOOP,
+  TASK_CONTROL,
+  TASK_COUNT
+};
+SupervisedTask supervisedTasks[TASK_COUNT] = {
+  { "loop", LOOP_DEADLINE_MS },   // a blocking MQTT connect and then some
+  { "control", 2000 },            // 20 ticks
+};
+retained ResetLog resetLog;
+Supervisor supervisor(supervisedTasks, TASK_COUNT, resetLog);
+Thread *supervisorThread;
+bool bootReported;                // diagnostics sent since this boot
+
+//DIAGNOSTICS
+// Heap use and, with LOOP_PROFILE, the time spent in each part of loop() and
+// of the control task go to the hydropot-diagnostics feed every 15 minutes.
+// Sending 'p' over Serial prints both profiles for the current window.
+Adafruit_MQTT_Publish DIAGNOSTICS = Adafruit_MQTT_Publish(&mqtt, AIO_USERNAME "/feeds/hydropot-diagnostics");
+HeapMonitor heap;
+#if LOOP_PROFILE
+enum {
+  PROF_LOOP,          // all of loop()
+  PROF_SYSTEM,        // between passes of loop(): Device OS and the control task
+  PROF_MQTT,          // connection upkeep, reading and callbacks
+  PROF_PUBLISH,       // telemetry queue and publishes
+  PROF_FRAMES,        // readings from the control task: history and alert publishes
+  PROF_STATUS,        // status report into the event log
+  PROF_LOG,           // event log records written to Serial
+  PROF_COUNT
+};
+ProfileSection profileSections[PROF_COUNT] = {
+  { "loop" }, { "system" }, { "mqtt" }, { "publish" }, { "frames" }, { "status" }, { "log" },
+};
+LoopProfiler profiler(profileSections, PROF_COUNT);
+
+// Only the control task records here. loop() reads it for the diagnostics,
+// where a count torn by a tick in progress does no harm, and has it reset
+// with CMD_PROFILE_RESET.
+enum {
+  CTRL_TICK,          // all of one tick
+  CTRL_LATE,          // how long after its due time a tick started: the jitter
+  CTRL_BME,           // BME280 over I2C
+  CTRL_ANALOG,        // air quality, soil moisture and water level
+  CTRL_LEDS,          // NeoPixel SPI
+  CTRL_IRRIGATION,
+  CTRL_DISPLAY,       // OLED over I2C
+  CTRL_COUNT
+};
+ProfileSection controlSections[CTRL_COUNT] = {
+  { "control" }, { "late" }, { "bme" }, { "analog" }, { "leds" }, { "irrigation" }, { "display" },
+};
+LoopProfiler controlProfiler(controlSections, CTRL_COUNT);
+unsigned long profileWindowStart;
+#endif
 
 int buttonState;
 unsigned long publishTime;
-void MQTT_connect();
-bool MQTT_ping();
 int readWaterLevelSensor();
-void setupWiFi();
-
-// Function to scan for I2C devices
-void scanI2C() {
-  Serial.println("Scanning for I2C devices...");
-  byte error, address;
-  int nDevices = 0;
-  
-  for(address = 1; address < 127; address++) {
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-    
-    if (error == 0) {
-      Serial.printf("I2C device found at address 0x%02X\n", address);
-      nDevices++;
-    }
-  }
-  
-  if (nDevices == 0) {
-    Serial.println("No I2C devices found");
-  } else {
-    Serial.printf("Found %d I2C device(s)\n", nDevices);
-  }
-  Serial.println();
-}
+bool publishSample(const TelemetrySample &sample);
+bool publishFrame(const TelemetryFrameWriter &frame);
+void onWaterButton(int state);
+void onConfigMessage(char *data, uint16_t len);
+void onConfigChanged(uint8_t id);
+bool validateConfig();
+IrrigationConfig irrigationConfig();
+void shareControlConfig();
+void checkControlConfig();
+uint32_t seriesTime(uint32_t ms);
+float intervalMean(TimeSeries &series, float latest);
+void publishSummary();
+void recordHistory();
+void remoteWater();
+void controlTask(void *param);
+void supervisorTask(void *param);
+void runCommand(uint8_t command);
+void checkPotButton();
+void readSensors();
+void startAlerts(uint32_t nowMs);
+void updateOutputs();
+void showPixels();
+void refreshDisplay();
+bool findDevices(void *context);
+bool readBme(void *context);
+bool sendDisplay(void *context);
+void checkBus(uint8_t device, I2CResult result);
+void sendFrame();
+void recordFrame(const SensorFrame &frame);
+void sampleHeap();
+void publishDiagnostics();
+void checkWiFi();
+void logEvent(uint8_t event, ...);
+void drainLog();
+void printBootTimes();
+#if LOOP_PROFILE
+void printProfile();
+#endif
+#if SENSOR_TRACE
+void traceSensors(int air, int moisture, int water);
+#endif
 
+// Everything from here to the NeoPixels belongs to the control task once
+// setup() is done; other threads see the readings through sensorFrames and
+// sensorSnapshot.
 int soilMoist= A1;  
 int moistureReads;
 
@@ -80,23 +421,28 @@ const int sensorPower = D3;
 int sensorValue = 0;
 float waterLevelPercentage;
 
-String dateTime, timeOnly;
+// Formatted once a second into fixed buffers, not Strings, so loop() does not churn the heap.
+// The status report and the display each have their own, as they run in different threads.
+ClockText clockText;
+ClockText displayClock;
 unsigned int lastTime;
 unsigned int lastPublish;
 
 Adafruit_BME280 bme;
 bool status;
-const int hexAddress = 0x77; // Try 0x77 if 0x76 doesn't work
+int hexAddress = 0x77; // Found at boot, see i2cDevices
 unsigned int currentTime;
 unsigned int lastSecond;
 float tempC;
 float tempF;
 float humidRH;
+bool bmeOk;
 const byte PERCENT = 37;
 const byte DEGREE  = 167;
 
 AirQualitySensor sensor (A0);  
-int quality;
+int quality = -1;
+int airValue;
 
 #define SCREEN_WIDTH  128
 #define SCREEN_HEIGHT 32
@@ -104,23 +450,74 @@ int quality;
 Adafruit_SSD1306 display(OLED_RESET);
 
 const int WATER_PUMP = D16;
+
+// The control task's copy of controlConfig, and the version it came from
+ControlConfig settings;
+uint32_t settingsVersion;
+
+//POT BUTTON
+// A push button on the pot, from D19 (S4) to ground. D19 is a plain GPIO:
+// D2-D5 are SPI1, which drives the NeoPixels, and D0/D1 are I2C. Presses are
+// queued by an interrupt and handled on the next control tick: a click waters
+// as the Adafruit IO button does, a long press stops the pump. A click only
+// counts once the 300 ms double-click window has passed without a second
+// press, so the pump starts 300-400 ms after the button is let go.
+const int POT_BUTTON = D19;
+InterruptButton potButton(POT_BUTTON, true);
+const char *const BUTTON_EVENT_NAMES[] = { "none", "click", "double click", "long press" };
 unsigned int currentTimeWater;
 unsigned int lastSecondWater;
 
 //NEOPIXEL
 const int PIXELCOUNT = 12;
-int brightness = 50;
-int i;
-int j;
+#if STATIC_ALLOCATION
+Adafruit_NeoPixelStatic<PIXELCOUNT, WS2812B> pixel(SPI1);
+#else
 Adafruit_NeoPixel pixel(PIXELCOUNT, SPI1, WS2812B);
+#endif
+// Alert patterns, stepped once per control tick
+PixelAnimation pixelAlerts(PIXELCOUNT);
 
 //WATER LEVEL ALERT TIMING
 unsigned long lastWaterAlert = 0;
-const unsigned long WATER_ALERT_INTERVAL = 300000; // 5 minutes in milliseconds
+
+// The alerts last sent to Adafruit IO by loop(), which sends each only when it changes
+const char *airPublished = NULL;
+bool waterLowPublished = false;
+// And the states last logged, so an alert is logged when it starts, not on every frame
+int airLogged = -2;               // frame.quality; -1 is unknown, -2 nothing logged yet
+int8_t waterLogged = 0;           // -1 low, 1 high, 0 in between
 
 void setup() {
   Serial.begin(9600);
+
+  // The display comes up first, before waiting for a serial monitor or WiFi.
+  // Both devices take 400 kHz; at 100 kHz redrawing the display (about 1 KB)
+  // would take longer than a control tick. A device still holding the bus
+  // from before the reset is clocked out first, or discovery would find
+  // nothing and save that.
+  i2cBus.begin(CLOCK_SPEED_400KHZ);
+  i2cBus.run(BUS_DISCOVERY, findDevices);
+  if (i2cBus.recoveries()) {
+    Serial.println("I2C bus was held low at boot, clocked out");
+  }
+  if (i2c.found(I2C_BME280)) {
+    hexAddress = i2c.address(I2C_BME280);
+  }
+  status = bme.begin (hexAddress); 
+  bootPhaseEnd[BOOT_I2C] = millis();
+
+  display.begin(SSD1306_SWITCHCAPVCC, i2c.found(I2C_DISPLAY) ? i2c.address(I2C_DISPLAY) : 0x3D);
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setTextColor(WHITE);
+  display.setCursor(0,0);
+  display.printf("My Hydro Flower\nStarting...");
+  display.display();
+  bootPhaseEnd[BOOT_DISPLAY] = millis();
+
   waitFor(Serial.isConnected,10000);
+  bootPhaseEnd[BOOT_SERIAL] = millis();
 
   // Print device information
   Serial.println("=== HYDROPOT DEVICE INFO ===");
@@ -128,19 +525,33 @@ void setup() {
   Serial.printf("Free Memory: %lu bytes\n", System.freeMemory());
   Serial.println("============================");
 
-  setupWiFi();
+  config.begin();
+  config.setChangeCallback(onConfigChanged);
+  config.setValidateCallback(validateConfig);
+  shareControlConfig();
+
+  if (!history.begin()) {
+    Serial.println("Sensor history unavailable");
+  }
+
+  telemetryQueue.setDrainInterval(TelemetryQueue::drainIntervalFor(BACKLOG_SAMPLE_PUBLISHES, BACKLOG_PUBLISHES_PER_MINUTE));
+  if (!telemetryQueue.begin()) {
+    Serial.println("Telemetry queue unavailable - samples will only be published while online");
+  }
+  bootPhaseEnd[BOOT_STORAGE] = millis();
+
+  wifi.begin(WIFI_SSID, WIFI_PASSWORD, millis());
+  bootPhaseEnd[BOOT_WIFI] = millis();
   
+  WaterButton.setCallback(onWaterButton);
   mqtt.subscribe(&WaterButton);
+  CONFIG.setCallback(onConfigMessage);
+  mqtt.subscribe(&CONFIG);
   Time.zone(-7);
 
   pinMode(sensorPower, OUTPUT);
   digitalWrite(sensorPower, LOW);  
 
-  // Scan for I2C devices first
-  Wire.begin();
-  scanI2C();
-
-  status = bme.begin (hexAddress); 
   if (status== false){
     Serial.printf("BME280 at address 0x%02x failed to start\n", hexAddress);
     Serial.println("Could be a wiring problem, or try the other I2C address!");
@@ -159,298 +570,966 @@ void setup() {
       Serial.println("Check wiring on pin A0");
   }
   
-  // Give the air quality sensor some time to stabilize
+  // Give the air quality sensor some time to stabilize; WiFi joins meanwhile
   Serial.println("Air quality sensor warming up for 20 seconds...");
-  delay(20000); // Wait 20 seconds for sensor to warm up
+  unsigned long warmupStart = millis();
+  while (millis() - warmupStart < 20000) {
+    checkWiFi();
+    delay(100);
+  }
   Serial.println("Air quality sensor warm-up complete.");
-  
-  display.begin(SSD1306_SWITCHCAPVCC, 0x3D);
-  display.clearDisplay();
+  bootPhaseEnd[BOOT_SENSORS] = millis();
 
   pinMode (WATER_PUMP, OUTPUT);
+  potButton.begin();
 
   //NEOPIXELS
   pixel.begin();
-  pixel.setBrightness(brightness);
+  pixel.setBrightness(config.getInt(CFG_BRIGHTNESS));
   pixel.show();
   pixel.clear();
   pixel.show();
+  bootPhaseEnd[BOOT_OUTPUTS] = millis();
+  printBootTimes();
+
+  supervisor.begin(millis(), System.resetReason() == RESET_REASON_WATCHDOG);
+  if (supervisor.watchdogReset()) {
+    Serial.printf("Watchdog reset: %s was %lu ms overdue\n", supervisor.taskName(supervisor.resetTask()),
+                  (unsigned long)resetLog.lastOverdueMs);
+  }
+
+  // From here on the control task owns the sensors, pump, display and pixels
+  controlThread = new Thread("control", controlTask, NULL, OS_THREAD_PRIORITY_DEFAULT + 1, CONTROL_STACK);
+
+  Watchdog.init(WatchdogConfiguration().timeout(WATCHDOG_TIMEOUT_MS));
+  Watchdog.start();
+  supervisorThread = new Thread("supervisor", supervisorTask, NULL, OS_THREAD_PRIORITY_DEFAULT + 2, SUPERVISOR_STACK);
+
+  // Everything allocated in setup() is in place; from here the heap should stay flat
+  sampleHeap();
+  heap.setBaseline();
 }
 
+// The network side: Serial, MQTT and publishing. However long any of it
+// takes, the control task keeps its own time.
 void loop() {
-  MQTT_connect();
-  MQTT_ping();
- 
-   Adafruit_MQTT_Subscribe *subscription;
-   while ((subscription = mqtt.readSubscription(1000))) {
-     if (subscription == &WaterButton) {
-       buttonState = atof((char *)WaterButton.lastread);
-       Serial.printf("Button State: %d\n", buttonState);
- 
-       if (buttonState==1){
-         if (waterLevelPercentage > 30) {
-           Serial.printf("Remote water pump activation! Water level OK (%.1f%%)\n", waterLevelPercentage);
-           digitalWrite(WATER_PUMP, HIGH);
-           // Turn all pixels blue when pump is on
-           for(i = 0; i < PIXELCOUNT; i++) {
-             pixel.setPixelColor(i, 0x0000FF); // blue
-           }
-           pixel.show();
-           delay(3000); 
-           digitalWrite(WATER_PUMP, LOW);
-           // Turn all pixels off when pump is off
-           for(i = 0; i < PIXELCOUNT; i++) {
-             pixel.setPixelColor(i, 0x000000); // off
-           }
-           pixel.show();
-           Serial.printf("Remote pump OFF\n");
-         }
-         else {
-           Serial.printf("Remote pump activation BLOCKED - water level too low (%.1f%%)\n", waterLevelPercentage);
-           // Flash red to indicate blocked action
-           for(int flash = 0; flash < 3; flash++) {
-             for(i = 0; i < PIXELCOUNT; i++) {
-               pixel.setPixelColor(i, 0xFF0000); // red
-             }
-             pixel.show();
-             delay(300);
-             for(i = 0; i < PIXELCOUNT; i++) {
-               pixel.setPixelColor(i, 0x000000); // off
-             }
-             pixel.show();
-             delay(300);
-           }
-         }
-       }
-     }
+  SensorFrame frame;
+  SensorFrame latest;
+
+  PROFILE_STOP(profiler, PROF_SYSTEM);
+  PROFILE_START(profiler, PROF_LOOP);
+  if (Serial.available()) {
+    int command = Serial.read();
+#if LOOP_PROFILE
+    if (command == 'p') {
+      printProfile();
     }
+#endif
+    if (command == 'v') {
+      eventLog.setLevel(eventLog.level() == EVENT_TRACE ? EVENT_INFO : EVENT_TRACE);
+    }
+  }
+  drainLog();
 
-    if(millis()-lastPublish > 30000) { 
+  PROFILE_START(profiler, PROF_MQTT);
+  checkWiFi();
+  mqttConnection.loop();
+ 
+  // Decode whatever has arrived and run the subscription callbacks; never waits
+  if (mqttConnection.connected()) {
+    mqtt.poll();
+  }
+  PROFILE_STOP(profiler, PROF_MQTT);
+
+  // The reset cause and counts go out as soon as there is somewhere to send them
+  if (!bootReported && mqttConnection.connected()) {
+    bootReported = true;
+    publishDiagnostics();
+  }
+
+  PROFILE_START(profiler, PROF_FRAMES);
+  while (sensorFrames.pop(frame)) {
+    recordFrame(frame);
+  }
+  PROFILE_STOP(profiler, PROF_FRAMES);
+
+  PROFILE_START(profiler, PROF_PUBLISH);
+    if(millis()-lastPublish > (unsigned long)config.getInt(CFG_PUBLISH_INTERVAL) && sensorSnapshot.read(latest)) { 
       lastPublish=millis();
-    if (mqtt.Update()) {
-      Serial.println("Publishing sensor data...");
-      TEMP.publish (tempF);
-      HUMIDITY.publish (humidRH);
-      MOISTURE.publish (moistureReads);
-      WATERLEVEL.publish (waterLevelPercentage);
+      TelemetrySample sample;
+      sample.timestamp = Time.isValid() ? Time.now() : 0;
+      sample.tempF = intervalMean(tempSeries, latest.tempF);
+      sample.humidRH = intervalMean(humidSeries, latest.humidRH);
+      sample.moisture = intervalMean(moistureSeries, latest.moisture);
+      sample.waterLevel = intervalMean(waterSeries, latest.waterLevel);
+      sample.airQuality = latest.quality;
+      // Straight out when nothing is queued ahead of it, so the queue (and
+      // the flash) is only written while the broker can't be reached
+      bool sent = false;
+      if (mqttConnection.connected() && telemetryQueue.isEmpty()) {
+#if TELEMETRY_BINARY
+        telemetryFrame.clear();
+        sent = telemetryFrame.add(sample) && publishFrame(telemetryFrame);
+#else
+        sent = publishSample(sample);
+#endif
+      }
+      if (!sent) {
+        telemetryQueue.push(sample);
+      }
+  }
+
+#if TELEMETRY_BINARY
+  if (mqttConnection.connected() && telemetryQueue.drainFrame(telemetryFrame, publishFrame) > 0) {
+#else
+  if (mqttConnection.connected() && telemetryQueue.drain(publishSample, 1) > 0) {
+#endif
+    logEvent(EV_QUEUE_DRAINED, telemetryQueue.size(), (unsigned long)telemetryQueue.dropped());
+  }
+  PROFILE_STOP(profiler, PROF_PUBLISH);
+
+if(millis()-lastTime>1200 && sensorSnapshot.read(latest)) {
+  PROFILE_START(profiler, PROF_STATUS);
+  lastTime = millis();
+  sampleHeap();
+  clockText.update(Time.local());
+  
+  logEvent(EV_TIME, clockText.time());
+  logEvent(EV_MOISTURE, latest.moisture);
+  logEvent(EV_WATER_LEVEL, latest.water, latest.waterLevel);
+  logEvent(EV_TEMPERATURE, latest.tempF, DEGREE, latest.tempC, DEGREE);
+  logEvent(EV_HUMIDITY, latest.humidRH, PERCENT);
+  logEvent(EV_BME_STATUS, latest.bmeOk ? "OK" : "FAILED");
+  const ConnectionStats &conn = mqttConnection.stats();
+  logEvent(EV_MQTT_STATUS, mqttConnection.stateName(), (unsigned long)conn.attempts, (unsigned long)conn.failures,
+           (unsigned long)conn.disconnects, (unsigned long)mqttConnection.retryIn());
+  SeriesStats recentTemp = tempSeries.current(SERIES_QUARTER);
+  SeriesStats recentMoisture = moistureSeries.current(SERIES_QUARTER);
+  logEvent(EV_RECENT, recentTemp.min, recentTemp.mean(), recentTemp.max, recentMoisture.min, recentMoisture.mean(),
+           recentMoisture.max);
+  logEvent(EV_IRRIGATION_STATUS, latest.irrigationState, (unsigned long)latest.pumpMsToday,
+           (unsigned long)latest.dailyCapMs, (unsigned long)latest.doses,
+           (unsigned long)latest.skippedLowWater, (unsigned long)latest.skippedCap);
+  logEvent(EV_HEAP, (unsigned long)heap.freeBytes(), (unsigned long)heap.minFree(), (unsigned long)heap.largestBlock(),
+           heap.fragmentation(), (long)heap.drift());
+  logEvent(EV_DATE_TIME, clockText.dateTime());
+  logEvent(EV_AIR_VALUE, latest.airValue);
+  PROFILE_STOP(profiler, PROF_STATUS);
+}
+
+drainLog();
+supervisor.checkIn(TASK_LOOP, millis());
+
+PROFILE_STOP(profiler, PROF_LOOP);
+PROFILE_START(profiler, PROF_SYSTEM);
+} // End of loop() function
+
+// Readings from the control task, oldest first: into the sensor history, and
+// the alerts out to Adafruit IO. The lights for them are the control task's.
+void recordFrame(const SensorFrame &frame) {
+  // When the reading was taken, which may be a few frames back
+  uint32_t t = seriesTime(frame.ms);
+
+  if (!seriesOnWallTime && Time.isValid()) {
+    // The clock has just synced: what was recorded on uptime moves to wall
+    // time, so open windows do not close with uptime starts
+    uint32_t offset = Time.now() - millis() / 1000;
+    tempSeries.rebase(offset);
+    humidSeries.rebase(offset);
+    waterSeries.rebase(offset);
+    moistureSeries.rebase(offset);
+    seriesOnWallTime = true;
+  }
+
+  if (frame.bmeOk) {
+    tempSeries.add(t, frame.tempF);
+    humidSeries.add(t, frame.humidRH);
+  }
+  waterSeries.add(t, frame.waterLevel);
+  uint8_t closedWindows = moistureSeries.add(t, frame.moisture);
+  if (closedWindows & (1 << SERIES_MINUTE)) {
+    recordHistory();
+  }
+  if (closedWindows & (1 << SERIES_QUARTER)) {
+    publishSummary();
+    publishDiagnostics();
+  }
+
+  const char *air = NULL;
+  const char *airFeed = NULL;
+  if (frame.quality == AirQualitySensor::FORCE_SIGNAL) {
+    air = "High pollution!";
+    airFeed = "High pollution! ";
+  }
+  else if (frame.quality == AirQualitySensor::HIGH_POLLUTION) {
+    air = airFeed = "High pollution!";
+  }
+  else if (frame.quality == AirQualitySensor::LOW_POLLUTION) {
+    air = airFeed = "Low pollution!";
+  }
+  else if (frame.quality == AirQualitySensor::FRESH_AIR) {
+    air = "Fresh air.";
+    airFeed = "Fresh air";
+  }
+  bool airChanged = frame.quality != airLogged;
+  airLogged = frame.quality;
+  if (air) {
+    if (airChanged) {
+      logEvent(EV_AIR_ALERT, air);
     }
+    // A new state only: a frame every 500 ms is far over Adafruit IO's rate limit
+    if (airFeed != airPublished && mqttConnection.connected() && AIRQUALITY.publish(airFeed)) {
+      airPublished = airFeed;
+    }
+  }
+  else if (airChanged) {
+    // Debug: Unknown air quality state
+    logEvent(EV_AIR_UNKNOWN, frame.quality, frame.airValue);
   }
 
-  dateTime = Time.timeStr ();
-  timeOnly = dateTime. substring (11,19);
+  int8_t water = 0;
+  if (frame.waterLevel < config.getInt(CFG_WATER_LOW)) {
+    water = -1;
+    if (!waterLowPublished && mqttConnection.connected()) {
+      waterLowPublished = WATERLEVEL.publish("Low water level!");
+    }
+  }
+  else {
+    waterLowPublished = false;
+    if (frame.waterLevel > config.getInt(CFG_WATER_HIGH)) {
+      water = 1;
+    }
+  }
+  if (water != waterLogged) {
+    waterLogged = water;
+    if (water < 0) {
+      logEvent(EV_WATER_LOW);
+    }
+    else if (water > 0) {
+      logEvent(EV_WATER_HIGH);
+    }
+  }
+}
 
-  tempC = bme.readTemperature();
-  humidRH = bme.readHumidity();
+// The control task: one tick every CONTROL_PERIOD_MS for as long as the
+// device runs. A tick only ever waits on its own I2C and SPI transfers.
+void controlTask(void *param) {
+  system_tick_t wake = millis();
+  uint32_t dueUs = micros();
+  int32_t lateUs;
+  uint32_t tick = 0;
+  uint8_t command;
+
+  for (;;) {
+    // Ticks wake on the 1 ms system tick, so one may start up to 1 ms before
+    // dueUs; that counts as on time.
+    lateUs = (int32_t)(micros() - dueUs);
+    if (lateUs < 0) {
+      lateUs = 0;
+    }
+    if (lateUs >= CONTROL_PERIOD_MS * 1000L) {
+      // A whole tick behind, e.g. after a stuck I2C transfer: start the
+      // schedule again from now rather than run the missed ticks back to back.
+      logEvent(EV_CONTROL_LATE, (unsigned long)(lateUs / 1000));
+      wake = millis();
+      dueUs = micros();
+    }
+#if LOOP_PROFILE
+    controlProfiler.record(CTRL_LATE, lateUs);
+#endif
+    PROFILE_START(controlProfiler, CTRL_TICK);
+    checkControlConfig();
+    while (controlCommands.pop(command)) {
+      runCommand(command);
+    }
+    checkPotButton();
+    if (tick % CONTROL_SENSE_TICK == 0) {
+      readSensors();
+      startAlerts(millis());
+    }
+    updateOutputs();
+    if (tick % CONTROL_SENSE_TICK == 0) {
+      sendFrame();
+    }
+    else if (tick % CONTROL_SENSE_TICK == CONTROL_DISPLAY_TICK) {
+      refreshDisplay();
+    }
+    PROFILE_STOP(controlProfiler, CTRL_TICK);
+    supervisor.checkIn(TASK_CONTROL, millis());
+    tick++;
+    dueUs += CONTROL_PERIOD_MS * 1000UL;
+    os_thread_delay_until(&wake, CONTROL_PERIOD_MS);
+  }
+}
+
+// Refreshes the watchdog once a second while every task is on time. Runs
+// above the control task so a busy tick cannot hold it up, and takes no
+// locks: a task stuck holding one must not stop the check.
+void supervisorTask(void *param) {
+  system_tick_t wake = millis();
+
+  for (;;) {
+    if (supervisor.check(millis())) {
+      Watchdog.refresh();
+    }
+    os_thread_delay_until(&wake, SUPERVISOR_PERIOD_MS);
+  }
+}
+
+void runCommand(uint8_t command) {
+  if (command == CMD_REMOTE_WATER) {
+    remoteWater();
+  }
+#if LOOP_PROFILE
+  else if (command == CMD_PROFILE_RESET) {
+    controlProfiler.reset();
+  }
+#endif
+}
+
+void checkPotButton() {
+  ButtonEvent event;
+
+  while ((event = potButton.read()) != BUTTON_NONE) {
+    logEvent(EV_POT_BUTTON, BUTTON_EVENT_NAMES[event]);
+    if (event == BUTTON_CLICK) {
+      remoteWater();
+    }
+    else if (event == BUTTON_LONG_PRESS && irrigation.cancelDose(millis())) {
+      logEvent(EV_PUMP_OFF, (unsigned long)irrigation.pumpMsToday(), (unsigned long)irrigation.config().dailyCapMs);
+    }
+  }
+}
+
+void readSensors() {
+  PROFILE_START(controlProfiler, CTRL_BME);
+  I2CResult result = i2cBus.run(BUS_BME280, readBme);
+  PROFILE_STOP(controlProfiler, CTRL_BME);
+  checkBus(BUS_BME280, result);
   tempF = (tempC*9/5)+32;
 
-  // Check if BME280 readings are valid
-  if (isnan(tempC) || isnan(humidRH)) {
-    Serial.println("Failed to read from BME280 sensor!");
+  // Readings from a transaction that timed out are not to be trusted either
+  bmeOk = result == I2C_OK;
+  if (!bmeOk) {
+    logEvent(EV_BME_FAILED);
     tempC = 0.0;
     humidRH = 0.0;
     tempF = 32.0; // Freezing point as default
   }
 
-  int quality = sensor.slope();
+  PROFILE_START(controlProfiler, CTRL_ANALOG);
+  quality = sensor.slope();
 
   // Debug air quality sensor
-  int airValue = sensor.getValue();
-  Serial.printf("Air Quality Raw Value: %i, Quality Level: %i\n", airValue, quality);
+  airValue = sensor.getValue();
+  logEvent(EV_AIR_READING, airValue, quality);
 
   moistureReads = analogRead(soilMoist);
 
   sensorValue = readWaterLevelSensor();
   waterLevelPercentage = map(sensorValue, 0, 520, 0, 100);
+  PROFILE_STOP(controlProfiler, CTRL_ANALOG);
+#if SENSOR_TRACE
+  traceSensors(airValue, moistureReads, sensorValue);
+#endif
+}
 
+// Lights for the latest readings. A sweep in the air quality colour starts
+// whenever nothing else is showing, except while the pump runs so its blue
+// stays on; the water level flash comes every CFG_WATER_ALERT_INTERVAL and
+// cuts in over a sweep.
+void startAlerts(uint32_t nowMs) {
+  uint32_t air = 0;
 
-if(millis()-lastTime>1200) {
-  lastTime = millis();
-  
-  Serial.printf("Time is %s\n",timeOnly.c_str());
-  Serial.printf("Moisture is %i\n", moistureReads);
-  Serial.printf("Water Level: %i (%.1f%%)\n", sensorValue, waterLevelPercentage);
-  Serial.printf("Temp: %.2f%c (%.2f%cC)\n", tempF,DEGREE, tempC,DEGREE); 
-  Serial.printf("Humi: %.2f%c\n",humidRH,PERCENT);
-  Serial.printf("BME280 Status: %s\n", status ? "OK" : "FAILED");
-  Serial.printf("Date and Time is %s\n",dateTime.c_str());
-  Serial.print("Sensor value: ");
-  Serial.println(sensor.getValue());
-}
-
-if (quality == AirQualitySensor::FORCE_SIGNAL) {
-  Serial.println("High pollution!");
-  AIRQUALITY.publish("High pollution! ");
-  for(i=0;i<PIXELCOUNT;i++){
-    pixel.setPixelColor(i,0xFF0000); // red
-    pixel.show();
-    delay(50);
+  if (quality == AirQualitySensor::FORCE_SIGNAL) {
+    air = 0xFF0000; // red
+  }
+  else if (quality == AirQualitySensor::HIGH_POLLUTION) {
+    air = 0xFF8000; // orange
+  }
+  else if (quality == AirQualitySensor::LOW_POLLUTION) {
+    air = 0xFFFF00; // yellow
+  }
+  else if (quality == AirQualitySensor::FRESH_AIR) {
+    air = 0x00FF00; // green
+  }
+
+  bool low = waterLevelPercentage < settings.waterLow;
+  bool high = waterLevelPercentage > settings.waterHigh;
+  if ((low || high) && nowMs - lastWaterAlert > settings.waterAlertMs) {
+    lastWaterAlert = nowMs;
+    // Yellow 10 times for low water, green 5 times for high
+    pixelAlerts.flash(low ? 0xFFFF00 : 0x00FF00, low ? 10 : 5, 200, nowMs);
+  }
+  else if (air && !pixelAlerts.busy() && !irrigation.dosing()) {
+    pixelAlerts.sweep(air, CONTROL_PERIOD_MS, nowMs);
   }
-  pixel.show();
-  pixel.clear(); 
-  pixel.show(); 
 }
-else if (quality == AirQualitySensor::HIGH_POLLUTION) {
-  Serial.println("High pollution!");
-  AIRQUALITY.publish("High pollution!");
-  for(i=0;i<PIXELCOUNT;i++){
-    pixel.setPixelColor(i,0xFF8000); // orange
-    pixel.show();
-    delay(50);
+
+// Watering: the controller starts a cycle when the soil reads dry (low reading =
+// dry soil), doses, lets it soak in and measures again until it reads wet.
+// The pump is switched on the tick the controller decides, then the pixels
+// move on a step.
+void updateOutputs() {
+  PROFILE_START(controlProfiler, CTRL_IRRIGATION);
+  bool wasDosing = irrigation.dosing();
+  irrigation.update(millis(), moistureReads, waterLevelPercentage);
+  digitalWrite(WATER_PUMP, irrigation.pumpOn() ? HIGH : LOW);
+  if (irrigation.dosing() && !wasDosing) {
+    logEvent(EV_PUMP_ON, moistureReads, (unsigned long)irrigation.lastDoseMs(),
+             irrigation.config().dryRun ? " (dry run)" : "");
+  }
+  else if (!irrigation.dosing() && wasDosing) {
+    logEvent(EV_PUMP_OFF, (unsigned long)irrigation.pumpMsToday(), (unsigned long)irrigation.config().dailyCapMs);
+  }
+  PROFILE_STOP(controlProfiler, CTRL_IRRIGATION);
+
+  // All pixels blue while the pump is on, between the alert patterns
+  pixelAlerts.setIdle(irrigation.dosing() ? 0x0000FF : 0x000000);
+  if (pixelAlerts.update(millis())) {
+    showPixels();
   }
-  pixel.show();
-  pixel.clear();  
-  pixel.show();
 }
-else if (quality == AirQualitySensor::LOW_POLLUTION) {
-  Serial.println("Low pollution!");
-  AIRQUALITY.publish("Low pollution!");
-  for(i=0;i<PIXELCOUNT;i++){
-    pixel.setPixelColor(i,0xFFFF00); // yellow
-    pixel.show();
-    delay(50);
+
+void showPixels() {
+  PROFILE_START(controlProfiler, CTRL_LEDS);
+  for (uint8_t p = 0; p < PIXELCOUNT; p++) {
+    pixel.setPixelColor(p, pixelAlerts.color(p));
   }
   pixel.show();
-  pixel.clear();
-  pixel.show(); 
+  PROFILE_STOP(controlProfiler, CTRL_LEDS);
+}
+
+void refreshDisplay() {
+  displayClock.update(Time.local());
+
+  PROFILE_START(controlProfiler, CTRL_DISPLAY);
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setTextColor(WHITE);
+  display.setCursor(0,0);
+  display.printf("Time: %s\n",displayClock.time());
+  display.setCursor(0,8);
+  display.printf("Temp: %.1f%c Hum: %.1f%c\n",tempF,DEGREE,humidRH,PERCENT);
+  display.setCursor(0,24);
+  display.printf("Moisture: %i\n", moistureReads);
+  display.setCursor(0,16);
+
+  display.printf("My Hydro Flower");
+  checkBus(BUS_DISPLAY, i2cBus.run(BUS_DISPLAY, sendDisplay));
+  PROFILE_STOP(controlProfiler, CTRL_DISPLAY);
+}
+
+// I2C transactions, run by i2cBus with the bus held.
+bool findDevices(void *context) {
+  return i2c.begin();
+}
+
+bool readBme(void *context) {
+  tempC = bme.readTemperature();
+  humidRH = bme.readHumidity();
+  return !isnan(tempC) && !isnan(humidRH);
 }
-else if (quality == AirQualitySensor::FRESH_AIR) {
-  Serial.println("Fresh air."); 
-  AIRQUALITY.publish("Fresh air");
-  for(i=0;i<PIXELCOUNT;i++){
-    pixel.setPixelColor(i,0x00FF00); // green
-    pixel.show();
-    delay(50);
+
+bool sendDisplay(void *context) {
+  display.display();
+  return true;
+}
+
+// A transaction that overran has already had the bus recovered; log it.
+void checkBus(uint8_t device, I2CResult result) {
+  const I2CBusDevice &d = i2cBus.device(device);
+
+  if (result == I2C_TIMEOUT) {
+    logEvent(EV_I2C_TIMEOUT, d.name, (unsigned long)(d.lastUs / 1000));
+  }
+  else if (result == I2C_STUCK) {
+    logEvent(EV_I2C_STUCK, d.name, (unsigned long)(d.lastUs / 1000));
   }
-  pixel.show();
-  pixel.clear();
-  pixel.show();
 }
-else {
-  // Debug: Unknown air quality state
-  Serial.printf("Unknown air quality state: %i (Raw value: %i)\n", quality, sensor.getValue());
-} 
 
-if (waterLevelPercentage < 30) {
-  Serial.println("Low water level!");
-  WATERLEVEL.publish("Low water level!");
-  
-  // Flash yellow 10 times every 5 minutes for low water
-  if (millis() - lastWaterAlert > WATER_ALERT_INTERVAL) {
-    lastWaterAlert = millis();
-    for(int flash = 0; flash < 10; flash++) {
-      // Turn all pixels yellow
-      for(i = 0; i < PIXELCOUNT; i++) {
-        pixel.setPixelColor(i, 0xFFFF00); // yellow
-      }
-      pixel.show();
-      delay(200);
-      
-      // Turn all pixels off
-      for(i = 0; i < PIXELCOUNT; i++) {
-        pixel.setPixelColor(i, 0x000000); // off
-      }
-      pixel.show();
-      delay(200);
-    }
+// Hand the readings just taken to loop(). If it has fallen 8 frames behind
+// they miss the history (counted in the diagnostics), but the snapshot is
+// always current; the tick goes on regardless.
+void sendFrame() {
+  SensorFrame frame;
+  const IrrigationStats &water = irrigation.stats();
+
+  frame.ms = millis();
+  frame.tempC = tempC;
+  frame.tempF = tempF;
+  frame.humidRH = humidRH;
+  frame.bmeOk = bmeOk;
+  frame.airValue = airValue;
+  frame.quality = quality;
+  frame.moisture = moistureReads;
+  frame.water = sensorValue;
+  frame.waterLevel = waterLevelPercentage;
+  frame.irrigationState = irrigation.stateName();
+  frame.pumpMsToday = irrigation.pumpMsToday();
+  frame.dailyCapMs = irrigation.config().dailyCapMs;
+  frame.doses = water.doses;
+  frame.skippedLowWater = water.skippedLowWater;
+  frame.skippedCap = water.skippedCap;
+  sensorSnapshot.write(frame);
+  sensorFrames.push(frame);
+}
+
+// Adafruit IO water button. Runs from mqtt.poll() in loop() as soon as the
+// message is decoded; the control task runs the pump on its next tick.
+void onWaterButton(int state) {
+  buttonState = state;
+  logEvent(EV_WATER_BUTTON, buttonState);
+  if (buttonState == 1) {
+    controlCommands.push(CMD_REMOTE_WATER);
   }
 }
-else if (waterLevelPercentage > 80) {
-  Serial.println("High water level!");
-  
-  // Flash green 5 times every 5 minutes for high water
-  if (millis() - lastWaterAlert > WATER_ALERT_INTERVAL) {
-    lastWaterAlert = millis();
-    for(int flash = 0; flash < 5; flash++) {
-      // Turn all pixels green
-      for(i = 0; i < PIXELCOUNT; i++) {
-        pixel.setPixelColor(i, 0x00FF00); // green
-      }
-      pixel.show();
-      delay(200);
-      
-      // Turn all pixels off
-      for(i = 0; i < PIXELCOUNT; i++) {
-        pixel.setPixelColor(i, 0x000000); // off
-      }
-      pixel.show();
-      delay(200);
-    }
+
+// Runs the pump through the irrigation controller, which switches it off
+// again on a later tick when the dose is done. Control task only.
+void remoteWater() {
+  if (irrigation.dosing()) {
+    logEvent(EV_REMOTE_BUSY);
+  }
+  else if (irrigation.requestDose(millis(), settings.remotePumpMs, waterLevelPercentage)) {
+    logEvent(EV_REMOTE_OK, waterLevelPercentage);
+  }
+  else {
+    logEvent(EV_REMOTE_BLOCKED, waterLevelPercentage);
+    // Flash red to indicate blocked action
+    pixelAlerts.flash(0xFF0000, 3, 300, millis());
+  }
+}
+
+// Adafruit IO config feed. Applies the update, then echoes the full resulting
+// configuration to the status feed so the sender can see what was accepted.
+void onConfigMessage(char *data, uint16_t len) {
+  char current[192];
+  char update[EVENT_LOG_STRING + 1];
+  int changed;
+
+  // The control task gets the result once, not a copy per changed key
+  configUpdating = true;
+  changed = config.applyUpdate(data, len);
+  configUpdating = false;
+  if (changed > 0) {
+    shareControlConfig();
+  }
+  if (changed < 0) {
+    snprintf(update, sizeof(update), "%.*s", len, data);
+    logEvent(EV_CONFIG_REJECTED, update);
+  }
+  else {
+    logEvent(EV_CONFIG_APPLIED, changed);
   }
+  config.format(current, sizeof(current));
+  CONFIG_STATUS.publish(current);
 }
 
-// Only turn pump on if soil is DRY (low reading = dry soil) AND water level is sufficient
-if (moistureReads < 1000 && waterLevelPercentage > 30){
-    Serial.printf("Soil is dry (moisture: %i) and water level OK (%.1f%%) - turning pump ON\n", moistureReads, waterLevelPercentage);
-    digitalWrite(WATER_PUMP,HIGH);
-    // Turn all pixels blue when pump is on
-    for(i = 0; i < PIXELCOUNT; i++) {
-      pixel.setPixelColor(i, 0x0000FF); // blue
+// An update the irrigation controller could not work with is rejected whole.
+bool validateConfig() {
+  return IrrigationController::validConfig(irrigationConfig());
+}
+
+// Runs in loop(); the control task picks the new values up on its next tick.
+void onConfigChanged(uint8_t id) {
+  if (!configUpdating) {
+    shareControlConfig();
+  }
+}
+
+// The irrigation settings in the registry. setup() and loop() only.
+IrrigationConfig irrigationConfig() {
+  IrrigationConfig cfg;
+
+  cfg.dryThreshold = config.getInt(CFG_MOISTURE_THRESHOLD);
+  cfg.wetThreshold = config.getInt(CFG_MOISTURE_WET);
+  cfg.soakMs = config.getInt(CFG_SOAK);
+  cfg.maxDoseMs = config.getInt(CFG_PUMP_PULSE);
+  cfg.kp = config.getFloat(CFG_KP);
+  cfg.ki = config.getFloat(CFG_KI);
+  cfg.dailyCapMs = config.getInt(CFG_DAILY_CAP);
+  cfg.minWaterLevel = config.getInt(CFG_WATER_LOW);
+  cfg.dryRun = config.getInt(CFG_DRY_RUN) != 0;
+  return cfg;
+}
+
+// Copy the control task's settings out of the registry for it. setup() and
+// loop() only.
+void shareControlConfig() {
+  ControlConfig cfg;
+
+  cfg.irrigation = irrigationConfig();
+  cfg.waterLow = config.getInt(CFG_WATER_LOW);
+  cfg.waterHigh = config.getInt(CFG_WATER_HIGH);
+  cfg.waterAlertMs = config.getInt(CFG_WATER_ALERT_INTERVAL);
+  cfg.remotePumpMs = config.getInt(CFG_REMOTE_PUMP);
+  cfg.brightness = config.getInt(CFG_BRIGHTNESS);
+  controlConfig.write(cfg);
+}
+
+// Control task: apply settings loop() has shared since the last tick. A read
+// that meets a write in progress is tried again on the next tick.
+void checkControlConfig() {
+  uint32_t version = controlConfig.version();
+
+  if (version == settingsVersion || !controlConfig.read(settings)) {
+    return;
+  }
+  settingsVersion = version;
+  if (!irrigation.setConfig(settings.irrigation)) {
+    // Only settings saved by older firmware; updates are checked before they are kept
+    logEvent(EV_IRRIGATION_INVALID, settings.irrigation.wetThreshold, settings.irrigation.dryThreshold,
+             (unsigned long)settings.irrigation.maxDoseMs);
+  }
+  pixel.setBrightness(settings.brightness);
+  showPixels();
+}
+
+// Publish one sample to the four sensor feeds. Fresh samples are sent as one
+// group message; samples held in the queue through an outage are sent with their
+// original time so Adafruit IO graphs them where they belong.
+bool publishSample(const TelemetrySample &sample) {
+  char createdAt[24];
+  char payload[64];
+  time_t t;
+  struct tm tm;
+  bool sent = true;
+
+  if (sample.timestamp == 0 || (unsigned long)(Time.now() - sample.timestamp) < TELEMETRY_STALE_AGE) {
+    logEvent(EV_PUBLISH_LIVE);
+    SENSORS.add("temperature", sample.tempF);
+    SENSORS.add("humidity", sample.humidRH);
+    SENSORS.add("moisture", (int)sample.moisture);
+    SENSORS.add("waterlevel", (int)sample.waterLevel);
+    return SENSORS.publish();
+  }
+
+  t = sample.timestamp;
+  gmtime_r(&t, &tm);
+  strftime(createdAt, sizeof(createdAt), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  logEvent(EV_PUBLISH_BACKLOG, createdAt);
+
+  snprintf(payload, sizeof(payload), "{\"value\":%.2f,\"created_at\":\"%s\"}", sample.tempF, createdAt);
+  sent &= backlogBatch.send(&TEMP_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%.2f,\"created_at\":\"%s\"}", sample.humidRH, createdAt);
+  sent &= backlogBatch.send(&HUMIDITY_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%i,\"created_at\":\"%s\"}", sample.moisture, createdAt);
+  sent &= backlogBatch.send(&MOISTURE_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%i,\"created_at\":\"%s\"}", sample.waterLevel, createdAt);
+  sent &= backlogBatch.send(&WATERLEVEL_JSON, payload);
+  return backlogBatch.flush() && sent;
+}
+
+#if TELEMETRY_BINARY
+// Publish a binary frame of one or more samples as a single message.
+bool publishFrame(const TelemetryFrameWriter &frame) {
+  logEvent(EV_PUBLISH_FRAME, frame.count(), frame.length());
+  return TELEMETRY_FRAME.publish((uint8_t *)frame.data(), frame.length());
+}
+#endif
+
+// Clock for the sensor history at millis() `ms`: wall time once synced,
+// uptime before that.
+uint32_t seriesTime(uint32_t ms) {
+  return Time.isValid() ? Time.now() - (millis() - ms) / 1000 : ms / 1000;
+}
+
+// Mean of the readings since the last publish, or the latest reading if there
+// were none (e.g. the BME280 failed for the whole interval).
+float intervalMean(TimeSeries &series, float latest) {
+  SeriesStats interval = series.takeInterval();
+  return interval.count ? interval.mean() : latest;
+}
+
+// Publish min/mean/max of the 15 minute window that just closed.
+void publishSummary() {
+  SeriesStats temp, humid, moisture, water;
+  char summary[200];
+
+  if (!mqttConnection.connected() || !moistureSeries.history(SERIES_QUARTER, 0, moisture)) {
+    return;
+  }
+  // A series with no readings in the window (failed BME280) reports zeros.
+  if (!tempSeries.history(SERIES_QUARTER, 0, temp) || temp.start != moisture.start) {
+    temp.clear(moisture.start);
+  }
+  if (!humidSeries.history(SERIES_QUARTER, 0, humid) || humid.start != moisture.start) {
+    humid.clear(moisture.start);
+  }
+  if (!waterSeries.history(SERIES_QUARTER, 0, water) || water.start != moisture.start) {
+    water.clear(moisture.start);
+  }
+  snprintf(summary, sizeof(summary),
+           "{\"start\":%lu,\"n\":%lu,\"temp\":[%.1f,%.1f,%.1f],\"humid\":[%.1f,%.1f,%.1f],"
+           "\"moisture\":[%.0f,%.0f,%.0f],\"water\":[%.0f,%.0f,%.0f]}",
+           (unsigned long)moisture.start, (unsigned long)moisture.count,
+           temp.min, temp.mean(), temp.max, humid.min, humid.mean(), humid.max,
+           moisture.min, moisture.mean(), moisture.max, water.min, water.mean(), water.max);
+  SUMMARY.publish(summary);
+}
+
+// Append the minute that just closed to the flash history. Only minutes on
+// wall time: one that started before the clock synced is on uptime, which
+// is never this large (2001).
+void recordHistory() {
+  const uint32_t WALL_TIME_MIN = 1000000000;
+  TimeSeries *series[] = { &tempSeries, &humidSeries, &moistureSeries, &waterSeries };
+  SeriesStats minute, reference;
+  float values[4];
+
+  if (!moistureSeries.history(SERIES_MINUTE, 0, reference) || reference.start < WALL_TIME_MIN) {
+    return;
+  }
+  for (int m = 0; m < 4; m++) {
+    // A sensor with no readings in this minute is stored as missing.
+    values[m] = series[m]->history(SERIES_MINUTE, 0, minute) && minute.start == reference.start ? minute.mean() : NAN;
+  }
+  history.append(reference.start, values);
+}
+
+void sampleHeap() {
+  runtime_info_t info;
+
+  memset(&info, 0, sizeof(info));
+  info.size = sizeof(info);
+  HAL_Core_Runtime_Info(&info, NULL);
+  heap.sample(info.freeheap, info.largest_free_block_heap);
+}
+
+// Add one member to the JSON object being built in `buf` (`len` so far,
+// starting with '{'), written by `format(dest, size)`, which returns its
+// length or 0 if it did not fit. Room is always kept for the closing '}'.
+// Returns false, leaving the object as it was, if the member did not fit.
+template <typename Format>
+bool addMember(char *buf, size_t size, size_t &len, Format format) {
+  size_t start = len > 1 ? len + 1 : len;
+  size_t n;
+
+  if (start + 2 > size) {
+    return false;
+  }
+  n = format(buf + start, size - start - 1);
+  if (n == 0) {
+    buf[len] = 0;
+    return false;
+  }
+  if (start > len) {
+    buf[len] = ',';
+  }
+  len = start + n;
+  return true;
+}
+
+// {"heap":[...],"logDropped":n,"framesDropped":n,"wifi":[...],"supervisor":{...},
+// "i2c":{...},"loop":[...],...,"control":[...],...}: see HeapMonitor::format(),
+// WiFiBootstrap::format(), Supervisor::format(), I2CBus::format() and
+// LoopProfiler::format(). Every section that fits, in a 1024 byte message;
+// any that did not are counted in EV_DIAGNOSTICS_FULL and the rest still go
+// out as valid JSON.
+void publishDiagnostics() {
+  char diagnostics[1024];
+  size_t len = 1;
+  uint8_t omitted = 0;
+
+  sampleHeap();
+  diagnostics[0] = '{';
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return heap.format(buf, size); });
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len, [](char *buf, size_t size) {
+    int n = snprintf(buf, size, "\"logDropped\":%lu,\"framesDropped\":%lu", (unsigned long)eventLog.dropped(),
+                     (unsigned long)sensorFrames.dropped());
+    return n > 0 && (size_t)n < size ? (size_t)n : 0;
+  });
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return wifi.format(buf, size); });
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return supervisor.format(buf, size); });
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return i2cBus.format(buf, size); });
+#if LOOP_PROFILE
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return profiler.format(buf, size); });
+  omitted += !addMember(diagnostics, sizeof(diagnostics), len,
+                        [](char *buf, size_t size) { return controlProfiler.format(buf, size); });
+  // Start the next profile window
+  profiler.reset();
+  controlCommands.push(CMD_PROFILE_RESET);
+  profileWindowStart = millis();
+#endif
+  diagnostics[len++] = '}';
+  diagnostics[len] = 0;
+  if (omitted) {
+    logEvent(EV_DIAGNOSTICS_FULL, omitted, (unsigned)len, (unsigned)sizeof(diagnostics));
+  }
+  if (mqttConnection.connected()) {
+    DIAGNOSTICS.publish(diagnostics);
+  }
+}
+
+void logEvent(uint8_t event, ...) {
+  va_list args;
+
+  va_start(args, event);
+  logLock.lock();
+  eventLog.addv(millis(), event, args);
+  logLock.unlock();
+  va_end(args);
+}
+
+// Write out as many logged records as the USB port has room for, oldest
+// first, in the same layout as SerialLogHandler. Whatever does not fit waits
+// for the next call rather than blocking. Only writes what fits in the USB
+// buffer, so the control task is never kept waiting on logLock for long.
+void drainLog() {
+  uint8_t record[EVENT_LOG_RECORD];
+  char line[200];
+  uint16_t length;
+  size_t len;
+
+  PROFILE_START(profiler, PROF_LOG);
+  logLock.lock();
+  while ((length = eventLog.peek(record)) > 0) {
+#if LOG_BINARY
+    len = eventRecordToHex(record, length, line, sizeof(line) - 2);
+#else
+    char text[160];
+    uint32_t ms;
+    EventLevel level;
+    const char *category;
+    int n = 0;
+
+    if (eventLog.format(record, length, text, sizeof(text), ms, level, category)) {
+      n = snprintf(line, sizeof(line) - 2, "%010lu [app.%s] %s: %s", (unsigned long)ms, category,
+                   eventLevelName(level), text);
+    }
+    len = n > 0 && n < (int)sizeof(line) - 2 ? n : 0;
+#endif
+    if (len == 0) {
+      // Too long for the line; the event's format needs shortening.
+      eventLog.pop();
+      continue;
     }
-    pixel.show();
-    delay(500); 
-    digitalWrite(WATER_PUMP,LOW);
-    // Turn all pixels off when pump is off
-    for(i = 0; i < PIXELCOUNT; i++) {
-      pixel.setPixelColor(i, 0x000000); // off
+    line[len++] = '\r';
+    line[len++] = '\n';
+    if (Serial.availableForWrite() < (int)len) {
+      break;
     }
-    pixel.show();
-    Serial.printf("Pump OFF\n");
+    Serial.write((const uint8_t *)line, len);
+    eventLog.pop();
+  }
+  logLock.unlock();
+  PROFILE_STOP(profiler, PROF_LOG);
 }
-else if (moistureReads < 1000 && waterLevelPercentage <= 30) {
-    Serial.printf("Soil is dry but water level too low (%.1f%%) - NOT turning pump on!\n", waterLevelPercentage);
+
+#if LOOP_PROFILE
+// Per-section timing since the last publish, in µs, for loop() and then the
+// control task. "share" is the fraction of the window's wall time spent in
+// the section ("late" is not time spent, so its share means nothing).
+void printProfile() {
+  unsigned long windowMs = millis() - profileWindowStart;
+  const LoopProfiler *profilers[] = { &profiler, &controlProfiler };
+
+  Serial.printf("Loop profile over the last %lu s (us):\n", windowMs / 1000);
+  Serial.printf("%-11s %8s %8s %8s %8s %8s %6s\n", "section", "count", "mean", "p50", "p99", "max", "share");
+  for (const LoopProfiler *p : profilers) {
+    for (uint8_t id = 0; id < p->count(); id++) {
+      ProfileStats s = p->stats(id);
+      Serial.printf("%-11s %8lu %8lu %8lu %8lu %8lu %5.1f%%\n", p->name(id), (unsigned long)s.count,
+                    (unsigned long)s.mean(), (unsigned long)s.p50, (unsigned long)s.p99, (unsigned long)s.max,
+                    windowMs ? s.total / (windowMs * 10.0) : 0.0);
+    }
+  }
 }
-else if (moistureReads >= 1000) {
-    Serial.printf("Soil moisture OK (moisture: %i) - pump not needed\n", moistureReads);
+#endif
+
+#if SENSOR_TRACE
+// `len` consecutive BME280 registers from `reg`, for readBmeRegisters().
+struct BmeRegisters {
+  uint8_t reg;
+  uint8_t *buf;
+  uint8_t len;
+};
+
+// Read the registers straight off the bus, bypassing the driver, so the trace
+// holds what the chip returned. A transaction (BmeRegisters context).
+bool readBmeRegisters(void *context) {
+  BmeRegisters &r = *(BmeRegisters *)context;
+
+  Wire.beginTransmission(hexAddress);
+  Wire.write(r.reg);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom(hexAddress, (int)r.len) != r.len) {
+    return false;
+  }
+  for (uint8_t n = 0; n < r.len; n++) {
+    r.buf[n] = Wire.read();
+  }
+  return true;
 }
 
-display.clearDisplay();
-display.setTextSize(1);
-display.setTextColor(WHITE);
-display.setCursor(0,0);
-display.printf("Time: %s\n",timeOnly.c_str());
-display.setCursor(0,8);
-display.printf("Temp: %.1f%c Hum: %.1f%c\n",tempF,DEGREE,humidRH,PERCENT);
-display.setCursor(0,24);
-display.printf("Moisture: %i\n", moistureReads);
-display.setCursor(0,16);
+// One trace line for this pass, preceded every SENSOR_TRACE_REPEAT samples by
+// the header and the BME280 calibration so a capture can start at any time.
+void traceSensors(int air, int moisture, int water) {
+  static uint32_t samples = 0;
+  char line[SENSOR_TRACE_LINE];
+  uint8_t calibration[SENSOR_TRACE_CALBYTES];
+  TraceSample sample;
 
-display.printf("My Hydro Flower");
-display.display();
+  // Runs in the control task; logLock keeps the lines whole among the log's.
+  if (samples++ % SENSOR_TRACE_REPEAT == 0) {
+    BmeRegisters low = { 0x88, calibration, 26 }, high = { 0xE1, calibration + 26, 7 };
+    bool calibrated = i2cBus.run(BUS_BME280, readBmeRegisters, &low) == I2C_OK &&
+                      i2cBus.run(BUS_BME280, readBmeRegisters, &high) == I2C_OK;
+    logLock.lock();
+    traceFormatHeader(line, sizeof(line));
+    Serial.println(line);
+    if (calibrated && traceFormatCalibration(line, sizeof(line), calibration)) {
+      Serial.println(line);
+    }
+    logLock.unlock();
+  }
+  sample.ms = millis();
+  sample.air = air;
+  sample.moisture = moisture;
+  sample.water = water;
+  BmeRegisters data = { 0xF7, sample.bme, SENSOR_TRACE_BMEBYTES };
+  sample.hasBme = status && i2cBus.run(BUS_BME280, readBmeRegisters, &data) == I2C_OK;
+  if (traceFormatSample(line, sizeof(line), sample)) {
+    logLock.lock();
+    Serial.println(line);
+    logLock.unlock();
+  }
+}
+#endif
 
-} // End of loop() function
+// Follow the WiFi join and log its progress.
+void checkWiFi() {
+  WiFiChange network = wifi.loop(millis());
 
-void MQTT_connect() {
-  int8_t ret;
- 
-  if (mqtt.connected()) {
-    return;
+  if (network == WIFI_JOINED) {
+    IPAddress ip = WiFi.localIP();
+    logEvent(EV_WIFI_JOINED, (unsigned long)wifi.joinMs(), ip[0], ip[1], ip[2], ip[3], (int)WiFi.RSSI());
   }
- 
-  Serial.print("Connecting to MQTT... ");
- 
-  while ((ret = mqtt.connect()) != 0) { 
-       Serial.printf("Error Code %s\n",mqtt.connectErrorString(ret));
-       Serial.printf("Retrying MQTT connection in 5 seconds...\n");
-       mqtt.disconnect();
-       delay(5000); 
+  else if (network == WIFI_REJOINED) {
+    logEvent(EV_WIFI_REJOINED, (unsigned long)wifi.stats().lastRejoinMs);
+  }
+  else if (network == WIFI_DROPPED) {
+    logEvent(EV_WIFI_DROPPED);
   }
-  Serial.printf("MQTT Connected!\n");
 }
 
-bool MQTT_ping() {
-  static unsigned int last;
-  bool pingStatus = true;
+// One line with the time each part of setup() took, and how the I2C devices
+// were found.
+void printBootTimes() {
+  unsigned long start = 0;
 
-  if ((millis()-last)>60000) {
-      Serial.printf("Pinging MQTT \n");
-      pingStatus = mqtt.ping();
-      if(!pingStatus) {
-        Serial.printf("Disconnecting \n");
-        mqtt.disconnect();
-      }
-      last = millis();
+  Serial.print("Boot:");
+  for (uint8_t phase = 0; phase < BOOT_PHASES; phase++) {
+    Serial.printf(" %s %lu ms,", BOOT_PHASE_NAMES[phase], bootPhaseEnd[phase] - start);
+    start = bootPhaseEnd[phase];
   }
-  return pingStatus;
+  Serial.printf(" display up at %lu ms, ready at %lu ms (I2C %s, %u probes)\n", bootPhaseEnd[BOOT_DISPLAY],
+                bootPhaseEnd[BOOT_PHASES - 1], i2c.cacheHit() ? "map from EEPROM" : "full scan", i2c.probes());
 }
 
 int readWaterLevelSensor() {
@@ -460,26 +1539,3 @@ int readWaterLevelSensor() {
   digitalWrite(sensorPower, LOW);
   return reading;
 }
-
-void setupWiFi() {
-  Serial.printf("Setting up WiFi credentials...\n");
-  
-  
-  WiFi.clearCredentials();
-  Serial.printf("Has Credentials = %i\n",WiFi.hasCredentials());
-  
-  // Use WiFi credentials from credentials.h
-  WiFi.setCredentials(WIFI_SSID, WIFI_PASSWORD);
-
-  Serial.printf("Connecting to WiFi...\n");
-  WiFi.on();
-  WiFi.connect();
-  while(WiFi.connecting()) {
-    Serial.printf(".");
-    delay(100);
-  }
-  Serial.printf("\nWiFi Connected!\n");
-  Serial.printf("Local IP: %s\n", WiFi.localIP().toString().c_str());
-  Serial.printf("Signal Strength: %d dBm\n", WiFi.RSSI());
-  Serial.println("WiFi setup complete - ready for MQTT!\n");
-}
@@ -0,0 +1,200 @@
+/*
+ * button_check.cpp
+ * Host check of InterruptButton (lib/IoTClassroom_CNM/src/Button.h), the pot
+ * button. The pin, the clock and the interrupt are played by hand: each
+ * level change calls the attached handler at the current time, as the edge
+ * interrupt would, and read() is called on every 100 ms control tick.
+ *
+ *   bounce       contact bounce on press and release gives one click, and
+ *                a glitch shorter than the debounce time gives nothing
+ *   click        reported only once the double-click window has passed
+ *                after the release, never sooner
+ *   double       two clicks inside the window give one double click
+ *   long         a long press is reported while the button is still held,
+ *                and its release is not a click
+ *   late         a long press released before read() saw it held (a
+ *                stalled control task) is still a long press
+ *   overflow     more edges than the ring holds without a read(): read()
+ *                goes by the pin, and the next press works normally
+ *
+ * Prints each check and exits with 1 if any failed.
+ *
+ * Build: g++ -I../sim -I../lib/IoTClassroom_CNM/src button_check.cpp -o button_check
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "Particle.h"
+#include "Button.h"
+
+// The mock Device OS pieces Button.h uses, driven by the checks.
+static unsigned long nowMs = 1000;
+static int32_t pinLevel = HIGH;           // pull-up: released
+static wiring_interrupt_handler_t onEdge;
+
+unsigned long millis() { return nowMs; }
+int32_t digitalRead(uint16_t pin) { (void)pin; return pinLevel; }
+void pinMode(uint16_t pin, PinMode mode) { (void)pin; (void)mode; }
+bool attachInterrupt(uint16_t pin, wiring_interrupt_handler_t handler, InterruptMode mode, int8_t priority,
+                     uint8_t subpriority) {
+  (void)pin; (void)mode; (void)priority; (void)subpriority;
+  onEdge = handler;
+  return true;
+}
+
+static const uint16_t DEBOUNCE_MS = 20;
+static const uint16_t DOUBLE_CLICK_MS = 300;
+static const uint16_t LONG_PRESS_MS = 1000;
+static const unsigned long TICK_MS = 100;
+
+struct Event {
+  ButtonEvent event;
+  unsigned long ms;
+};
+
+static InterruptButton *button;
+static std::vector<Event> events;
+static unsigned long nextTick;
+
+// Time passes, with read() on each control tick.
+static void run(unsigned long ms, bool reading = true) {
+  unsigned long end = nowMs + ms;
+
+  while (nowMs < end) {
+    if (reading && nowMs >= nextTick) {
+      ButtonEvent event;
+      while ((event = button->read()) != BUTTON_NONE) {
+        events.push_back({ event, nowMs });
+      }
+      nextTick += TICK_MS;
+    }
+    nowMs++;
+  }
+  if (!reading) {
+    nextTick = nowMs;
+  }
+}
+
+static void level(bool pressed) {
+  pinLevel = pressed ? LOW : HIGH;
+  onEdge();
+}
+
+// A change of level with a few ms of contact bounce first.
+static void bouncy(bool pressed, bool reading = true) {
+  for (int b = 0; b < 3; b++) {
+    level(pressed);
+    run(1, reading);
+    level(!pressed);
+    run(2, reading);
+  }
+  level(pressed);
+}
+
+static void begin() {
+  static InterruptButton *previous;
+
+  delete previous;
+  pinLevel = HIGH;
+  previous = button = new InterruptButton(D19, true, DEBOUNCE_MS, DOUBLE_CLICK_MS, LONG_PRESS_MS);
+  button->begin();
+  events.clear();
+  nextTick = nowMs;
+}
+
+static int failures;
+
+static void check(const char *name, bool ok) {
+  printf("%-9s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) {
+    failures++;
+    for (const Event &e : events) {
+      printf("  event %d at %lu\n", e.event, e.ms);
+    }
+  }
+}
+
+static bool only(ButtonEvent event) {
+  return events.size() == 1 && events[0].event == event;
+}
+
+int main() {
+  unsigned long released;
+  bool ok;
+
+  begin();
+  bouncy(true);
+  run(150);
+  bouncy(false);
+  run(1000);
+  ok = only(BUTTON_CLICK) && !button->isPressed();
+  events.clear();
+  level(true);
+  run(DEBOUNCE_MS / 2);
+  level(false);
+  run(1000);
+  check("bounce", ok && events.empty());
+
+  begin();
+  level(true);
+  run(120);
+  level(false);
+  released = nowMs;
+  run(DOUBLE_CLICK_MS);
+  ok = events.empty();
+  run(TICK_MS + 1);
+  check("click", ok && only(BUTTON_CLICK) && events[0].ms - released > DOUBLE_CLICK_MS &&
+                 events[0].ms - released <= DOUBLE_CLICK_MS + DEBOUNCE_MS + TICK_MS);
+
+  begin();
+  bouncy(true);
+  run(100);
+  bouncy(false);
+  run(150);
+  bouncy(true);
+  run(100);
+  bouncy(false);
+  run(1000);
+  check("double", only(BUTTON_DOUBLE_CLICK));
+
+  begin();
+  bouncy(true);
+  run(LONG_PRESS_MS + TICK_MS + DEBOUNCE_MS);
+  ok = only(BUTTON_LONG_PRESS) && button->isPressed();
+  run(500);
+  bouncy(false);
+  run(1000);
+  check("long", ok && only(BUTTON_LONG_PRESS) && !button->isPressed());
+
+  begin();
+  run(TICK_MS);
+  bouncy(true, false);
+  run(LONG_PRESS_MS + 200, false);
+  bouncy(false, false);
+  run(50, false);
+  run(1000);
+  check("late", only(BUTTON_LONG_PRESS));
+
+  begin();
+  run(TICK_MS);
+  for (int b = 0; b < 41; b++) {
+    level(b % 2 == 0);
+    run(1, false);
+  }
+  // Ends pressed; held long enough to count once read() catches up
+  run(DEBOUNCE_MS * 2, false);
+  run(TICK_MS + 1);
+  ok = button->isPressed();
+  level(false);
+  run(1000);
+  ok = ok && !button->isPressed();
+  events.clear();
+  bouncy(true);
+  run(100);
+  bouncy(false);
+  run(1000);
+  check("overflow", ok && only(BUTTON_CLICK));
+
+  return failures ? 1 : 0;
+}
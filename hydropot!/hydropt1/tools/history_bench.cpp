@@ -0,0 +1,137 @@
+/*
+ * history_bench.cpp
+ * Benchmark of the HistoryLog encoding on synthetic per-minute data for the
+ * four hydropot sensors. For several flush intervals it reports:
+ *
+ *   bytes/record    encoded size of one record (timestamp + 4 values)
+ *   ratio           against the 20 byte raw record (uint32 time + 4 floats)
+ *   file WA         bytes passed to write() (records, segment headers, index
+ *                   rewrites) over encoded record bytes
+ *   flash WA        upper bound assuming every flush rewrites the partly
+ *                   filled tail block of the segment from its start, as a
+ *                   copy-on-write filesystem may
+ *
+ * Usage: history_bench [days] [blockSize]        defaults: 28 days, 4096
+ *
+ * Build: g++ -O2 -I../src history_bench.cpp ../src/HistoryCodec.cpp -o history_bench
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "HistoryCodec.h"
+
+// Keep in step with the defaults in HistoryLog.h.
+static const uint32_t SEGMENT_BYTES = 16384;
+static const uint32_t MAX_SEGMENTS = 16;
+
+static const uint8_t METRICS = 4;
+static const float SCALES[METRICS] = { 100, 100, 1, 1 };
+
+static uint32_t seed = 12345;
+
+static float noise(float amplitude) {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 16) & 0x7FFF) / 32767.0f * 2 * amplitude - amplitude;
+}
+
+// One minute of readings: diurnal temperature and humidity, soil drying out
+// and watered back up, reservoir slowly emptying.
+static void synthesize(uint32_t minute, float *values) {
+  static float moisture = 2200;
+  static float water = 95;
+  float day = 2 * M_PI * (minute % 1440) / 1440.0f;
+
+  values[0] = roundf((70 + 8 * sinf(day) + noise(0.15f)) * 100) / 100;
+  values[1] = roundf((45 - 10 * sinf(day) + noise(0.3f)) * 100) / 100;
+  moisture -= 0.4f + noise(0.2f);
+  if (moisture < 1000) {
+    moisture += 1400;
+    water -= 2;
+  }
+  if (water < 35) {
+    water = 95;   // refilled
+  }
+  values[2] = roundf(moisture + noise(15));
+  values[3] = roundf(water);
+}
+
+static void run(uint32_t minutes, uint8_t flushEvery, uint32_t blockSize) {
+  HistoryCodec encoder(METRICS, SCALES);
+  HistoryCodec decoder(METRICS, SCALES);
+  uint8_t record[HISTORY_MAXRECORD];
+  float values[METRICS], decoded[METRICS];
+  uint32_t t, decodedTime;
+  uint64_t payload = 0, written = 0, flash = 0;
+  uint32_t segmentBytes = sizeof(HistorySegmentHeader);
+  uint32_t closedSegments = 0;
+  uint32_t buffered = 0, bufferedBytes = 0;
+  float maxError = 0;
+
+  seed = 12345;
+  written += sizeof(HistorySegmentHeader);
+  flash += sizeof(HistorySegmentHeader);
+
+  for (uint32_t i = 0; i < minutes; i++) {
+    t = 1760000000 + i * 60;
+    synthesize(i, values);
+
+    if (segmentBytes + bufferedBytes + HISTORY_MAXRECORD > SEGMENT_BYTES) {
+      // Flush, close into the index and start a new segment, as HistoryLog::rotate().
+      if (bufferedBytes) {
+        segmentBytes += bufferedBytes;
+        written += bufferedBytes;
+        flash += segmentBytes % blockSize ? segmentBytes % blockSize : blockSize;
+        buffered = bufferedBytes = 0;
+      }
+      closedSegments++;
+      uint32_t indexBytes = sizeof(HistoryIndexHeader) +
+                            (closedSegments < MAX_SEGMENTS ? closedSegments : MAX_SEGMENTS - 1) * sizeof(HistoryIndexEntry);
+      written += indexBytes + sizeof(HistorySegmentHeader);
+      flash += indexBytes + sizeof(HistorySegmentHeader);
+      segmentBytes = sizeof(HistorySegmentHeader);
+      encoder.reset();
+      decoder.reset();
+    }
+
+    uint16_t len = encoder.encode(t, values, record);
+    payload += len;
+    bufferedBytes += len;
+
+    if (decoder.decode(record, len, decodedTime, decoded) != len || decodedTime != t) {
+      fprintf(stderr, "round trip failed at record %lu\n", (unsigned long)i);
+      exit(1);
+    }
+    for (uint8_t m = 0; m < METRICS; m++) {
+      float err = fabsf(decoded[m] - values[m]);
+      if (err > maxError) {
+        maxError = err;
+      }
+    }
+
+    if (++buffered >= flushEvery) {
+      segmentBytes += bufferedBytes;
+      written += bufferedBytes;
+      flash += segmentBytes % blockSize ? segmentBytes % blockSize : blockSize;
+      buffered = bufferedBytes = 0;
+    }
+  }
+
+  printf("%10u %13.2f %8.1fx %9.3f %9.2f %10.4f %9.1f\n", flushEvery, (double)payload / minutes,
+         20.0 * minutes / payload, (double)written / payload, (double)flash / payload, maxError,
+         (double)MAX_SEGMENTS * SEGMENT_BYTES / ((double)payload / minutes) / 1440);
+}
+
+int main(int argc, char **argv) {
+  uint32_t days = argc > 1 ? atoi(argv[1]) : 28;
+  uint32_t blockSize = argc > 2 ? atoi(argv[2]) : 4096;
+  static const uint8_t FLUSH_EVERY[] = { 1, 4, 16, 60 };
+
+  printf("%u days of per-minute records, %u metrics, %u byte flash blocks\n\n", days, METRICS, blockSize);
+  printf("flushEvery  bytes/record    ratio   file WA  flash WA  max error  days kept\n");
+  for (uint8_t i = 0; i < sizeof(FLUSH_EVERY); i++) {
+    run(days * 1440, FLUSH_EVERY[i], blockSize);
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * history_read.cpp
+ * Host-side reader for the HistoryLog files. Given a copy of the device's
+ * history directory, prints the records in a time range as CSV.
+ *
+ * Usage: history_read <dir> [from [to]]      (times in epoch seconds)
+ *
+ * Build: g++ -O2 -I../src history_read.cpp ../src/HistoryCodec.cpp -o history_read
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "HistoryCodec.h"
+
+static bool printSegment(const char *dir, uint32_t id, uint32_t from, uint32_t to, bool &printedHeader) {
+  char path[512];
+  HistorySegmentHeader hdr;
+  static uint8_t data[1 << 20];
+  size_t len, pos = 0;
+  float values[HISTORY_MAXMETRICS];
+  uint32_t t;
+  uint16_t used;
+
+  snprintf(path, sizeof(path), "%s/seg%05lu.dat", dir, (unsigned long)id);
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "%s: missing\n", path);
+    return false;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != HISTORY_SEGMENT_MAGIC ||
+      hdr.version != HISTORY_VERSION || hdr.metrics == 0 || hdr.metrics > HISTORY_MAXMETRICS) {
+    fprintf(stderr, "%s: not a history segment\n", path);
+    fclose(f);
+    return false;
+  }
+  len = fread(data, 1, sizeof(data), f);
+  fclose(f);
+
+  if (!printedHeader) {
+    printf("timestamp,time");
+    for (uint8_t m = 0; m < hdr.metrics; m++) {
+      printf(",%.*s", HISTORY_NAMELEN, hdr.names[m]);
+    }
+    printf("\n");
+    printedHeader = true;
+  }
+
+  HistoryCodec codec(hdr.metrics, hdr.scales);
+  while (pos < len && (used = codec.decode(data + pos, len - pos > 0xFFFF ? 0xFFFF : len - pos, t, values)) > 0) {
+    pos += used;
+    if (t < from || t > to) {
+      continue;
+    }
+    char when[24];
+    time_t tt = t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    printf("%lu,%s", (unsigned long)t, when);
+    for (uint8_t m = 0; m < hdr.metrics; m++) {
+      if (isnan(values[m])) {
+        printf(",");
+      } else {
+        printf(",%g", values[m]);
+      }
+    }
+    printf("\n");
+  }
+  if (pos < len) {
+    fprintf(stderr, "%s: %lu trailing bytes (partial record)\n", path, (unsigned long)(len - pos));
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  char path[512];
+  HistoryIndexHeader hdr;
+  HistoryIndexEntry entry;
+  uint32_t from = 0, to = 0xFFFFFFFF;
+  bool printedHeader = false;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dir> [from [to]]\n", argv[0]);
+    return 2;
+  }
+  if (argc > 2) {
+    from = strtoul(argv[2], NULL, 10);
+  }
+  if (argc > 3) {
+    to = strtoul(argv[3], NULL, 10);
+  }
+
+  snprintf(path, sizeof(path), "%s/index.dat", argv[1]);
+  FILE *f = fopen(path, "rb");
+  if (!f || fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != HISTORY_INDEX_MAGIC ||
+      hdr.version != HISTORY_VERSION) {
+    // No segment has been closed yet: everything is in segment 0.
+    hdr.count = 0;
+    hdr.activeId = 0;
+  }
+
+  // Closed segments from the index, skipping those outside the range...
+  for (uint16_t i = 0; i < hdr.count && f && fread(&entry, sizeof(entry), 1, f) == 1; i++) {
+    if (entry.lastTime >= from && entry.firstTime <= to) {
+      printSegment(argv[1], entry.id, from, to, printedHeader);
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+  // ...then the active one, whose range is only known by decoding it.
+  return printSegment(argv[1], hdr.activeId, from, to, printedHeader) ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+/*
+ * irrigation_sim.cpp
+ * Runs the irrigation logic against a simple soil-moisture model on the host
+ * and compares the old threshold pulse (500 ms of pump on every loop pass that
+ * reads dry) with IrrigationController.
+ *
+ * Soil model: the reading falls with evaporation (faster in the afternoon).
+ * Pumped water takes TRANSPORT_S to reach the root zone and then soaks in with
+ * a first-order lag, so the sensor keeps reading dry for a while after the
+ * pump has run and keeps rising after it stops. Anything above field capacity
+ * drains away.
+ *
+ * Then checks the controller's limits, each over the same number of days:
+ *
+ *   cap          with a sensor stuck dry, the pump time in any 24 hours stays
+ *                within dailyCapMs and no run is longer than its dose
+ *   dry run      dryRun doses as usual but never turns the pump on
+ *   lockout      a reservoir drained by the pump: the pump is never on with
+ *                the level at or below minWaterLevel
+ *   resets       as cap, with the firmware reset every 5 hours and the clock
+ *                starting over: the day carried over in IrrigationDay keeps
+ *                the pump time in each 24 hours within dailyCapMs
+ *   chatter      a sensor reading the dry threshold, give or take its noise,
+ *                whatever is pumped: the pump always rests a soak period
+ *                between runs (as it does in the comparison run)
+ *
+ * Prints each check and exits with 1 if any failed.
+ *
+ * Usage: irrigation_sim [days]                 default 7
+ *
+ * Build: g++ -O2 -I../src irrigation_sim.cpp ../src/IrrigationController.cpp -o irrigation_sim
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IrrigationController.h"
+
+static const uint32_t STEP_MS = 100;
+static const uint32_t LOOP_MS = 1200;           // one pass of loop() without watering
+static const float COUNTS_PER_PUMP_MS = 0.1f;   // reading gained per ms of pump, eventually
+static const uint32_t TRANSPORT_S = 45;
+static const float INFILTRATION_TAU_S = 60;
+static const float FIELD_CAPACITY = 2600;
+
+struct Soil {
+  float moisture = 1250;
+  float transit[TRANSPORT_S * 1000 / STEP_MS] = {};   // water on its way down
+  uint32_t transitPos = 0;
+  float surface = 0;          // water soaking in around the sensor
+  uint32_t seed = 1;
+
+  void step(uint32_t nowMs, bool pumping) {
+    const uint32_t slots = sizeof(transit) / sizeof(transit[0]);
+    float dt = STEP_MS / 1000.0f;
+    float day = 2 * M_PI * ((nowMs / 1000) % 86400) / 86400.0f;
+    float evaporation = (0.6f + 0.8f * fmaxf(0, sinf(day))) / 60;   // counts per second
+    float infiltrate = surface * dt / INFILTRATION_TAU_S;
+
+    surface += transit[transitPos];
+    transit[transitPos] = pumping ? COUNTS_PER_PUMP_MS * STEP_MS : 0;
+    transitPos = (transitPos + 1) % slots;
+    surface -= infiltrate;
+    moisture += infiltrate - evaporation * dt;
+    if (moisture > FIELD_CAPACITY) {
+      moisture = FIELD_CAPACITY;
+    }
+  }
+
+  int16_t read() {
+    return (int16_t)moisture + noise();
+  }
+
+  int16_t noise() {
+    seed = seed * 1103515245 + 12345;
+    return (int16_t)((seed >> 16) % 11) - 5;
+  }
+};
+
+// What runController() is up against, besides the soil.
+struct Scenario {
+  IrrigationConfig config;
+  int16_t stuckAt = -1;           // if set, the sensor reads this (with noise) whatever is pumped
+  float reservoir = 80;           // % at the start
+  float usedPerPumpS = 0;         // reservoir % used per second of pumping
+  uint32_t resetEveryMs = 0;      // if set, the firmware resets this often and millis() starts over
+};
+
+struct Result {
+  uint32_t pumpStarts = 0;
+  uint64_t pumpMs = 0;
+  float minMoisture = 1e9f;
+  float maxMoisture = 0;
+  uint64_t dryMs = 0;
+  // For the checks
+  uint32_t maxPumpToday = 0;      // highest pumpMsToday()
+  uint32_t longRuns = 0;          // pump runs longer than their dose, to the step
+  uint32_t minRestMs = UINT32_MAX;  // shortest pump off time between two runs
+  uint32_t lockedSteps = 0;       // steps pumping with the reservoir at or below minWaterLevel
+  uint32_t dosingSteps = 0;       // steps dosing(), pump on or not
+  IrrigationStats stats = {};
+};
+
+static void account(Result &r, const Soil &soil, bool pumping, bool wasPumping) {
+  if (pumping && !wasPumping) {
+    r.pumpStarts++;
+  }
+  if (pumping) {
+    r.pumpMs += STEP_MS;
+  }
+  r.minMoisture = fminf(r.minMoisture, soil.moisture);
+  r.maxMoisture = fmaxf(r.maxMoisture, soil.moisture);
+  if (soil.moisture < 1000) {
+    r.dryMs += STEP_MS;
+  }
+}
+
+// The original loop(): a blocking 500 ms pulse whenever a pass reads dry.
+static Result runThreshold(uint32_t durationMs) {
+  Soil soil;
+  Result r;
+  uint32_t nextPass = 0, pumpUntil = 0;
+  bool wasPumping = false;
+
+  for (uint32_t now = 0; now < durationMs; now += STEP_MS) {
+    if (now >= nextPass && now >= pumpUntil) {
+      nextPass = now + LOOP_MS;
+      if (soil.read() < 1000) {
+        pumpUntil = now + 500;
+        nextPass += 500;
+      }
+    }
+    bool pumping = now < pumpUntil;
+    soil.step(now, pumping);
+    account(r, soil, pumping, wasPumping);
+    wasPumping = pumping;
+  }
+  return r;
+}
+
+static Result runController(uint32_t durationMs, const Scenario &scenario, double &nsPerUpdate) {
+  Soil soil;
+  Result r;
+  IrrigationDay day = {};                       // retained across the resets
+  IrrigationController *controller = new IrrigationController(day);
+  uint32_t nextPass = 0, runStart = 0, runEnd = 0, bootAt = 0;
+  uint64_t updates = 0;
+  bool wasPumping = false, ran = false;
+  float reservoir = scenario.reservoir;
+  std::chrono::nanoseconds spent(0);
+
+  controller->setConfig(scenario.config);
+  auto read = [&]() -> int16_t {
+    return scenario.stuckAt >= 0 ? scenario.stuckAt + soil.noise() : soil.read();
+  };
+  for (uint32_t now = 0; now < durationMs; now += STEP_MS) {
+    int16_t level = (int16_t)reservoir;
+    if (scenario.resetEveryMs && now - bootAt >= scenario.resetEveryMs) {
+      // The pump stops with the reset; only the retained day carries over
+      r.stats.doses += controller->stats().doses;
+      r.stats.skippedCap += controller->stats().skippedCap;
+      delete controller;
+      controller = new IrrigationController(day);
+      controller->setConfig(scenario.config);
+      bootAt = now;
+    }
+    if (now >= nextPass) {
+      nextPass = now + LOOP_MS;
+      int16_t reading = read();
+      auto start = std::chrono::steady_clock::now();
+      controller->update(now - bootAt, reading, level);
+      spent += std::chrono::steady_clock::now() - start;
+      updates++;
+    }
+    // The pump is switched off promptly at the end of a dose, not at the next pass.
+    if (controller->dosing()) {
+      controller->update(now - bootAt, read(), level);
+    }
+    bool pumping = controller->pumpOn();
+
+    if (pumping && !wasPumping) {
+      if (ran && now - runEnd < r.minRestMs) {
+        r.minRestMs = now - runEnd;
+      }
+      runStart = now;
+    }
+    if (!pumping && wasPumping) {
+      uint32_t dose = (controller->lastDoseMs() + STEP_MS - 1) / STEP_MS * STEP_MS;
+      if (now - runStart > dose) {
+        r.longRuns++;
+      }
+      runEnd = now;
+      ran = true;
+    }
+    if (controller->pumpMsToday() > r.maxPumpToday) {
+      r.maxPumpToday = controller->pumpMsToday();
+    }
+    if (pumping && level <= scenario.config.minWaterLevel) {
+      r.lockedSteps++;
+    }
+    if (controller->dosing()) {
+      r.dosingSteps++;
+    }
+
+    soil.step(now, pumping);
+    if (pumping) {
+      reservoir -= scenario.usedPerPumpS * STEP_MS / 1000;
+    }
+    account(r, soil, pumping, wasPumping);
+    wasPumping = pumping;
+  }
+  uint32_t doses = r.stats.doses, skippedCap = r.stats.skippedCap;
+  r.stats = controller->stats();
+  r.stats.doses += doses;
+  r.stats.skippedCap += skippedCap;
+  delete controller;
+  nsPerUpdate = (double)spent.count() / updates;
+  return r;
+}
+
+static void print(const char *name, const Result &r, uint32_t days) {
+  printf("%-22s %10.1f %12.1f %12.1f %10.0f %10.0f %10.2f\n", name, (double)r.pumpStarts / days,
+         r.pumpMs / 1000.0 / days, r.pumpMs * COUNTS_PER_PUMP_MS / days, r.minMoisture, r.maxMoisture,
+         100.0 * r.dryMs / ((uint64_t)days * 86400000ULL));
+}
+
+static int failures;
+
+static void check(const char *name, bool ok, const Result &r) {
+  printf("%-9s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) {
+    failures++;
+    printf("  %u doses, %u cycles, most in a day %u ms, %u long runs, shortest rest %u ms, %u steps locked out,"
+           " %u dosing\n", r.stats.doses, r.stats.cycles, r.maxPumpToday, r.longRuns, r.minRestMs, r.lockedSteps,
+           r.dosingSteps);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t days = argc > 1 ? atoi(argv[1]) : 7;
+  uint32_t duration = days * 86400000UL;
+  double nsPerUpdate;
+  Scenario scenario;
+  Result r;
+
+  printf("%u simulated days, per day:\n\n", days);
+  printf("%-22s %10s %12s %12s %10s %10s %10s\n", "", "pump starts", "pump s", "water", "min", "max", "% dry");
+  print("threshold pulse", runThreshold(duration), days);
+  Result controlled = runController(duration, scenario, nsPerUpdate);
+  print("IrrigationController", controlled, days);
+  printf("\nIrrigationController::update(): %.1f ns per call on this host\n\n", nsPerUpdate);
+
+  scenario = Scenario();
+  scenario.stuckAt = 500;
+  scenario.config.dailyCapMs = 20000;
+  r = runController(duration, scenario, nsPerUpdate);
+  check("cap", r.maxPumpToday <= scenario.config.dailyCapMs && r.longRuns == 0 && r.stats.skippedCap > 0 &&
+               r.pumpMs <= (uint64_t)scenario.config.dailyCapMs * days + (uint64_t)STEP_MS * r.stats.doses, r);
+
+  scenario = Scenario();
+  scenario.config.dryRun = true;
+  r = runController(duration, scenario, nsPerUpdate);
+  check("dry run", r.pumpStarts == 0 && r.pumpMs == 0 && r.stats.doses > 0 && r.dosingSteps > 0, r);
+
+  scenario = Scenario();
+  scenario.reservoir = 40;
+  scenario.usedPerPumpS = 0.5f;
+  r = runController(duration, scenario, nsPerUpdate);
+  check("lockout", r.lockedSteps == 0 && r.stats.skippedLowWater > 0 && r.pumpMs > 0, r);
+
+  scenario = Scenario();
+  scenario.stuckAt = 500;
+  scenario.config.dailyCapMs = 20000;
+  scenario.resetEveryMs = 5 * 3600000UL;
+  r = runController(duration, scenario, nsPerUpdate);
+  check("resets", r.maxPumpToday <= scenario.config.dailyCapMs && r.stats.skippedCap > 0 &&
+                  r.pumpMs <= (uint64_t)scenario.config.dailyCapMs * days + (uint64_t)STEP_MS * r.stats.doses, r);
+
+  scenario = Scenario();
+  scenario.stuckAt = scenario.config.dryThreshold;
+  r = runController(duration, scenario, nsPerUpdate);
+  check("chatter", r.pumpStarts > 1 && r.minRestMs >= scenario.config.soakMs &&
+                   controlled.minRestMs >= scenario.config.soakMs, r);
+
+  return failures ? 1 : 0;
+}
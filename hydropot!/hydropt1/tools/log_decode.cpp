@@ -0,0 +1,69 @@
+/*
+ * log_decode.cpp
+ * Host-side decoder for the firmware's binary event log (LOG_BINARY 1).
+ * Turns each "#<hex>" record line back into the text line the firmware
+ * would have printed, and passes every other line through unchanged, so a
+ * whole serial capture can be read as it is:
+ *   particle serial monitor --follow > capture.log
+ *   log_decode capture.log
+ *
+ * Reads the files given as arguments, or stdin when there are none. Needs the
+ * LogEvents table of the firmware that made the capture.
+ *
+ * Build: g++ -O2 -I../src log_decode.cpp ../src/EventLog.cpp ../src/LogEvents.cpp -o log_decode
+ */
+
+#include <stdio.h>
+
+#include "EventLog.h"
+#include "LogEvents.h"
+
+// Only used to format records; nothing is stored in it.
+static uint8_t unused[1];
+static EventLog decoder(unused, sizeof(unused), LOG_EVENTS, LOG_EVENT_COUNT, LOG_CATEGORIES, LOG_CATEGORY_COUNT);
+
+static unsigned long invalid = 0;
+
+static void decode(FILE *f) {
+  char line[512];
+  uint8_t record[EVENT_LOG_RECORD];
+  uint16_t length;
+  char text[256];
+  uint32_t ms;
+  EventLevel level;
+  const char *category;
+
+  while (fgets(line, sizeof(line), f)) {
+    length = eventRecordFromHex(line, record);
+    if (length == 0) {
+      fputs(line, stdout);
+    }
+    else if (decoder.format(record, length, text, sizeof(text), ms, level, category)) {
+      printf("%010lu [app.%s] %s: %s\n", (unsigned long)ms, category, eventLevelName(level), text);
+    }
+    else {
+      printf("?? unknown record %s", line);
+      invalid++;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      FILE *f = fopen(argv[i], "r");
+      if (!f) {
+        perror(argv[i]);
+        return 1;
+      }
+      decode(f);
+      fclose(f);
+    }
+  } else {
+    decode(stdin);
+  }
+  if (invalid) {
+    fprintf(stderr, "%lu records did not match this version's event table\n", invalid);
+  }
+  return invalid ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * mqtt_check.cpp
+ * Host check of the publish path in lib/Adafruit_MQTT: packets go through
+ * Adafruit_MQTT_SPARK into a TCPClient that only records what is written,
+ * and the bytes are parsed back into PUBLISH packets and compared with what
+ * was sent:
+ *
+ *   chunks     a batch longer than one 250 byte write reaches the wire
+ *              whole and in order, in as few 250 byte writes as it fits
+ *   full       a batch is filled until add() refuses a packet, which leaves
+ *              it unchanged; flush() sends every packet that was accepted
+ *   send       a backlog like publishSample()'s, more than one batch holds,
+ *              goes out through send() without losing or reordering any
+ *              packet; one bigger than the whole buffer is published alone
+ *   failed     a write error is reported by flush() and send()
+ *
+ * Prints each check and exits with 1 if any failed.
+ *
+ * Build: g++ -I../sim -I../lib/Adafruit_MQTT/src -DSPARK=1 mqtt_check.cpp
+ *        ../lib/Adafruit_MQTT/src/Adafruit_MQTT.cpp
+ *        ../lib/Adafruit_MQTT/src/Adafruit_MQTT_SPARK.cpp -o mqtt_check
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Adafruit_MQTT_SPARK.h"
+
+// The library is built against the mock Device OS (sim/Particle.h), but not
+// linked with it: these are the few pieces it uses.
+
+static std::vector<uint8_t> wire;       // everything written, in order
+static unsigned writes;
+static bool writeFails;
+
+USBSerial Serial;
+int USBSerial::available() { return 0; }
+int USBSerial::read() { return -1; }
+int USBSerial::peek() { return -1; }
+void USBSerial::flush() {}
+size_t USBSerial::write(uint8_t c) { return write(&c, 1); }
+size_t USBSerial::write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n])) {
+    n++;
+  }
+  return n;
+}
+size_t Print::print(long value, int base) { char s[24]; return write(ltoa(value, s, base)); }
+size_t Print::print(unsigned long value, int base) { char s[24]; return write(ultoa(value, s, base)); }
+char *ltoa(long value, char *s, int base) { snprintf(s, 24, base == 16 ? "%lx" : "%ld", value); return s; }
+char *ultoa(unsigned long value, char *s, int base) { snprintf(s, 24, base == 16 ? "%lx" : "%lu", value); return s; }
+
+static unsigned long clockMs;
+unsigned long millis() { return clockMs; }
+void delay(unsigned long ms) { clockMs += ms; }
+
+TCPClient::TCPClient() : _fd(-1), _closed(false) {}
+TCPClient::~TCPClient() {}
+int TCPClient::connect(const char *host, uint16_t port) { (void)host; (void)port; return 1; }
+int TCPClient::connect(IPAddress ip, uint16_t port) { (void)ip; (void)port; return 1; }
+uint8_t TCPClient::connected() { return true; }
+void TCPClient::stop() {}
+void TCPClient::poll() {}
+int TCPClient::available() { return 0; }
+int TCPClient::read() { return -1; }
+int TCPClient::read(uint8_t *buffer, size_t size) { (void)buffer; (void)size; return -1; }
+int TCPClient::peek() { return -1; }
+size_t TCPClient::write(const uint8_t *buffer, size_t size) {
+  writes++;
+  if (writeFails) {
+    return 0;
+  }
+  wire.insert(wire.end(), buffer, buffer + size);
+  return size;
+}
+
+struct Packet {
+  std::string topic;
+  std::string payload;
+};
+
+// Split the wire into QoS 0 PUBLISH packets. Returns false if anything on it
+// is not one.
+static bool parse(std::vector<Packet> &packets) {
+  size_t pos = 0;
+
+  packets.clear();
+  while (pos < wire.size()) {
+    uint32_t remaining = 0, shift = 0;
+    uint8_t b;
+
+    if (wire[pos++] != MQTT_CTRL_PUBLISH << 4) {
+      return false;
+    }
+    do {
+      if (pos >= wire.size() || shift > 21) {
+        return false;
+      }
+      b = wire[pos++];
+      remaining |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    if (remaining < 2 || pos + remaining > wire.size()) {
+      return false;
+    }
+    uint16_t topicLen = wire[pos] << 8 | wire[pos + 1];
+    if (2u + topicLen > remaining) {
+      return false;
+    }
+    Packet p;
+    p.topic.assign((const char *)&wire[pos + 2], topicLen);
+    p.payload.assign((const char *)&wire[pos + 2 + topicLen], remaining - 2 - topicLen);
+    packets.push_back(p);
+    pos += remaining;
+  }
+  return true;
+}
+
+static int failures;
+
+static void check(const char *name, bool ok) {
+  printf("%-8s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) {
+    failures++;
+  }
+}
+
+static bool same(const std::vector<Packet> &got, const std::vector<Packet> &want) {
+  if (got.size() != want.size()) {
+    printf("  %zu packets, expected %zu\n", got.size(), want.size());
+    return false;
+  }
+  for (size_t i = 0; i < got.size(); i++) {
+    if (got[i].topic != want[i].topic || got[i].payload != want[i].payload) {
+      printf("  packet %zu is %s %s, expected %s %s\n", i, got[i].topic.c_str(), got[i].payload.c_str(),
+             want[i].topic.c_str(), want[i].payload.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void reset() {
+  wire.clear();
+  writes = 0;
+  writeFails = false;
+}
+
+int main() {
+  TCPClient client;
+  Adafruit_MQTT_SPARK mqtt(&client, "io.adafruit.com", 1883, "user", "key");
+  Adafruit_MQTT_Publish temp(&mqtt, "user/feeds/hydropot-temperature-json");
+  Adafruit_MQTT_Publish water(&mqtt, "user/feeds/hydropot-waterlevel-json");
+  uint8_t buffer[512];
+  Adafruit_MQTT_Batch batch(&mqtt, buffer, sizeof(buffer));
+  std::vector<Packet> want, got;
+  char payload[300];
+  bool ok;
+
+  // chunks: a few packets, more than 250 bytes together
+  reset();
+  want.clear();
+  ok = true;
+  for (int i = 0; i < 5; i++) {
+    snprintf(payload, sizeof(payload), "{\"value\":%d.25,\"created_at\":\"2026-10-19T12:%02d:00Z\"}", 20 + i, i);
+    ok &= batch.add(&temp, payload);
+    want.push_back({ "user/feeds/hydropot-temperature-json", payload });
+  }
+  uint16_t batched = batch.length();
+  ok = ok && batched > 250 && batch.flush();
+  check("chunks", ok && writes == (batched + 249) / 250 && parse(got) && same(got, want));
+
+  // full: add until refused
+  reset();
+  want.clear();
+  for (int i = 0; ; i++) {
+    uint16_t length = batch.length();
+    snprintf(payload, sizeof(payload), "{\"value\":%d,\"created_at\":\"2026-10-19T13:%02d:00Z\"}", i, i % 60);
+    if (!batch.add(&water, payload)) {
+      ok = batch.length() == length && batch.count() == want.size() && batch.length() <= sizeof(buffer);
+      break;
+    }
+    want.push_back({ "user/feeds/hydropot-waterlevel-json", payload });
+  }
+  ok = ok && batch.flush() && batch.count() == 0;
+  check("full", ok && want.size() > 1 && parse(got) && same(got, want));
+
+  // send: 20 samples of two feeds, then one too big for the buffer
+  reset();
+  want.clear();
+  ok = true;
+  for (int i = 0; i < 20; i++) {
+    snprintf(payload, sizeof(payload), "{\"value\":%d.50,\"created_at\":\"2026-10-19T14:%02d:00Z\"}", i, i);
+    ok &= batch.send(&temp, payload);
+    want.push_back({ "user/feeds/hydropot-temperature-json", payload });
+    snprintf(payload, sizeof(payload), "{\"value\":%d,\"created_at\":\"2026-10-19T14:%02d:00Z\"}", 50 - i, i);
+    ok &= batch.send(&water, payload);
+    want.push_back({ "user/feeds/hydropot-waterlevel-json", payload });
+  }
+  std::string big(sizeof(buffer), 'x');
+  ok &= batch.send(&temp, big.c_str());
+  want.push_back({ "user/feeds/hydropot-temperature-json", big });
+  ok = ok && batch.flush();
+  check("send", ok && parse(got) && same(got, want));
+
+  // failed: nothing accepted by the client
+  reset();
+  writeFails = true;
+  ok = batch.add(&temp, "1");
+  ok = ok && !batch.flush() && batch.count() == 0;
+  while (ok && batch.add(&temp, "{\"value\":1,\"created_at\":\"2026-10-19T15:00:00Z\"}")) {
+  }
+  ok = ok && !batch.send(&temp, "{\"value\":2,\"created_at\":\"2026-10-19T15:01:00Z\"}") && batch.count() == 1;
+  batch.clear();
+  check("failed", ok && wire.empty());
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * queue_check.cpp
+ * Host check of TelemetryQueue (src/TelemetryQueue.h) through a broker
+ * outage: samples are queued while nothing can be sent, then drained the way
+ * loop() does once the connection is back. The queue file is a real one,
+ * queue-check/telemetry.dat under the working directory.
+ *
+ *   offline    more samples than the queue holds: it keeps the newest and
+ *              counts the rest as dropped
+ *   drain      a drain of 4 at a time sends every queued sample once, oldest
+ *              first, until the queue is empty
+ *   partial    a send that fails part way through a drain: the samples sent
+ *              before it are not sent again, and the next drain starts with
+ *              the one that failed
+ *   reset      a queue reopened after a reset has what the last drain left,
+ *              and loses fewer than syncEvery of the samples pushed since
+ *
+ * Prints each check and exits with 1 if any failed.
+ *
+ * Build: g++ -I../sim -I../src queue_check.cpp ../src/TelemetryQueue.cpp ../src/TelemetryFrame.cpp -o queue_check
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "Particle.h"
+#include "TelemetryQueue.h"
+
+// The mock Device OS pieces TelemetryQueue uses.
+static unsigned long clockMs;
+unsigned long millis() { return clockMs; }
+const Logger Log;
+void Logger::info(const char *format, ...) const { (void)format; }
+void Logger::error(const char *format, ...) const { (void)format; }
+
+static const char *PATH = "queue-check/telemetry.dat";
+static const uint16_t CAPACITY = 64;
+static const uint16_t SYNC_EVERY = 8;
+
+static std::vector<uint32_t> sent;      // timestamps, in the order sent
+static int failAfter = -1;              // sends that succeed before one fails, -1 for never
+
+static bool send(const TelemetrySample &sample) {
+  if (failAfter == 0) {
+    return false;
+  }
+  if (failAfter > 0) {
+    failAfter--;
+  }
+  sent.push_back(sample.timestamp);
+  return true;
+}
+
+static TelemetrySample sample(uint32_t n) {
+  TelemetrySample s;
+
+  s.timestamp = 1790000000 + n * 30;
+  s.tempF = 70 + n % 10;
+  s.humidRH = 40;
+  s.moisture = 1000 + n;
+  s.waterLevel = 80;
+  s.airQuality = 0;
+  return s;
+}
+
+// Sent in order, one each, from sample `first` to `last`.
+static bool inOrder(uint32_t first, uint32_t last) {
+  if (sent.size() != last - first + 1) {
+    printf("  %zu sent, expected %u\n", sent.size(), last - first + 1);
+    return false;
+  }
+  for (uint32_t n = first; n <= last; n++) {
+    if (sent[n - first] != sample(n).timestamp) {
+      printf("  sample %u sent as %lu, expected %lu\n", n - first, (unsigned long)sent[n - first],
+             (unsigned long)sample(n).timestamp);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void drainAll(TelemetryQueue &queue) {
+  while (!queue.isEmpty() && queue.drain(send, 4) > 0) {
+    clockMs += 2000;
+  }
+}
+
+static int failures;
+
+static void check(const char *name, bool ok) {
+  printf("%-8s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) {
+    failures++;
+  }
+}
+
+static TelemetryQueue *open() {
+  TelemetryQueue *queue = new TelemetryQueue(PATH, CAPACITY, DROP_OLDEST);
+
+  queue->setDrainInterval(2000);
+  queue->setSyncEvery(SYNC_EVERY);
+  if (!queue->begin()) {
+    printf("cannot open %s\n", PATH);
+    exit(1);
+  }
+  return queue;
+}
+
+int main() {
+  TelemetryQueue *queue;
+  bool ok;
+
+  unlink(PATH);
+  queue = open();
+
+  // offline: 100 samples into 64 slots
+  for (uint32_t n = 1; n <= 100; n++) {
+    queue->push(sample(n));
+    clockMs += 30000;
+  }
+  check("offline", queue->size() == CAPACITY && queue->dropped() == 100 - CAPACITY);
+
+  // drain: back online
+  drainAll(*queue);
+  check("drain", queue->isEmpty() && inOrder(100 - CAPACITY + 1, 100));
+
+  // partial: 10 queued, the third send of a drain fails
+  sent.clear();
+  for (uint32_t n = 101; n <= 110; n++) {
+    queue->push(sample(n));
+  }
+  clockMs += 2000;
+  failAfter = 2;
+  ok = queue->drain(send, 4) == 2 && queue->size() == 8;
+  failAfter = -1;
+  clockMs += 2000;
+  drainAll(*queue);
+  check("partial", ok && inOrder(101, 110));
+
+  // reset: after a partial drain, then after more pushes
+  sent.clear();
+  for (uint32_t n = 111; n <= 130; n++) {
+    queue->push(sample(n));
+  }
+  clockMs += 2000;
+  queue->drain(send, 4);
+  delete queue;
+  queue = open();
+  ok = queue->size() == 16;
+  for (uint32_t n = 131; n <= 140; n++) {
+    queue->push(sample(n));
+  }
+  delete queue;
+  queue = open();
+  ok = ok && queue->size() > 16 + 10 - SYNC_EVERY && queue->size() <= 16 + 10;
+  uint16_t kept = queue->size();
+  clockMs += 2000;
+  drainAll(*queue);
+  check("reset", ok && inOrder(111, 110 + 4 + kept));
+  delete queue;
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * replay_check.cpp
+ * Host check of the replay after a broker outage, end to end: samples taken
+ * every 30 s go into TelemetryQueue (src/TelemetryQueue.h) while the broker
+ * can't be reached, and come back out the way loop() sends them, as four /json
+ * publishes per sample through an Adafruit_MQTT_Batch and Adafruit_MQTT_SPARK
+ * into a TCPClient that is down for the outage and records what is written.
+ * The queue file is queue-check/replay.dat under the working directory.
+ *
+ *   outage     nothing reaches the wire while the client is down
+ *   rate       the replay never puts more than Adafruit IO's 30 publishes
+ *              into any minute, with the firmware's drain interval
+ *   order      every sample goes out once, all four feeds of it together,
+ *              oldest first, the ones taken during the replay included
+ *   dropout    a second outage in the middle of the replay loses or repeats
+ *              nothing
+ *
+ * Prints each check and exits with 1 if any failed.
+ *
+ * Build: g++ -I../sim -I../src -I../lib/Adafruit_MQTT/src -DSPARK=1 replay_check.cpp
+ *        ../src/TelemetryQueue.cpp ../src/TelemetryFrame.cpp
+ *        ../lib/Adafruit_MQTT/src/Adafruit_MQTT.cpp
+ *        ../lib/Adafruit_MQTT/src/Adafruit_MQTT_SPARK.cpp -o replay_check
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Adafruit_MQTT_SPARK.h"
+#include "TelemetryQueue.h"
+
+// The mock Device OS pieces the library and TelemetryQueue use.
+static std::vector<uint8_t> wire;       // everything written, in order
+static std::vector<std::pair<size_t, unsigned long>> writeTimes;   // offset on the wire, millis()
+static bool brokerUp = true;
+static unsigned downWrites;             // writes tried while the broker was down
+
+USBSerial Serial;
+int USBSerial::available() { return 0; }
+int USBSerial::read() { return -1; }
+int USBSerial::peek() { return -1; }
+void USBSerial::flush() {}
+size_t USBSerial::write(uint8_t c) { return write(&c, 1); }
+size_t USBSerial::write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n])) {
+    n++;
+  }
+  return n;
+}
+size_t Print::print(long value, int base) { char s[24]; return write(ltoa(value, s, base)); }
+size_t Print::print(unsigned long value, int base) { char s[24]; return write(ultoa(value, s, base)); }
+char *ltoa(long value, char *s, int base) { snprintf(s, 24, base == 16 ? "%lx" : "%ld", value); return s; }
+char *ultoa(unsigned long value, char *s, int base) { snprintf(s, 24, base == 16 ? "%lx" : "%lu", value); return s; }
+
+static unsigned long clockMs;
+unsigned long millis() { return clockMs; }
+void delay(unsigned long ms) { clockMs += ms; }
+const Logger Log;
+void Logger::info(const char *format, ...) const { (void)format; }
+void Logger::error(const char *format, ...) const { (void)format; }
+
+TCPClient::TCPClient() : _fd(-1), _closed(false) {}
+TCPClient::~TCPClient() {}
+int TCPClient::connect(const char *host, uint16_t port) { (void)host; (void)port; return brokerUp; }
+int TCPClient::connect(IPAddress ip, uint16_t port) { (void)ip; (void)port; return brokerUp; }
+uint8_t TCPClient::connected() { return brokerUp; }
+void TCPClient::stop() {}
+void TCPClient::poll() {}
+int TCPClient::available() { return 0; }
+int TCPClient::read() { return -1; }
+int TCPClient::read(uint8_t *buffer, size_t size) { (void)buffer; (void)size; return -1; }
+int TCPClient::peek() { return -1; }
+size_t TCPClient::write(const uint8_t *buffer, size_t size) {
+  if (!brokerUp) {
+    downWrites++;
+    return 0;
+  }
+  writeTimes.push_back({ wire.size(), clockMs });
+  wire.insert(wire.end(), buffer, buffer + size);
+  return size;
+}
+
+// The firmware's numbers (hydropt1.cpp).
+static const uint16_t AIO_PUBLISHES_PER_MINUTE = 30;
+static const uint16_t BACKLOG_PUBLISHES_PER_MINUTE = AIO_PUBLISHES_PER_MINUTE - 6;
+static const uint16_t BACKLOG_SAMPLE_PUBLISHES = 4;
+static const unsigned long SAMPLE_INTERVAL_MS = 30000;
+
+static const char *PATH = "queue-check/replay.dat";
+static const char *const FEEDS[] = {
+  "user/feeds/temperature/json", "user/feeds/humidity/json", "user/feeds/moisture/json", "user/feeds/waterlevel/json"
+};
+
+static TCPClient client;
+static Adafruit_MQTT_SPARK mqtt(&client, "io.adafruit.com", 1883, "user", "key");
+static Adafruit_MQTT_Publish TEMP_JSON(&mqtt, FEEDS[0]);
+static Adafruit_MQTT_Publish HUMIDITY_JSON(&mqtt, FEEDS[1]);
+static Adafruit_MQTT_Publish MOISTURE_JSON(&mqtt, FEEDS[2]);
+static Adafruit_MQTT_Publish WATERLEVEL_JSON(&mqtt, FEEDS[3]);
+static uint8_t batchBuffer[512];
+static Adafruit_MQTT_Batch backlogBatch(&mqtt, batchBuffer, sizeof(batchBuffer));
+
+// publishSample()'s backlog path, with the timestamp as created_at.
+static bool publishSample(const TelemetrySample &sample) {
+  char payload[64];
+  bool sent = true;
+
+  snprintf(payload, sizeof(payload), "{\"value\":%.2f,\"created_at\":%lu}", sample.tempF, (unsigned long)sample.timestamp);
+  sent &= backlogBatch.send(&TEMP_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%.2f,\"created_at\":%lu}", sample.humidRH, (unsigned long)sample.timestamp);
+  sent &= backlogBatch.send(&HUMIDITY_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%i,\"created_at\":%lu}", sample.moisture, (unsigned long)sample.timestamp);
+  sent &= backlogBatch.send(&MOISTURE_JSON, payload);
+  snprintf(payload, sizeof(payload), "{\"value\":%i,\"created_at\":%lu}", sample.waterLevel, (unsigned long)sample.timestamp);
+  sent &= backlogBatch.send(&WATERLEVEL_JSON, payload);
+  return backlogBatch.flush() && sent;
+}
+
+static TelemetrySample sample(uint32_t n) {
+  TelemetrySample s;
+
+  s.timestamp = 1790000000 + n * 30;
+  s.tempF = 70 + n % 10;
+  s.humidRH = 40;
+  s.moisture = 1000 + n;
+  s.waterLevel = 80;
+  s.airQuality = 0;
+  return s;
+}
+
+static TelemetryQueue queue(PATH, 960, DROP_OLDEST);
+static uint32_t taken;                  // samples taken so far
+static unsigned long lastSample;
+
+// loop() for ms milliseconds in 100 ms passes: a sample every 30 s, published
+// straight out only while connected with nothing queued, and the drain.
+static void run(unsigned long ms) {
+  for (unsigned long end = clockMs + ms; clockMs < end; clockMs += 100) {
+    if (clockMs - lastSample >= SAMPLE_INTERVAL_MS) {
+      lastSample = clockMs;
+      TelemetrySample s = sample(++taken);
+      if (!(client.connected() && queue.isEmpty() && publishSample(s))) {
+        queue.push(s);
+      }
+    }
+    if (client.connected()) {
+      queue.drain(publishSample, 1);
+    }
+  }
+}
+
+struct Packet {
+  std::string topic;
+  std::string payload;
+  unsigned long ms;                     // when the write that started it went out
+};
+
+// Split the wire into QoS 0 PUBLISH packets. Returns false if anything on it
+// is not one.
+static bool parse(std::vector<Packet> &packets) {
+  size_t pos = 0, write = 0;
+
+  packets.clear();
+  while (pos < wire.size()) {
+    uint32_t remaining = 0, shift = 0;
+    uint8_t b;
+    Packet p;
+
+    while (write + 1 < writeTimes.size() && writeTimes[write + 1].first <= pos) {
+      write++;
+    }
+    p.ms = writeTimes[write].second;
+    if (wire[pos++] != MQTT_CTRL_PUBLISH << 4) {
+      return false;
+    }
+    do {
+      if (pos >= wire.size() || shift > 21) {
+        return false;
+      }
+      b = wire[pos++];
+      remaining |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    if (remaining < 2 || pos + remaining > wire.size()) {
+      return false;
+    }
+    uint16_t topicLen = wire[pos] << 8 | wire[pos + 1];
+    if (2u + topicLen > remaining) {
+      return false;
+    }
+    p.topic.assign((const char *)&wire[pos + 2], topicLen);
+    p.payload.assign((const char *)&wire[pos + 2 + topicLen], remaining - 2 - topicLen);
+    packets.push_back(p);
+    pos += remaining;
+  }
+  return true;
+}
+
+// The most packets in any minute.
+static unsigned busiestMinute(const std::vector<Packet> &packets) {
+  unsigned most = 0;
+
+  for (size_t first = 0, last = 0; last < packets.size(); last++) {
+    while (packets[last].ms - packets[first].ms >= 60000) {
+      first++;
+    }
+    if (last - first + 1 > most) {
+      most = last - first + 1;
+    }
+  }
+  return most;
+}
+
+// Samples first to last, four feeds each, in order.
+static bool inOrder(const std::vector<Packet> &packets, uint32_t first, uint32_t last) {
+  if (packets.size() != 4 * (last - first + 1)) {
+    printf("  %zu packets, expected %u\n", packets.size(), 4 * (last - first + 1));
+    return false;
+  }
+  for (uint32_t n = first; n <= last; n++) {
+    char createdAt[24];
+
+    snprintf(createdAt, sizeof(createdAt), "\"created_at\":%lu}", (unsigned long)sample(n).timestamp);
+    for (int feed = 0; feed < 4; feed++) {
+      const Packet &p = packets[4 * (n - first) + feed];
+      if (p.topic != FEEDS[feed] || p.payload.find(createdAt) == std::string::npos) {
+        printf("  sample %u feed %d went out as %s %s\n", n, feed, p.topic.c_str(), p.payload.c_str());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static int failures;
+
+static void check(const char *name, bool ok) {
+  printf("%-8s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) {
+    failures++;
+  }
+}
+
+int main() {
+  std::vector<Packet> packets;
+  bool ok;
+
+  unlink(PATH);
+  queue.setDrainInterval(TelemetryQueue::drainIntervalFor(BACKLOG_SAMPLE_PUBLISHES, BACKLOG_PUBLISHES_PER_MINUTE));
+  if (!queue.begin()) {
+    printf("cannot open %s\n", PATH);
+    return 1;
+  }
+
+  // outage: an hour down, then back up until the backlog is gone
+  run(60000);
+  uint32_t online = taken;
+  wire.clear();
+  writeTimes.clear();
+  brokerUp = false;
+  run(3600000);
+  uint32_t queued = queue.size();
+  ok = wire.empty() && queued == taken - online;
+  brokerUp = true;
+  unsigned long back = clockMs;
+  while (!queue.isEmpty() && clockMs - back < 4 * 3600000UL) {
+    run(1000);
+  }
+  run(SAMPLE_INTERVAL_MS);
+  check("outage", ok && queued == 120 && queue.isEmpty());
+
+  ok = parse(packets);
+  unsigned most = ok ? busiestMinute(packets) : 0;
+  if (most > AIO_PUBLISHES_PER_MINUTE) {
+    printf("  %u publishes in the busiest minute\n", most);
+  }
+  check("rate", ok && most > 0 && most <= AIO_PUBLISHES_PER_MINUTE);
+  check("order", ok && inOrder(packets, online + 1, taken));
+
+  // dropout: five minutes down in the middle of the next replay
+  wire.clear();
+  writeTimes.clear();
+  downWrites = 0;
+  uint32_t before = taken;
+  brokerUp = false;
+  run(1800000);
+  brokerUp = true;
+  run(300000);
+  brokerUp = false;
+  run(300000);
+  ok = downWrites == 0 && !queue.isEmpty();
+  brokerUp = true;
+  back = clockMs;
+  while (!queue.isEmpty() && clockMs - back < 4 * 3600000UL) {
+    run(1000);
+  }
+  run(SAMPLE_INTERVAL_MS);
+  ok = ok && queue.isEmpty() && parse(packets);
+  check("dropout", ok && busiestMinute(packets) <= AIO_PUBLISHES_PER_MINUTE && inOrder(packets, before + 1, taken));
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * spsc_stress.cpp
+ * Host stress run of the lock-free structures the control task shares with
+ * loop(), on real threads, looking for lost, reordered or torn data:
+ *
+ *   queue      SpscQueue<uint32_t, 64>: a producer pushes 0, 1, 2, ... and
+ *              the consumer checks it pops them all, in order
+ *   frames     SpscQueue<SensorFrame, 8>: as above with whole frames, every
+ *              field derived from a counter so a torn copy shows
+ *   snapshot   Snapshot<SensorFrame>: one writer, several readers checking
+ *              each frame they get is whole and never older than the last
+ *
+ * Prints the counts for each and exits with 1 if anything was wrong.
+ *
+ * Usage: spsc_stress [items] [readers]        defaults: 2000000, 3
+ *
+ * Build: g++ -O2 -pthread -I../src spsc_stress.cpp -o spsc_stress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+#include "Snapshot.h"
+#include "SensorFrame.h"
+
+static const char *const STATES[] = { "idle", "dosing" };
+
+static SensorFrame makeFrame(uint32_t n) {
+  SensorFrame frame;
+
+  frame.ms = n;
+  frame.tempC = n % 65536;
+  frame.tempF = frame.tempC * 2;
+  frame.humidRH = frame.tempC + 1;
+  frame.bmeOk = n & 1;
+  frame.airValue = n ^ 0x5555;
+  frame.quality = n % 4;
+  frame.moisture = n * 3;
+  frame.water = ~n;
+  frame.waterLevel = n % 101;
+  frame.irrigationState = STATES[n & 1];
+  frame.pumpMsToday = n * 7;
+  frame.dailyCapMs = n + 11;
+  frame.doses = n >> 4;
+  frame.skippedLowWater = n >> 8;
+  frame.skippedCap = n * 13;
+  return frame;
+}
+
+// Whole if every field agrees with the counter in frame.ms.
+static bool frameWhole(const SensorFrame &frame) {
+  SensorFrame expect = makeFrame(frame.ms);
+
+  return frame.tempC == expect.tempC && frame.tempF == expect.tempF && frame.humidRH == expect.humidRH &&
+         frame.bmeOk == expect.bmeOk && frame.airValue == expect.airValue && frame.quality == expect.quality &&
+         frame.moisture == expect.moisture && frame.water == expect.water && frame.waterLevel == expect.waterLevel &&
+         frame.irrigationState == expect.irrigationState && frame.pumpMsToday == expect.pumpMsToday &&
+         frame.dailyCapMs == expect.dailyCapMs && frame.doses == expect.doses &&
+         frame.skippedLowWater == expect.skippedLowWater && frame.skippedCap == expect.skippedCap;
+}
+
+static unsigned long stressQueue(uint32_t items) {
+  SpscQueue<uint32_t, 64> queue;
+  unsigned long errors = 0;
+  unsigned long full = 0;
+
+  std::thread producer([&] {
+    for (uint32_t n = 0; n < items; n++) {
+      while (!queue.push(n)) {
+        full++;
+        std::this_thread::yield();
+      }
+    }
+  });
+  uint32_t expect = 0;
+  uint32_t value;
+  while (expect < items) {
+    if (!queue.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (value != expect && errors++ < 5) {
+      fprintf(stderr, "queue: popped %lu, expected %lu\n", (unsigned long)value, (unsigned long)expect);
+    }
+    expect = value + 1;
+  }
+  producer.join();
+  if (!queue.empty()) {
+    errors++;
+  }
+  printf("queue      %lu items, %lu pushes found it full, %lu errors\n", (unsigned long)items, full, errors);
+  return errors;
+}
+
+static unsigned long stressFrames(uint32_t items) {
+  SpscQueue<SensorFrame, 8> queue;
+  unsigned long errors = 0;
+
+  std::thread producer([&] {
+    for (uint32_t n = 0; n < items; n++) {
+      SensorFrame frame = makeFrame(n);
+      while (!queue.push(frame)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  uint32_t expect = 0;
+  SensorFrame frame;
+  while (expect < items) {
+    if (!queue.pop(frame)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if ((frame.ms != expect || !frameWhole(frame)) && errors++ < 5) {
+      fprintf(stderr, "frames: got frame %lu (whole %d), expected %lu\n", (unsigned long)frame.ms,
+              frameWhole(frame), (unsigned long)expect);
+    }
+    expect = frame.ms + 1;
+  }
+  producer.join();
+  printf("frames     %lu frames, %lu errors\n", (unsigned long)items, errors);
+  return errors;
+}
+
+static unsigned long stressSnapshot(uint32_t items, unsigned readers) {
+  Snapshot<SensorFrame> snapshot;
+  std::atomic<bool> done(false);
+  std::atomic<unsigned long> errors(0), reads(0), busy(0);
+  std::vector<std::thread> threads;
+
+  for (unsigned r = 0; r < readers; r++) {
+    threads.emplace_back([&] {
+      SensorFrame frame;
+      uint32_t last = 0;
+      unsigned long myReads = 0, myBusy = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        if (!snapshot.read(frame)) {
+          myBusy++;
+          continue;
+        }
+        myReads++;
+        if ((!frameWhole(frame) || frame.ms < last) && errors.fetch_add(1) < 5) {
+          fprintf(stderr, "snapshot: frame %lu after %lu, whole %d\n", (unsigned long)frame.ms,
+                  (unsigned long)last, frameWhole(frame));
+        }
+        last = frame.ms;
+      }
+      reads += myReads;
+      busy += myBusy;
+    });
+  }
+  for (uint32_t n = 1; n <= items; n++) {
+    snapshot.write(makeFrame(n));
+  }
+  done = true;
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  if (snapshot.version() != items) {
+    errors++;
+  }
+  printf("snapshot   %lu writes, %u readers, %lu reads, %lu gave up or empty, %lu errors\n", (unsigned long)items,
+         readers, reads.load(), busy.load(), errors.load());
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  uint32_t items = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+  unsigned readers = argc > 2 ? atoi(argv[2]) : 3;
+  unsigned long errors = 0;
+
+  if (items == 0 || readers == 0) {
+    fprintf(stderr, "usage: %s [items] [readers]\n", argv[0]);
+    return 2;
+  }
+  errors += stressQueue(items);
+  errors += stressFrames(items);
+  errors += stressSnapshot(items, readers);
+  return errors ? 1 : 0;
+}
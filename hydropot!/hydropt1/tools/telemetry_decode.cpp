@@ -0,0 +1,100 @@
+/*
+ * telemetry_decode.cpp
+ * Host-side decoder for binary TelemetryFrames. Prints one CSV line per sample.
+ *
+ * Each command line argument, or each line of stdin when there are none, is
+ * one frame in hex, as printed by e.g.
+ *   mosquitto_sub -h <broker> -t '<user>/telemetry/frame' -F %x | telemetry_decode
+ *
+ * Build: g++ -O2 -I../src telemetry_decode.cpp ../src/TelemetryFrame.cpp -o telemetry_decode
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "TelemetryFrame.h"
+
+static const char *AIR_QUALITY[] = { "force signal", "high pollution", "low pollution", "fresh air" };
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Returns the number of bytes decoded, or -1 on a malformed string.
+static int parseHex(const char *text, uint8_t *out, int size) {
+  int len = 0;
+  int hi = -1;
+
+  for (; *text; text++) {
+    if (isspace((unsigned char)*text)) {
+      continue;
+    }
+    int v = hexValue(*text);
+    if (v < 0 || len >= size) {
+      return -1;
+    }
+    if (hi < 0) {
+      hi = v;
+    } else {
+      out[len++] = (hi << 4) | v;
+      hi = -1;
+    }
+  }
+  return hi < 0 ? len : -1;
+}
+
+static bool decodeFrame(const char *hex) {
+  uint8_t frame[4096];
+  int len = parseHex(hex, frame, sizeof(frame));
+  TelemetrySample sample;
+  char when[24];
+
+  if (len < 0) {
+    fprintf(stderr, "not a hex frame: %s\n", hex);
+    return false;
+  }
+  if (len == 0) {
+    return true;
+  }
+
+  TelemetryFrameReader reader(frame, len);
+  while (reader.next(sample)) {
+    time_t t = sample.timestamp;
+    struct tm tm;
+    if (sample.timestamp != 0 && gmtime_r(&t, &tm)) {
+      strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    } else {
+      strcpy(when, "");
+    }
+    printf("%lu,%s,%.2f,%.2f,%d,%d,%s\n", (unsigned long)sample.timestamp, when, sample.tempF, sample.humidRH,
+           sample.moisture, sample.waterLevel,
+           sample.airQuality >= 0 && sample.airQuality <= 3 ? AIR_QUALITY[sample.airQuality] : "unknown");
+  }
+  if (reader.error()) {
+    fprintf(stderr, "bad frame (version %u, expected %u, or truncated)\n", reader.version(), TELEMETRY_FRAME_VERSION);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  char line[8192];
+  bool ok = true;
+
+  printf("timestamp,time,tempF,humidRH,moisture,waterlevel,airquality\n");
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      ok &= decodeFrame(argv[i]);
+    }
+  } else {
+    while (fgets(line, sizeof(line), stdin)) {
+      ok &= decodeFrame(line);
+    }
+  }
+  return ok ? 0 : 1;
+}